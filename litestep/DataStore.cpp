@@ -20,6 +20,354 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "DataStore.h"
+#include "../utility/logger.h"
+#include <algorithm>
+
+
+namespace
+{
+    const DWORD FileMagic = 0x5344534C;     // "LSDS"
+    const DWORD SlotMagic = 0x544F4C53;     // "SLOT"
+    const WORD FileVersion = 1;
+
+    // The file grows in multiples of this
+    const UINT64 GrowBytes = 64 * 1024;
+
+    enum SlotState : WORD
+    {
+        SlotLive = 1,
+        SlotReleased
+    };
+
+    struct FileHeader
+    {
+        DWORD dwMagic;
+        WORD wVersion;
+        WORD wHeaderSize;
+        UINT64 ullEnd;          // end of the last complete slot
+    };
+
+    // Followed by the data, padded to 8 bytes. The checksum covers the
+    // identifier, the length and the data, but not the state.
+    struct SlotHeader
+    {
+        DWORD dwMagic;
+        WORD wIdent;
+        WORD wState;
+        DWORD dwLength;
+        DWORD dwChecksum;
+    };
+
+    static_assert(sizeof(FileHeader) == 16, "FileHeader layout changed");
+    static_assert(sizeof(SlotHeader) == 16, "SlotHeader layout changed");
+
+    UINT64 SlotSize(DWORD dwLength)
+    {
+        return (sizeof(SlotHeader) + UINT64(dwLength) + 7) & ~UINT64(7);
+    }
+
+    UINT64 RoundUpCapacity(UINT64 ullBytes)
+    {
+        return std::max(GrowBytes, (ullBytes + GrowBytes - 1) / GrowBytes * GrowBytes);
+    }
+}
+
+
+DataStoreFile::DataStoreFile()
+: m_hFile(INVALID_HANDLE_VALUE), m_pbView(nullptr), m_ullCapacity(0)
+{
+    // do nothing
+}
+
+
+DataStoreFile::~DataStoreFile()
+{
+    Close(false);
+}
+
+
+bool DataStoreFile::Open(LPCWSTR pwzPath, std::vector<Slot>& vecSlots)
+{
+    bool bWasted = false;
+
+    if (!_Open(pwzPath, vecSlots, bWasted))
+    {
+        return false;
+    }
+
+    if (bWasted && _Compact(vecSlots))
+    {
+        vecSlots.clear();
+        return _Open(pwzPath, vecSlots, bWasted);
+    }
+
+    return true;
+}
+
+
+bool DataStoreFile::_Open(LPCWSTR pwzPath, std::vector<Slot>& vecSlots, bool& bWasted)
+{
+    Close(false);
+    bWasted = false;
+
+    m_hFile = CreateFileW(pwzPath, GENERIC_READ | GENERIC_WRITE, 0,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    m_sPath = pwzPath;
+
+    LARGE_INTEGER liSize = { 0 };
+    GetFileSizeEx(m_hFile, &liSize);
+
+    if (!_Map(RoundUpCapacity(UINT64(liSize.QuadPart))))
+    {
+        Close(false);
+        return false;
+    }
+
+    const FileHeader* pHeader = (const FileHeader*)m_pbView;
+
+    if (pHeader->dwMagic != FileMagic || pHeader->wVersion != FileVersion ||
+        pHeader->wHeaderSize != sizeof(FileHeader) ||
+        pHeader->ullEnd < sizeof(FileHeader) || pHeader->ullEnd > m_ullCapacity)
+    {
+        Reset();
+        return true;
+    }
+
+    UINT64 ullOffset = sizeof(FileHeader);
+
+    while (ullOffset + sizeof(SlotHeader) <= pHeader->ullEnd)
+    {
+        const SlotHeader* pSlot = (const SlotHeader*)(m_pbView + ullOffset);
+        const BYTE* pbData = (const BYTE*)(pSlot + 1);
+
+        if (pSlot->dwMagic != SlotMagic ||
+            SlotSize(pSlot->dwLength) > pHeader->ullEnd - ullOffset ||
+            pSlot->dwChecksum != _Checksum(pSlot->wIdent, pbData, pSlot->dwLength))
+        {
+            LS_LOG_WARNING(General, L"DataStore file %ls is damaged at offset %llu, dropping the rest.",
+                pwzPath, ullOffset);
+            bWasted = true;
+            break;
+        }
+
+        if (pSlot->wState == SlotLive)
+        {
+            Slot slot = { pSlot->wIdent, ullOffset, pbData, pSlot->dwLength };
+            vecSlots.push_back(slot);
+        }
+        else
+        {
+            bWasted = true;
+        }
+
+        ullOffset += SlotSize(pSlot->dwLength);
+    }
+
+    ((FileHeader*)m_pbView)->ullEnd = ullOffset;
+
+    return true;
+}
+
+
+void DataStoreFile::Close(bool bDelete)
+{
+    _Unmap();
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+
+        if (bDelete)
+        {
+            DeleteFileW(m_sPath.c_str());
+        }
+    }
+}
+
+
+UINT64 DataStoreFile::Append(WORD wIdent, const void* pvData, DWORD dwLength)
+{
+    if (!IsOpen())
+    {
+        return 0;
+    }
+
+    UINT64 ullOffset = ((const FileHeader*)m_pbView)->ullEnd;
+    UINT64 ullSlotSize = SlotSize(dwLength);
+
+    if (ullOffset + ullSlotSize > m_ullCapacity)
+    {
+        UINT64 ullOldCapacity = m_ullCapacity;
+
+        if (!_Map(RoundUpCapacity(std::max(ullOldCapacity * 2, ullOffset + ullSlotSize))))
+        {
+            if (!_Map(ullOldCapacity))
+            {
+                Close(false);
+            }
+
+            return 0;
+        }
+    }
+
+    SlotHeader* pSlot = (SlotHeader*)(m_pbView + ullOffset);
+    pSlot->dwMagic = SlotMagic;
+    pSlot->wIdent = wIdent;
+    pSlot->wState = SlotLive;
+    pSlot->dwLength = dwLength;
+
+    memcpy(pSlot + 1, pvData, dwLength);
+    pSlot->dwChecksum = _Checksum(wIdent, (const BYTE*)(pSlot + 1), dwLength);
+
+    // Only now the slot counts
+    ((FileHeader*)m_pbView)->ullEnd = ullOffset + ullSlotSize;
+
+    return ullOffset;
+}
+
+
+void DataStoreFile::Release(UINT64 ullOffset)
+{
+    if (IsOpen() && ullOffset >= sizeof(FileHeader) &&
+        ullOffset < ((const FileHeader*)m_pbView)->ullEnd)
+    {
+        ((SlotHeader*)(m_pbView + ullOffset))->wState = SlotReleased;
+    }
+}
+
+
+void DataStoreFile::Reset()
+{
+    if (IsOpen())
+    {
+        FileHeader* pHeader = (FileHeader*)m_pbView;
+        pHeader->dwMagic = FileMagic;
+        pHeader->wVersion = FileVersion;
+        pHeader->wHeaderSize = sizeof(FileHeader);
+        pHeader->ullEnd = sizeof(FileHeader);
+    }
+}
+
+
+//
+// _Compact
+// The live slots go to a new file first, which then replaces this one in a
+// single rename. A crash at any point leaves either the old or the new file
+// in place, both with every item.
+//
+bool DataStoreFile::_Compact(const std::vector<Slot>& vecSlots)
+{
+    std::wstring sPath(m_sPath);
+    std::wstring sNewPath(sPath + L".new");
+
+    DeleteFileW(sNewPath.c_str());
+
+    {
+        DataStoreFile dsfNew;
+        std::vector<Slot> vecNone;
+
+        if (!dsfNew.Open(sNewPath.c_str(), vecNone))
+        {
+            return false;
+        }
+
+        for (const Slot& slot : vecSlots)
+        {
+            if (dsfNew.Append(slot.wIdent, slot.pbData, slot.dwLength) == 0)
+            {
+                dsfNew.Close(false);
+                DeleteFileW(sNewPath.c_str());
+                return false;
+            }
+        }
+
+        dsfNew.Close(false);
+    }
+
+    Close(false);
+
+    if (!MoveFileExW(sNewPath.c_str(), sPath.c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        LS_LOG_WARNING(General, L"DataStore could not replace %ls with its compacted copy (error=%u).",
+            sPath.c_str(), GetLastError());
+        DeleteFileW(sNewPath.c_str());
+    }
+
+    return true;
+}
+
+
+//
+// _Map
+// Creating the mapping with a size past the end of the file extends the
+// file. The view keeps the mapping alive after its handle is closed.
+//
+bool DataStoreFile::_Map(UINT64 ullCapacity)
+{
+    _Unmap();
+
+    HANDLE hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READWRITE,
+        DWORD(ullCapacity >> 32), DWORD(ullCapacity), nullptr);
+
+    if (hMapping != nullptr)
+    {
+        m_pbView = (BYTE*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, SIZE_T(ullCapacity));
+        CloseHandle(hMapping);
+    }
+
+    if (m_pbView == nullptr)
+    {
+        return false;
+    }
+
+    m_ullCapacity = ullCapacity;
+    return true;
+}
+
+
+void DataStoreFile::_Unmap()
+{
+    if (m_pbView != nullptr)
+    {
+        UnmapViewOfFile(m_pbView);
+        m_pbView = nullptr;
+    }
+
+    m_ullCapacity = 0;
+}
+
+
+//
+// _Checksum
+// 32 bit FNV-1a
+//
+DWORD DataStoreFile::_Checksum(WORD wIdent, const BYTE* pbData, DWORD dwLength)
+{
+    DWORD dwHash = 2166136261U;
+
+    auto hashBytes = [&dwHash] (const BYTE* pbBytes, size_t stBytes)
+    {
+        for (size_t i = 0; i < stBytes; ++i)
+        {
+            dwHash ^= pbBytes[i];
+            dwHash *= 16777619U;
+        }
+    };
+
+    hashBytes((const BYTE*)&wIdent, sizeof(wIdent));
+    hashBytes((const BYTE*)&dwLength, sizeof(dwLength));
+    hashBytes(pbData, dwLength);
+
+    return dwHash;
+}
 
 
 DataStore::DataStore()
@@ -31,6 +379,51 @@ DataStore::DataStore()
 DataStore::~DataStore()
 {
     Clear();
+    m_dsfFile.Close(true);
+}
+
+
+BOOL DataStore::Open(LPCWSTR pwzPath)
+{
+    std::vector<DataStoreFile::Slot> vecSlots;
+
+    if (!m_dsfFile.Open(pwzPath, vecSlots))
+    {
+        LS_LOG_WARNING(General, L"DataStore could not open %ls (error=%u).",
+            pwzPath, GetLastError());
+        return FALSE;
+    }
+
+    m_mapSlots.clear();
+
+    for (const DataStoreFile::Slot& slot : vecSlots)
+    {
+        DataHolderMap::iterator iter = m_dhmData.find(slot.wIdent);
+
+        if (iter != m_dhmData.end())
+        {
+            // The later slot wins
+            delete iter->second;
+            m_dsfFile.Release(m_mapSlots[slot.wIdent]);
+        }
+
+        m_dhmData[slot.wIdent] = new DataHolder(slot.pbData, slot.dwLength);
+        m_mapSlots[slot.wIdent] = slot.ullOffset;
+    }
+
+    if (!vecSlots.empty())
+    {
+        LS_LOG_NOTICE(General, L"DataStore restored %u items left by the last session.",
+            static_cast<UINT>(m_dhmData.size()));
+    }
+
+    return TRUE;
+}
+
+
+bool DataStore::IsPersistent() const
+{
+    return m_dsfFile.IsOpen();
 }
 
 
@@ -45,6 +438,8 @@ void DataStore::Clear()
     }
 
     m_dhmData.clear();
+    m_mapSlots.clear();
+    m_dsfFile.Reset();
 }
 
 
@@ -54,22 +449,37 @@ size_t DataStore::Count()
 }
 
 
-BOOL DataStore::StoreData(WORD wIdent, void *pvData, WORD wLength)
+BOOL DataStore::StoreData(WORD wIdent, const void *pvData, DWORD dwLength)
 {
     BOOL bReturn = FALSE;
 
-    if (pvData != NULL && wLength > 0)
+    if (pvData != NULL && dwLength > 0)
     {
         DataHolderMap::iterator iter = m_dhmData.find(wIdent);
 
         if (iter == m_dhmData.end())
         {
-            DataHolder* pdhData = new DataHolder(pvData, wLength);
+            DataHolder* pdhData = new DataHolder(pvData, dwLength);
 
             if (pdhData != NULL)
             {
                 m_dhmData[wIdent] = pdhData;
                 bReturn = TRUE;
+
+                if (m_dsfFile.IsOpen())
+                {
+                    UINT64 ullSlot = m_dsfFile.Append(wIdent, pvData, dwLength);
+
+                    if (ullSlot != 0)
+                    {
+                        m_mapSlots[wIdent] = ullSlot;
+                    }
+                    else
+                    {
+                        LS_LOG_WARNING(General, L"DataStore could not write item %u (%u bytes) to its file.",
+                            static_cast<UINT>(wIdent), static_cast<UINT>(dwLength));
+                    }
+                }
             }
         }
     }
@@ -78,11 +488,11 @@ BOOL DataStore::StoreData(WORD wIdent, void *pvData, WORD wLength)
 }
 
 
-BOOL DataStore::ReleaseData(WORD wIdent, void *pvData, WORD wLength)
+BOOL DataStore::ReleaseData(WORD wIdent, void *pvData, DWORD dwLength, LPDWORD pdwCopied)
 {
     BOOL bReturn = FALSE;
 
-    if (pvData != NULL && wLength > 0)
+    if (pvData != NULL && dwLength > 0)
     {
         DataHolderMap::iterator iter = m_dhmData.find(wIdent);
 
@@ -92,12 +502,30 @@ BOOL DataStore::ReleaseData(WORD wIdent, void *pvData, WORD wLength)
 
             if (pdhData != NULL)
             {
-                pdhData->GetData(pvData, wLength);
+                DWORD dwCopied = pdhData->GetData(pvData, dwLength);
                 delete pdhData;
                 bReturn = TRUE;
+
+                if (pdwCopied != NULL)
+                {
+                    *pdwCopied = dwCopied;
+                }
             }
 
             m_dhmData.erase(iter);
+
+            std::map<WORD, UINT64>::iterator slot = m_mapSlots.find(wIdent);
+
+            if (slot != m_mapSlots.end())
+            {
+                m_dsfFile.Release(slot->second);
+                m_mapSlots.erase(slot);
+            }
+
+            if (m_dhmData.empty())
+            {
+                m_dsfFile.Reset();
+            }
         }
     }
 
@@ -106,27 +534,27 @@ BOOL DataStore::ReleaseData(WORD wIdent, void *pvData, WORD wLength)
 
 
 DataHolder::DataHolder()
-: m_wLength(0), m_pvData(NULL)
+: m_dwLength(0), m_pvData(NULL)
 {
     // do nothing
 }
 
 
-DataHolder::DataHolder(void *pvData, WORD wLength)
+DataHolder::DataHolder(const void *pvData, DWORD dwLength)
 {
-    if (pvData == NULL || wLength == 0)
+    if (pvData == NULL || dwLength == 0)
     {
-        m_wLength = 0;
+        m_dwLength = 0;
         m_pvData = NULL;
     }
     else
     {
-        m_pvData = new BYTE[wLength];
+        m_pvData = new BYTE[dwLength];
 
         if (m_pvData != NULL)
         {
-            m_wLength = wLength;
-            memcpy(m_pvData, pvData, wLength);
+            m_dwLength = dwLength;
+            memcpy(m_pvData, pvData, dwLength);
         }
     }
 }
@@ -141,58 +569,58 @@ DataHolder::~DataHolder()
 }
 
 
-int DataHolder::GetData(void *pvData, WORD wLength)
+DWORD DataHolder::GetData(void *pvData, DWORD dwLength)
 {
-    int nReturn = 0;
+    DWORD dwReturn = 0;
 
-    if (pvData != NULL && wLength > 0 &&
-        m_pvData != NULL && m_wLength > 0)
+    if (pvData != NULL && dwLength > 0 &&
+        m_pvData != NULL && m_dwLength > 0)
     {
-        if (wLength > m_wLength)
+        if (dwLength > m_dwLength)
         {
-            wLength = m_wLength;
+            dwLength = m_dwLength;
         }
 
-        memcpy(pvData, m_pvData, wLength);
-        nReturn = wLength;
+        memcpy(pvData, m_pvData, dwLength);
+        dwReturn = dwLength;
     }
 
-    return nReturn;
+    return dwReturn;
 }
 
 
-int DataHolder::SetData(void *pvData, WORD wLength)
+DWORD DataHolder::SetData(const void *pvData, DWORD dwLength)
 {
-    int nReturn = 0;
+    DWORD dwReturn = 0;
 
-    if ((pvData == NULL) || (wLength == 0))
+    if ((pvData == NULL) || (dwLength == 0))
     {
         if (m_pvData)
         {
             delete [] m_pvData;
             m_pvData = NULL;
-            m_wLength = 0;
+            m_dwLength = 0;
         }
     }
-    else if (pvData != NULL && wLength > 0)
+    else if (pvData != NULL && dwLength > 0)
     {
         if (m_pvData == NULL)
         {
-            m_pvData = new BYTE[wLength];
+            m_pvData = new BYTE[dwLength];
         }
         else
         {
             delete [] m_pvData;
-            m_pvData = new BYTE[wLength];
+            m_pvData = new BYTE[dwLength];
         }
 
         if (m_pvData != NULL)
         {
-            memcpy(m_pvData, pvData, wLength);
-            m_wLength = wLength;
-            nReturn = m_wLength;
+            memcpy(m_pvData, pvData, dwLength);
+            m_dwLength = dwLength;
+            dwReturn = m_dwLength;
         }
     }
 
-    return nReturn;
+    return dwReturn;
 }
@@ -24,6 +24,8 @@
 
 #include "../utility/common.h"
 #include <map>
+#include <string>
+#include <vector>
 
 
 /**
@@ -34,7 +36,7 @@ class DataHolder
 private:
 
     /** Size of data in bytes */
-    WORD m_wLength;
+    DWORD m_dwLength;
 
     /** Pointer to data */
     BYTE* m_pvData;
@@ -49,10 +51,10 @@ public:
     /**
      * Constructs a DataHolder containing a copy of the specified data.
      *
-     * @param  pvData   pointer to data
-     * @param  wLength  size of data in bytes
+     * @param  pvData    pointer to data
+     * @param  dwLength  size of data in bytes
      */
-    DataHolder(void *pvData, WORD wLength);
+    DataHolder(const void *pvData, DWORD dwLength);
 
     /**
      * Destructor.
@@ -62,25 +64,131 @@ public:
     /**
      * Copies the data into the supplied buffer.
      *
-     * @param   pvData   buffer to receive data
-     * @param   wLength  maximum number of bytes to copy
+     * @param   pvData    buffer to receive data
+     * @param   dwLength  maximum number of bytes to copy
      * @return  number of bytes copied
      */
-    int GetData(void *pvData, WORD wLength);
+    DWORD GetData(void *pvData, DWORD dwLength);
 
     /**
      * Replaces the current data with a copy of the specified data.
      *
-     * @param   pvData   pointer to data
-     * @param   wLength  size of data in bytes
+     * @param   pvData    pointer to data
+     * @param   dwLength  size of data in bytes
      * @return  number of bytes copied
      */
-    int SetData(void *pvData, WORD wLength);
+    DWORD SetData(const void *pvData, DWORD dwLength);
+
+    /**
+     * Returns the data, without copying it.
+     */
+    const BYTE* GetBuffer() const
+    {
+        return m_pvData;
+    }
+
+    /**
+     * Returns the size of the data in bytes.
+     */
+    DWORD GetLength() const
+    {
+        return m_dwLength;
+    }
+};
+
+
+/**
+ * File backing for the data store, so that its contents survive a crash.
+ *
+ * The file is mapped into memory and holds a table of slots that is only
+ * ever appended to. Every slot carries its identifier, length and a
+ * checksum of its data; releasing an item only flags its slot. Once no
+ * items are left the table starts over. A slot is only counted once it is
+ * complete, so a crash in the middle of an append loses that item but
+ * nothing else. Data written to the view survives the process, not the
+ * machine, going down.
+ */
+class DataStoreFile
+{
+public:
+
+    /**
+     * A live slot found in the file.
+     */
+    struct Slot
+    {
+        WORD wIdent;
+        UINT64 ullOffset;
+        const BYTE* pbData;     // valid until the next Append
+        DWORD dwLength;
+    };
+
+    DataStoreFile();
+    ~DataStoreFile();
+
+    /**
+     * Opens or creates the file, and fills vecSlots with the items a
+     * previous session left in it. Slots from the first damaged one on are
+     * dropped. A file with released or damaged slots is compacted.
+     */
+    bool Open(LPCWSTR pwzPath, std::vector<Slot>& vecSlots);
+
+    /**
+     * Closes the file. With bDelete it is removed as well.
+     */
+    void Close(bool bDelete);
+
+    bool IsOpen() const
+    {
+        return m_pbView != nullptr;
+    }
+
+    /**
+     * Appends a slot holding a copy of the data.
+     *
+     * @return  offset of the slot, or 0 if the file could not grow
+     */
+    UINT64 Append(WORD wIdent, const void* pvData, DWORD dwLength);
+
+    /**
+     * Flags the slot at the given offset as released.
+     */
+    void Release(UINT64 ullOffset);
+
+    /**
+     * Drops every slot.
+     */
+    void Reset();
+
+private:
+    DataStoreFile(const DataStoreFile&) = delete;
+    DataStoreFile& operator=(const DataStoreFile&) = delete;
+
+    bool _Open(LPCWSTR pwzPath, std::vector<Slot>& vecSlots, bool& bWasted);
+
+    /**
+     * Replaces the file with one holding just the given slots. Returns
+     * false, with the file still open, if the copy could not be written.
+     * Otherwise the file is closed and has to be opened again.
+     */
+    bool _Compact(const std::vector<Slot>& vecSlots);
+
+    bool _Map(UINT64 ullCapacity);
+    void _Unmap();
+
+    static DWORD _Checksum(WORD wIdent, const BYTE* pbData, DWORD dwLength);
+
+    std::wstring m_sPath;
+    HANDLE m_hFile;
+
+    BYTE* m_pbView;
+    UINT64 m_ullCapacity;
 };
 
 
 /**
- * Manages module data that needs to be preserved across recycles.
+ * Manages module data that needs to be preserved across recycles, and,
+ * when backed by a file, across a crash.
  */
 class DataStore
 {
@@ -90,6 +198,12 @@ class DataStore
     /** List of data item index by identifier */
     DataHolderMap m_dhmData;
 
+    /** Optional file backing */
+    DataStoreFile m_dsfFile;
+
+    /** Offset of each item's slot in m_dsfFile */
+    std::map<WORD, UINT64> m_mapSlots;
+
 public:
 
     /**
@@ -98,10 +212,25 @@ public:
     DataStore();
 
     /**
-     * Destructor.
+     * Destructor. Deletes the backing file, if any, as nothing needs to
+     * survive a regular shutdown.
      */
     virtual ~DataStore();
 
+    /**
+     * Backs the data store with a file and loads the items a crashed
+     * session left in it.
+     *
+     * @param   pwzPath  path of the file
+     * @return  <code>TRUE</code> if the file could be opened
+     */
+    BOOL Open(LPCWSTR pwzPath);
+
+    /**
+     * Returns whether the data store is backed by a file.
+     */
+    bool IsPersistent() const;
+
     /**
      * Returns the number of items in the data store.
      */
@@ -115,26 +244,27 @@ public:
     /**
      * Retrieves a stored data item and removes it from the data store.
      *
-     * @param   wIdent   data identifier
-     * @param   pvData   buffer to receive data
-     * @param   wLength  maximum number of bytes to copy
+     * @param   wIdent     data identifier
+     * @param   pvData     buffer to receive data
+     * @param   dwLength   maximum number of bytes to copy
+     * @param   pdwCopied  receives the number of bytes copied, may be NULL
      * @return  <code>TRUE</code> if the operation succeeds or
      *          <code>FALSE</code> if no data item with the given
      *          identifier exists
      */
-    BOOL ReleaseData(WORD wIdent, void *pvData, WORD wLength);
+    BOOL ReleaseData(WORD wIdent, void *pvData, DWORD dwLength, LPDWORD pdwCopied);
 
     /**
      * Adds a data item to the data store.
      *
-     * @param   wIdent   data identifier
-     * @param   pvData   pointer to data
-     * @param   wLength  size of data in bytes
+     * @param   wIdent    data identifier
+     * @param   pvData    pointer to data
+     * @param   dwLength  size of data in bytes
      * @return  <code>TRUE</code> if the operation succeeds or
      *          <code>FALSE</code> if another data item with the same
      *          identifier already exists
      */
-    BOOL StoreData(WORD wIdent, void *pvData, WORD wLength);
+    BOOL StoreData(WORD wIdent, const void *pvData, DWORD dwLength);
 };
 
 #endif // DATASTORE_H
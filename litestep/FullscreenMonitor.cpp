@@ -22,16 +22,27 @@
 #include "FullscreenMonitor.h"
 #include "../lsapi/lsapi.h"
 #include "../utility/debug.hpp"
+#include "../utility/logger.h"
+#include <strsafe.h>
+#include <algorithm>
 #include <functional>
 
 
+FullscreenMonitor* FullscreenMonitor::s_pInstance = nullptr;
+
+
 //
 // FullscreenMonitor
 //
 FullscreenMonitor::FullscreenMonitor() :
-    m_workerSleepDuration(100)
+    m_bRecord(false),
+    m_dwLiteStepProcID(0),
+    m_hRecordFile(INVALID_HANDLE_VALUE),
+    m_bCheckForeground(false)
 {
     m_bReHide = false;
+    m_dwPollInterval = 2000;
+    m_hWakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 }
 
 
@@ -40,6 +51,10 @@ FullscreenMonitor::FullscreenMonitor() :
 //
 FullscreenMonitor::~FullscreenMonitor()
 {
+    if (m_hWakeEvent)
+    {
+        CloseHandle(m_hWakeEvent);
+    }
 }
 
 
@@ -183,6 +198,170 @@ void FullscreenMonitor::HideModules(HMONITOR hMonitor, HWND hWnd)
 }
 
 
+//
+// _WinEventProc
+// Runs on the worker thread while it dispatches messages. Only notes which
+// windows need a look, the checks run once the queue is empty.
+//
+void CALLBACK FullscreenMonitor::_WinEventProc(HWINEVENTHOOK, DWORD dwEvent,
+    HWND hWnd, LONG idObject, LONG idChild, DWORD, DWORD)
+{
+    FullscreenMonitor* pThis = s_pInstance;
+
+    if (pThis == nullptr)
+    {
+        return;
+    }
+
+    if (dwEvent == EVENT_SYSTEM_FOREGROUND)
+    {
+        pThis->m_bCheckForeground = true;
+    }
+    else if (idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+    {
+        // Location changes are frequent, only the foreground window and
+        // known fullscreen windows can change anything
+        if (hWnd == GetForegroundWindow())
+        {
+            pThis->m_bCheckForeground = true;
+        }
+        else if (pThis->m_state.IsTracked(hWnd))
+        {
+            pThis->m_vecPending.push_back(hWnd);
+        }
+    }
+}
+
+
+//
+// _CheckForeground
+//
+void FullscreenMonitor::_CheckForeground(FullscreenState::ActionList& actions)
+{
+    HWND hwndForeGround = GetForegroundWindow();
+
+    if (hwndForeGround == nullptr)
+    {
+        return;
+    }
+
+    // If the currently active window belongs to litestep, show all modules.
+    DWORD dwProcID = 0;
+    GetWindowThreadProcessId(hwndForeGround, &dwProcID);
+
+    if (dwProcID == m_dwLiteStepProcID)
+    {
+        m_state.LitestepActivated(actions);
+    }
+    else
+    {
+        m_state.WindowChanged(hwndForeGround,
+            IsFullscreenWindow(hwndForeGround), true, actions);
+    }
+}
+
+
+//
+// _CheckWindows
+//
+void FullscreenMonitor::_CheckWindows(const std::vector<HWND>& vecWindows,
+                                      FullscreenState::ActionList& actions)
+{
+    for (HWND hWnd : vecWindows)
+    {
+        m_state.WindowChanged(hWnd, IsFullscreenWindow(hWnd), false, actions);
+    }
+}
+
+
+//
+// _Apply
+//
+void FullscreenMonitor::_Apply(const FullscreenState::ActionList& actions)
+{
+    for (const FullscreenState::Action& action : actions)
+    {
+        if (action.type == FullscreenState::Action::Hide)
+        {
+            HideModules(action.hMonitor, action.hWnd);
+        }
+        else
+        {
+            ShowModules(action.hMonitor);
+        }
+    }
+}
+
+
+//
+// _RecordEvent
+//
+void FullscreenMonitor::_RecordEvent(const FullscreenState::Event& event, LPVOID pContext)
+{
+    FullscreenMonitor* pThis = (FullscreenMonitor*)pContext;
+
+    // "window", two handles and "background" fit easily
+    wchar_t wzLine[80];
+    FullscreenState::FormatEvent(event, wzLine, _countof(wzLine));
+
+    // The format is plain ASCII
+    char szLine[80];
+    int nLength = WideCharToMultiByte(CP_ACP, 0, wzLine, -1,
+        szLine, _countof(szLine) - 2, nullptr, nullptr);
+
+    if (nLength > 0)
+    {
+        StringCchCatA(szLine, _countof(szLine), "\r\n");
+
+        DWORD dwWritten = 0;
+        WriteFile(pThis->m_hRecordFile, szLine, (DWORD)strlen(szLine), &dwWritten, nullptr);
+    }
+}
+
+
+//
+// _StartRecording
+//
+void FullscreenMonitor::_StartRecording()
+{
+    wchar_t wzPath[MAX_PATH];
+
+    if (!LSGetLitestepPathW(wzPath, _countof(wzPath)) ||
+        FAILED(StringCchCatW(wzPath, _countof(wzPath), L"logs\\fullscreen.rec")))
+    {
+        return;
+    }
+
+    // Each session starts with a reset, so appending keeps them apart
+    m_hRecordFile = CreateFileW(wzPath, FILE_APPEND_DATA, FILE_SHARE_READ,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (m_hRecordFile == INVALID_HANDLE_VALUE)
+    {
+        LS_LOG_WARNING(General, L"FullscreenMonitor could not open %ls for recording (error=%u).",
+            wzPath, GetLastError());
+        return;
+    }
+
+    m_state.SetRecorder(_RecordEvent, this);
+}
+
+
+//
+// _StopRecording
+//
+void FullscreenMonitor::_StopRecording()
+{
+    m_state.SetRecorder(nullptr, nullptr);
+
+    if (m_hRecordFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hRecordFile);
+        m_hRecordFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+
 //
 // ThreadProc
 //
@@ -193,150 +372,144 @@ void FullscreenMonitor::ThreadProc()
     DbgSetCurrentThreadName("LS FullscreenMonitor Service");
 #endif
 
-    //
-    struct FSWindow {
-        FSWindow(HWND hWnd, HMONITOR hMonitor) {
-            this->hWnd = hWnd;
-            this->hMonitor = hMonitor;
-        }
-        HWND hWnd;
-        HMONITOR hMonitor;
+    GetWindowThreadProcessId(GetLitestepWnd(), &m_dwLiteStepProcID);
+
+    if (m_bRecord)
+    {
+        _StartRecording();
+    }
+
+    m_state.Reset();
+    m_vecPending.clear();
+    m_bCheckForeground = false;
+    s_pInstance = this;
+
+    // The foreground hook also has to see LiteStep's own windows
+    const struct
+    {
+        DWORD dwMin;
+        DWORD dwMax;
+        DWORD dwFlags;
+    } hookRanges[] =
+    {
+        { EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+          WINEVENT_OUTOFCONTEXT },
+        { EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND,
+          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS },
+        { EVENT_OBJECT_DESTROY, EVENT_OBJECT_HIDE,
+          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS },
+        { EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE,
+          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS }
     };
 
-    // List of all currently living known fullscreen windows
-    std::list<FSWindow> fullscreenWindows;
+    std::vector<HWINEVENTHOOK> vecHooks;
+    bool bHooked = true;
+
+    for (const auto& range : hookRanges)
+    {
+        HWINEVENTHOOK hHook = SetWinEventHook(range.dwMin, range.dwMax,
+            nullptr, _WinEventProc, 0, 0, range.dwFlags);
+
+        if (hHook)
+        {
+            vecHooks.push_back(hHook);
+        }
+        else
+        {
+            bHooked = false;
+        }
+    }
 
-    // The monitors which currently have modules hidden
-    std::unordered_multiset<HMONITOR> hiddenMonitors;
+    if (!bHooked)
+    {
+        LS_LOG_WARNING(General, L"FullscreenMonitor could not hook window events, polling instead.");
+    }
 
-    DWORD dwLiteStepProcID;
-    GetWindowThreadProcessId(GetLitestepWnd(), &dwLiteStepProcID);
+    FullscreenState::ActionList actions;
 
     // On startup, find any existing fullscreen windows.
+    std::vector<HWND> vecFullscreen;
+
     EnumDesktopWindows(nullptr, [] (HWND hWnd, LPARAM lParam) -> BOOL
     {
-        HMONITOR hMonitor = IsFullscreenWindow(hWnd);
-        std::list<FSWindow> *fullscreenWindows = (std::list<FSWindow>*)lParam;
-        if (hMonitor)
+        if (IsFullscreenWindow(hWnd))
         {
-            // And add it to the list of fullscreen windows.
-            fullscreenWindows->push_back(FSWindow(hWnd, hMonitor));
+            ((std::vector<HWND>*)lParam)->push_back(hWnd);
         }
         return TRUE;
-    }, (LPARAM)&fullscreenWindows);
+    }, (LPARAM)&vecFullscreen);
 
-    // Hide modules on any monitor we found
-    for (FSWindow window : fullscreenWindows)
+    // And hide modules on any monitor we found
+    for (HWND hWnd : vecFullscreen)
     {
-        hiddenMonitors.insert(window.hMonitor);
-        if (hiddenMonitors.count(window.hMonitor) == 1)
-        {
-            HideModules(window.hMonitor, window.hWnd);
-        }
+        m_state.WindowChanged(hWnd, IsFullscreenWindow(hWnd), true, actions);
     }
 
+    _Apply(actions);
+
+    DWORD dwLastPoll = GetTickCount();
+
     // Main Loop
     while (m_bRun.load())
     {
-        HWND hwndForeGround = GetForegroundWindow();
-        bool bCheckedForeGround = false;
+        // Without the hooks this is the only way to notice anything
+        DWORD dwPollInterval = bHooked ? m_dwPollInterval.load() : 100;
+        DWORD dwElapsed = GetTickCount() - dwLastPoll;
+
+        MsgWaitForMultipleObjects(1, &m_hWakeEvent, FALSE,
+            dwElapsed < dwPollInterval ? dwPollInterval - dwElapsed : 0, QS_ALLINPUT);
+
+        // Delivers the window events to _WinEventProc
+        MSG msg;
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            DispatchMessage(&msg);
+        }
+
+        actions.clear();
 
         // Re-Hide modules on all monitors
-        if (m_bReHide.load())
+        if (m_bReHide.exchange(false))
         {
-            hiddenMonitors.clear();
-            for (FSWindow window : fullscreenWindows)
-            {
-                hiddenMonitors.insert(window.hMonitor);
-                if (hiddenMonitors.count(window.hMonitor) == 1)
-                {
-                    HideModules(window.hMonitor, window.hWnd);
-                }
-            }
+            m_state.ReHide(actions);
         }
 
-        // Verify that all currently known fullscreen windows are still fullscreen.
-        std::list<FSWindow>::iterator iter = fullscreenWindows.begin();
-        while (iter != fullscreenWindows.end())
+        // Safety net, re-verify all known fullscreen windows and the
+        // foreground window every now and then
+        if (GetTickCount() - dwLastPoll >= dwPollInterval)
         {
-            HMONITOR hNewMonitor = IsFullscreenWindow(iter->hWnd);
-
-            // If we already checked the foreground window, don't bother doing it again.
-            if (iter->hWnd == hwndForeGround)
-            {
-                bCheckedForeGround = true;
-            }
-
-            //
-            if (hNewMonitor != iter->hMonitor)
-            {
-                hiddenMonitors.erase(iter->hMonitor);
-
-                // If there are no fullscreen windows left on the monitor, show the modules
-                if (hiddenMonitors.count(iter->hMonitor) == 0)
-                {
-                    ShowModules(iter->hMonitor);
-                }
-
-                // Check if the window moved to another monitor (and stayed fullscreen)
-                if (hNewMonitor)
-                {
-                    iter->hMonitor = hNewMonitor;
-                    hiddenMonitors.insert(hNewMonitor);
-                    if (hiddenMonitors.count(hNewMonitor) == 1)
-                    {
-                        HideModules(hNewMonitor, iter->hWnd);
-                    }
-                }
-                else
-                {
-                    iter = fullscreenWindows.erase(iter);
-                    continue;
-                }
-            }
-
-            ++iter;
+            dwLastPoll = GetTickCount();
+            m_state.GetWindows(m_vecPending);
+            m_bCheckForeground = true;
         }
 
-        // Check if the currently active window is a fullscreen window.
-        if (!bCheckedForeGround)
+        if (!m_vecPending.empty())
         {
-            // If the currently active window belongs to litestep, show all modules.
-            DWORD dwProcID;
-            GetWindowThreadProcessId(hwndForeGround, &dwProcID);
-            if (dwProcID == dwLiteStepProcID)
-            {
-                if (!hiddenMonitors.empty())
-                {
-                    for (HMONITOR hMonitor : hiddenMonitors)
-                    {
-                        ShowModules(hMonitor);
-                    }
-                    hiddenMonitors.clear();
-                    fullscreenWindows.clear();
-                }
-            }
-            else
-            {
-                HMONITOR hMonitor = IsFullscreenWindow(hwndForeGround);
-                if (hMonitor)
-                {
-                    // Add the window to the list of known foreground windows.
-                    fullscreenWindows.push_back(FSWindow(hwndForeGround, hMonitor));
-                    hiddenMonitors.insert(hMonitor);
-
-                    // If we didn't know about any fullscreen windows on this monitor before, hide the modules on it.
-                    if (hiddenMonitors.count(hMonitor) == 1)
-                    {
-                        HideModules(hMonitor, hwndForeGround);
-                    }
-                }
-            }
+            // A window that is being moved reports many changes
+            std::sort(m_vecPending.begin(), m_vecPending.end());
+            m_vecPending.erase(std::unique(m_vecPending.begin(), m_vecPending.end()),
+                m_vecPending.end());
+
+            _CheckWindows(m_vecPending, actions);
+            m_vecPending.clear();
+        }
+
+        if (m_bCheckForeground)
+        {
+            m_bCheckForeground = false;
+            _CheckForeground(actions);
         }
 
-        // Avoid using excesive amounts of CPU time
-        std::this_thread::sleep_for(m_workerSleepDuration);
+        _Apply(actions);
     }
+
+    for (HWINEVENTHOOK hHook : vecHooks)
+    {
+        UnhookWinEvent(hHook);
+    }
+
+    _StopRecording();
+    s_pInstance = nullptr;
 }
 
 
@@ -346,6 +519,8 @@ void FullscreenMonitor::ThreadProc()
 HRESULT FullscreenMonitor::Start()
 {
     m_bAutoHideModules = GetRCBoolW(L"LSAutoHideModules", TRUE) != FALSE;
+    m_dwPollInterval = (DWORD)std::max(100, GetRCIntW(L"LSFullscreenPollInterval", 2000));
+    m_bRecord = GetRCBoolDefW(L"LSFullscreenRecord", FALSE) != FALSE;
     m_bRun.store(true);
     m_fullscreenMonitorThread = std::thread(std::bind(&FullscreenMonitor::ThreadProc, this));
 
@@ -359,6 +534,7 @@ HRESULT FullscreenMonitor::Start()
 HRESULT FullscreenMonitor::Stop()
 {
     m_bRun.store(false);
+    SetEvent(m_hWakeEvent);
     m_fullscreenMonitorThread.join();
 
     return S_OK;
@@ -372,6 +548,7 @@ HRESULT FullscreenMonitor::Recycle()
 {
     bool bAlreadyHidden = m_bAutoHideModules;
     m_bAutoHideModules = GetRCBoolW(L"LSAutoHideModules", TRUE) != FALSE;
+    m_dwPollInterval = (DWORD)std::max(100, GetRCIntW(L"LSFullscreenPollInterval", 2000));
 
     // We need to show the modules that were hidden before
     if (bAlreadyHidden && !m_bAutoHideModules)
@@ -381,6 +558,7 @@ HRESULT FullscreenMonitor::Recycle()
     }
 
     m_bReHide.store(true);
+    SetEvent(m_hWakeEvent);
 
     return S_OK;
 }
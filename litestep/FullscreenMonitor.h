@@ -24,11 +24,21 @@
 #define FULLSCREENMONITOR_H
 
 #include "../utility/IService.h"
+#include "FullscreenState.h"
 #include <thread>
 #include <atomic>
-#include <list>
-#include <unordered_set>
+#include <vector>
 
+/**
+ * Hides the modules on monitors that show a fullscreen window.
+ *
+ * The worker thread listens for foreground, show/hide, minimize and
+ * location change events and only then re-checks the windows involved.
+ * A slow poll (LSFullscreenPollInterval) catches anything the events miss.
+ * The decisions are made by FullscreenState. With LSFullscreenRecord set,
+ * every event it sees is appended to logs\fullscreen.rec, which
+ * tools\fsreplay can replay.
+ */
 class FullscreenMonitor: public IService
 {
 public:
@@ -43,10 +53,22 @@ private:
     static HMONITOR _FullScreenGetMonitorHelper(HWND hWnd);
     static BOOL CALLBACK _EnumThreadFSWnd(HWND hWnd, LPARAM lParam);
     static HMONITOR IsFullscreenWindow(HWND hwnd);
+    static void CALLBACK _WinEventProc(HWINEVENTHOOK hHook, DWORD dwEvent,
+        HWND hWnd, LONG idObject, LONG idChild, DWORD dwThread, DWORD dwTime);
+    static void _RecordEvent(const FullscreenState::Event& event, LPVOID pContext);
+    void _StartRecording();
+    void _StopRecording();
     void ThreadProc();
+    void _CheckForeground(FullscreenState::ActionList& actions);
+    void _CheckWindows(const std::vector<HWND>& vecWindows,
+        FullscreenState::ActionList& actions);
+    void _Apply(const FullscreenState::ActionList& actions);
     void ShowModules(HMONITOR hMonitor);
     void HideModules(HMONITOR hMonitor, HWND hWnd);
 
+    // The instance the event hooks report to
+    static FullscreenMonitor* s_pInstance;
+
     // LS thread only
 private:
     std::thread m_fullscreenMonitorThread;
@@ -56,10 +78,23 @@ private:
     std::atomic<bool> m_bRun;
     std::atomic<bool> m_bReHide;
     std::atomic<bool> m_bAutoHideModules;
+    std::atomic<DWORD> m_dwPollInterval;
+
+    // Read by Start, before the worker thread runs
+    bool m_bRecord;
+
+    // Wakes up the worker thread for Stop and Recycle
+    HANDLE m_hWakeEvent;
 
     // Worker thread only
 private:
-    std::chrono::milliseconds m_workerSleepDuration;
+    FullscreenState m_state;
+    DWORD m_dwLiteStepProcID;
+    HANDLE m_hRecordFile;
+
+    // Collected by _WinEventProc until the message queue is empty
+    std::vector<HWND> m_vecPending;
+    bool m_bCheckForeground;
 };
 
 #endif // FULLSCREENMONITOR_H
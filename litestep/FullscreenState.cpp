@@ -0,0 +1,306 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "FullscreenState.h"
+#include <strsafe.h>
+#include <cwctype>
+#include <unordered_set>
+
+
+//
+// FullscreenState
+//
+FullscreenState::FullscreenState() :
+    m_pfnRecord(nullptr),
+    m_pRecordContext(nullptr)
+{
+    // do nothing
+}
+
+
+//
+// WindowChanged
+//
+void FullscreenState::WindowChanged(HWND hWnd, HMONITOR hMonitor, bool bForeground,
+                                    ActionList& actions)
+{
+    _Record(Event::WindowChanged, hWnd, hMonitor, bForeground);
+
+    auto iter = m_windows.find(hWnd);
+
+    if (iter == m_windows.end())
+    {
+        if (bForeground && hMonitor)
+        {
+            m_windows.emplace(hWnd, hMonitor);
+            _Acquire(hMonitor, hWnd, actions);
+        }
+    }
+    else if (iter->second != hMonitor)
+    {
+        HMONITOR hOldMonitor = iter->second;
+
+        // Check if the window moved to another monitor (and stayed fullscreen)
+        if (hMonitor)
+        {
+            iter->second = hMonitor;
+        }
+        else
+        {
+            m_windows.erase(iter);
+        }
+
+        _Release(hOldMonitor, actions);
+
+        if (hMonitor)
+        {
+            _Acquire(hMonitor, hWnd, actions);
+        }
+    }
+}
+
+
+//
+// LitestepActivated
+//
+void FullscreenState::LitestepActivated(ActionList& actions)
+{
+    _Record(Event::LitestepActivated, nullptr, nullptr, false);
+
+    for (const auto& monitor : m_hiddenMonitors)
+    {
+        Action action = { Action::Show, monitor.first, nullptr };
+        actions.push_back(action);
+    }
+
+    m_windows.clear();
+    m_hiddenMonitors.clear();
+}
+
+
+//
+// ReHide
+//
+void FullscreenState::ReHide(ActionList& actions)
+{
+    _Record(Event::ReHide, nullptr, nullptr, false);
+
+    std::unordered_set<HMONITOR> hidden;
+
+    for (const auto& window : m_windows)
+    {
+        if (hidden.insert(window.second).second)
+        {
+            Action action = { Action::Hide, window.second, window.first };
+            actions.push_back(action);
+        }
+    }
+}
+
+
+//
+// Reset
+//
+void FullscreenState::Reset()
+{
+    _Record(Event::Reset, nullptr, nullptr, false);
+
+    m_windows.clear();
+    m_hiddenMonitors.clear();
+}
+
+
+//
+// IsTracked
+//
+bool FullscreenState::IsTracked(HWND hWnd) const
+{
+    return m_windows.count(hWnd) != 0;
+}
+
+
+//
+// GetWindows
+//
+void FullscreenState::GetWindows(std::vector<HWND>& vecWindows) const
+{
+    for (const auto& window : m_windows)
+    {
+        vecWindows.push_back(window.first);
+    }
+}
+
+
+//
+// SetRecorder
+//
+void FullscreenState::SetRecorder(RecordProc pfnRecord, LPVOID pContext)
+{
+    m_pfnRecord = pfnRecord;
+    m_pRecordContext = pContext;
+}
+
+
+//
+// Replay
+//
+void FullscreenState::Replay(const Event& event, ActionList& actions)
+{
+    switch (event.type)
+    {
+    case Event::WindowChanged:
+        WindowChanged(event.hWnd, event.hMonitor, event.bForeground, actions);
+        break;
+
+    case Event::LitestepActivated:
+        LitestepActivated(actions);
+        break;
+
+    case Event::ReHide:
+        ReHide(actions);
+        break;
+
+    case Event::Reset:
+        Reset();
+        break;
+    }
+}
+
+
+//
+// FormatEvent
+//
+void FullscreenState::FormatEvent(const Event& event, LPWSTR pwzBuffer, size_t cchBuffer)
+{
+    switch (event.type)
+    {
+    case Event::WindowChanged:
+        StringCchPrintfW(pwzBuffer, cchBuffer, L"window 0x%llX 0x%llX %ls",
+            (unsigned long long)(UINT_PTR)event.hWnd,
+            (unsigned long long)(UINT_PTR)event.hMonitor,
+            event.bForeground ? L"foreground" : L"background");
+        break;
+
+    case Event::LitestepActivated:
+        StringCchCopyW(pwzBuffer, cchBuffer, L"activated");
+        break;
+
+    case Event::ReHide:
+        StringCchCopyW(pwzBuffer, cchBuffer, L"rehide");
+        break;
+
+    case Event::Reset:
+        StringCchCopyW(pwzBuffer, cchBuffer, L"reset");
+        break;
+    }
+}
+
+
+//
+// ParseEvent
+//
+bool FullscreenState::ParseEvent(LPCWSTR pwzLine, Event& event)
+{
+    Event parsed = { Event::Reset, nullptr, nullptr, false };
+
+    if (_wcsnicmp(pwzLine, L"window ", 7) == 0)
+    {
+        LPWSTR pwzEnd = nullptr;
+
+        parsed.type = Event::WindowChanged;
+        parsed.hWnd = (HWND)(UINT_PTR)wcstoull(pwzLine + 7, &pwzEnd, 16);
+        parsed.hMonitor = (HMONITOR)(UINT_PTR)wcstoull(pwzEnd, &pwzEnd, 16);
+
+        while (iswspace(*pwzEnd))
+        {
+            ++pwzEnd;
+        }
+
+        if (_wcsicmp(pwzEnd, L"foreground") == 0)
+        {
+            parsed.bForeground = true;
+        }
+        else if (_wcsicmp(pwzEnd, L"background") != 0)
+        {
+            return false;
+        }
+    }
+    else if (_wcsicmp(pwzLine, L"activated") == 0)
+    {
+        parsed.type = Event::LitestepActivated;
+    }
+    else if (_wcsicmp(pwzLine, L"rehide") == 0)
+    {
+        parsed.type = Event::ReHide;
+    }
+    else if (_wcsicmp(pwzLine, L"reset") != 0)
+    {
+        return false;
+    }
+
+    event = parsed;
+    return true;
+}
+
+
+//
+// _Record
+//
+void FullscreenState::_Record(Event::Type type, HWND hWnd, HMONITOR hMonitor, bool bForeground)
+{
+    if (m_pfnRecord)
+    {
+        Event event = { type, hWnd, hMonitor, bForeground };
+        m_pfnRecord(event, m_pRecordContext);
+    }
+}
+
+
+//
+// _Acquire
+// The first fullscreen window on a monitor hides the modules on it.
+//
+void FullscreenState::_Acquire(HMONITOR hMonitor, HWND hWnd, ActionList& actions)
+{
+    if (++m_hiddenMonitors[hMonitor] == 1)
+    {
+        Action action = { Action::Hide, hMonitor, hWnd };
+        actions.push_back(action);
+    }
+}
+
+
+//
+// _Release
+// Once no fullscreen windows are left on a monitor its modules are shown.
+//
+void FullscreenState::_Release(HMONITOR hMonitor, ActionList& actions)
+{
+    auto iter = m_hiddenMonitors.find(hMonitor);
+
+    if (iter != m_hiddenMonitors.end() && --iter->second == 0)
+    {
+        m_hiddenMonitors.erase(iter);
+
+        Action action = { Action::Show, hMonitor, nullptr };
+        actions.push_back(action);
+    }
+}
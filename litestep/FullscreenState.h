@@ -0,0 +1,146 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(FULLSCREENSTATE_H)
+#define FULLSCREENSTATE_H
+
+#include "../utility/common.h"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Decides on which monitors modules have to be hidden.
+ *
+ * Knows nothing about windows beyond their handles: the caller observes a
+ * window, tells the state which monitor it fills (if any), and carries out
+ * the actions it gets back. Handles are only compared, so a recorded
+ * sequence of observations can be replayed against it (see
+ * tools\fsreplay).
+ */
+class FullscreenState
+{
+public:
+    struct Action
+    {
+        enum Type
+        {
+            Hide,
+            Show
+        };
+
+        Type type;
+        HMONITOR hMonitor;
+        HWND hWnd;  // the fullscreen window, for Hide
+    };
+
+    typedef std::vector<Action> ActionList;
+
+    /**
+     * One call that changes the state, as it is recorded and replayed.
+     */
+    struct Event
+    {
+        enum Type
+        {
+            WindowChanged,
+            LitestepActivated,
+            ReHide,
+            Reset
+        };
+
+        Type type;
+        HWND hWnd;          // WindowChanged only
+        HMONITOR hMonitor;  // WindowChanged only
+        bool bForeground;   // WindowChanged only
+    };
+
+    typedef void (*RecordProc)(const Event& event, LPVOID pContext);
+
+public:
+    FullscreenState();
+
+    /**
+     * Reports the monitor a window currently fills, or nullptr if it is not
+     * fullscreen (anymore), or gone. Untracked windows are only picked up
+     * while they are in the foreground.
+     */
+    void WindowChanged(HWND hWnd, HMONITOR hMonitor, bool bForeground,
+        ActionList& actions);
+
+    /**
+     * A LiteStep window came to the foreground. Shows the modules everywhere
+     * and forgets all fullscreen windows.
+     */
+    void LitestepActivated(ActionList& actions);
+
+    /**
+     * Hides the modules again on every monitor that has a fullscreen window,
+     * e.g. after a recycle brought them back.
+     */
+    void ReHide(ActionList& actions);
+
+    /**
+     * Forgets everything, without any actions.
+     */
+    void Reset();
+
+    bool IsTracked(HWND hWnd) const;
+
+    /**
+     * Appends the tracked windows, for re-validating them.
+     */
+    void GetWindows(std::vector<HWND>& vecWindows) const;
+
+    /**
+     * Calls pfnRecord with every event before it is handled, or stops
+     * recording if pfnRecord is nullptr.
+     */
+    void SetRecorder(RecordProc pfnRecord, LPVOID pContext);
+
+    /**
+     * Handles a recorded event the way the original call did.
+     */
+    void Replay(const Event& event, ActionList& actions);
+
+    /**
+     * Converts an event to and from one line of text, such as
+     * "window 0x3012A 0x10001 foreground" or "activated".
+     */
+    static void FormatEvent(const Event& event, LPWSTR pwzBuffer, size_t cchBuffer);
+    static bool ParseEvent(LPCWSTR pwzLine, Event& event);
+
+private:
+    void _Record(Event::Type type, HWND hWnd, HMONITOR hMonitor, bool bForeground);
+    void _Acquire(HMONITOR hMonitor, HWND hWnd, ActionList& actions);
+    void _Release(HMONITOR hMonitor, ActionList& actions);
+
+private:
+    // Known fullscreen windows, and the monitor each of them fills
+    std::unordered_map<HWND, HMONITOR> m_windows;
+
+    // Number of fullscreen windows per monitor with hidden modules
+    std::unordered_map<HMONITOR, UINT> m_hiddenMonitors;
+
+    RecordProc m_pfnRecord;
+    LPVOID m_pRecordContext;
+};
+
+#endif // FULLSCREENSTATE_H
@@ -20,73 +20,260 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "MessageManager.h"
+#include "../utility/core.hpp"
+#include "../utility/logger.h"
+
+#include <algorithm>
+
+
+namespace
+{
+    // Same buckets as the task executor's histograms.
+    size_t BucketFor(UINT64 value)
+    {
+        size_t bucket = 0;
+        while (value != 0 && bucket < LSTASKSTATS_BUCKETS - 1)
+        {
+            value >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void AddSample(LSTASKHISTOGRAM& histogram, UINT64 value)
+    {
+        ++histogram.ullCount;
+        histogram.ullTotal += value;
+        histogram.ullMax = std::max(histogram.ullMax, value);
+        ++histogram.aullBuckets[BucketFor(value)];
+    }
+
+    std::wstring GetWindowModule(HWND hWnd)
+    {
+        wchar_t wzPath[MAX_PATH] = { 0 };
+        HINSTANCE hInstance = (HINSTANCE)GetWindowLongPtrW(hWnd, GWLP_HINSTANCE);
+
+        if (hInstance == nullptr ||
+            GetModuleFileNameW(hInstance, wzPath, _countof(wzPath)) == 0)
+        {
+            return L"(unknown)";
+        }
+
+        return PathFindFileNameW(wzPath);
+    }
+}
+
+
+MessageManager::ReadGuard::ReadGuard(const MessageManager& manager)
+    : m_pManager(&manager)
+{
+    m_pManager->m_lReaders.fetch_add(1, std::memory_order_seq_cst);
+}
+
+
+MessageManager::ReadGuard::ReadGuard(ReadGuard&& other)
+    : m_pManager(other.m_pManager)
+{
+    other.m_pManager = nullptr;
+}
+
+
+MessageManager::ReadGuard::~ReadGuard()
+{
+    if (m_pManager &&
+        m_pManager->m_lReaders.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+        m_pManager->m_bRetiredPending.load(std::memory_order_seq_cst))
+    {
+        // Last reader out frees what writers could not free while it was
+        // still looking.
+        Lock lock(m_pManager->m_cs);
+        m_pManager->_Reclaim();
+    }
+}
 
 
 MessageManager::MessageManager()
+    : m_pTable(new tableT)
+    , m_lReaders(0)
+    , m_bRetiredPending(false)
+    , m_bProfiling(false)
+    , m_ullOutlierMicroseconds(0)
+    , m_llFrequency(0)
 {
-    // do nothing
+    LARGE_INTEGER frequency;
+    if (QueryPerformanceFrequency(&frequency))
+    {
+        m_llFrequency = frequency.QuadPart;
+    }
 }
 
 
 MessageManager::~MessageManager()
 {
-    // do nothing
+    const tableT* pTable = m_pTable.load(std::memory_order_relaxed);
+
+    for (const TableEntry& entry : *pTable)
+    {
+        delete entry.windows;
+    }
+
+    delete pTable;
 }
 
 
-void MessageManager::AddMessage(HWND window, UINT message)
+const MessageManager::windowListT* MessageManager::_Find(
+    const tableT& table, UINT message)
 {
-    Lock lock(m_cs);
-    m_MessageMap[message].insert(window);
+    tableT::const_iterator it = std::lower_bound(table.begin(), table.end(),
+        message, [](const TableEntry& entry, UINT value)
+    {
+        return entry.message < value;
+    });
+
+    if (it != table.end() && it->message == message)
+    {
+        return it->windows;
+    }
+
+    return nullptr;
 }
 
 
-void MessageManager::AddMessages(HWND window, UINT *pMessages)
+void MessageManager::_Publish(std::vector<UINT>& vecMessages)
 {
-    Lock lock(m_cs);
+    if (vecMessages.empty())
+    {
+        return;
+    }
 
-    if (pMessages != NULL)
+    std::sort(vecMessages.begin(), vecMessages.end());
+    vecMessages.erase(std::unique(vecMessages.begin(), vecMessages.end()),
+        vecMessages.end());
+
+    const tableT* pOldTable = m_pTable.load(std::memory_order_relaxed);
+
+    std::unique_ptr<tableT> pNewTable(new tableT);
+    pNewTable->reserve(pOldTable->size() + vecMessages.size());
+
+    // Merge the old table with the changed messages. Every other entry
+    // keeps pointing at the same window array.
+    tableT::const_iterator oldIt = pOldTable->begin();
+
+    for (UINT message : vecMessages)
     {
-        while (*pMessages != 0)
+        while (oldIt != pOldTable->end() && oldIt->message < message)
+        {
+            pNewTable->push_back(*oldIt++);
+        }
+
+        if (oldIt != pOldTable->end() && oldIt->message == message)
+        {
+            m_retiredWindows.emplace_back(oldIt->windows);
+            ++oldIt;
+        }
+
+        messageMapT::const_iterator mapIt = m_MessageMap.find(message);
+
+        if (mapIt != m_MessageMap.end())
         {
-            AddMessage(window, *pMessages++);
+            TableEntry newEntry = { message,
+                new windowListT(mapIt->second.begin(), mapIt->second.end()) };
+            pNewTable->push_back(newEntry);
         }
     }
+
+    pNewTable->insert(pNewTable->end(), oldIt, pOldTable->end());
+
+    m_pTable.store(pNewTable.release(), std::memory_order_seq_cst);
+
+    m_retiredTables.emplace_back(pOldTable);
+    m_bRetiredPending.store(true, std::memory_order_seq_cst);
+
+    _Reclaim();
 }
 
 
-void MessageManager::RemoveMessage(HWND window, UINT message)
+void MessageManager::_Reclaim() const
 {
-    //
-    // This function is the main reason why everything here is locked...
-    // You wouldn't want this function to mess around while another thread is in
-    // SendMessage for example.
-    //
-    Lock lock(m_cs);
+    // A reader that registered after the new table was stored can only
+    // have loaded the new table, so once the count is zero nothing on the
+    // retired lists is reachable.
+    if (m_lReaders.load(std::memory_order_seq_cst) == 0)
+    {
+        m_bRetiredPending.store(false, std::memory_order_seq_cst);
+        m_retiredTables.clear();
+        m_retiredWindows.clear();
+    }
+}
 
-    messageMapT::iterator it = m_MessageMap.find(message);
 
-    if (it != m_MessageMap.end())
+void MessageManager::AddMessage(HWND window, UINT message)
+{
+    UINT messages[] = { message, 0 };
+    AddMessages(window, messages);
+}
+
+
+void MessageManager::AddMessages(HWND window, UINT *pMessages)
+{
+    Lock lock(m_cs);
+
+    if (pMessages != NULL)
     {
-        it->second.erase(window);
+        // Update the map for the whole list, then publish a single table
+        std::vector<UINT> vecChanged;
 
-        if (it->second.empty())
+        for (; *pMessages != 0; ++pMessages)
         {
-            m_MessageMap.erase(it);
+            if (m_MessageMap[*pMessages].insert(window).second)
+            {
+                vecChanged.push_back(*pMessages);
+            }
         }
+
+        _Publish(vecChanged);
     }
 }
 
 
+void MessageManager::RemoveMessage(HWND window, UINT message)
+{
+    UINT messages[] = { message, 0 };
+    RemoveMessages(window, messages);
+}
+
+
 void MessageManager::RemoveMessages(HWND window, UINT *pMessages)
 {
     Lock lock(m_cs);
 
     if (pMessages != NULL)
     {
-        while (*pMessages != 0)
+        std::vector<UINT> vecChanged;
+
+        for (; *pMessages != 0; ++pMessages)
         {
-            RemoveMessage(window, *pMessages++);
+            messageMapT::iterator it = m_MessageMap.find(*pMessages);
+
+            if (it != m_MessageMap.end() && it->second.erase(window) > 0)
+            {
+                if (it->second.empty())
+                {
+                    m_MessageMap.erase(it);
+                }
+
+                vecChanged.push_back(*pMessages);
+            }
+        }
+
+        if (!vecChanged.empty())
+        {
+            _Publish(vecChanged);
+
+            if (!_IsRegistered(window))
+            {
+                _DropWindowStats(window);
+            }
         }
     }
 }
@@ -95,27 +282,138 @@ void MessageManager::RemoveMessages(HWND window, UINT *pMessages)
 void MessageManager::ClearMessages(void)
 {
     Lock lock(m_cs);
+
+    const tableT* pOldTable = m_pTable.exchange(new tableT, std::memory_order_seq_cst);
+
+    for (const TableEntry& entry : *pOldTable)
+    {
+        m_retiredWindows.emplace_back(entry.windows);
+    }
+    m_retiredTables.emplace_back(pOldTable);
+    m_bRetiredPending.store(true, std::memory_order_seq_cst);
+
     m_MessageMap.clear();
+    _Reclaim();
+
+    Lock statsLock(m_csStats);
+    m_WindowStats.clear();
 }
 
 
-LRESULT MessageManager::SendMessage(UINT message, WPARAM wParam, LPARAM lParam)
+void MessageManager::RemoveModuleWindows(const std::vector<HINSTANCE>& vecInstances)
 {
     Lock lock(m_cs);
-    LRESULT lResult = 0;
 
-    messageMapT::iterator it = m_MessageMap.find(message);
+    std::vector<UINT> vecChanged;
+    windowSetT removed;
 
-    if (it != m_MessageMap.end())
+    for (messageMapT::iterator it = m_MessageMap.begin(); it != m_MessageMap.end();)
     {
-        // Make a copy since modules may unregister messages in their message
-        // handlers
-        windowSetT windowSet(it->second);
+        windowSetT& windows = it->second;
+        const size_t stBefore = windows.size();
+
+        for (windowSetT::iterator winIt = windows.begin(); winIt != windows.end();)
+        {
+            // A destroyed window reports no instance, it can only have
+            // belonged to a module that is gone
+            HINSTANCE hInstance = IsWindow(*winIt) ?
+                (HINSTANCE)GetWindowLongPtrW(*winIt, GWLP_HINSTANCE) : nullptr;
+
+            if (hInstance == nullptr || std::find(vecInstances.begin(),
+                vecInstances.end(), hInstance) != vecInstances.end())
+            {
+                removed.insert(*winIt);
+                winIt = windows.erase(winIt);
+            }
+            else
+            {
+                ++winIt;
+            }
+        }
+
+        if (windows.size() != stBefore)
+        {
+            vecChanged.push_back(it->first);
+        }
 
-        for (windowSetT::const_iterator winIt = windowSet.begin();
-            winIt != windowSet.end(); ++winIt)
+        if (windows.empty())
+        {
+            it = m_MessageMap.erase(it);
+        }
+        else
         {
-            lResult |= ::SendMessage(*winIt, message, wParam, lParam);
+            ++it;
+        }
+    }
+
+    _Publish(vecChanged);
+
+    for (HWND window : removed)
+    {
+        _DropWindowStats(window);
+    }
+
+    if (!removed.empty())
+    {
+        LS_LOG_NOTICE(Module, L"Removed the message registrations of %u windows left by unloaded modules.",
+            static_cast<UINT>(removed.size()));
+    }
+}
+
+
+bool MessageManager::_IsRegistered(HWND window) const
+{
+    for (const messageMapT::value_type& entry : m_MessageMap)
+    {
+        if (entry.second.count(window) != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void MessageManager::_DropWindowStats(HWND window)
+{
+    // The handle may be reused by an unrelated window later on
+    Lock lock(m_csStats);
+    m_WindowStats.erase(window);
+}
+
+
+LRESULT MessageManager::SendMessage(UINT message, WPARAM wParam, LPARAM lParam)
+{
+    ReadGuard guard(*this);
+    LRESULT lResult = 0;
+
+    // Modules may unregister from inside their handlers. The guard keeps
+    // this snapshot alive until we are done with it, so nothing is copied.
+    const windowListT* pWindows =
+        _Find(*m_pTable.load(std::memory_order_seq_cst), message);
+
+    if (pWindows)
+    {
+        if (!m_bProfiling.load(std::memory_order_relaxed) || m_llFrequency == 0)
+        {
+            for (HWND hWnd : *pWindows)
+            {
+                lResult |= ::SendMessage(hWnd, message, wParam, lParam);
+            }
+        }
+        else
+        {
+            for (HWND hWnd : *pWindows)
+            {
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                lResult |= ::SendMessage(hWnd, message, wParam, lParam);
+                QueryPerformanceCounter(&end);
+
+                _RecordHandling(message, hWnd,
+                    UINT64(end.QuadPart - start.QuadPart) * 1000000 / UINT64(m_llFrequency));
+            }
         }
     }
 
@@ -125,17 +423,16 @@ LRESULT MessageManager::SendMessage(UINT message, WPARAM wParam, LPARAM lParam)
 
 BOOL MessageManager::PostMessage(UINT message, WPARAM wParam, LPARAM lParam)
 {
-    Lock lock(m_cs);
+    ReadGuard guard(*this);
     BOOL bResult = TRUE;
 
-    messageMapT::iterator it = m_MessageMap.find(message);
+    const windowListT* pWindows =
+        _Find(*m_pTable.load(std::memory_order_seq_cst), message);
 
-    if (it != m_MessageMap.end())
+    if (pWindows)
     {
-        windowSetT::iterator winIt;
-
-        for (winIt = it->second.begin();
-            winIt != it->second.end() && bResult; ++winIt)
+        for (windowListT::const_iterator winIt = pWindows->begin();
+            winIt != pWindows->end() && bResult; ++winIt)
         {
             bResult = ::PostMessage(*winIt, message, wParam, lParam);
         }
@@ -147,23 +444,104 @@ BOOL MessageManager::PostMessage(UINT message, WPARAM wParam, LPARAM lParam)
 
 BOOL MessageManager::HandlerExists(UINT message)
 {
-    Lock lock(m_cs);
-    return (m_MessageMap.find(message) != m_MessageMap.end()) ? TRUE : FALSE;
+    ReadGuard guard(*this);
+    return _Find(*m_pTable.load(std::memory_order_seq_cst), message) ? TRUE : FALSE;
 }
 
 
-bool MessageManager::GetWindowsForMessage(UINT uMsg, windowSetT& setWindows) const
+MessageManager::WindowView MessageManager::GetWindowsForMessage(UINT uMsg) const
 {
-    Lock lock(m_cs);
-    bool bResult = false;
+    ReadGuard guard(*this);
+    const windowListT* pWindows = _Find(*m_pTable.load(std::memory_order_seq_cst), uMsg);
+
+    return WindowView(std::move(guard), pWindows);
+}
+
+
+void MessageManager::SetProfiling(bool bEnable, DWORD dwOutlierMs)
+{
+    m_ullOutlierMicroseconds.store(UINT64(dwOutlierMs) * 1000, std::memory_order_relaxed);
+    m_bProfiling.store(bEnable, std::memory_order_relaxed);
+}
+
+
+void MessageManager::_RecordHandling(UINT message, HWND window, UINT64 ullMicroseconds)
+{
+    const UINT64 ullThreshold = m_ullOutlierMicroseconds.load(std::memory_order_relaxed);
+    const bool bOutlier = (ullThreshold != 0 && ullMicroseconds >= ullThreshold);
+
+    std::wstring sModule;
+    {
+        Lock lock(m_csStats);
+
+        HandlingStats& messageStats = m_MessageStats[message];
+        AddSample(messageStats.handlingTime, ullMicroseconds);
+
+        HandlingStats& windowStats = m_WindowStats[window];
+        AddSample(windowStats.handlingTime, ullMicroseconds);
+
+        if (windowStats.sModule.empty())
+        {
+            // Looked up once, the window may be gone by the time anyone
+            // enumerates the stats.
+            windowStats.sModule = GetWindowModule(window);
+        }
 
-    messageMapT::const_iterator iter = m_MessageMap.find(uMsg);
+        if (bOutlier)
+        {
+            ++messageStats.ullOutliers;
+            ++windowStats.ullOutliers;
+            sModule = windowStats.sModule;
+        }
+    }
 
-    if (iter != m_MessageMap.end())
+    if (bOutlier)
     {
-        setWindows = iter->second;
-        bResult = true;
+        LS_LOG_WARNING(Module, L"Window %p (%ls) took %llu us to handle message %u.",
+            window, sModule.c_str(), ullMicroseconds, message);
     }
+}
 
-    return bResult;
+
+HRESULT MessageManager::EnumStats(LSENUMMESSAGESTATSPROCW pfnCallback, LPARAM lParam) const
+{
+    // Copied so that callbacks may broadcast, and get timed, themselves.
+    messageStatsT messageStats;
+    windowStatsT windowStats;
+    {
+        Lock lock(m_csStats);
+        messageStats = m_MessageStats;
+        windowStats = m_WindowStats;
+    }
+
+    LSMESSAGESTATS stats = { 0 };
+    stats.cbSize = sizeof(stats);
+
+    for (const messageStatsT::value_type& entry : messageStats)
+    {
+        stats.uMsg = entry.first;
+        stats.hWnd = nullptr;
+        stats.ullOutliers = entry.second.ullOutliers;
+        stats.handlingTime = entry.second.handlingTime;
+
+        if (!pfnCallback(nullptr, &stats, lParam))
+        {
+            return S_FALSE;
+        }
+    }
+
+    for (const windowStatsT::value_type& entry : windowStats)
+    {
+        stats.uMsg = 0;
+        stats.hWnd = entry.first;
+        stats.ullOutliers = entry.second.ullOutliers;
+        stats.handlingTime = entry.second.handlingTime;
+
+        if (!pfnCallback(entry.second.sModule.c_str(), &stats, lParam))
+        {
+            return S_FALSE;
+        }
+    }
+
+    return S_OK;
 }
@@ -24,9 +24,14 @@
 
 #include "../utility/common.h"
 #include "../utility/criticalsection.h"
+#include "../lsapi/lsapidefines.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
+#include <string>
+#include <vector>
 
 
 /**
@@ -36,6 +41,18 @@
  * of window messages using <code>LM_REGISTERMESSAGE</code>. Whenever
  * LiteStep's main window (GetLitestepWnd) receives a message it doesn't
  * handle, that message is resent to all windows that registered for it.
+ *
+ * Registrations are rare, broadcasts happen for every shell hook and tray
+ * message. Broadcasts therefore read an immutable snapshot: a table of
+ * message numbers sorted for binary search, each pointing to an immutable
+ * array of windows. Registering or unregistering builds a new table that
+ * shares every untouched window array with the old one and publishes it
+ * atomically. Readers take no lock and allocate nothing. Snapshots that
+ * have been replaced are freed once no reader is left that could still
+ * be looking at them.
+ *
+ * With profiling enabled SendMessage also times every window's handling of
+ * every broadcast, see SetProfiling.
  */
 class MessageManager
 {
@@ -50,19 +67,158 @@ public:
      */
     ~MessageManager();
 
+private:
     /** Set of window handles */
     typedef std::set<HWND> windowSetT;
 
-private:
     /** Maps message numbers to sets of window handles */
     typedef std::map<UINT, windowSetT> messageMapT;
 
-    /** Message map */
+    /** Immutable, sorted windows registered for one message */
+    typedef std::vector<HWND> windowListT;
+
+    /** One message in a published table */
+    struct TableEntry
+    {
+        UINT message;
+        const windowListT* windows;
+    };
+
+    /** Immutable snapshot of all registrations, sorted by message */
+    typedef std::vector<TableEntry> tableT;
+
+    /**
+     * Keeps the snapshots a reader may hold from being freed. Nests, which
+     * happens when a window unregisters from inside a broadcast.
+     */
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const MessageManager& manager);
+        ReadGuard(ReadGuard&& other);
+        ~ReadGuard();
+
+    private:
+        ReadGuard(const ReadGuard&);
+        ReadGuard& operator=(const ReadGuard&);
+
+        const MessageManager* m_pManager;
+    };
+
+public:
+    /**
+     * The windows registered for a message at the time the view was taken.
+     * Stays valid, and unchanged, while the view exists.
+     */
+    class WindowView
+    {
+    public:
+        WindowView(ReadGuard&& guard, const windowListT* pWindows)
+            : m_guard(std::move(guard)), m_pWindows(pWindows)
+        {
+        }
+
+        const HWND* begin() const
+        {
+            return m_pWindows ? m_pWindows->data() : nullptr;
+        }
+
+        const HWND* end() const
+        {
+            return m_pWindows ? m_pWindows->data() + m_pWindows->size() : nullptr;
+        }
+
+        bool empty() const
+        {
+            return m_pWindows == nullptr;
+        }
+
+    private:
+        ReadGuard m_guard;
+        const windowListT* m_pWindows;
+    };
+
+private:
+    /** Registrations, only touched with m_cs held */
     messageMapT m_MessageMap;
 
-    /** Critical section used to serialize access to data members */
+    /** Currently published snapshot, never NULL */
+    std::atomic<const tableT*> m_pTable;
+
+    /** Number of ReadGuards alive */
+    mutable std::atomic<LONG> m_lReaders;
+
+    /** Set when there is something on the retired lists */
+    mutable std::atomic<bool> m_bRetiredPending;
+
+    /** Replaced snapshots, freed once there are no readers */
+    mutable std::vector<std::unique_ptr<const tableT>> m_retiredTables;
+    mutable std::vector<std::unique_ptr<const windowListT>> m_retiredWindows;
+
+    /** Critical section used to serialize writers */
     mutable CriticalSection m_cs;
 
+    /**
+     * Publishes a new table in which the entries for the given messages
+     * reflect m_MessageMap. Sorts vecMessages. Must be called with m_cs
+     * held.
+     */
+    void _Publish(std::vector<UINT>& vecMessages);
+
+    /**
+     * Frees retired snapshots if no reader can still see them. Must be
+     * called with m_cs held.
+     */
+    void _Reclaim() const;
+
+    /**
+     * Returns the windows registered for a message in a table, or NULL.
+     */
+    static const windowListT* _Find(const tableT& table, UINT message);
+
+    /**
+     * Whether a window is registered for any message. Must be called with
+     * m_cs held.
+     */
+    bool _IsRegistered(HWND window) const;
+
+    /** Handling times for one message or one window */
+    struct HandlingStats
+    {
+        LSTASKHISTOGRAM handlingTime;
+        UINT64 ullOutliers;
+        std::wstring sModule;   // owner of the window, per-window stats only
+    };
+
+    typedef std::map<UINT, HandlingStats> messageStatsT;
+    typedef std::map<HWND, HandlingStats> windowStatsT;
+
+    /** Whether SendMessage times handlers */
+    std::atomic<bool> m_bProfiling;
+
+    /** Handling times at or above this are logged */
+    std::atomic<UINT64> m_ullOutlierMicroseconds;
+
+    /** Performance counter frequency */
+    LONGLONG m_llFrequency;
+
+    /** Collected timings, guarded by m_csStats */
+    messageStatsT m_MessageStats;
+    windowStatsT m_WindowStats;
+    mutable CriticalSection m_csStats;
+
+    /**
+     * Adds one handling time to the message's and the window's stats and
+     * logs it if it is an outlier.
+     */
+    void _RecordHandling(UINT message, HWND window, UINT64 ullMicroseconds);
+
+    /**
+     * Forgets the per-window stats of a window that is no longer
+     * registered for anything.
+     */
+    void _DropWindowStats(HWND window);
+
 public:
     /**
      * Registers a window as a handler for a message.
@@ -101,9 +257,19 @@ public:
      */
     void ClearMessages();
 
+    /**
+     * Unregisters, from every message, the windows created by the given
+     * modules and windows that no longer exist.
+     *
+     * @param  vecInstances  handles to the modules' DLL instances
+     */
+    void RemoveModuleWindows(const std::vector<HINSTANCE>& vecInstances);
+
     /**
      * Sends a message to all windows that have registered for it. Does
-     * not return until all windows have processed the message.
+     * not return until all windows have processed the message. Windows
+     * that register or unregister while the message is being sent do not
+     * change who receives it.
      *
      * @param   message  message number
      * @param   wParam   message parameter
@@ -137,15 +303,36 @@ public:
     BOOL HandlerExists(UINT message);
 
     /**
-     * Fills in a window set with the handles of all the windows that are
-     * registered for a message.
+     * Returns the windows that are registered for a message, without
+     * copying them.
+     *
+     * @param  uMsg  message number
+     * @return view of the registered windows, empty if there are none
+     */
+    WindowView GetWindowsForMessage(UINT uMsg) const;
+
+    /**
+     * Turns timing of SendMessage broadcasts on or off. Collected stats are
+     * kept when profiling is turned off.
+     *
+     * @param  bEnable      whether to time handlers
+     * @param  dwOutlierMs  handling times of at least this many milliseconds
+     *                      are logged as warnings, 0 logs none
+     */
+    void SetProfiling(bool bEnable, DWORD dwOutlierMs);
+
+    /**
+     * Enumerates the collected timings, first one entry per message, then
+     * one per window. See ELD_MESSAGESTATS.
      *
-     * @param  uMsg        message number
-     * @param  setWindows  window set to receive results
-     * @return <code>true</code> if at least one window is registered for the
-     *         message, <code>false</code> otherwise
+     * @param  pfnCallback  callback function
+     * @param  lParam       application-defined value passed to the callback
+     *                      function
+     * @return <code>S_OK</code> if all entries were enumerated,
+     *         <code>S_FALSE</code> if the callback function returned
+     *         <code>FALSE</code>
      */
-    bool GetWindowsForMessage(UINT uMsg, windowSetT& setWindows) const;
+    HRESULT EnumStats(LSENUMMESSAGESTATSPROCW pfnCallback, LPARAM lParam) const;
 };
 
 
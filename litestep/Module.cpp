@@ -37,9 +37,19 @@ Module::Module(const std::wstring& sLocation, DWORD dwFlags)
     m_hInitEvent = nullptr;
     m_hInitCopyEvent = nullptr;
     m_pQuit = nullptr;
+    m_pRefresh = nullptr;
+    m_nRefreshResult = -1;
     m_dwFlags = dwFlags;
     m_dwLoadTime = 0;
+    m_dwPreloadTime = 0;
+    m_eLoadState = LOAD_PENDING;
+    m_hrLoadError = S_OK;
     m_wzLocation = sLocation;
+
+    for (std::atomic<LONGLONG>& llTicks : m_allPhaseTicks)
+    {
+        llTicks.store(0, std::memory_order_relaxed);
+    }
 }
 
 
@@ -85,100 +95,160 @@ void AssignToFunction(std::function<T> &func, T* value)
 }
 
 
-bool Module::_LoadDll()
+void Module::_LoadDll()
 {
-    bool bReturn = false;
+    if (m_eLoadState != LOAD_PENDING)
+    {
+        LS_LOG_DEBUG(Module, L"Module DLL already loaded: %ls", m_wzLocation.c_str());
+        return;
+    }
 
-    if (!m_hInstance)
+    LS_LOG_DEBUG(Module, L"Attempting to load module DLL: %ls", m_wzLocation.c_str());
+    // Modules like popup2 like to call SetErrorMode. While that may not be
+    // good style, there is little we can do about it. However, LoadLibrary
+    // usually produces helpful error messages such as
+    // "msvcp70.dll not found" which are not displayed if a module has
+    // disabled them via SetErrorMode. We force their display here.
+    // First, make Windows display all errors. Only for this thread, other
+    // modules may be loading at the same time.
+    DWORD dwOldMode = 0;
+    SetThreadErrorMode(0, &dwOldMode);
+
+    MarkPhase(LSMODULEPHASE_LOADSTART);
     {
-        Logger::Log(L"Attempting to load module DLL: %ls", m_wzLocation.c_str());
-        // Modules like popup2 like to call SetErrorMode. While that may not be
-        // good style, there is little we can do about it. However, LoadLibrary
-        // usually produces helpful error messages such as
-        // "msvcp70.dll not found" which are not displayed if a module has
-        // disabled them via SetErrorMode. We force their display here.
-        // First, make Windows display all errors
-        UINT uOldMode = SetErrorMode(0);
-
-        if ((m_hInstance = LoadLibraryW(m_wzLocation.c_str())) != nullptr)
-        {
-            Logger::Log(L"Loaded module DLL %ls.", m_wzLocation.c_str());
-            AssignToFunction(m_pInit, (initModuleProc) GetProcAddress(
-                m_hInstance, "initModuleW"));
+        LS_TRACE_SCOPE(Module, ModuleLoad, m_wzLocation);
+        m_hInstance = LoadLibraryW(m_wzLocation.c_str());
+    }
+    MarkPhase(LSMODULEPHASE_LOADED);
 
-            if (!m_pInit) // Might be a legacy module, check for initModuleEx
-            {
-                initModuleProcA pInit = (initModuleProcA)GetProcAddress(
-                    m_hInstance, "initModuleEx");
-
-                if (!pInit) // Might be a BC module, check for underscore
-                {
-                    pInit = (initModuleProcA)GetProcAddress(
-                        m_hInstance, "_initModuleEx");
-                }
-
-                if (pInit)
-                {
-                    m_pInit = [pInit] (HWND hWnd, HINSTANCE hInst, LPCWSTR pwzPath) -> int {
-                        char szPath[MAX_PATH];
-                        WideCharToMultiByte(CP_ACP, 0, pwzPath, -1,
-                            szPath, sizeof(szPath), "", nullptr);
-                        return pInit(hWnd, hInst, szPath);
-                    };
-                }
-            }
+    if (m_hInstance != nullptr)
+    {
+        LS_LOG_DEBUG(Module, L"Loaded module DLL %ls.", m_wzLocation.c_str());
+        LS_TRACE_SCOPE(Module, ModuleResolve, m_wzLocation);
 
-            m_pQuit = (quitModuleProc)GetProcAddress(
-                m_hInstance, "quitModule");
+        AssignToFunction(m_pInit, (initModuleProc) GetProcAddress(
+            m_hInstance, "initModuleW"));
 
-            if (!m_pQuit)   // Might be a BC module, check for underscore
-            {
-                m_pQuit = (quitModuleProc)GetProcAddress(
-                    m_hInstance, "_quitModule");
-            }
+        if (!m_pInit) // Might be a legacy module, check for initModuleEx
+        {
+            initModuleProcA pInit = (initModuleProcA)GetProcAddress(
+                m_hInstance, "initModuleEx");
 
-            if (m_pInit == nullptr)
+            if (!pInit) // Might be a BC module, check for underscore
             {
-                Logger::Log(L"Module %ls missing init entry point.", m_wzLocation.c_str());
-                RESOURCE_STR(nullptr, IDS_INITMODULEEXNOTFOUND_ERROR,
-                    L"Error: Could not find initModule().\n"
-                    L"\n"
-                    L"Please confirm that the dll is a LiteStep module,\n"
-                    L"and check with the author for updates.");
+                pInit = (initModuleProcA)GetProcAddress(
+                    m_hInstance, "_initModuleEx");
             }
-            else if (m_pQuit == nullptr)
-            {
-                Logger::Log(L"Module %ls missing quit entry point.", m_wzLocation.c_str());
-                RESOURCE_STR(nullptr, IDS_QUITMODULENOTFOUND_ERROR,
-                    L"Error: Could not find quitModule().\n"
-                    L"\n"
-                    L"Please confirm that the dll is a LiteStep module.");
-            }
-            else
+
+            if (pInit)
             {
-                bReturn = true;
-                Logger::Log(L"Module %ls initialized successfully.", m_wzLocation.c_str());
+                m_pInit = [pInit] (HWND hWnd, HINSTANCE hInst, LPCWSTR pwzPath) -> int {
+                    char szPath[MAX_PATH];
+                    WideCharToMultiByte(CP_ACP, 0, pwzPath, -1,
+                        szPath, sizeof(szPath), "", nullptr);
+                    return pInit(hWnd, hInst, szPath);
+                };
             }
         }
+
+        m_pQuit = (quitModuleProc)GetProcAddress(
+            m_hInstance, "quitModule");
+
+        if (!m_pQuit)   // Might be a BC module, check for underscore
+        {
+            m_pQuit = (quitModuleProc)GetProcAddress(
+                m_hInstance, "_quitModule");
+        }
+
+        // Optional, see Refresh
+        m_pRefresh = (refreshModuleProc)GetProcAddress(
+            m_hInstance, "refreshModule");
+
+        if (!m_pRefresh)
+        {
+            m_pRefresh = (refreshModuleProc)GetProcAddress(
+                m_hInstance, "_refreshModule");
+        }
+
+        MarkPhase(LSMODULEPHASE_RESOLVED);
+
+        if (m_pInit == nullptr)
+        {
+            LS_LOG_ERROR(Module, L"Module %ls missing init entry point.", m_wzLocation.c_str());
+            m_eLoadState = LOAD_NO_INIT;
+        }
+        else if (m_pQuit == nullptr)
+        {
+            LS_LOG_ERROR(Module, L"Module %ls missing quit entry point.", m_wzLocation.c_str());
+            m_eLoadState = LOAD_NO_QUIT;
+        }
         else
         {
-            HRESULT hrError = HrGetLastError();
-            WCHAR errorDescription[512] = { 0 };
-            bool hasDescription = SUCCEEDED(DescriptionFromHR(hrError, errorDescription, _countof(errorDescription))) && errorDescription[0] != L'\0';
+            LS_LOG_NOTICE(Module, L"Module %ls initialized successfully.", m_wzLocation.c_str());
+            m_eLoadState = LOAD_SUCCEEDED;
+        }
+
+        if (m_eLoadState != LOAD_SUCCEEDED)
+        {
+            FreeLibrary(m_hInstance);
+            m_hInstance = nullptr;
+        }
+    }
+    else
+    {
+        m_hrLoadError = HrGetLastError();
+        m_eLoadState = LOAD_FAILED;
+
+        WCHAR errorDescription[512] = { 0 };
+        bool hasDescription = SUCCEEDED(DescriptionFromHR(m_hrLoadError, errorDescription, _countof(errorDescription))) && errorDescription[0] != L'\0';
+
+        if (hasDescription)
+        {
+            LS_LOG_ERROR(Module, L"Failed to load module DLL %ls (hr=0x%08X - %ls).", m_wzLocation.c_str(), m_hrLoadError, errorDescription);
+        }
+        else
+        {
+            LS_LOG_ERROR(Module, L"Failed to load module DLL %ls (hr=0x%08X).", m_wzLocation.c_str(), m_hrLoadError);
+        }
+    }
+
+    // Second, restore the old state
+    SetThreadErrorMode(dwOldMode, nullptr);
+}
 
-            if (hasDescription)
-            {
-                Logger::Log(L"Failed to load module DLL %ls (hr=0x%08X - %ls).", m_wzLocation.c_str(), hrError, errorDescription);
-            }
-            else
-            {
-                Logger::Log(L"Failed to load module DLL %ls (hr=0x%08X).", m_wzLocation.c_str(), hrError);
-            }
 
+bool Module::_CheckLoad()
+{
+    switch (m_eLoadState)
+    {
+    case LOAD_SUCCEEDED:
+        return true;
+
+    case LOAD_NO_INIT:
+        {
+            RESOURCE_STR(nullptr, IDS_INITMODULEEXNOTFOUND_ERROR,
+                L"Error: Could not find initModule().\n"
+                L"\n"
+                L"Please confirm that the dll is a LiteStep module,\n"
+                L"and check with the author for updates.");
+        }
+        break;
+
+    case LOAD_NO_QUIT:
+        {
+            RESOURCE_STR(nullptr, IDS_QUITMODULENOTFOUND_ERROR,
+                L"Error: Could not find quitModule().\n"
+                L"\n"
+                L"Please confirm that the dll is a LiteStep module.");
+        }
+        break;
+
+    default:
+        {
 #if defined(_WIN64)
             if (GetModuleArchitecture(m_wzLocation.c_str()) == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
             {
-                Logger::Log(L"Module %ls has 32-bit architecture and cannot be loaded by 64-bit LiteStep.", m_wzLocation.c_str());
+                LS_LOG_ERROR(Module, L"Module %ls has 32-bit architecture and cannot be loaded by 64-bit LiteStep.", m_wzLocation.c_str());
                 RESOURCE_STR(nullptr, IDS_MODULEWRONGARCH64_ERROR,
                     L"Error: Could not load module.\n"
                     L"\n"
@@ -187,7 +257,7 @@ bool Module::_LoadDll()
 #else
             if (GetModuleArchitecture(m_wzLocation.c_str()) == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
             {
-                Logger::Log(L"Module %ls has 64-bit architecture and cannot be loaded by 32-bit LiteStep.", m_wzLocation.c_str());
+                LS_LOG_ERROR(Module, L"Module %ls has 64-bit architecture and cannot be loaded by 32-bit LiteStep.", m_wzLocation.c_str());
                 RESOURCE_STR(nullptr, IDS_MODULEWRONGARCH32_ERROR,
                     L"Error: Could not load module.\n"
                     L"\n"
@@ -196,7 +266,7 @@ bool Module::_LoadDll()
 #endif
             else if (PathFileExistsW(m_wzLocation.c_str()))
             {
-                Logger::Log(L"Module %ls found on disk but dependent libraries appear to be missing.", m_wzLocation.c_str());
+                LS_LOG_ERROR(Module, L"Module %ls found on disk but dependent libraries appear to be missing.", m_wzLocation.c_str());
                 RESOURCE_STR(nullptr, IDS_MODULEDEPENDENCY_ERROR,
                     L"Error: Could not load module.\n"
                     L"\n"
@@ -208,41 +278,80 @@ bool Module::_LoadDll()
 
                 size_t nLen = 0;
                 StringCchLengthW(resourceTextBuffer, _countof(resourceTextBuffer), &nLen);
-                DescriptionFromHR(hrError, resourceTextBuffer + nLen, _countof(resourceTextBuffer) - nLen);
+                DescriptionFromHR(m_hrLoadError, resourceTextBuffer + nLen, _countof(resourceTextBuffer) - nLen);
             }
             else
             {
-                Logger::Log(L"Module %ls does not exist at expected path.", m_wzLocation.c_str());
+                LS_LOG_ERROR(Module, L"Module %ls does not exist at expected path.", m_wzLocation.c_str());
                 RESOURCE_STR(nullptr, IDS_MODULENOTFOUND_ERROR,
                     L"Error: Could not locate module.\n"
                     L"\n"
                     L"Please check your configuration.");
             }
         }
+        break;
+    }
 
-        // Second, restore the old state
-        SetErrorMode(uOldMode);
+    LS_LOG_ERROR(Module, L"Module %ls load failed; displaying error dialog.", m_wzLocation.c_str());
+    LPCWSTR pwzFileName = PathFindFileNameW(m_wzLocation.c_str());
 
-        if (!bReturn)
-        {
-            Logger::Log(L"Module %ls load failed; displaying error dialog.", m_wzLocation.c_str());
-            LPCWSTR pwzFileName = PathFindFileNameW(m_wzLocation.c_str());
+    RESOURCE_MSGBOX_F(pwzFileName, MB_ICONERROR);
 
-            RESOURCE_MSGBOX_F(pwzFileName, MB_ICONERROR);
+    return false;
+}
 
-            if (m_hInstance)
-            {
-                FreeLibrary(m_hInstance);
-                m_hInstance = nullptr;
-            }
+
+void Module::MarkPhase(UINT uPhase, LONGLONG llTicks)
+{
+    ASSERT(uPhase < LSMODULEPHASE_COUNT);
+
+    // Cheap enough to call for every message
+    if (m_allPhaseTicks[uPhase].load(std::memory_order_relaxed) != 0)
+    {
+        return;
+    }
+
+    if (llTicks == 0)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        llTicks = now.QuadPart;
+    }
+
+    LONGLONG llUnset = 0;
+    if (m_allPhaseTicks[uPhase].compare_exchange_strong(llUnset, llTicks))
+    {
+        if (uPhase == LSMODULEPHASE_FIRSTMESSAGE)
+        {
+            LS_TRACE_INSTANT(Module, ModuleFirstMessage, m_wzLocation);
+        }
+        else if (uPhase == LSMODULEPHASE_FIRSTPAINT)
+        {
+            LS_TRACE_INSTANT(Module, ModuleFirstPaint, m_wzLocation);
         }
     }
+}
+
+
+void Module::Preload()
+{
+    __int64 iStartTime, iEndTime, iFrequency;
+
+    DWORD dwStartTime = GetTickCount();
+    BOOL bCounter = QueryPerformanceCounter((LARGE_INTEGER*)&iStartTime);
+
+    _LoadDll();
+
+    if (!bCounter ||
+        QueryPerformanceCounter((LARGE_INTEGER*)&iEndTime) == FALSE ||
+        QueryPerformanceFrequency((LARGE_INTEGER*)&iFrequency) == FALSE)
+    {
+        m_dwPreloadTime = GetTickCount() - dwStartTime;
+    }
     else
     {
-        Logger::Log(L"Module DLL already loaded: %ls", m_wzLocation.c_str());
+        m_dwPreloadTime = (DWORD)((iEndTime - iStartTime)*1000/iFrequency);
     }
-
-    return bReturn;
 }
 
 
@@ -285,8 +394,9 @@ Module::~Module()
 
 bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
 {
-    ASSERT(NULL == m_hInstance);
-    Logger::Log(L"Module::Init %ls (flags=0x%08X).", m_wzLocation.c_str(), m_dwFlags);
+    ASSERT(NULL == m_hThread);
+    LS_LOG_DEBUG(Module, L"Module::Init %ls (flags=0x%08X).", m_wzLocation.c_str(), m_dwFlags);
+    LS_TRACE_SCOPE(Module, ModuleInit, m_wzLocation);
 
     DWORD dwStartTime = 0;
     __int64 iStartTime, iEndTime, iFrequency;
@@ -298,8 +408,11 @@ bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
     }
 
     // delaying the LoadLibrary call until this point is necessary to make
-    // grdtransparent work (it hooks LoadLibrary)
-    if (_LoadDll())
+    // grdtransparent work (it hooks LoadLibrary), unless the module manager
+    // already preloaded the DLL, see ModuleManager::_StartModules
+    _LoadDll();
+
+    if (_CheckLoad())
     {
         ASSERT(nullptr != m_pInit);
         ASSERT(nullptr != m_pQuit);
@@ -322,29 +435,21 @@ bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
             m_hThread = (HANDLE)_beginthreadex(&sa, 0, Module::ThreadProc,
                 this, 0, (UINT*)&m_dwThreadID);
             bResult = true;
-            Logger::Log(L"Module %ls launched threaded init (thread id=%lu).", m_wzLocation.c_str(), static_cast<unsigned long>(m_dwThreadID));
+            LS_LOG_DEBUG(Module, L"Module %ls launched threaded init (thread id=%lu).", m_wzLocation.c_str(), static_cast<unsigned long>(m_dwThreadID));
         }
         else
         {
-            Logger::Log(L"Module %ls invoking synchronous init.", m_wzLocation.c_str());
+            LS_LOG_DEBUG(Module, L"Module %ls invoking synchronous init.", m_wzLocation.c_str());
 
             int initResult = -1;
-            DWORD sehCode = 0;
-            bool caughtSeh = false;
 
-            __try
-            {
-                initResult = CallInit();
-            }
-            __except(sehCode = GetExceptionCode(), EXCEPTION_EXECUTE_HANDLER)
-            {
-                caughtSeh = true;
-                Logger::Log(L"Module %ls init raised SEH exception 0x%08X.", m_wzLocation.c_str(), sehCode);
-            }
+            MarkPhase(LSMODULEPHASE_INITSTART);
+            bool bInitRan = _CallInitGuarded(initResult);
+            MarkPhase(LSMODULEPHASE_INITDONE);
 
-            if (!caughtSeh)
+            if (bInitRan)
             {
-                Logger::Log(L"Module %ls synchronous init returned %d.", m_wzLocation.c_str(), initResult);
+                LS_LOG_DEBUG(Module, L"Module %ls synchronous init returned %d.", m_wzLocation.c_str(), initResult);
                 bResult = (initResult == 0);
             }
             else
@@ -362,15 +467,37 @@ bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
         {
             m_dwLoadTime = (DWORD)((iEndTime - iStartTime)*1000/iFrequency);
         }
+
+        m_dwLoadTime += m_dwPreloadTime;
     }
 
-    Logger::Log(L"Module::Init %ls final result: %s (%lu ms).", m_wzLocation.c_str(), bResult ? L"succeeded" : L"failed", static_cast<unsigned long>(m_dwLoadTime));
+    LS_LOG_NOTICE(Module, L"Module::Init %ls final result: %s (%lu ms).", m_wzLocation.c_str(), bResult ? L"succeeded" : L"failed", static_cast<unsigned long>(m_dwLoadTime));
 
     return bResult;
 }
 
 
 
+bool Module::_CallInitGuarded(int& initResult)
+{
+    // Kept out of Init, __try can not be used in functions that have objects
+    // to unwind, like Init's trace scope.
+    DWORD sehCode = 0;
+
+    __try
+    {
+        initResult = CallInit();
+    }
+    __except(sehCode = GetExceptionCode(), EXCEPTION_EXECUTE_HANDLER)
+    {
+        LS_LOG_ERROR(Module, L"Module %ls init raised SEH exception 0x%08X.", m_wzLocation.c_str(), sehCode);
+        return false;
+    }
+
+    return true;
+}
+
+
 int Module::CallInit()
 {
     ASSERT(m_pInit != nullptr);
@@ -385,20 +512,57 @@ void Module::CallQuit()
 }
 
 
+void Module::CallRefresh()
+{
+    ASSERT(m_pRefresh != NULL);
+    m_nRefreshResult = m_pRefresh(m_hInstance);
+}
+
+
+HANDLE Module::Refresh()
+{
+    LS_LOG_DEBUG(Module, L"Module::Refresh %ls.", m_wzLocation.c_str());
+
+    HANDLE hDone = nullptr;
+    m_nRefreshResult = -1;
+
+    if (m_hInstance && m_pRefresh)
+    {
+        if (m_dwFlags & LS_MODULE_THREADED)
+        {
+            hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+            if (hDone && !PostThreadMessage(m_dwThreadID,
+                LM_THREAD_REFRESHMODULE, (WPARAM)hDone, (LPARAM)this))
+            {
+                CloseHandle(hDone);
+                hDone = nullptr;
+            }
+        }
+        else
+        {
+            CallRefresh();
+        }
+    }
+
+    return hDone;
+}
+
+
 void Module::Quit()
 {
-    Logger::Log(L"Module::Quit %ls.", m_wzLocation.c_str());
+    LS_LOG_DEBUG(Module, L"Module::Quit %ls.", m_wzLocation.c_str());
 
     if (m_hInstance)
     {
         if (m_dwFlags & LS_MODULE_THREADED)
         {
-            Logger::Log(L"Posting WM_DESTROY to module thread %lu.", static_cast<unsigned long>(m_dwThreadID));
+            LS_LOG_DEBUG(Module, L"Posting WM_DESTROY to module thread %lu.", static_cast<unsigned long>(m_dwThreadID));
             PostThreadMessage(m_dwThreadID, WM_DESTROY, 0, (LPARAM)this);
         }
         else
         {
-            Logger::Log(L"Calling module quit synchronously for %ls.", m_wzLocation.c_str());
+            LS_LOG_DEBUG(Module, L"Calling module quit synchronously for %ls.", m_wzLocation.c_str());
             CallQuit();
         }
     }
@@ -408,15 +572,17 @@ void Module::Quit()
 UINT __stdcall Module::ThreadProc(void* dllModPtr)
 {
     Module* dllMod = (Module*)dllModPtr;
-    Logger::Log(L"Module thread started for %ls.", dllMod->m_wzLocation.c_str());
+    LS_LOG_DEBUG(Module, L"Module thread started for %ls.", dllMod->m_wzLocation.c_str());
 
 #if defined(MSVC_DEBUG)
     LPCTSTR pszFileName = PathFindFileName(dllMod->m_wzLocation.c_str());
     DbgSetCurrentThreadName(WCSTOMBS(pszFileName));
 #endif
 
+    dllMod->MarkPhase(LSMODULEPHASE_INITSTART);
     const int initResult = dllMod->CallInit();
-    Logger::Log(L"Module thread init returned %d for %ls.", initResult, dllMod->m_wzLocation.c_str());
+    dllMod->MarkPhase(LSMODULEPHASE_INITDONE);
+    LS_LOG_DEBUG(Module, L"Module thread init returned %d for %ls.", initResult, dllMod->m_wzLocation.c_str());
 
     // We must use a copy of our event, and hope no one has closed it before
     // waiting for it to be signaled.  See: TakeThread() member function.
@@ -436,10 +602,12 @@ UINT __stdcall Module::ThreadProc(void* dllModPtr)
             // Window message
             TranslateMessage(&msg);
             DispatchMessage(&msg);
+
+            dllMod->MarkPhase(LSMODULEPHASE_FIRSTMESSAGE);
         }
     }
 
-    Logger::Log(L"Module thread exiting for %ls.", dllMod->m_wzLocation.c_str());
+    LS_LOG_DEBUG(Module, L"Module thread exiting for %ls.", dllMod->m_wzLocation.c_str());
     return 0;
 }
 
@@ -460,6 +628,19 @@ void Module::HandleThreadMessage(MSG &msg)
         }
         break;
 
+    case LM_THREAD_REFRESHMODULE:
+        {
+            Module *dll_mod = (Module*)msg.lParam;
+
+            if (dll_mod)
+            {
+                dll_mod->CallRefresh();
+            }
+
+            SetEvent((HANDLE)msg.wParam);
+        }
+        break;
+
     case WM_DESTROY:
         {
             Module *dll_mod = (Module*)msg.lParam;
@@ -24,8 +24,10 @@
 
 #include "../lsapi/lsapidefines.h"
 #include "../utility/common.h"
+#include <atomic>
 #include <string>
 #include <functional>
+#include <vector>
 
 
 /**
@@ -58,12 +60,43 @@ private:
     /** Pointer to <code>quitModule</code> function */
     quitModuleProc m_pQuit;
 
+    /** Pointer to the optional <code>refreshModule</code> function */
+    refreshModuleProc m_pRefresh;
+
+    /** Return value of the last <code>refreshModule</code> call */
+    int m_nRefreshResult;
+
     /** Flags used to load module */
     DWORD m_dwFlags;
 
     /** The amount of time it took to load the module */
     DWORD m_dwLoadTime;
 
+    /** The amount of time <code>Preload</code> spent loading the DLL */
+    DWORD m_dwPreloadTime;
+
+    /** Outcome of loading the DLL, reported by <code>Init</code> */
+    enum LoadState
+    {
+        LOAD_PENDING,
+        LOAD_SUCCEEDED,
+        LOAD_FAILED,
+        LOAD_NO_INIT,
+        LOAD_NO_QUIT
+    } m_eLoadState;
+
+    /** Error code if <code>LoadLibrary</code> failed */
+    HRESULT m_hrLoadError;
+
+    /** Modules that must be initialized before this one */
+    std::vector<std::wstring> m_vecDependencies;
+
+    /**
+     * Performance counter values at which the module reached each
+     * LSMODULEPHASE_*, 0 for phases it has not reached (yet)
+     */
+    std::atomic<LONGLONG> m_allPhaseTicks[LSMODULEPHASE_COUNT];
+
     /**
      * Event that is triggered when a threaded module completes initialization
      */
@@ -97,6 +130,35 @@ public:
      */
     bool Init(HWND hMainWindow, const std::wstring& sAppPath);
 
+    /**
+     * Loads the module's DLL and looks up its entry points without calling
+     * into the module. May be called on any thread before <code>Init</code>,
+     * which then only has to call <code>initModuleEx</code>. Errors are
+     * reported by <code>Init</code> on the calling thread.
+     */
+    void Preload();
+
+    /**
+     * Records the time the module reached a startup phase, unless it
+     * already has. May be called on any thread.
+     *
+     * @param  uPhase   one of the LSMODULEPHASE_* values
+     * @param  llTicks  performance counter value at which it did, or 0 for
+     *                  now
+     */
+    void MarkPhase(UINT uPhase, LONGLONG llTicks = 0);
+
+    /**
+     * Returns the performance counter value at which the module reached a
+     * startup phase, or 0 if it has not.
+     *
+     * @param  uPhase  one of the LSMODULEPHASE_* values
+     */
+    LONGLONG GetPhaseTicks(UINT uPhase) const
+    {
+        return m_allPhaseTicks[uPhase].load(std::memory_order_relaxed);
+    }
+
     /**
      * Shuts down the module and unloads it. If the module was loaded in its
      * own thread then shutdown is done asynchronously. Use event handle
@@ -104,6 +166,36 @@ public:
      */
     void Quit();
 
+    /**
+     * Returns <code>true</code> if the module exports
+     * <code>refreshModule</code> and can stay loaded on a soft recycle.
+     */
+    bool CanRefresh() const
+    {
+        return m_pRefresh != nullptr;
+    }
+
+    /**
+     * Calls the module's <code>refreshModule</code> function. If the module
+     * was loaded in its own thread then this is done asynchronously, use
+     * the returned event to wait for it. Check the outcome with
+     * <code>RefreshSucceeded</code> afterwards.
+     *
+     * @return event that is set once the module is refreshed, or
+     *         <code>NULL</code> if it already is. The caller is responsible
+     *         for calling CloseHandle() on it once it is set.
+     */
+    HANDLE Refresh();
+
+    /**
+     * Returns <code>true</code> if the last <code>refreshModule</code> call
+     * returned 0.
+     */
+    bool RefreshSucceeded() const
+    {
+        return m_nRefreshResult == 0;
+    }
+
     /**
      * Entry point for the module's main thread.
      *
@@ -190,6 +282,24 @@ public:
         return m_dwFlags;
     }
 
+    /**
+     * Returns the modules, given by file name or path, that have to be
+     * initialized before this one.
+     */
+    const std::vector<std::wstring>& GetDependencies() const
+    {
+        return m_vecDependencies;
+    }
+
+    /**
+     * Adds a module, given by file name or path, that has to be initialized
+     * before this one.
+     */
+    void AddDependency(const std::wstring& sModule)
+    {
+        m_vecDependencies.push_back(sModule);
+    }
+
     /**
      * Returns how long this module took to load.
      */
@@ -216,12 +326,18 @@ public:
 
 private:
     /**
-     * Loads this module's DLL.
+     * Loads this module's DLL and looks up its entry points. Does not show
+     * any UI, so it can run on any thread.
+     */
+    void _LoadDll();
+
+    /**
+     * Reports a failure of <code>_LoadDll</code> to the user.
      *
-     * @return <code>true</code> if successful or
-     *         <code>false</code> if an error occurs
+     * @return <code>true</code> if the DLL was loaded or
+     *         <code>false</code> if an error was reported
      */
-    bool _LoadDll();
+    bool _CheckLoad();
 
     /**
      * Calls this module's <code>initModuleEx</code> function.
@@ -230,10 +346,26 @@ private:
      */
     int CallInit();
 
+    /**
+     * Calls this module's <code>initModuleEx</code> function, catching
+     * structured exceptions.
+     *
+     * @param  initResult  receives the return value from
+     *                     <code>initModuleEx</code>
+     * @return <code>false</code> if the module raised an exception
+     */
+    bool _CallInitGuarded(int& initResult);
+
     /**
      * Calls this module's <code>quitModule</code> function.
      */
     void CallQuit();
+
+    /**
+     * Calls this module's <code>refreshModule</code> function and stores
+     * its return value.
+     */
+    void CallRefresh();
 };
 
 
@@ -21,12 +21,57 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "ModuleManager.h"
 #include "../utility/core.hpp"
+#include "../utility/logger.h"
 #include <algorithm>
 #include <vector>
 
 
+namespace
+{
+    //
+    // Predicate used by _OrderModules and the lazy module code to locate a
+    // module given either the path to its DLL or just the DLL's file name.
+    //
+    struct IsNameEqual
+    {
+        IsNameEqual(LPCWSTR pwzName) : m_pwzName(pwzName)
+        {
+            // do nothing
+        }
+
+        bool operator() (LPCWSTR pwzLocation) const
+        {
+            return (_wcsicmp(m_pwzName, pwzLocation) == 0 ||
+                _wcsicmp(m_pwzName, PathFindFileNameW(pwzLocation)) == 0);
+        }
+
+        bool operator() (const Module* pModule) const
+        {
+            return (*this)(pModule->GetLocation());
+        }
+
+    private:
+        LPCWSTR m_pwzName;
+    };
+
+    //
+    // Whether two "after" lists name the same modules in the same order
+    //
+    bool IsSameDependencies(const std::vector<std::wstring>& vecLeft,
+        const std::vector<std::wstring>& vecRight)
+    {
+        return std::equal(vecLeft.begin(), vecLeft.end(), vecRight.begin(), vecRight.end(),
+            [](const std::wstring& sLeft, const std::wstring& sRight)
+            {
+                return _wcsicmp(sLeft.c_str(), sRight.c_str()) == 0;
+            });
+    }
+}
+
+
 ModuleManager::ModuleManager() :
-    m_pILiteStep(NULL), m_hLiteStep(NULL)
+    m_pILiteStep(NULL), m_hLiteStep(NULL), m_llTimelineOrigin(0),
+    m_bWatchMessages(false), m_dwWatchStart(0)
 {
     // do nothing
 }
@@ -75,7 +120,7 @@ HRESULT ModuleManager::Stop()
 {
     HRESULT hr = S_OK;
 
-    _QuitModules();
+    _QuitModules(false);
 
     if (m_pILiteStep)
     {
@@ -101,7 +146,7 @@ HRESULT ModuleManager::rStop()
 {
     HRESULT hr = S_OK;
 
-    _QuitModules();
+    _QuitModules(false);
 
     return hr;
 }
@@ -112,62 +157,278 @@ UINT ModuleManager::_LoadModules()
     ASSERT(m_ModuleQueue.empty());
 
     UINT uReturn = 0;
+
+    LARGE_INTEGER origin;
+    if (QueryPerformanceCounter(&origin))
+    {
+        m_llTimelineOrigin = origin.QuadPart;
+    }
+
+    // need to use a separate queue as modules may load other modules (e.g.
+    // mzscript via LoadModule) during the startup process
+    ModuleQueue mqModules;
+    std::vector<LazyModule> vecLazy;
+
+    if (_ReadModuleList(mqModules, vecLazy))
+    {
+        _DeferLazyModules(vecLazy);
+        uReturn = _StartModules(mqModules);
+    }
+
+    return uReturn;
+}
+
+
+bool ModuleManager::_ReadModuleList(ModuleQueue& mqModules, std::vector<LazyModule>& vecLazy)
+{
     wchar_t wzLine[MAX_LINE_LENGTH];
 
     LPVOID f = LCOpenW(nullptr);
 
-    if (f)
+    if (!f)
     {
-        // need to use a separate queue as modules may load other modules (e.g.
-        // mzscript via LoadModule) during the startup process
-        ModuleQueue mqModules;
+        return false;
+    }
 
 #if defined(LS_COMPAT_LSLOADMODULE)
-        while (LCReadNextConfig(f, "*LSLoadModule", szLine, MAX_LINE_LENGTH))
+    while (LCReadNextConfig(f, "*LSLoadModule", szLine, MAX_LINE_LENGTH))
 #elif defined(LS_COMPAT_LCREADNEXTCONFIG)
-        while (LCReadNextCommand(f, szLine, MAX_LINE_LENGTH))
+    while (LCReadNextCommand(f, szLine, MAX_LINE_LENGTH))
 #else
-        while (LCReadNextConfigW(f, L"LoadModule", wzLine, MAX_LINE_LENGTH))
+    while (LCReadNextConfigW(f, L"LoadModule", wzLine, MAX_LINE_LENGTH))
 #endif
+    {
+        wchar_t wzCommand[MAX_RCCOMMAND] = { 0 };
+        wchar_t wzToken1[MAX_LINE_LENGTH] = { 0 };
+        wchar_t wzOptions[MAX_LINE_LENGTH] = { 0 };
+
+        // first buffer takes the "LoadModule" token
+        LPWSTR lpwzBuffers[] = { wzCommand, wzToken1 };
+
+        if (LCTokenizeW(wzLine, lpwzBuffers, 2, wzOptions) >= 2)
         {
-            wchar_t wzCommand[MAX_RCCOMMAND] = { 0 };
-            wchar_t wzToken1[MAX_LINE_LENGTH] = { 0 };
-            wchar_t wzToken2[MAX_LINE_LENGTH] = { 0 };
+#if defined(LS_COMPAT_LCREADNEXTCONFIG)
+            if (_wcsicmp(wzCommand, L"LoadModule"))
+            {
+                continue;
+            }
+#endif
+
+            DWORD dwFlags = 0;
+            std::vector<std::wstring> vecDependencies;
+            std::vector<std::wstring> vecLazyBangs;
 
-            // first buffer takes the "LoadModule" token
-            LPWSTR lpwzBuffers[] = { wzCommand, wzToken1, wzToken2 };
+            _ParseModuleOptions(wzOptions, dwFlags, vecDependencies, vecLazyBangs);
 
-            if (LCTokenizeW(wzLine, lpwzBuffers, 3, nullptr) >= 2)
+            if (!vecLazyBangs.empty())
             {
-#if defined(LS_COMPAT_LCREADNEXTCONFIG)
-                if (_wcsicmp(wzCommand, L"LoadModule"))
+                LazyModule lazy;
+                lazy.sLocation = wzToken1;
+                lazy.dwFlags = dwFlags;
+                lazy.vecDependencies.swap(vecDependencies);
+                lazy.vecBangs.swap(vecLazyBangs);
+
+                vecLazy.push_back(lazy);
+                continue;
+            }
+
+            Module* pModule = _MakeModule(wzToken1, dwFlags);
+
+            if (pModule)
+            {
+                for (const std::wstring& sDependency : vecDependencies)
                 {
-                    continue;
+                    pModule->AddDependency(sDependency);
                 }
-#endif
 
-                DWORD dwFlags = 0;
+                mqModules.push_back(pModule);
+            }
+        }
+    }
+
+    LCClose (f);
 
-                if (_wcsicmp(wzToken2, L"threaded") == 0)
+    // A lazy module that a regular module depends on has to be loaded
+    // right away after all. Its own dependencies then have to be, too.
+    ModuleQueue::iterator iterDependent = mqModules.begin();
+
+    while (iterDependent != mqModules.end())
+    {
+        for (const std::wstring& sName : (*iterDependent)->GetDependencies())
+        {
+            IsNameEqual isName(sName.c_str());
+
+            for (std::vector<LazyModule>::iterator iterLazy = vecLazy.begin();
+                iterLazy != vecLazy.end(); ++iterLazy)
+            {
+                if (isName(iterLazy->sLocation.c_str()))
                 {
-                    dwFlags |= LS_MODULE_THREADED;
+                    LS_LOG_NOTICE(Module, L"Loading %ls now, %ls depends on it.",
+                        iterLazy->sLocation.c_str(), (*iterDependent)->GetLocation());
+
+                    Module* pModule = _MakeModule(
+                        iterLazy->sLocation.c_str(), iterLazy->dwFlags);
+
+                    if (pModule)
+                    {
+                        for (const std::wstring& sDependency : iterLazy->vecDependencies)
+                        {
+                            pModule->AddDependency(sDependency);
+                        }
+
+                        mqModules.push_back(pModule);
+                    }
+
+                    vecLazy.erase(iterLazy);
+                    break;
                 }
+            }
+        }
+
+        ++iterDependent;
+    }
+
+    return true;
+}
+
+
+void ModuleManager::_DeferLazyModules(const std::vector<LazyModule>& vecLazy)
+{
+    // Everything else waits for its first bang command
+    for (const LazyModule& lazy : vecLazy)
+    {
+        for (const std::wstring& sBang : lazy.vecBangs)
+        {
+            AddBangCommandExW(sBang.c_str(), LazyBangProc);
+        }
+
+        m_vecLazyModules.push_back(lazy);
+    }
 
-                Module* pModule = _MakeModule(wzToken1, dwFlags);
+    if (!vecLazy.empty())
+    {
+        LS_LOG_NOTICE(Module, L"Deferring %u lazy modules until their bang commands are used.",
+            static_cast<UINT>(vecLazy.size()));
+    }
+}
 
-                if (pModule)
+
+HRESULT ModuleManager::PrepareSoftRecycle(std::vector<HINSTANCE>& vecUnloaded)
+{
+    HRESULT hr = S_OK;
+
+    _QuitModules(true, &vecUnloaded);
+
+    return hr;
+}
+
+
+HRESULT ModuleManager::FinishSoftRecycle()
+{
+    ModuleQueue mqModules;
+    std::vector<LazyModule> vecLazy;
+
+    _ReadModuleList(mqModules, vecLazy);
+
+    UINT uRefreshed = 0;
+    const DWORD dwStartTime = GetTickCount();
+
+    // Work on a copy, QuitModule removes modules from the list
+    ModuleQueue mqResident(m_ModuleQueue);
+
+    for (Module* pModule : mqResident)
+    {
+        ModuleQueue::iterator iterEntry = std::find_if(mqModules.begin(), mqModules.end(),
+            IsLocationEqual(pModule->GetLocation()));
+
+        // A lazy module that has been loaded since keeps a lazy line
+        std::vector<LazyModule>::iterator iterLazy = vecLazy.end();
+
+        if (iterEntry == mqModules.end())
+        {
+            iterLazy = std::find_if(vecLazy.begin(), vecLazy.end(),
+                [pModule](const LazyModule& lazy)
                 {
-                    mqModules.push_back(pModule);
-                }
+                    return _wcsicmp(lazy.sLocation.c_str(), pModule->GetLocation()) == 0;
+                });
+        }
+
+        bool bUnchanged = false;
+
+        if (iterEntry != mqModules.end())
+        {
+            bUnchanged = (*iterEntry)->GetFlags() == pModule->GetFlags() &&
+                IsSameDependencies((*iterEntry)->GetDependencies(), pModule->GetDependencies());
+        }
+        else if (iterLazy != vecLazy.end())
+        {
+            bUnchanged = iterLazy->dwFlags == pModule->GetFlags() &&
+                IsSameDependencies(iterLazy->vecDependencies, pModule->GetDependencies());
+        }
+
+        if (!bUnchanged)
+        {
+            if (iterEntry == mqModules.end() && iterLazy == vecLazy.end())
+            {
+                LS_LOG_NOTICE(Module, L"Unloading %ls, it is no longer loaded by step.rc.",
+                    pModule->GetLocation());
+            }
+            else
+            {
+                LS_LOG_NOTICE(Module, L"Unloading %ls, its LoadModule line changed.",
+                    pModule->GetLocation());
             }
+
+            QuitModule(pModule->GetInstance());
+            continue;
         }
 
-        LCClose (f);
+        HANDLE hDone = pModule->Refresh();
 
-        uReturn = _StartModules(mqModules);
+        if (hDone)
+        {
+            _WaitForModules(&hDone, 1);
+            CloseHandle(hDone);
+        }
+
+        if (pModule->RefreshSucceeded())
+        {
+            // Already running, nothing to start or to defer
+            if (iterEntry != mqModules.end())
+            {
+                delete *iterEntry;
+                mqModules.erase(iterEntry);
+            }
+            else
+            {
+                vecLazy.erase(iterLazy);
+            }
+
+            ++uRefreshed;
+        }
+        else if (iterEntry != mqModules.end())
+        {
+            LS_LOG_WARNING(Module, L"Module %ls could not refresh, reloading it.",
+                pModule->GetLocation());
+
+            QuitModule(pModule->GetInstance());
+        }
+        else
+        {
+            LS_LOG_WARNING(Module, L"Module %ls could not refresh, it waits for its bang commands again.",
+                pModule->GetLocation());
+
+            QuitModule(pModule->GetInstance());
+        }
     }
 
-    return uReturn;
+    LS_LOG_NOTICE(Module, L"Refreshed %u modules in place in %lu ms.", uRefreshed,
+        static_cast<unsigned long>(GetTickCount() - dwStartTime));
+
+    _DeferLazyModules(vecLazy);
+    _StartModules(mqModules);
+
+    return S_OK;
 }
 
 
@@ -175,6 +436,9 @@ BOOL ModuleManager::LoadModule(LPCWSTR pwzLocation, DWORD dwFlags)
 {
     BOOL bReturn = FALSE;
 
+    // Loading a lazy module explicitly means it is not waiting anymore
+    _ForgetLazyModule(pwzLocation);
+
     Module* pModule = _MakeModule(pwzLocation, dwFlags);
 
     if (pModule)
@@ -195,45 +459,130 @@ Module* ModuleManager::_MakeModule(LPCWSTR pwzLocation, DWORD dwFlags)
 
 UINT ModuleManager::_StartModules(ModuleQueue& mqModules)
 {
+    LS_TRACE_SCOPE(Module, StartModules, mqModules.size());
+
     UINT uReturn = 0;
 
     if (mqModules.size() > 0)
     {
-        std::vector<HANDLE> vecInitEvents;
-        ModuleQueue::iterator iter = mqModules.begin();
-
-        while (iter != mqModules.end())
+        const DWORD dwStartTime = GetTickCount();
+        // Opt-in, since loading a DLL on another thread runs its DllMain
+        // there, which older modules do not expect
+        const bool bParallel = GetRCBoolDefW(L"LSParallelModuleLoad", FALSE) != FALSE;
+
+        std::vector<std::vector<size_t>> vecDependencies = _OrderModules(mqModules);
+        std::vector<Module*> vecModules(mqModules.begin(), mqModules.end());
+        const size_t stCount = vecModules.size();
+
+        // Note: We are taking ownership of the init event handles of
+        //       "threaded" modules here. We call CloseHandle() below.
+        std::vector<HANDLE> vecInitEvents(stCount, nullptr);
+        std::vector<PreloadRequest> vecRequests(stCount);
+        std::vector<bool> vecDone(stCount, false);
+
+        // A module's DLL may be loaded ahead once everything it depends on
+        // is initialized. Modules without dependencies all start loading
+        // right away.
+        auto preloadReady = [&]()
         {
-            if (*iter)
+            for (size_t stModule = 0; stModule < stCount; ++stModule)
             {
-                if (_FindModule((*iter)->GetLocation()) == m_ModuleQueue.end())
+                if (vecDone[stModule] || vecRequests[stModule].hDone)
                 {
-                    if ((*iter)->Init(m_hLiteStep, m_sAppPath))
+                    continue;
+                }
+
+                bool bReady = true;
+
+                for (size_t stDependency : vecDependencies[stModule])
+                {
+                    if (!vecDone[stDependency] || (vecInitEvents[stDependency] &&
+                        WaitForSingleObject(vecInitEvents[stDependency], 0) != WAIT_OBJECT_0))
                     {
-                        if ((*iter)->GetInitEvent())
-                        {
-                            // Note: We are taking ownership of the Event handle
-                            //       here.  We call CloseHandle() below.
-                            vecInitEvents.push_back((*iter)->TakeInitEvent());
-                        }
+                        bReady = false;
+                        break;
+                    }
+                }
+
+                if (bReady)
+                {
+                    _PostPreload(vecModules[stModule], vecRequests[stModule]);
+                }
+            }
+        };
 
-                        m_ModuleQueue.push_back(*iter);
-                        ++uReturn;
+        ModuleQueue mqStarted;
 
-                        ++iter;
-                        continue;
+        if (bParallel)
+        {
+            preloadReady();
+        }
+
+        for (size_t stModule = 0; stModule < stCount; ++stModule)
+        {
+            Module* pModule = vecModules[stModule];
+            bool bStarted = false;
+
+            std::vector<HANDLE> vecWait;
+            for (size_t stDependency : vecDependencies[stModule])
+            {
+                if (vecInitEvents[stDependency])
+                {
+                    vecWait.push_back(vecInitEvents[stDependency]);
+                }
+            }
+
+            if (!vecWait.empty())
+            {
+                // "threaded" dependencies have to finish their init first
+                _WaitForModules(&vecWait[0], vecWait.size());
+            }
+
+            if (vecRequests[stModule].hDone)
+            {
+                _WaitForModules(&vecRequests[stModule].hDone, 1);
+                CloseHandle(vecRequests[stModule].hDone);
+            }
+
+            if (_FindModule(pModule->GetLocation()) == m_ModuleQueue.end())
+            {
+                if (pModule->Init(m_hLiteStep, m_sAppPath))
+                {
+                    if (pModule->GetInitEvent())
+                    {
+                        vecInitEvents[stModule] = pModule->TakeInitEvent();
                     }
+
+                    m_ModuleQueue.push_back(pModule);
+                    mqStarted.push_back(pModule);
+                    ++uReturn;
+
+                    bStarted = true;
                 }
             }
 
-            // If we got here, then this is an invalid entry, and needs erased.
-            ModuleQueue::iterator iterOld = iter++;
+            // If we got here without starting it, this is an invalid entry,
+            // and needs deleted.
+            if (!bStarted)
+            {
+                delete pModule;
+            }
+
+            vecDone[stModule] = true;
 
-            delete *iterOld;
-            mqModules.erase(iterOld);
+            if (bParallel)
+            {
+                preloadReady();
+            }
         }
 
+        mqModules.swap(mqStarted);
+
         // Are there any "threaded" modules?
+        vecInitEvents.erase(
+            std::remove(vecInitEvents.begin(), vecInitEvents.end(), nullptr),
+            vecInitEvents.end());
+
         if (!vecInitEvents.empty())
         {
             // Wait for all modules to signal that they have started.
@@ -243,17 +592,335 @@ UINT ModuleManager::_StartModules(ModuleQueue& mqModules)
             std::for_each(
                 vecInitEvents.begin(), vecInitEvents.end(), CloseHandle);
         }
+
+        // Look out for the first message of the new modules
+        m_bWatchMessages = (uReturn > 0);
+        m_dwWatchStart = GetTickCount();
+
+        DWORD dwLoadTime = 0;
+        for (const Module* pModule : mqModules)
+        {
+            dwLoadTime += pModule->GetLoadTime();
+        }
+
+        LS_LOG_NOTICE(Module, L"Started %u of %u modules in %lu ms, their load times add up to %lu ms (parallel loading %ls).",
+            uReturn, static_cast<UINT>(stCount), static_cast<unsigned long>(GetTickCount() - dwStartTime),
+            static_cast<unsigned long>(dwLoadTime), bParallel ? L"on" : L"off");
     }
 
     return uReturn;
 }
 
 
-void ModuleManager::_QuitModules()
+void ModuleManager::_PostPreload(Module* pModule, PreloadRequest& request)
+{
+    request.pModule = pModule;
+    request.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    if (request.hDone)
+    {
+        LSTASKDESC task = { 0 };
+        task.executeProc = PreloadProc;
+        task.executeContext = &request;
+        task.dwFlags = LSTASK_BLOCKING;
+        task.pwzName = L"ModuleLoad";
+
+        if (LSPostTaskDesc(&task, nullptr, 0) == 0)
+        {
+            // No executor, the module loads its DLL in Init
+            CloseHandle(request.hDone);
+            request.hDone = nullptr;
+        }
+    }
+}
+
+
+void CALLBACK ModuleManager::PreloadProc(LPVOID pContext)
+{
+    PreloadRequest* pRequest = (PreloadRequest*)pContext;
+
+    pRequest->pModule->Preload();
+    SetEvent(pRequest->hDone);
+}
+
+
+std::vector<std::vector<size_t>> ModuleManager::_OrderModules(ModuleQueue& mqModules) const
+{
+    std::vector<Module*> vecModules(mqModules.begin(), mqModules.end());
+    const size_t stCount = vecModules.size();
+
+    std::vector<std::vector<size_t>> vecDependsOn(stCount);
+    std::vector<std::vector<size_t>> vecDependents(stCount);
+    std::vector<size_t> vecPending(stCount, 0);
+
+    for (size_t stModule = 0; stModule < stCount; ++stModule)
+    {
+        for (const std::wstring& sName : vecModules[stModule]->GetDependencies())
+        {
+            IsNameEqual isName(sName.c_str());
+
+            std::vector<Module*>::const_iterator iter =
+                std::find_if(vecModules.begin(), vecModules.end(), isName);
+
+            if (iter != vecModules.end() && *iter != vecModules[stModule])
+            {
+                size_t stDependency = iter - vecModules.begin();
+
+                vecDependsOn[stModule].push_back(stDependency);
+                vecDependents[stDependency].push_back(stModule);
+                ++vecPending[stModule];
+            }
+            else if (std::find_if(m_ModuleQueue.begin(), m_ModuleQueue.end(), isName) ==
+                m_ModuleQueue.end())
+            {
+                LS_LOG_WARNING(Module, L"Module %ls depends on %ls, which is not loaded.",
+                    vecModules[stModule]->GetLocation(), sName.c_str());
+            }
+        }
+    }
+
+    // Always take the first module in list order that has no pending
+    // dependencies, so modules without any keep their step.rc order.
+    std::vector<size_t> vecOrder;
+    std::vector<size_t> vecPosition(stCount, 0);
+    std::vector<bool> vecPlaced(stCount, false);
+
+    while (vecOrder.size() < stCount)
+    {
+        size_t stNext = stCount;
+
+        for (size_t stModule = 0; stModule < stCount; ++stModule)
+        {
+            if (!vecPlaced[stModule] && vecPending[stModule] == 0)
+            {
+                stNext = stModule;
+                break;
+            }
+        }
+
+        if (stNext == stCount)
+        {
+            // Only cycles are left, break one at the first module
+            for (stNext = 0; vecPlaced[stNext]; ++stNext)
+            {
+                // do nothing
+            }
+
+            LS_LOG_WARNING(Module, L"Module %ls is part of a dependency cycle.",
+                vecModules[stNext]->GetLocation());
+        }
+
+        vecPlaced[stNext] = true;
+        vecPosition[stNext] = vecOrder.size();
+        vecOrder.push_back(stNext);
+
+        for (size_t stDependent : vecDependents[stNext])
+        {
+            if (vecPending[stDependent] > 0)
+            {
+                --vecPending[stDependent];
+            }
+        }
+    }
+
+    mqModules.clear();
+
+    std::vector<std::vector<size_t>> vecSorted(stCount);
+
+    for (size_t stIndex = 0; stIndex < stCount; ++stIndex)
+    {
+        size_t stModule = vecOrder[stIndex];
+        mqModules.push_back(vecModules[stModule]);
+
+        // Dependencies dropped to break a cycle come later
+        for (size_t stDependency : vecDependsOn[stModule])
+        {
+            if (vecPosition[stDependency] < stIndex)
+            {
+                vecSorted[stIndex].push_back(vecPosition[stDependency]);
+            }
+        }
+    }
+
+    return vecSorted;
+}
+
+
+void ModuleManager::_ParseModuleOptions(LPCWSTR pwzOptions, DWORD& dwFlags,
+    std::vector<std::wstring>& vecDependencies,
+    std::vector<std::wstring>& vecLazyBangs)
+{
+    wchar_t wzToken[MAX_LINE_LENGTH] = { 0 };
+    LPCWSTR pwzNextToken = pwzOptions;
+    bool bLazy = false;
+
+    while (GetTokenW(pwzNextToken, wzToken, &pwzNextToken, FALSE))
+    {
+        if (_wcsicmp(wzToken, L"threaded") == 0)
+        {
+            dwFlags |= LS_MODULE_THREADED;
+        }
+        else if (_wcsicmp(wzToken, L"lazy") == 0)
+        {
+            bLazy = true;
+        }
+        else if (wzToken[0] == L'!')
+        {
+            // lazy !bang [!bang...]
+            vecLazyBangs.push_back(wzToken);
+        }
+        else if (_wcsicmp(wzToken, L"after") == 0 &&
+            GetTokenW(pwzNextToken, wzToken, &pwzNextToken, FALSE))
+        {
+            // after module[,module...]
+            LPWSTR pwzContext = nullptr;
+            LPWSTR pwzName = wcstok_s(wzToken, L",", &pwzContext);
+
+            while (pwzName)
+            {
+                if (*pwzName)
+                {
+                    vecDependencies.push_back(pwzName);
+                }
+
+                pwzName = wcstok_s(nullptr, L",", &pwzContext);
+            }
+        }
+        else
+        {
+            LS_LOG_WARNING(Module, L"Ignoring unknown LoadModule option %ls.", wzToken);
+        }
+    }
+
+    if (bLazy && vecLazyBangs.empty())
+    {
+        LS_LOG_WARNING(Module, L"A lazy module has to name its bang commands, loading it right away.");
+    }
+    else if (!bLazy && !vecLazyBangs.empty())
+    {
+        LS_LOG_WARNING(Module, L"Ignoring bang commands given without the lazy option.");
+        vecLazyBangs.clear();
+    }
+}
+
+
+BOOL ModuleManager::ExecuteLazyBang(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs)
+{
+    BOOL bReturn = FALSE;
+    size_t stLazy = 0;
+
+    for (; stLazy < m_vecLazyModules.size(); ++stLazy)
+    {
+        const std::vector<std::wstring>& vecBangs = m_vecLazyModules[stLazy].vecBangs;
+
+        if (std::find_if(vecBangs.begin(), vecBangs.end(),
+            [pwzCommand](const std::wstring& sBang)
+            {
+                return _wcsicmp(sBang.c_str(), pwzCommand) == 0;
+            }) != vecBangs.end())
+        {
+            break;
+        }
+    }
+
+    if (stLazy == m_vecLazyModules.size())
+    {
+        // The module was unloaded, failed to load or did not register this
+        // bang command after all. Don't come back here.
+        LS_LOG_WARNING(Module, L"No module provides %ls.", pwzCommand);
+        RemoveBangCommandW(pwzCommand);
+    }
+    else
+    {
+        LS_LOG_NOTICE(Module, L"Loading %ls for %ls.",
+            m_vecLazyModules[stLazy].sLocation.c_str(), pwzCommand);
+
+        // The module replaces the stub with its own bang command. If it
+        // does not, the stub ends up above since the module is no longer
+        // in the lazy list.
+        if (_LoadLazyModule(stLazy))
+        {
+            bReturn = InternalExecuteBangCommand(hCaller, pwzCommand, pwzArgs);
+        }
+    }
+
+    return bReturn;
+}
+
+
+BOOL ModuleManager::_LoadLazyModule(size_t stLazy)
+{
+    LazyModule lazy = m_vecLazyModules[stLazy];
+    m_vecLazyModules.erase(m_vecLazyModules.begin() + stLazy);
+
+    for (const std::wstring& sName : lazy.vecDependencies)
+    {
+        IsNameEqual isName(sName.c_str());
+
+        for (size_t stDependency = 0; stDependency < m_vecLazyModules.size(); ++stDependency)
+        {
+            if (isName(m_vecLazyModules[stDependency].sLocation.c_str()))
+            {
+                _LoadLazyModule(stDependency);
+                break;
+            }
+        }
+    }
+
+    BOOL bReturn = FALSE;
+
+    Module* pModule = _MakeModule(lazy.sLocation.c_str(), lazy.dwFlags);
+
+    if (pModule)
+    {
+        for (const std::wstring& sDependency : lazy.vecDependencies)
+        {
+            pModule->AddDependency(sDependency);
+        }
+
+        ModuleQueue mqModule(1, pModule);
+        bReturn = (_StartModules(mqModule) == 1);
+    }
+
+    return bReturn;
+}
+
+
+bool ModuleManager::_ForgetLazyModule(LPCWSTR pwzLocation)
+{
+    std::vector<LazyModule>::iterator iter = std::find_if(
+        m_vecLazyModules.begin(), m_vecLazyModules.end(),
+        [pwzLocation](const LazyModule& lazy)
+        {
+            return _wcsicmp(lazy.sLocation.c_str(), pwzLocation) == 0;
+        });
+
+    bool bFound = (iter != m_vecLazyModules.end());
+
+    if (bFound)
+    {
+        m_vecLazyModules.erase(iter);
+    }
+
+    return bFound;
+}
+
+
+void ModuleManager::LazyBangProc(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs)
+{
+    LazyBangRequest request = { hCaller, pwzCommand, pwzArgs };
+
+    SendMessage(GetLitestepWnd(), LM_LAZYBANGCOMMAND, 0, (LPARAM)&request);
+}
+
+
+void ModuleManager::_QuitModules(bool bKeepRefreshable,
+    std::vector<HINSTANCE>* pvecUnloaded)
 {
     std::vector<HANDLE> vecQuitObjects;
     ModuleQueue::reverse_iterator iter = m_ModuleQueue.rbegin();
     ModuleQueue TempQueue;
+    ModuleQueue KeptQueue;
 
     // Note:
     //  Store each module in a temporary queue, so that the module may not be
@@ -263,10 +930,22 @@ void ModuleManager::_QuitModules()
 
     while (iter != m_ModuleQueue.rend())
     {
+        if (bKeepRefreshable && *iter && (*iter)->CanRefresh())
+        {
+            KeptQueue.push_front(*iter);
+            ++iter;
+            continue;
+        }
+
         TempQueue.push_back(*iter);
 
         if (*iter)
         {
+            if (pvecUnloaded && (*iter)->GetInstance())
+            {
+                pvecUnloaded->push_back((*iter)->GetInstance());
+            }
+
             (*iter)->Quit();
 
             if ((*iter)->GetThread())
@@ -278,7 +957,10 @@ void ModuleManager::_QuitModules()
         ++iter;
     }
 
-    m_ModuleQueue.clear();
+    m_ModuleQueue.swap(KeptQueue);
+
+    // Their stubs go away with the other bang commands on recycle
+    m_vecLazyModules.clear();
 
     if (!vecQuitObjects.empty())
     {
@@ -326,7 +1008,7 @@ BOOL ModuleManager::QuitModule(HINSTANCE hModule)
 
 BOOL ModuleManager::QuitModule(LPCWSTR pwzLocation)
 {
-    BOOL bReturn = FALSE;
+    BOOL bReturn = _ForgetLazyModule(pwzLocation) ? TRUE : FALSE;
 
     ModuleQueue::iterator iter = _FindModule(pwzLocation);
 
@@ -435,3 +1117,90 @@ HRESULT ModuleManager::EnumPerformance(LSENUMPERFORMANCEPROCW pfnCallback, LPARA
 
     return hr;
 }
+
+
+HRESULT ModuleManager::EnumTimeline(LSENUMMODULETIMELINEPROCW pfnCallback, LPARAM lParam) const
+{
+    LARGE_INTEGER frequency;
+    if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart == 0)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = S_OK;
+
+    for (ModuleQueue::const_iterator iter = m_ModuleQueue.begin();
+        iter != m_ModuleQueue.end(); ++iter)
+    {
+        LSMODULETIMELINE timeline = { 0 };
+        timeline.cbSize = sizeof(timeline);
+        timeline.dwFlags = (*iter)->GetFlags();
+
+        for (UINT uPhase = 0; uPhase < LSMODULEPHASE_COUNT; ++uPhase)
+        {
+            LONGLONG llTicks = (*iter)->GetPhaseTicks(uPhase);
+
+            if (llTicks == 0)
+            {
+                timeline.aullPhases[uPhase] = LSMODULEPHASE_NONE;
+            }
+            else
+            {
+                timeline.aullPhases[uPhase] =
+                    UINT64(std::max<LONGLONG>(llTicks - m_llTimelineOrigin, 0)) *
+                    1000000 / UINT64(frequency.QuadPart);
+            }
+        }
+
+        if (!pfnCallback((*iter)->GetLocation(), &timeline, lParam))
+        {
+            hr = S_FALSE;
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+void ModuleManager::NoteMessage(HWND hWnd)
+{
+    HINSTANCE hInstance = (HINSTANCE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE);
+    bool bPending = false;
+
+    for (Module* pModule : m_ModuleQueue)
+    {
+        if (pModule->GetInstance() == hInstance)
+        {
+            pModule->MarkPhase(LSMODULEPHASE_FIRSTMESSAGE);
+        }
+        else if (pModule->GetPhaseTicks(LSMODULEPHASE_FIRSTMESSAGE) == 0)
+        {
+            bPending = true;
+        }
+    }
+
+    // Some modules never get a message, don't slow down the message loop
+    // for them forever.
+    if (!bPending || GetTickCount() - m_dwWatchStart > 60 * 1000)
+    {
+        m_bWatchMessages = false;
+    }
+}
+
+
+void ModuleManager::NoteFirstPaint(HINSTANCE hModule, DWORD dwPaintTicks)
+{
+    ModuleQueue::iterator iter = _FindModule(hModule);
+
+    if (iter != m_ModuleQueue.end())
+    {
+        // The message is handled long before the low 32 bits wrap, so the
+        // high bits are the current ones
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+
+        (*iter)->MarkPhase(LSMODULEPHASE_FIRSTPAINT,
+            now.QuadPart - DWORD(now.LowPart - dwPaintTicks));
+    }
+}
@@ -26,6 +26,8 @@
 #include "../utility/IManager.h"
 #include "../utility/common.h"
 #include <list>
+#include <string>
+#include <vector>
 
 
 /** List of modules */
@@ -78,6 +80,30 @@ public:
      */
     HRESULT rStop();
 
+    /**
+     * First half of a soft recycle, called before settings and bang commands
+     * are reloaded. Unloads the modules that do not export
+     * <code>refreshModule</code>, the others stay loaded.
+     *
+     * @param  vecUnloaded  receives the instance handles the unloaded
+     *                      modules had
+     * @return <code>S_OK</code> if successful or an error code
+     */
+    HRESULT PrepareSoftRecycle(std::vector<HINSTANCE>& vecUnloaded);
+
+    /**
+     * Second half of a soft recycle, called once settings and bang commands
+     * are reloaded. Calls <code>refreshModule</code> of the modules that
+     * stayed loaded and loads the remaining modules in <code>step.rc</code>.
+     * A module whose <code>LoadModule</code> line changed (its flags or its
+     * "after" list), or whose <code>refreshModule</code> fails, is unloaded
+     * and loaded again. A lazy module that was loaded keeps running when its
+     * line is the same.
+     *
+     * @return <code>S_OK</code> if successful or an error code
+     */
+    HRESULT FinishSoftRecycle();
+
     /**
      * Loads a module.
      *
@@ -115,6 +141,34 @@ public:
      */
     BOOL ReloadModule(HINSTANCE hModule);
 
+    /**
+     * A bang command of a "lazy" module that has not been loaded yet, sent
+     * to LiteStep's main window in the LPARAM of LM_LAZYBANGCOMMAND.
+     */
+    struct LazyBangRequest
+    {
+        /** Window handle belonging to the caller of the bang command */
+        HWND hCaller;
+
+        /** Bang command name */
+        LPCWSTR pwzCommand;
+
+        /** Arguments, already expanded */
+        LPCWSTR pwzArgs;
+    };
+
+    /**
+     * Loads the "lazy" module that declared a bang command and then executes
+     * the bang command again, now that the module has registered it.
+     *
+     * @param  hCaller     window handle belonging to the caller
+     * @param  pwzCommand  bang command name
+     * @param  pwzArgs     bang command arguments
+     * @return <code>TRUE</code> if the module was loaded and the bang command
+     *         executed or <code>FALSE</code> otherwise
+     */
+    BOOL ExecuteLazyBang(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs);
+
     /**
      * Enumerates loaded modules. Calls the callback function once for each
      * loaded module. Continues until all modules have been enumerated or the
@@ -143,7 +197,69 @@ public:
      */
     HRESULT EnumPerformance(LSENUMPERFORMANCEPROCW pfnCallback, LPARAM lParam) const;
 
+    /**
+     * Enumerates the startup timeline of loaded modules, see
+     * ELD_MODULETIMELINE. Calls the callback function once for each loaded
+     * module. Continues until all modules have been enumerated or the
+     * callback function returns <code>FALSE</code>.
+     *
+     * @param  pfnCallback  pointer to callback function
+     * @param  lParam       application-defined value passed to the callback
+     *                      function
+     * @return <code>S_OK</code> if all modules were enumerated,
+     *         <code>S_FALSE</code> if the callback function returned
+     *         <code>FALSE</code>, or an error code
+     */
+    HRESULT EnumTimeline(LSENUMMODULETIMELINEPROCW pfnCallback, LPARAM lParam) const;
+
+    /**
+     * Returns <code>true</code> while some modules have not handled their
+     * first message yet and the main message loop should call
+     * <code>NoteMessage</code>.
+     */
+    bool IsWatchingMessages() const
+    {
+        return m_bWatchMessages;
+    }
+
+    /**
+     * Records the first message handled by a window on the main thread as
+     * the owning module's LSMODULEPHASE_FIRSTMESSAGE. Stops watching once
+     * all modules have one, or a minute after they were started.
+     *
+     * @param  hWnd  window that just handled a message
+     */
+    void NoteMessage(HWND hWnd);
+
+    /**
+     * Records a module's first paint (LM_MODULEFIRSTPAINT).
+     *
+     * @param  hModule       handle to the module's DLL instance
+     * @param  dwPaintTicks  low 32 bits of the performance counter at the
+     *                       paint
+     */
+    void NoteFirstPaint(HINSTANCE hModule, DWORD dwPaintTicks);
+
 private:
+    /**
+     * A module that is only loaded once one of its bang commands is used.
+     * Until then each of its bang commands is registered as LazyBangProc.
+     */
+    struct LazyModule
+    {
+        /** Path to the module's DLL */
+        std::wstring sLocation;
+
+        /** Flags for the module */
+        DWORD dwFlags;
+
+        /** Modules named by "after" */
+        std::vector<std::wstring> vecDependencies;
+
+        /** Bang commands the module registers */
+        std::vector<std::wstring> vecBangs;
+    };
+
     /**
      * Loads all the modules specified in <code>step.rc</code>.
      *
@@ -151,18 +267,139 @@ private:
      */
     UINT _LoadModules();
 
+    /**
+     * Reads the <code>LoadModule</code> lines in <code>step.rc</code>.
+     *
+     * @param  mqModules  receives the modules to load now, not initialized
+     * @param  vecLazy    receives the modules to load lazily
+     * @return <code>false</code> if the settings could not be read
+     */
+    bool _ReadModuleList(ModuleQueue& mqModules, std::vector<LazyModule>& vecLazy);
+
+    /**
+     * Adds modules to the lazy module list and registers their bang
+     * commands as LazyBangProc.
+     *
+     * @param  vecLazy  modules to add
+     */
+    void _DeferLazyModules(const std::vector<LazyModule>& vecLazy);
+
     /**
      * Initializes the modules in the specified list.
      *
+     * Modules are initialized on the calling thread in list order, except
+     * that a module comes after the modules it depends on. If
+     * LSParallelModuleLoad is set, the DLLs of modules whose dependencies
+     * are initialized are loaded on the task executor's I/O pool meanwhile,
+     * so by the time a module's turn comes only its initModuleEx is left to
+     * call.
+     *
      * @param  mqModules  list of modules to initialize
      * @return number of modules initialized
      */
     UINT _StartModules(ModuleQueue& mqModules);
 
+    /**
+     * Sorts a list of modules so that every module comes after the modules
+     * it depends on, keeping the list order otherwise. Dependencies on
+     * modules that are not in the list are ignored, as are dependency
+     * cycles.
+     *
+     * @param  mqModules  list of modules to sort
+     * @return for every module in the sorted list, the indexes of the
+     *         modules it depends on
+     */
+    std::vector<std::vector<size_t>> _OrderModules(ModuleQueue& mqModules) const;
+
+    /**
+     * A module whose DLL is being loaded on the task executor.
+     */
+    struct PreloadRequest
+    {
+        PreloadRequest() : pModule(nullptr), hDone(nullptr)
+        {
+            // do nothing
+        }
+
+        /** Module to load */
+        Module* pModule;
+
+        /** Event that is set once the DLL is loaded */
+        HANDLE hDone;
+    };
+
+    /**
+     * Starts loading a module's DLL on the task executor's I/O pool. Leaves
+     * <code>request.hDone</code> <code>NULL</code> if the task could not be
+     * posted, the module then loads its DLL in <code>Module::Init</code>.
+     *
+     * @param  pModule  module to load
+     * @param  request  request to fill in, has to stay put until
+     *                  <code>request.hDone</code> is set
+     */
+    static void _PostPreload(Module* pModule, PreloadRequest& request);
+
+    /**
+     * Task executor procedure that loads a module's DLL.
+     *
+     * @param  pContext  pointer to the <code>PreloadRequest</code>
+     */
+    static void CALLBACK PreloadProc(LPVOID pContext);
+
+    /**
+     * Loads a module from the lazy module list, after any modules in that
+     * list it depends on.
+     *
+     * @param  stLazy  index of the module in <code>m_vecLazyModules</code>
+     * @return <code>TRUE</code> if successful or <code>FALSE</code> if an
+     *         error occurs
+     */
+    BOOL _LoadLazyModule(size_t stLazy);
+
+    /**
+     * Removes a module from the lazy module list, if it is there. Its bang
+     * commands stay registered as LazyBangProc, which removes them when
+     * they are used.
+     *
+     * @param  pwzLocation  path to the module's DLL
+     * @return <code>true</code> if the module was in the list
+     */
+    bool _ForgetLazyModule(LPCWSTR pwzLocation);
+
+    /**
+     * Bang command registered for each bang command of a lazy module. Hands
+     * the bang command to ExecuteLazyBang through LM_LAZYBANGCOMMAND.
+     *
+     * Bang commands run on the thread that registered them, so this always
+     * runs on the main thread.
+     */
+    static void LazyBangProc(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs);
+
+    /**
+     * Parses the options following the path in a <code>LoadModule</code>
+     * line: <code>threaded</code>, <code>after module[,module...]</code>
+     * and <code>lazy !bang [!bang...]</code>.
+     *
+     * @param  pwzOptions       options
+     * @param  dwFlags          receives the flags for the module
+     * @param  vecDependencies  receives the modules named by "after"
+     * @param  vecLazyBangs     receives the bang commands named by "lazy",
+     *                          empty unless the module should be lazy
+     */
+    static void _ParseModuleOptions(LPCWSTR pwzOptions, DWORD& dwFlags,
+        std::vector<std::wstring>& vecDependencies,
+        std::vector<std::wstring>& vecLazyBangs);
+
     /**
      * Unloads all loaded modules.
+     *
+     * @param  bKeepRefreshable  <code>true</code> to keep the modules that
+     *                           export <code>refreshModule</code> loaded
+     * @param  pvecUnloaded      if not <code>NULL</code>, receives the
+     *                           instance handles of the unloaded modules
      */
-    void _QuitModules();
+    void _QuitModules(bool bKeepRefreshable,
+        std::vector<HINSTANCE>* pvecUnloaded = nullptr);
 
     /**
      * Finds a module in the loaded module list based on the path to its DLL.
@@ -199,6 +436,9 @@ private:
     /** List of loaded modules */
     ModuleQueue m_ModuleQueue;
 
+    /** Modules waiting for one of their bang commands to be used */
+    std::vector<LazyModule> m_vecLazyModules;
+
     /** Pointer to LiteStep's core interface */
     ILiteStep *m_pILiteStep;
 
@@ -208,6 +448,15 @@ private:
     /** Path to LiteStep's root directory */
     std::wstring m_sAppPath;
 
+    /** Performance counter value the startup timeline is relative to */
+    LONGLONG m_llTimelineOrigin;
+
+    /** Whether NoteMessage still has modules to look out for */
+    bool m_bWatchMessages;
+
+    /** When the modules being watched were started */
+    DWORD m_dwWatchStart;
+
     /**
      * Predicate used by <code>_FindModule</code> to locate a loaded module
      * given the path to its DLL.
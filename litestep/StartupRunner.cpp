@@ -23,6 +23,7 @@
 #include "../utility/core.hpp"
 #include "../utility/logger.h"
 #include <regstr.h>
+#include <algorithm>
 
 
 #define ERK_NONE                0x0000
@@ -51,19 +52,19 @@ StartupRunner::~StartupRunner()
 
 void StartupRunner::Run(BOOL bForce)
 {
-    Logger::Log(L"StartupRunner::Run invoked (force=%d).", static_cast<int>(bForce));
+    LS_LOG_DEBUG(StartupRunner, L"StartupRunner::Run invoked (force=%d).", static_cast<int>(bForce));
 
     HANDLE hThread = LSCreateThread("StartupRunner",
         StartupRunner::_ThreadProc, (LPVOID)(INT_PTR)bForce, NULL);
 
     if (hThread)
     {
-        Logger::Log(L"StartupRunner worker thread created (handle=%p).", hThread);
+        LS_LOG_DEBUG(StartupRunner, L"StartupRunner worker thread created (handle=%p).", hThread);
         CloseHandle(hThread);
     }
     else
     {
-        Logger::Log(L"StartupRunner worker thread creation failed (error=%u).", GetLastError());
+        LS_LOG_ERROR(StartupRunner, L"StartupRunner worker thread creation failed (error=%u).", GetLastError());
     }
 }
 
@@ -72,7 +73,7 @@ DWORD WINAPI StartupRunner::_ThreadProc(LPVOID lpData)
     bool bRunStartup = IsFirstRunThisSession(_T("StartupHasBeenRun"));
     BOOL bForceStartup = (lpData != 0);
 
-    Logger::Log(L"StartupRunner::_ThreadProc started (force=%d, firstRun=%d).", static_cast<int>(bForceStartup), static_cast<int>(bRunStartup));
+    LS_LOG_DEBUG(StartupRunner, L"StartupRunner::_ThreadProc started (force=%d, firstRun=%d).", static_cast<int>(bForceStartup), static_cast<int>(bRunStartup));
 
     // Maintain the session marker Explorer expects when running in modern Windows.
     IsFirstRunThisSession(_T("RunStuffHasBeenRun"));
@@ -81,7 +82,7 @@ DWORD WINAPI StartupRunner::_ThreadProc(LPVOID lpData)
     // regkey is created even if we're in "force startup" mode
     if (bRunStartup || bForceStartup)
     {
-        Logger::Log(L"StartupRunner executing startup sequence.");
+        LS_LOG_NOTICE(StartupRunner, L"StartupRunner executing startup sequence.");
         // Need to call CoInitializeEx for ShellExecuteEx
         VERIFY_HR(CoInitializeEx(
             NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
@@ -116,45 +117,54 @@ DWORD WINAPI StartupRunner::_ThreadProc(LPVOID lpData)
         //
         if (bHKLMRunOnce)
         {
-            Logger::Log(L"StartupRunner running HKLM\\RunOnce keys.");
+            LS_LOG_DEBUG(StartupRunner, L"StartupRunner running HKLM\\RunOnce keys.");
             _RunRegKeys(HKEY_LOCAL_MACHINE, REGSTR_PATH_RUNONCE,
                 (ERK_RUNSUBKEYS | ERK_DELETE |
-                 ERK_WAITFOR_QUIT | ERK_WIN64_BOTH));
+                 ERK_WAITFOR_QUIT | ERK_WIN64_BOTH), nullptr);
         }
 
         _RunRunOnceEx();
 
+        //
+        // The Run keys and the Startup folders do not depend on each other,
+        // they are collected first and launched concurrently. The RunOnce
+        // keys still run in order, before and after them.
+        //
+        StartupQueue queue;
+
         if (bHKLMRun)
         {
-            Logger::Log(L"StartupRunner running HKLM\\Run keys.");
-            _RunRegKeys(HKEY_LOCAL_MACHINE, REGSTR_PATH_RUN, ERK_WIN64_BOTH);
+            LS_LOG_DEBUG(StartupRunner, L"StartupRunner collecting HKLM\\Run keys.");
+            _RunRegKeys(HKEY_LOCAL_MACHINE, REGSTR_PATH_RUN, ERK_WIN64_BOTH, &queue);
         }
 
-        Logger::Log(L"StartupRunner running HKLM policy Run keys.");
-        _RunRegKeys(HKEY_LOCAL_MACHINE, REGSTR_PATH_RUN_POLICY, ERK_NONE);
-        Logger::Log(L"StartupRunner running HKCU policy Run keys.");
-        _RunRegKeys(HKEY_CURRENT_USER, REGSTR_PATH_RUN_POLICY, ERK_NONE);
+        LS_LOG_DEBUG(StartupRunner, L"StartupRunner collecting HKLM policy Run keys.");
+        _RunRegKeys(HKEY_LOCAL_MACHINE, REGSTR_PATH_RUN_POLICY, ERK_NONE, &queue);
+        LS_LOG_DEBUG(StartupRunner, L"StartupRunner collecting HKCU policy Run keys.");
+        _RunRegKeys(HKEY_CURRENT_USER, REGSTR_PATH_RUN_POLICY, ERK_NONE, &queue);
 
         if (bHKCURun)
         {
-            Logger::Log(L"StartupRunner running HKCU\\Run keys.");
-            _RunRegKeys(HKEY_CURRENT_USER, REGSTR_PATH_RUN, ERK_NONE);
+            LS_LOG_DEBUG(StartupRunner, L"StartupRunner collecting HKCU\\Run keys.");
+            _RunRegKeys(HKEY_CURRENT_USER, REGSTR_PATH_RUN, ERK_NONE, &queue);
         }
 
-        Logger::Log(L"StartupRunner running Startup menu entries.");
-        _RunStartupMenu();
+        LS_LOG_DEBUG(StartupRunner, L"StartupRunner collecting Startup menu entries.");
+        _RunStartupMenu(queue);
+
+        _RunQueue(queue);
 
         if (bHKCURunOnce)
         {
-            Logger::Log(L"StartupRunner running HKCU\\RunOnce keys.");
+            LS_LOG_DEBUG(StartupRunner, L"StartupRunner running HKCU\\RunOnce keys.");
             _RunRegKeys(HKEY_CURRENT_USER, REGSTR_PATH_RUNONCE,
-                (ERK_RUNSUBKEYS | ERK_DELETE));
+                (ERK_RUNSUBKEYS | ERK_DELETE), nullptr);
         }
 
         CoUninitialize();
     }
 
-    Logger::Log(L"StartupRunner::_ThreadProc exiting (return=%d).", static_cast<int>(bRunStartup));
+    LS_LOG_DEBUG(StartupRunner, L"StartupRunner::_ThreadProc exiting (return=%d).", static_cast<int>(bRunStartup));
     return bRunStartup;
 }
 
@@ -183,17 +193,17 @@ void StartupRunner::_RunRunOnceEx()
 }
 
 
-void StartupRunner::_RunStartupMenu()
+void StartupRunner::_RunStartupMenu(StartupQueue& queue)
 {
-    _RunShellFolderContents(CSIDL_COMMON_STARTUP);
-    _RunShellFolderContents(CSIDL_COMMON_ALTSTARTUP);
+    _RunShellFolderContents(CSIDL_COMMON_STARTUP, queue);
+    _RunShellFolderContents(CSIDL_COMMON_ALTSTARTUP, queue);
 
-    _RunShellFolderContents(CSIDL_STARTUP);
-    _RunShellFolderContents(CSIDL_ALTSTARTUP);
+    _RunShellFolderContents(CSIDL_STARTUP, queue);
+    _RunShellFolderContents(CSIDL_ALTSTARTUP, queue);
 }
 
 
-void StartupRunner::_RunShellFolderContents(int nFolder)
+void StartupRunner::_RunShellFolderContents(int nFolder, StartupQueue& queue)
 {
     TCHAR tzPath[MAX_PATH] = { 0 };
 
@@ -213,20 +223,11 @@ void StartupRunner::_RunShellFolderContents(int nFolder)
                     !(findData.dwFileAttributes & FILE_ATTRIBUTE_SYSTEM) &&
                     !(findData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN))
                 {
-                    SHELLEXECUTEINFO seiCommand = { 0 };
-
-                    seiCommand.cbSize = sizeof(SHELLEXECUTEINFO);
-                    seiCommand.lpFile = findData.cFileName;
-                    seiCommand.lpDirectory = tzPath;
-                    seiCommand.nShow = SW_SHOWNORMAL;
-                    seiCommand.fMask =
-                        SEE_MASK_DOENVSUBST | SEE_MASK_FLAG_NO_UI;
+                    StartupItem item;
+                    item.sCommand = findData.cFileName;
+                    item.sDirectory = tzPath;
 
-                    if (!LSShellExecuteEx(&seiCommand))
-                    {
-                        TRACE("StartupRunner failed to launch '%ls'",
-                            findData.cFileName);
-                    }
+                    queue.push_back(item);
                 }
 
                 if (!FindNextFile(hSearch, &findData))
@@ -244,6 +245,195 @@ void StartupRunner::_RunShellFolderContents(int nFolder)
 }
 
 
+//
+// _RunQueue
+// Launches the collected startup items with up to LSStartupConcurrency of
+// them starting up at a time, and returns once all have been launched.
+//
+void StartupRunner::_RunQueue(const StartupQueue& queue)
+{
+    if (queue.empty())
+    {
+        return;
+    }
+
+    LaunchState state;
+    state.pQueue = &queue;
+    state.stNext = 0;
+    state.dwIdleTimeout = (DWORD)std::max(0, GetRCIntW(L"LSStartupItemTimeout", 0));
+    state.bBackground = GetRCBoolDefW(L"LSStartupBackground", TRUE) != FALSE;
+
+    // This thread is one of the launchers, and can wait for at most
+    // MAXIMUM_WAIT_OBJECTS others
+    int nConcurrency = std::max(1, std::min(GetRCIntW(L"LSStartupConcurrency", 4),
+        MAXIMUM_WAIT_OBJECTS + 1));
+    size_t stLaunchers = std::min((size_t)nConcurrency, queue.size());
+
+    DWORD dwStartTime = GetTickCount();
+    std::vector<HANDLE> vecThreads;
+
+    for (size_t stLauncher = 1; stLauncher < stLaunchers; ++stLauncher)
+    {
+        HANDLE hThread = LSCreateThread("StartupLauncher",
+            StartupRunner::_LaunchThreadProc, &state, NULL);
+
+        if (hThread)
+        {
+            vecThreads.push_back(hThread);
+        }
+    }
+
+    _LaunchThreadProc(&state);
+
+    if (!vecThreads.empty())
+    {
+        WaitForMultipleObjects((DWORD)vecThreads.size(), &vecThreads[0], TRUE, INFINITE);
+        std::for_each(vecThreads.begin(), vecThreads.end(), CloseHandle);
+    }
+
+    LS_LOG_NOTICE(StartupRunner, L"Launched %u startup items in %lu ms, up to %u at a time.",
+        static_cast<UINT>(queue.size()), static_cast<unsigned long>(GetTickCount() - dwStartTime),
+        static_cast<UINT>(vecThreads.size() + 1));
+}
+
+
+//
+// _LaunchThreadProc
+// Launches items from a LaunchState's queue until there are none left.
+//
+DWORD WINAPI StartupRunner::_LaunchThreadProc(LPVOID lpData)
+{
+    LaunchState* pState = (LaunchState*)lpData;
+
+    // Need to call CoInitializeEx for ShellExecuteEx
+    HRESULT hrCom = CoInitializeEx(
+        NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+
+    if (pState->bBackground)
+    {
+        // Low CPU and I/O priority for the launching itself. This only
+        // covers this thread. Background mode cannot be set on another
+        // process, so the processes only get below normal CPU priority.
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    }
+
+    // Processes left below normal priority until this launcher is done
+    std::vector<HANDLE> vecLowered;
+
+    for (size_t stItem = pState->stNext++; stItem < pState->pQueue->size();
+        stItem = pState->stNext++)
+    {
+        _LaunchItem((*pState->pQueue)[stItem], *pState, vecLowered);
+    }
+
+    for (HANDLE hProcess : vecLowered)
+    {
+        _RestorePriority(hProcess);
+        CloseHandle(hProcess);
+    }
+
+    if (pState->bBackground)
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+    }
+
+    if (SUCCEEDED(hrCom))
+    {
+        CoUninitialize();
+    }
+
+    return 0;
+}
+
+
+//
+// _LaunchItem
+// Launches one startup item. With LSStartupItemTimeout set it then waits,
+// up to that many ms, for the item to be ready for input. Run key items
+// are not waited on by default. With LSStartupBackground the process runs
+// below normal priority until it is ready, or without a wait until its
+// launcher has launched all of its items (it is then in vecLowered).
+//
+void StartupRunner::_LaunchItem(const StartupItem& item, const LaunchState& state,
+                                std::vector<HANDLE>& vecLowered)
+{
+    DWORD dwStartTime = GetTickCount();
+    HANDLE hProcess = nullptr;
+
+    if (item.sDirectory.empty())
+    {
+        // _LaunchCommand works on the command line in place
+        TCHAR tzCommandLine[MAX_LINE_LENGTH] = { 0 };
+        StringCchCopy(tzCommandLine, COUNTOF(tzCommandLine), item.sCommand.c_str());
+
+        hProcess = _LaunchCommand(tzCommandLine);
+    }
+    else
+    {
+        hProcess = _ShellExecuteEx(item.sCommand.c_str(), nullptr, item.sDirectory.c_str());
+    }
+
+    DWORD dwLaunchTime = GetTickCount() - dwStartTime;
+
+    if (hProcess == nullptr)
+    {
+        // Also the case for documents handed to an application that was
+        // already running
+        LS_LOG_WARNING(StartupRunner, L"No process for %ls after %lu ms.",
+            item.sCommand.c_str(), static_cast<unsigned long>(dwLaunchTime));
+        return;
+    }
+
+    if (state.bBackground)
+    {
+        SetPriorityClass(hProcess, BELOW_NORMAL_PRIORITY_CLASS);
+    }
+
+    if (state.dwIdleTimeout == 0)
+    {
+        if (state.bBackground)
+        {
+            vecLowered.push_back(hProcess);
+        }
+        else
+        {
+            CloseHandle(hProcess);
+        }
+
+        LS_LOG_NOTICE(StartupRunner, L"Launched %ls in %lu ms.",
+            item.sCommand.c_str(), static_cast<unsigned long>(dwLaunchTime));
+        return;
+    }
+
+    WaitForInputIdle(hProcess, state.dwIdleTimeout);
+
+    if (state.bBackground)
+    {
+        _RestorePriority(hProcess);
+    }
+
+    CloseHandle(hProcess);
+
+    LS_LOG_NOTICE(StartupRunner, L"Launched %ls in %lu ms, ready after %lu ms.",
+        item.sCommand.c_str(), static_cast<unsigned long>(dwLaunchTime),
+        static_cast<unsigned long>(GetTickCount() - dwStartTime));
+}
+
+
+//
+// _RestorePriority
+// Undoes the below normal priority _LaunchItem gave a process, unless the
+// application changed its priority itself.
+//
+void StartupRunner::_RestorePriority(HANDLE hProcess)
+{
+    if (GetPriorityClass(hProcess) == BELOW_NORMAL_PRIORITY_CLASS)
+    {
+        SetPriorityClass(hProcess, NORMAL_PRIORITY_CLASS);
+    }
+}
+
+
 //
 //
 // _CreateSessionInfoKey
@@ -320,18 +510,20 @@ bool StartupRunner::IsFirstRunThisSession(LPCTSTR pszSubkey)
 
 //
 // RunRegKeys
+// Runs the values right away if pQueue is NULL, or adds them to it.
 //
-void StartupRunner::_RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags)
+void StartupRunner::_RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags,
+                                StartupQueue* pQueue)
 {
     if (LSIsRunningOn64BitWindows() && (dwFlags & ERK_WIN64_BOTH))
     {
         dwFlags &= ~ERK_WIN64_BOTH;
-        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags | ERK_WIN64_KEY64);
-        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags | ERK_WIN64_KEY32);
+        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags | ERK_WIN64_KEY64, pQueue);
+        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags | ERK_WIN64_KEY32, pQueue);
     }
     else
     {
-        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags);
+        _RunRegKeysWorker(hkParent, ptzSubKey, dwFlags, pQueue);
     }
 }
 
@@ -340,7 +532,8 @@ void StartupRunner::_RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags)
 // _RunRegKeysWorker
 //
 void StartupRunner::_RunRegKeysWorker(HKEY hkParent,
-                                      LPCTSTR ptzSubKey, DWORD dwFlags)
+                                      LPCTSTR ptzSubKey, DWORD dwFlags,
+                                      StartupQueue* pQueue)
 {
     REGSAM samDesired = MAXIMUM_ALLOWED;
 
@@ -384,7 +577,14 @@ void StartupRunner::_RunRegKeysWorker(HKEY hkParent,
             {
                 if ((dwType == REG_SZ) || (dwType == REG_EXPAND_SZ))
                 {
-                    if (szValue[0])
+                    if (szValue[0] && pQueue)
+                    {
+                        StartupItem item;
+                        item.sCommand = szValue;
+
+                        pQueue->push_back(item);
+                    }
+                    else if (szValue[0])
                     {
                         _SpawnProcess(szValue, dwFlags);
                     }
@@ -425,7 +625,7 @@ void StartupRunner::_RunRegKeysWorker(HKEY hkParent,
                 }
                 else if (lResult2 == ERROR_SUCCESS)
                 {
-                    _RunRegKeys(hkey, szName, dwFlags);
+                    _RunRegKeys(hkey, szName, dwFlags, pQueue);
 
                     if (dwFlags & ERK_DELETE)
                     {
@@ -451,6 +651,39 @@ void StartupRunner::_SpawnProcess(LPTSTR ptzCommandLine, DWORD dwFlags)
 {
     ASSERT(!(dwFlags & ERK_WAITFOR_QUIT && dwFlags & ERK_WAITFOR_IDLE));
 
+    HANDLE hProcess = _LaunchCommand(ptzCommandLine);
+
+    if (hProcess != nullptr)
+    {
+        if (dwFlags & ERK_WAITFOR_QUIT)
+        {
+            WaitForSingleObject(hProcess, INFINITE);
+        }
+        else if (dwFlags & ERK_WAITFOR_IDLE)
+        {
+            WaitForInputIdle(hProcess, INFINITE);
+        }
+
+        CloseHandle(hProcess);
+    }
+#ifdef _DEBUG
+    else
+    {
+        TCHAR tzError[4096];
+        DescriptionFromHR(HrGetLastError(), tzError, _countof(tzError));
+        TRACE("StartupRunner failed to launch '%ls', %ls", ptzCommandLine, tzError);
+    }
+#endif
+}
+
+
+//
+// _LaunchCommand
+// Starts a command line from the registry. Returns the process handle,
+// which the caller has to close, or NULL.
+//
+HANDLE StartupRunner::_LaunchCommand(LPTSTR ptzCommandLine)
+{
     //
     // The following cases need to be supported:
     //
@@ -478,7 +711,7 @@ void StartupRunner::_SpawnProcess(LPTSTR ptzCommandLine, DWORD dwFlags)
     // If the first token does not contain a \ or the first token does not contain a :, assume it's a relative path.
     if (*_tcsspnp(ptzCommandLine, _T(" \t")) == _T('"') || !_tcschr(tzToken, _T('\\')) || !_tcschr(tzToken, _T(':')))
     {
-        hProcess = _ShellExecuteEx(tzToken, ptzArgs);
+        hProcess = _ShellExecuteEx(tzToken, ptzArgs, nullptr);
     }
     else
     {
@@ -493,7 +726,7 @@ void StartupRunner::_SpawnProcess(LPTSTR ptzCommandLine, DWORD dwFlags)
             }
             if (PathFileExists(ptzCommandLine) && PathIsDirectory(ptzCommandLine) == FALSE)
             {
-                hProcess = _ShellExecuteEx(ptzCommandLine, ptzArgs);
+                hProcess = _ShellExecuteEx(ptzCommandLine, ptzArgs, nullptr);
                 break;
             }
             if (ptzArgs != nullptr)
@@ -504,31 +737,12 @@ void StartupRunner::_SpawnProcess(LPTSTR ptzCommandLine, DWORD dwFlags)
         } while (ptzArgs != nullptr);
     }
 
-    if (hProcess != nullptr)
-    {
-        if (dwFlags & ERK_WAITFOR_QUIT)
-        {
-            WaitForSingleObject(hProcess, INFINITE);
-        }
-        else if (dwFlags & ERK_WAITFOR_IDLE)
-        {
-            WaitForInputIdle(hProcess, INFINITE);
-        }
-
-        CloseHandle(hProcess);
-    }
-#ifdef _DEBUG
-    else
-    {
-        TCHAR tzError[4096];
-        DescriptionFromHR(HrGetLastError(), tzError, _countof(tzError));
-        TRACE("StartupRunner failed to launch '%ls', %ls", ptzCommandLine, tzError);
-    }
-#endif
+    return hProcess;
 }
 
 
-HANDLE StartupRunner::_ShellExecuteEx(LPCTSTR ptzExecutable, LPCTSTR ptzArgs)
+HANDLE StartupRunner::_ShellExecuteEx(LPCTSTR ptzExecutable, LPCTSTR ptzArgs,
+                                      LPCTSTR ptzDirectory)
 {
     HANDLE hReturn = NULL;
 
@@ -536,6 +750,7 @@ HANDLE StartupRunner::_ShellExecuteEx(LPCTSTR ptzExecutable, LPCTSTR ptzArgs)
     sei.cbSize = sizeof(sei);
     sei.lpFile = ptzExecutable;
     sei.lpParameters = ptzArgs;
+    sei.lpDirectory = ptzDirectory;
     sei.nShow = SW_SHOWNORMAL;
     sei.fMask = \
         SEE_MASK_DOENVSUBST | SEE_MASK_FLAG_NO_UI | SEE_MASK_NOCLOSEPROCESS;
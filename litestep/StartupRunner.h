@@ -23,6 +23,9 @@
 #define STARTUPRUNNER_H
 
 #include "../utility/common.h"
+#include <atomic>
+#include <string>
+#include <vector>
 
 class StartupRunner
 {
@@ -34,15 +37,42 @@ public:
     static bool IsFirstRunThisSession(LPCTSTR pszSubkey);
 
 public:
+    // A Run key value or Startup folder entry waiting to be launched
+    struct StartupItem
+    {
+        // Command line, or file name for Startup folder entries
+        std::wstring sCommand;
+
+        // Startup folder the entry is in, empty for Run key values
+        std::wstring sDirectory;
+    };
+
+    typedef std::vector<StartupItem> StartupQueue;
+
+    // Shared by the threads that launch a StartupQueue
+    struct LaunchState
+    {
+        const StartupQueue* pQueue;
+        std::atomic<size_t> stNext;
+        DWORD dwIdleTimeout;
+        bool bBackground;
+    };
+
     static DWORD WINAPI _ThreadProc(LPVOID lpData);
+    static DWORD WINAPI _LaunchThreadProc(LPVOID lpData);
     static HKEY _CreateSessionInfoKey();
-    static void _RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags);
-    static void _RunRegKeysWorker(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags);
+    static void _RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags, StartupQueue* pQueue);
+    static void _RunRegKeysWorker(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags, StartupQueue* pQueue);
     static void _RunRunOnceEx();
-    static void _RunStartupMenu();
-    static void _RunShellFolderContents(int nFolder);
+    static void _RunStartupMenu(StartupQueue& queue);
+    static void _RunShellFolderContents(int nFolder, StartupQueue& queue);
+    static void _RunQueue(const StartupQueue& queue);
+    static void _LaunchItem(const StartupItem& item, const LaunchState& state,
+        std::vector<HANDLE>& vecLowered);
+    static void _RestorePriority(HANDLE hProcess);
     static void _SpawnProcess(LPTSTR ptzCommandLine, DWORD dwFlags);
-    static HANDLE _ShellExecuteEx(LPCTSTR ptzExecutable, LPCTSTR ptzArgs);
+    static HANDLE _LaunchCommand(LPTSTR ptzCommandLine);
+    static HANDLE _ShellExecuteEx(LPCTSTR ptzExecutable, LPCTSTR ptzArgs, LPCTSTR ptzDirectory);
 };
 
 #endif // STARTUPRUNNER_H
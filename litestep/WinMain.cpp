@@ -139,7 +139,7 @@ WORD ParseCommandLine(LPCTSTR pszCommandLine, LPTSTR pszFile, DWORD cchFile)
     ASSERT(pszCommandLine);
 
     const std::wstring commandLineText = ToWideString(pszCommandLine);
-    Logger::Log(L"ParseCommandLine input: %ls", commandLineText.c_str());
+    LS_LOG_DEBUG(General, L"ParseCommandLine input: %ls", commandLineText.c_str());
 
     WORD wStartFlags = LSF_RUN_LITESTEP | LSF_RUN_STARTUPAPPS;
 
@@ -153,39 +153,44 @@ WORD ParseCommandLine(LPCTSTR pszCommandLine, LPTSTR pszFile, DWORD cchFile)
         {
             if (!_tcsicmp(szToken, _T("-nostartup")))
             {
-                Logger::Log(L"Switch detected: -nostartup");
+                LS_LOG_DEBUG(General, L"Switch detected: -nostartup");
                 wStartFlags &= ~LSF_RUN_STARTUPAPPS;
             }
             else if (!_tcsicmp(szToken, _T("-startup")))
             {
-                Logger::Log(L"Switch detected: -startup");
+                LS_LOG_DEBUG(General, L"Switch detected: -startup");
                 wStartFlags |= LSF_FORCE_STARTUPAPPS;
             }
             else if (!_tcsicmp(szToken, _T("-explorer")))
             {
-                Logger::Log(L"Switch detected: -explorer");
+                LS_LOG_DEBUG(General, L"Switch detected: -explorer");
                 wStartFlags &= ~(LSF_RUN_LITESTEP | LSF_CLOSE_EXPLORER);
                 wStartFlags |= LSF_RUN_EXPLORER;
             }
             else if (!_tcsicmp(szToken, _T("-closeexplorer")))
             {
-                Logger::Log(L"Switch detected: -closeexplorer");
+                LS_LOG_DEBUG(General, L"Switch detected: -closeexplorer");
                 wStartFlags &= ~LSF_RUN_EXPLORER;
                 wStartFlags |= LSF_CLOSE_EXPLORER;
             }
             else if (!_tcsicmp(szToken, _T("-overlay")))
             {
-                Logger::Log(L"Switch detected: -overlay");
+                LS_LOG_DEBUG(General, L"Switch detected: -overlay");
                 wStartFlags |= LSF_OVERLAY_MODE;
                 wStartFlags &= ~LSF_CLOSE_EXPLORER;
             }
+            else if (!_tcsicmp(szToken, _T("-trace")))
+            {
+                LS_LOG_DEBUG(General, L"Switch detected: -trace");
+                Logger::StartTrace();
+            }
             else if (!_tcsicmp(szToken, _T("-nolite")))
             {
-                Logger::Log(L"Switch detected: -nolite (deprecated)");
+                LS_LOG_DEBUG(General, L"Switch detected: -nolite (deprecated)");
             }
             else
             {
-                Logger::Log(L"Unknown switch encountered: %ls", tokenText.c_str());
+                LS_LOG_WARNING(General, L"Unknown switch encountered: %ls", tokenText.c_str());
             }
         }
         else
@@ -195,20 +200,20 @@ WORD ParseCommandLine(LPCTSTR pszCommandLine, LPTSTR pszFile, DWORD cchFile)
 
             if (dwCopied == 0 || dwCopied > cchFile)
             {
-                Logger::Log(L"Failed to resolve alternate config path for token: %ls", tokenText.c_str());
+                LS_LOG_ERROR(General, L"Failed to resolve alternate config path for token: %ls", tokenText.c_str());
                 pszFile[0] = _T('\0');
             }
             else
             {
                 const std::wstring altConfigPath = ToWideString(pszFile);
-                Logger::Log(L"Alternate config specified: %ls", altConfigPath.c_str());
+                LS_LOG_NOTICE(General, L"Alternate config specified: %ls", altConfigPath.c_str());
             }
 
             wStartFlags |= LSF_ALTERNATE_CONFIG;
         }
     }
 
-    Logger::Log(L"ParseCommandLine resulting flags: 0x%04X (%ls)",
+    LS_LOG_DEBUG(General, L"ParseCommandLine resulting flags: 0x%04X (%ls)",
         wStartFlags, DescribeStartFlags(wStartFlags).c_str());
 
     return wStartFlags;
@@ -277,33 +282,33 @@ static bool ForceShutdownExistingInstance(DWORD timeoutMs)
         timeoutMs = 1;
     }
 
-    Logger::Log(L"ForceShutdownExistingInstance invoked (timeout=%u ms).", timeoutMs);
+    LS_LOG_NOTICE(General, L"ForceShutdownExistingInstance invoked (timeout=%u ms).", timeoutMs);
 
     SendCommandLineBang(_T("!ShutDown"), NULL);
-    Logger::Log(L"Sent !ShutDown bang to existing LiteStep instance.");
+    LS_LOG_NOTICE(General, L"Sent !ShutDown bang to existing LiteStep instance.");
 
     HWND hExisting = FindWindow(szMainWindowClass, szMainWindowTitle);
     HANDLE hExistingProcess = NULL;
 
     if (IsWindow(hExisting))
     {
-        Logger::Log(L"Existing LiteStep main window detected; requesting graceful shutdown.");
+        LS_LOG_NOTICE(General, L"Existing LiteStep main window detected; requesting graceful shutdown.");
         DWORD existingProcessId = 0;
         GetWindowThreadProcessId(hExisting, &existingProcessId);
 
         if (existingProcessId != 0)
         {
-            Logger::Log(L"Existing LiteStep process id=%u.", existingProcessId);
+            LS_LOG_NOTICE(General, L"Existing LiteStep process id=%u.", existingProcessId);
             hExistingProcess = OpenProcess(SYNCHRONIZE | PROCESS_TERMINATE, FALSE, existingProcessId);
 
             if (!hExistingProcess)
             {
-                Logger::Log(L"OpenProcess failed for existing LiteStep process (error=%u).", GetLastError());
+                LS_LOG_ERROR(General, L"OpenProcess failed for existing LiteStep process (error=%u).", GetLastError());
             }
         }
         else
         {
-            Logger::Log(L"Unable to resolve process id for existing LiteStep window.");
+            LS_LOG_ERROR(General, L"Unable to resolve process id for existing LiteStep window.");
         }
 
         SendMessageTimeout(hExisting, WM_SYSCOMMAND, SC_CLOSE, 0, SMTO_ABORTIFHUNG, 2000, NULL);
@@ -319,23 +324,23 @@ static bool ForceShutdownExistingInstance(DWORD timeoutMs)
             const DWORD waitResult = WaitForSingleObject(hExistingProcess, waitSlice);
             if (waitResult != WAIT_OBJECT_0)
             {
-                Logger::Log(L"Existing LiteStep process did not exit within %u ms, forcing termination.", waitSlice);
+                LS_LOG_WARNING(General, L"Existing LiteStep process did not exit within %u ms, forcing termination.", waitSlice);
                 TerminateProcess(hExistingProcess, 0);
                 WaitForSingleObject(hExistingProcess, waitSlice);
             }
             else
             {
-                Logger::Log(L"Existing LiteStep process exited gracefully within %u ms.", waitSlice);
+                LS_LOG_NOTICE(General, L"Existing LiteStep process exited gracefully within %u ms.", waitSlice);
             }
         }
         else
         {
-            Logger::Log(L"No process handle available; relying on window polling.");
+            LS_LOG_NOTICE(General, L"No process handle available; relying on window polling.");
         }
     }
     else
     {
-        Logger::Log(L"No LiteStep main window detected after shutdown request.");
+        LS_LOG_NOTICE(General, L"No LiteStep main window detected after shutdown request.");
     }
 
     if (hExistingProcess)
@@ -352,7 +357,7 @@ static bool ForceShutdownExistingInstance(DWORD timeoutMs)
         if (FindWindow(szMainWindowClass, szMainWindowTitle) == NULL)
         {
             const DWORD elapsed = GetTickCount() - startTick;
-            Logger::Log(L"Existing LiteStep instance terminated after %u ms.", elapsed);
+            LS_LOG_NOTICE(General, L"Existing LiteStep instance terminated after %u ms.", elapsed);
             return true;
         }
 
@@ -362,11 +367,11 @@ static bool ForceShutdownExistingInstance(DWORD timeoutMs)
     const bool closed = (FindWindow(szMainWindowClass, szMainWindowTitle) == NULL);
     if (!closed)
     {
-        Logger::Log(L"Existing LiteStep instance still running after %u ms.", timeoutMs);
+        LS_LOG_WARNING(General, L"Existing LiteStep instance still running after %u ms.", timeoutMs);
     }
     else
     {
-        Logger::Log(L"Existing LiteStep instance closed during final check.");
+        LS_LOG_NOTICE(General, L"Existing LiteStep instance closed during final check.");
     }
 
     return closed;
@@ -477,15 +482,15 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
 
     LPCTSTR effectiveCmdLine = (lpCmdLine != nullptr) ? lpCmdLine : _T("");
     const std::wstring commandLineLogText = ToWideString(effectiveCmdLine);
-    Logger::Log(L"_tWinMain starting. Command line=\"%ls\"", commandLineLogText.c_str());
+    LS_LOG_NOTICE(General, L"_tWinMain starting. Command line=\"%ls\"", commandLineLogText.c_str());
 
     int nReturn = 0;
 
     if (lpCmdLine != nullptr && lpCmdLine[0] == _T('!'))
     {
-        Logger::Log(L"Handling command-line bang request.");
+        LS_LOG_NOTICE(General, L"Handling command-line bang request.");
         nReturn = HandleCommandLineBang(lpCmdLine);
-        Logger::Log(L"Bang handling complete. Return code=%d", nReturn);
+        LS_LOG_NOTICE(General, L"Bang handling complete. Return code=%d", nReturn);
         Logger::Shutdown();
         return nReturn;
     }
@@ -495,17 +500,17 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
     WORD wStartFlags = ParseCommandLine(
         effectiveCmdLine, szAltConfigFile, COUNTOF(szAltConfigFile));
 
-    Logger::Log(L"Initial start flags: 0x%04X (%ls)",
+    LS_LOG_NOTICE(General, L"Initial start flags: 0x%04X (%ls)",
         wStartFlags, DescribeStartFlags(wStartFlags).c_str());
 
     if (szAltConfigFile[0] != _T('\0'))
     {
-        Logger::Log(L"Alternate config file requested: %ls", ToWideString(szAltConfigFile).c_str());
+        LS_LOG_NOTICE(General, L"Alternate config file requested: %ls", ToWideString(szAltConfigFile).c_str());
     }
 
     if (GetSystemMetrics(SM_CLEANBOOT))
     {
-        Logger::Log(L"Safe mode detected. Forcing Explorer shell and skipping startup apps.");
+        LS_LOG_NOTICE(General, L"Safe mode detected. Forcing Explorer shell and skipping startup apps.");
         wStartFlags |= LSF_RUN_EXPLORER;
         wStartFlags &= ~LSF_RUN_STARTUPAPPS;
     }
@@ -514,30 +519,30 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
     {
         if (wStartFlags & LSF_RUN_EXPLORER)
         {
-            Logger::Log(L"Attempting to start Explorer as shell.");
+            LS_LOG_NOTICE(General, L"Attempting to start Explorer as shell.");
 
             if (StartExplorerShell(EXPLORER_WAIT_TIMEOUT))
             {
-                Logger::Log(L"Explorer shell started successfully. Disabling LiteStep run.");
+                LS_LOG_NOTICE(General, L"Explorer shell started successfully. Disabling LiteStep run.");
                 wStartFlags &= ~LSF_RUN_LITESTEP;
             }
             else
             {
-                Logger::Log(L"Explorer shell failed to start within timeout.");
+                LS_LOG_ERROR(General, L"Explorer shell failed to start within timeout.");
                 wStartFlags &= ~LSF_RUN_EXPLORER;
             }
         }
 
         if (wStartFlags & LSF_RUN_LITESTEP)
         {
-            Logger::Log(L"Preparing LiteStep launch (flags=0x%04X).", wStartFlags);
+            LS_LOG_NOTICE(General, L"Preparing LiteStep launch (flags=0x%04X).", wStartFlags);
 
             HANDLE hMutex = NULL;
             bool allowLiteStep = true;
 
             if (IsOtherInstanceRunning(&hMutex))
             {
-                Logger::Log(L"Another LiteStep instance detected. Initiating shutdown.");
+                LS_LOG_NOTICE(General, L"Another LiteStep instance detected. Initiating shutdown.");
 
                 if (hMutex)
                 {
@@ -549,7 +554,7 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
 
                 if (!ForceShutdownExistingInstance(existingInstanceTimeout))
                 {
-                    Logger::Log(L"Failed to shut down existing LiteStep within %u ms.", existingInstanceTimeout);
+                    LS_LOG_ERROR(General, L"Failed to shut down existing LiteStep within %u ms.", existingInstanceTimeout);
                     MessageBox(NULL,
                         L"LiteStep could not close the previously running instance.",
                         L"LiteStep",
@@ -559,7 +564,7 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
                 }
                 else
                 {
-                    Logger::Log(L"Waiting for LiteStep mutex ownership after shutdown request.");
+                    LS_LOG_NOTICE(General, L"Waiting for LiteStep mutex ownership after shutdown request.");
 
                     const DWORD waitDeadline = GetTickCount() + existingInstanceTimeout;
                     bool obtainedMutex = false;
@@ -586,7 +591,7 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
 
                     if (!obtainedMutex)
                     {
-                        Logger::Log(L"Timed out waiting for LiteStep mutex after shutdown sequence.");
+                        LS_LOG_WARNING(General, L"Timed out waiting for LiteStep mutex after shutdown sequence.");
                         MessageBox(NULL,
                             L"LiteStep could not take ownership after closing the previous instance.",
                             L"LiteStep",
@@ -596,39 +601,39 @@ int WINAPI _tWinMain(HINSTANCE hInst, HINSTANCE, LPTSTR lpCmdLine, int)
                     }
                     else
                     {
-                        Logger::Log(L"LiteStep mutex acquired after shutting down previous instance.");
+                        LS_LOG_NOTICE(General, L"LiteStep mutex acquired after shutting down previous instance.");
                     }
                 }
             }
 
             if (allowLiteStep && (wStartFlags & LSF_RUN_LITESTEP))
             {
-                Logger::Log(L"Invoking StartLitestep.");
+                LS_LOG_NOTICE(General, L"Invoking StartLitestep.");
                 nReturn = StartLitestep(hInst, wStartFlags, szAltConfigFile);
-                Logger::Log(L"StartLitestep returned %d.", nReturn);
+                LS_LOG_NOTICE(General, L"StartLitestep returned %d.", nReturn);
             }
 
             if (hMutex)
             {
                 CloseHandle(hMutex);
                 hMutex = NULL;
-                Logger::Log(L"Released LiteStep mutex handle.");
+                LS_LOG_NOTICE(General, L"Released LiteStep mutex handle.");
             }
 
             if (!allowLiteStep)
             {
-                Logger::Log(L"LiteStep launch aborted due to existing instance conflict.");
+                LS_LOG_WARNING(General, L"LiteStep launch aborted due to existing instance conflict.");
                 wStartFlags &= ~LSF_RUN_LITESTEP;
             }
             else if (nReturn == LRV_EXPLORER_START)
             {
-                Logger::Log(L"LiteStep requested Explorer start; scheduling Explorer launch.");
+                LS_LOG_NOTICE(General, L"LiteStep requested Explorer start; scheduling Explorer launch.");
                 wStartFlags |= LSF_RUN_EXPLORER;
             }
         }
     } while (nReturn == LRV_EXPLORER_START && (wStartFlags & LSF_RUN_LITESTEP));
 
-    Logger::Log(L"LiteStep shutting down with return code %d.", nReturn);
+    LS_LOG_NOTICE(General, L"LiteStep shutting down with return code %d.", nReturn);
     Logger::Shutdown();
     return nReturn;
 }
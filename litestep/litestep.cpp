@@ -127,6 +127,54 @@ static void EnsureKnownFolderEnvironment()
     }
 }
 
+//
+// ConfigureLogging
+// Applies the LSLoggerLevel settings. LSLoggerLevel sets every category,
+// LSLoggerLevel<Category> (e.g. LSLoggerLevelModule) overrides one of them.
+// LSLoggerMaxSize (in KB, 0 for no limit), LSLoggerGenerations and
+// LSLoggerFlushInterval (in ms) control the log file itself. LSTrace starts
+// a structured trace, like the -trace switch.
+//
+static void ConfigureLogging()
+{
+    wchar_t wzLevel[MAX_LINE_LENGTH] = { 0 };
+    Logger::Level defaultLevel = Logger::Level::Notice;
+
+    if (GetRCStringW(L"LSLoggerLevel", wzLevel, nullptr, _countof(wzLevel)))
+    {
+        defaultLevel = Logger::ParseLevel(wzLevel, defaultLevel);
+    }
+
+    for (int i = 0; i < int(Logger::Category::Count); ++i)
+    {
+        Logger::Category category = Logger::Category(i);
+        Logger::Level level = defaultLevel;
+
+        wchar_t wzKey[MAX_RCCOMMAND] = { 0 };
+        StringCchPrintfW(wzKey, _countof(wzKey), L"LSLoggerLevel%ls",
+            Logger::GetCategoryName(category));
+
+        if (GetRCStringW(wzKey, wzLevel, nullptr, _countof(wzLevel)))
+        {
+            level = Logger::ParseLevel(wzLevel, defaultLevel);
+        }
+
+        Logger::SetLevel(category, level);
+    }
+
+    int nMaxSize = GetRCIntW(L"LSLoggerMaxSize", 4096);
+    int nGenerations = GetRCIntW(L"LSLoggerGenerations", 2);
+    int nFlushInterval = GetRCIntW(L"LSLoggerFlushInterval", 1000);
+
+    Logger::SetFileOptions(uint64_t(std::max(nMaxSize, 0)) * 1024,
+        unsigned(std::max(nGenerations, 0)), unsigned(std::max(nFlushInterval, 100)));
+
+    if (GetRCBoolDefW(L"LSTrace", FALSE))
+    {
+        Logger::StartTrace();
+    }
+}
+
 static std::wstring NormalizeShellValue(const std::wstring& value)
 {
     std::wstring normalized = lsapi::StringUtils::TrimCopy(value);
@@ -172,7 +220,7 @@ static bool IsCurrentUserShellLiteStep(const std::wstring& exePath)
 
     if (result != ERROR_SUCCESS)
     {
-        Logger::Log(L"Shell registry key open failed (error=%ld).", result);
+        LS_LOG_ERROR(General, L"Shell registry key open failed (error=%ld).", result);
         return false;
     }
 
@@ -187,7 +235,7 @@ static bool IsCurrentUserShellLiteStep(const std::wstring& exePath)
     {
         if (result != ERROR_FILE_NOT_FOUND)
         {
-            Logger::Log(L"Shell registry value query failed (error=%ld).", result);
+            LS_LOG_ERROR(General, L"Shell registry value query failed (error=%ld).", result);
         }
         return false;
     }
@@ -277,17 +325,17 @@ static void PromptForShellConfiguration(const std::wstring& exePath)
 {
     if (exePath.empty())
     {
-        Logger::Log(L"Executable path unavailable. Skipping shell configuration prompt.");
+        LS_LOG_NOTICE(General, L"Executable path unavailable. Skipping shell configuration prompt.");
         return;
     }
 
     if (IsCurrentUserShellLiteStep(exePath))
     {
-        Logger::Log(L"LiteStep already configured as current user shell. No prompt needed.");
+        LS_LOG_NOTICE(General, L"LiteStep already configured as current user shell. No prompt needed.");
         return;
     }
 
-    Logger::Log(L"LiteStep is not the configured shell. Prompting user for confirmation.");
+    LS_LOG_NOTICE(General, L"LiteStep is not the configured shell. Prompting user for confirmation.");
 
     const wchar_t* promptText =
         L"LiteStep is not currently configured as the shell for this account.\n\n"
@@ -302,7 +350,7 @@ static void PromptForShellConfiguration(const std::wstring& exePath)
         std::wstring errorMessage;
         if (ConfigureShellForCurrentUser(exePath, errorMessage))
         {
-            Logger::Log(L"Successfully updated current user shell setting.");
+            LS_LOG_NOTICE(General, L"Successfully updated current user shell setting.");
             MessageBoxW(nullptr,
                 L"LiteStep has been set as your shell. Sign out or restart to apply the change.",
                 L"LiteStep Shell",
@@ -310,7 +358,7 @@ static void PromptForShellConfiguration(const std::wstring& exePath)
         }
         else
         {
-            Logger::Log(L"Failed to update shell setting: %ls", errorMessage.c_str());
+            LS_LOG_ERROR(General, L"Failed to update shell setting: %ls", errorMessage.c_str());
             std::wstring message = L"LiteStep could not update the shell setting.\n";
             if (!errorMessage.empty())
             {
@@ -323,7 +371,7 @@ static void PromptForShellConfiguration(const std::wstring& exePath)
     }
     else
     {
-        Logger::Log(L"User declined shell configuration prompt.");
+        LS_LOG_WARNING(General, L"User declined shell configuration prompt.");
     }
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -429,6 +477,10 @@ int StartLitestep(HINSTANCE hInst, WORD wStartFlags, LPCTSTR pszAltConfigFile)
         return LRV_NO_STEP;
     }
 
+    // The LSAPI links its own copy of the logger, point it at ours so that
+    // settings parser messages end up in the same log.
+    LSAPISetLogSink(Logger::GetSink());
+
     // Initialize the LSAPI.  Note: The LSAPI controls the bang and settings
     // managers so they will be started at this point.
     if (!LSAPIInitialize(szAppPath, szRcPath))
@@ -439,6 +491,8 @@ int StartLitestep(HINSTANCE hInst, WORD wStartFlags, LPCTSTR pszAltConfigFile)
         return LRV_LSAPI_FAIL;
     }
 
+    ConfigureLogging();
+
     // All child processes get this variable
     VERIFY(SetEnvironmentVariable(_T("LitestepDir"), szAppPath));
 
@@ -518,6 +572,8 @@ CLiteStep::~CLiteStep()
 //
 HRESULT CLiteStep::Start(HINSTANCE hInstance, WORD wStartFlags)
 {
+    LS_TRACE_SCOPE(General, Startup);
+
     HRESULT hr = E_FAIL;
 
     m_hInstance = hInstance;
@@ -712,7 +768,7 @@ HRESULT CLiteStep::Start(HINSTANCE hInstance, WORD wStartFlags)
 
                 if (SUCCEEDED(hr))
                 {
-                    hr = _StartManagers();
+                    hr = _StartManagers(false);
                 }
             }
         }
@@ -749,7 +805,7 @@ HRESULT CLiteStep::Start(HINSTANCE hInstance, WORD wStartFlags)
 //
 HRESULT CLiteStep::Stop()
 {
-    _StopManagers();
+    _StopManagers(false);
     _CleanupManagers();
 
     _StopServices();
@@ -957,6 +1013,12 @@ void CLiteStep::MessageHandler(MSG &message)
     {
         TranslateMessage(&message);
         DispatchMessage(&message);
+
+        // For the startup timeline
+        if (m_pModuleManager && m_pModuleManager->IsWatchingMessages())
+        {
+            m_pModuleManager->NoteMessage(message.hwnd);
+        }
     }
 }
 
@@ -1155,6 +1217,24 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
         }
         break;
 
+    case LM_SAVEDATAEX:
+        {
+            const LSDATAITEM* pItem = (const LSDATAITEM*)lParam;
+            if ((pItem != NULL) && (pItem->cbSize == sizeof(LSDATAITEM)))
+            {
+                if (m_pDataStoreManager == NULL)
+                {
+                    m_pDataStoreManager = new DataStore();
+                }
+                if (m_pDataStoreManager)
+                {
+                    lReturn = m_pDataStoreManager->StoreData(
+                        pItem->wIdent, pItem->pvData, pItem->dwLength);
+                }
+            }
+        }
+        break;
+
     case LM_RESTOREDATA:
         {
             WORD wIdent = HIWORD(wParam);
@@ -1165,13 +1245,25 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
                 if (m_pDataStoreManager)
                 {
                     lReturn = m_pDataStoreManager->ReleaseData(
-                        wIdent, pvData, wLength);
+                        wIdent, pvData, wLength, NULL);
 
-                    if (m_pDataStoreManager->Count() == 0)
-                    {
-                        delete m_pDataStoreManager;
-                        m_pDataStoreManager = NULL;
-                    }
+                    _ReleaseDataStore();
+                }
+            }
+        }
+        break;
+
+    case LM_RESTOREDATAEX:
+        {
+            LSDATAITEM* pItem = (LSDATAITEM*)lParam;
+            if ((pItem != NULL) && (pItem->cbSize == sizeof(LSDATAITEM)))
+            {
+                if (m_pDataStoreManager)
+                {
+                    lReturn = m_pDataStoreManager->ReleaseData(
+                        pItem->wIdent, pItem->pvData, pItem->dwLength, &pItem->dwLength);
+
+                    _ReleaseDataStore();
                 }
             }
         }
@@ -1219,13 +1311,56 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
         }
         break;
 
+    case LM_ENUMMODULETIMELINE:
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pModuleManager)
+            {
+                hr = m_pModuleManager->EnumTimeline((LSENUMMODULETIMELINEPROCW)wParam,
+                    lParam);
+            }
+
+            return hr;
+        }
+        break;
+
+    case LM_MODULEFIRSTPAINT:
+        {
+            if (m_pModuleManager)
+            {
+                m_pModuleManager->NoteFirstPaint((HINSTANCE)wParam, (DWORD)lParam);
+            }
+        }
+        break;
+
+    case LM_ENUMMESSAGESTATS:
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pMessageManager)
+            {
+                hr = m_pMessageManager->EnumStats((LSENUMMESSAGESTATSPROCW)wParam,
+                    lParam);
+            }
+
+            return hr;
+        }
+        break;
+
     case LM_RECYCLE:
         {
             switch (wParam)
             {
             case LR_RECYCLE:
                 {
-                    _Recycle();
+                    _Recycle(false);
+                }
+                break;
+
+            case LR_SOFTRECYCLE:
+                {
+                    _Recycle(true);
                 }
                 break;
 
@@ -1380,6 +1515,19 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
         }
         break;
 
+    case LM_LAZYBANGCOMMAND:
+        {
+            const ModuleManager::LazyBangRequest* pRequest =
+                (const ModuleManager::LazyBangRequest*)lParam;
+
+            if (m_pModuleManager && pRequest != nullptr)
+            {
+                lReturn = m_pModuleManager->ExecuteLazyBang(pRequest->hCaller,
+                    pRequest->pwzCommand, pRequest->pwzArgs);
+            }
+        }
+        break;
+
     case WM_COPYDATA:
         {
             PCOPYDATASTRUCT pcds = (PCOPYDATASTRUCT)lParam;
@@ -1501,7 +1649,7 @@ LRESULT CLiteStep::_HandleSessionChange(DWORD dwCode, DWORD /* dwSession */)
     }
     else if (dwCode == WTS_SESSION_REMOTE_CONNECT || dwCode == WTS_SESSION_REMOTE_DISCONNECT)
     {
-        Logger::Log(L"Remote session state changed (code=%u).", dwCode);
+        LS_LOG_NOTICE(General, L"Remote session state changed (code=%u).", dwCode);
         _ScheduleUiRecycle(L"remote session change");
     }
     else if (dwCode == WTS_SESSION_UNLOCK)
@@ -1519,7 +1667,7 @@ LRESULT CLiteStep::_HandleSessionChange(DWORD dwCode, DWORD /* dwSession */)
 
 void CLiteStep::_HandleDisplayChange(UINT bitsPerPixel, UINT width, UINT height)
 {
-    Logger::Log(L"Display change detected (%ux%u @ %u bpp).", width, height, bitsPerPixel);
+    LS_LOG_NOTICE(General, L"Display change detected (%ux%u @ %u bpp).", width, height, bitsPerPixel);
     _ScheduleUiRecycle(L"display configuration change");
 }
 
@@ -1527,7 +1675,7 @@ void CLiteStep::_ScheduleUiRecycle(const wchar_t* reason)
 {
     if (m_hasPendingDisplayChangeRecycle)
     {
-        Logger::Log(L"LiteStep UI recycle already pending; ignoring additional trigger (%ls).",
+        LS_LOG_NOTICE(General, L"LiteStep UI recycle already pending; ignoring additional trigger (%ls).",
             reason ? reason : L"unknown");
         return;
     }
@@ -1536,11 +1684,11 @@ void CLiteStep::_ScheduleUiRecycle(const wchar_t* reason)
 
     if (reason && *reason)
     {
-        Logger::Log(L"Scheduling LiteStep recycle due to %ls.", reason);
+        LS_LOG_NOTICE(General, L"Scheduling LiteStep recycle due to %ls.", reason);
     }
     else
     {
-        Logger::Log(L"Scheduling LiteStep recycle.");
+        LS_LOG_NOTICE(General, L"Scheduling LiteStep recycle.");
     }
 
     if (m_hMainWindow)
@@ -1692,8 +1840,27 @@ HRESULT CLiteStep::_InitManagers()
     m_pModuleManager = new ModuleManager();
     m_pThemeEngineV2 = new litestep::themev2::ThemeEngineV2();
 
+    // A persistent DataStore is kept for the whole session, so whatever
+    // a crashed session left in its file is there before modules load.
+    if (GetRCBoolDefW(L"LSDataStorePersist", FALSE))
+    {
+        wchar_t wzPath[MAX_PATH] = { 0 };
+
+        if (LSGetLitestepPathW(wzPath, _countof(wzPath)) &&
+            SUCCEEDED(StringCchCatW(wzPath, _countof(wzPath), L"litestep.datastore")))
+        {
+            m_pDataStoreManager = new DataStore();
+
+            if (!m_pDataStoreManager->Open(wzPath))
+            {
+                delete m_pDataStoreManager;
+                m_pDataStoreManager = NULL;
+            }
+        }
+    }
+
     // Note:
-    // - The DataStore manager is dynamically initialized/started.
+    // - The DataStore manager is otherwise dynamically initialized/started.
     // - The Bang and Settings managers are located in LSAPI, and
     //   are instantiated via LSAPIInit.
 
@@ -1703,24 +1870,39 @@ HRESULT CLiteStep::_InitManagers()
 
 //
 // _StartManagers
+// On a soft recycle, modules that stayed loaded are refreshed instead.
 //
-HRESULT CLiteStep::_StartManagers()
+HRESULT CLiteStep::_StartManagers(bool bSoft)
 {
     HRESULT hr = S_OK;
 
+    // Set up profiling before modules start broadcasting
+    m_pMessageManager->SetProfiling(
+        GetRCBoolW(L"LSMessageProfiling", TRUE) != FALSE,
+        (DWORD)std::max(0, GetRCIntW(L"LSMessageProfilingThreshold", 50)));
+
     // Load modules
-    m_pModuleManager->Start(this);
+    if (bSoft)
+    {
+        m_pModuleManager->FinishSoftRecycle();
+    }
+    else
+    {
+        m_pModuleManager->Start(this);
+    }
+
     if (m_pThemeEngineV2)
     {
         HRESULT themeHr = m_pThemeEngineV2->Initialize();
         if (FAILED(themeHr))
         {
-            Logger::Log(L"ThemeEngineV2 failed to initialize (hr=0x%08X).", themeHr);
+            LS_LOG_ERROR(ThemeEngineV2, L"ThemeEngineV2 failed to initialize (hr=0x%08X).", themeHr);
         }
     }
 
     // Note:
-    // - MessageManager has/needs no Start method.
+    // - MessageManager has/needs no Start method, only its profiling
+    //   settings are re-read.
     // - The DataStore manager is dynamically initialized/started.
 
     m_hasPendingDisplayChangeRecycle = false;
@@ -1730,8 +1912,9 @@ HRESULT CLiteStep::_StartManagers()
 
 //
 // _StopManagers()
+// On a soft recycle, modules that can refresh themselves stay loaded.
 //
-HRESULT CLiteStep::_StopManagers()
+HRESULT CLiteStep::_StopManagers(bool bSoft)
 {
     HRESULT hr = S_OK;
 
@@ -1739,10 +1922,22 @@ HRESULT CLiteStep::_StopManagers()
     {
         m_pThemeEngineV2->Shutdown();
     }
-    m_pModuleManager->Stop();
 
-    // Clean up as modules might not have
-    m_pMessageManager->ClearMessages();
+    if (bSoft)
+    {
+        // The modules that stay keep their message registrations, but the
+        // unloaded ones may not have removed theirs
+        std::vector<HINSTANCE> vecUnloaded;
+        m_pModuleManager->PrepareSoftRecycle(vecUnloaded);
+        m_pMessageManager->RemoveModuleWindows(vecUnloaded);
+    }
+    else
+    {
+        m_pModuleManager->Stop();
+
+        // Clean up as modules might not have
+        m_pMessageManager->ClearMessages();
+    }
 
     // Note:
     // - The DataStore manager is persistent.
@@ -1752,6 +1947,21 @@ HRESULT CLiteStep::_StopManagers()
 }
 
 
+//
+// _ReleaseDataStore
+// Deletes the DataStore once it is empty, unless it is backed by a file.
+//
+void CLiteStep::_ReleaseDataStore()
+{
+    if (m_pDataStoreManager && m_pDataStoreManager->Count() == 0 &&
+        !m_pDataStoreManager->IsPersistent())
+    {
+        delete m_pDataStoreManager;
+        m_pDataStoreManager = NULL;
+    }
+}
+
+
 //
 // _CleanupManagers
 //
@@ -1785,8 +1995,10 @@ void CLiteStep::_CleanupManagers()
 
 //
 // _Recycle
+// A soft recycle keeps the modules that export refreshModule loaded, see
+// ModuleManager::PrepareSoftRecycle.
 //
-void CLiteStep::_Recycle()
+void CLiteStep::_Recycle(bool bSoft)
 {
     Block block(m_BlockRecycle);
 
@@ -1797,7 +2009,10 @@ void CLiteStep::_Recycle()
     {
         return;
     }
-    _StopManagers();
+
+    LS_LOG_NOTICE(General, L"Starting %ls recycle.", bSoft ? L"soft" : L"full");
+
+    _StopManagers(bSoft);
 
     if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
     {
@@ -1809,11 +2024,12 @@ void CLiteStep::_Recycle()
     // Re-initialize the bang and settings manager in LSAPI
     LSAPIReloadBangs();
     LSAPIReloadSettings();
+    ConfigureLogging();
 
     // Call service's Recycle function
     for_each(m_Services.begin(), m_Services.end(), mem_fun(&IService::Recycle));
 
-    _StartManagers();
+    _StartManagers(bSoft);
 }
 
 
@@ -1824,17 +2040,16 @@ HRESULT CLiteStep::_EnumRevIDs(LSENUMREVIDSPROCW pfnCallback, LPARAM lParam) con
 {
     HRESULT hr = E_FAIL;
 
-    MessageManager::windowSetT setWindowsW, setWindowsA;
-
-    m_pMessageManager->GetWindowsForMessage(LM_GETREVIDA, setWindowsA);
-    m_pMessageManager->GetWindowsForMessage(LM_GETREVIDW, setWindowsW);
+    MessageManager::WindowView windowsA =
+        m_pMessageManager->GetWindowsForMessage(LM_GETREVIDA);
+    MessageManager::WindowView windowsW =
+        m_pMessageManager->GetWindowsForMessage(LM_GETREVIDW);
 
-    if (!setWindowsA.empty() || !setWindowsW.empty())
+    if (!windowsA.empty() || !windowsW.empty())
     {
         hr = S_OK;
 
-        for (MessageManager::windowSetT::iterator iter = setWindowsW.begin();
-            iter != setWindowsW.end(); ++iter)
+        for (const HWND* iter = windowsW.begin(); iter != windowsW.end(); ++iter)
         {
             // Using MAX_LINE_LENGTH to be on the safe side. Modules
             // should assume a length of 64 or so.
@@ -1850,8 +2065,7 @@ HRESULT CLiteStep::_EnumRevIDs(LSENUMREVIDSPROCW pfnCallback, LPARAM lParam) con
             }
         }
 
-        for (MessageManager::windowSetT::iterator iter = setWindowsA.begin();
-            iter != setWindowsA.end(); ++iter)
+        for (const HWND* iter = windowsA.begin(); iter != windowsA.end(); ++iter)
         {
             // Using MAX_LINE_LENGTH to be on the safe side. Modules
             // should assume a length of 64 or so.
@@ -99,7 +99,7 @@ private:
     LRESULT InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
     LRESULT _HandleSessionChange(DWORD dwCode, DWORD dwSession);
 
-    void _Recycle();
+    void _Recycle(bool bSoft);
     HRESULT _EnumRevIDs(LSENUMREVIDSPROCW pfnCallback, LPARAM lParam) const;
     static BOOL _SetShellWindow(HWND hWnd);
 
@@ -136,9 +136,10 @@ private:
     MessageManager* m_pMessageManager; // = NULL;
 
     HRESULT _InitManagers();
-    HRESULT _StartManagers();
-    HRESULT _StopManagers();
+    HRESULT _StartManagers(bool bSoft);
+    HRESULT _StopManagers(bool bSoft);
     void _CleanupManagers();
+    void _ReleaseDataStore();
 
     bool m_bSignalExit; // = false
     int m_nQuitMsg;
@@ -0,0 +1,462 @@
+#include "BindingGraph.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        std::wstring ToLower(const std::wstring& text)
+        {
+            std::wstring lower(text);
+            for (wchar_t& ch : lower)
+            {
+                ch = static_cast<wchar_t>(std::towlower(ch));
+            }
+            return lower;
+        }
+
+        bool IsNameCharacter(wchar_t ch)
+        {
+            return std::iswalnum(ch) || ch == L'_';
+        }
+
+        // Text and variable names of a template, in order. A part with an
+        // empty name is text.
+        struct ParsedPart
+        {
+            std::wstring text;
+            std::wstring name;
+        };
+
+        std::vector<ParsedPart> ParseTemplate(const std::wstring& expression)
+        {
+            std::vector<ParsedPart> parts;
+            std::wstring text;
+
+            for (std::size_t index = 0; index < expression.length();)
+            {
+                const wchar_t ch = expression[index++];
+
+                if (ch != L'@' || index == expression.length())
+                {
+                    text.push_back(ch);
+                }
+                else if (expression[index] == L'@')
+                {
+                    text.push_back(L'@');
+                    ++index;
+                }
+                else if (!IsNameCharacter(expression[index]))
+                {
+                    text.push_back(L'@');
+                }
+                else
+                {
+                    const std::size_t start = index;
+                    while (index < expression.length() && IsNameCharacter(expression[index]))
+                    {
+                        ++index;
+                    }
+
+                    if (!text.empty())
+                    {
+                        ParsedPart part = { text, std::wstring() };
+                        parts.push_back(part);
+                        text.clear();
+                    }
+
+                    ParsedPart part = { std::wstring(), expression.substr(start, index - start) };
+                    parts.push_back(part);
+                }
+            }
+
+            if (!text.empty())
+            {
+                ParsedPart part = { text, std::wstring() };
+                parts.push_back(part);
+            }
+
+            return parts;
+        }
+    }
+
+    BindingGraph::BindingGraph()
+        : m_variables(), m_byName(), m_pendingSets(), m_pendingDefinitions(), m_valueVariables(), m_queue(),
+          m_statistics()
+    {
+    }
+
+    void BindingGraph::Set(const std::wstring& name, const std::wstring& value)
+    {
+        const ThemeIndex index = FindOrAdd(name);
+        Variable& variable = m_variables[index];
+
+        if (variable.derived)
+        {
+            Unlink(index);
+            variable.derived = false;
+            variable.parts.clear();
+            UpdateRank(index);
+        }
+
+        if (variable.pendingSet != InvalidThemeIndex)
+        {
+            m_pendingSets[variable.pendingSet].second = value;
+        }
+        else
+        {
+            variable.pendingSet = static_cast<ThemeIndex>(m_pendingSets.size());
+            m_pendingSets.push_back(std::make_pair(index, value));
+        }
+    }
+
+    bool BindingGraph::Define(const std::wstring& name, const std::wstring& expression)
+    {
+        const std::vector<ParsedPart> parsed = ParseTemplate(expression);
+        const ThemeIndex existing = Find(name);
+        const std::wstring key = ToLower(name);
+
+        // Variables that do not exist yet cannot lead back to this one
+        for (const ParsedPart& part : parsed)
+        {
+            if (part.name.empty())
+            {
+                continue;
+            }
+
+            const ThemeIndex dependency = Find(part.name);
+            if (ToLower(part.name) == key ||
+                (existing != InvalidThemeIndex && dependency != InvalidThemeIndex && DependsOn(dependency, existing)))
+            {
+                return false;
+            }
+        }
+
+        const ThemeIndex index = FindOrAdd(name);
+        Unlink(index);
+
+        std::vector<TemplatePart> parts;
+        std::vector<ThemeIndex> dependencies;
+
+        for (const ParsedPart& part : parsed)
+        {
+            TemplatePart templatePart = { part.text, InvalidThemeIndex };
+
+            if (!part.name.empty())
+            {
+                templatePart.variable = FindOrAdd(part.name);
+
+                if (std::find(dependencies.begin(), dependencies.end(), templatePart.variable) == dependencies.end())
+                {
+                    dependencies.push_back(templatePart.variable);
+                    m_variables[templatePart.variable].dependents.push_back(index);
+                }
+            }
+
+            parts.push_back(templatePart);
+        }
+
+        Variable& variable = m_variables[index];
+        variable.derived = true;
+        variable.parts = std::move(parts);
+        variable.dependencies = std::move(dependencies);
+
+        // The definition replaces a set from earlier in the frame
+        if (variable.pendingSet != InvalidThemeIndex)
+        {
+            m_pendingSets[variable.pendingSet].first = InvalidThemeIndex;
+            variable.pendingSet = InvalidThemeIndex;
+        }
+
+        UpdateRank(index);
+        m_pendingDefinitions.push_back(index);
+        return true;
+    }
+
+    void BindingGraph::Compile(const ThemeDocument& document, const DefaultResolver& defaults)
+    {
+        for (Variable& variable : m_variables)
+        {
+            variable.nodes.clear();
+        }
+
+        m_valueVariables.assign(document.values.size(), InvalidThemeIndex);
+
+        for (ThemeIndex node = 0; node < document.nodes.size(); ++node)
+        {
+            const IndexRange& attributes = document.nodes[node].attributes;
+            for (ThemeIndex attribute = attributes.first; attribute < attributes.first + attributes.count; ++attribute)
+            {
+                BindValues(document, document.attributes[attribute].value, node, defaults);
+            }
+        }
+    }
+
+    void BindingGraph::Clear()
+    {
+        m_variables.clear();
+        m_byName.clear();
+        m_pendingSets.clear();
+        m_pendingDefinitions.clear();
+        m_valueVariables.clear();
+        m_queue = decltype(m_queue)();
+    }
+
+    bool BindingGraph::HasPending() const noexcept
+    {
+        return !m_pendingSets.empty() || !m_pendingDefinitions.empty();
+    }
+
+    std::vector<ThemeIndex> BindingGraph::Flush()
+    {
+        std::vector<ThemeIndex> nodes;
+        m_statistics = BindingStatistics();
+
+        for (std::pair<ThemeIndex, std::wstring>& set : m_pendingSets)
+        {
+            if (set.first != InvalidThemeIndex)
+            {
+                m_variables[set.first].pendingSet = InvalidThemeIndex;
+                Assign(set.first, std::move(set.second), nodes);
+            }
+        }
+
+        for (ThemeIndex variable : m_pendingDefinitions)
+        {
+            Enqueue(variable);
+        }
+
+        m_pendingSets.clear();
+        m_pendingDefinitions.clear();
+
+        // A variable outranks everything it is built from, so by the time
+        // one comes off the queue all of its inputs are final
+        while (!m_queue.empty())
+        {
+            const ThemeIndex index = m_queue.top().second;
+            m_queue.pop();
+
+            Variable& variable = m_variables[index];
+            variable.queued = false;
+
+            if (variable.derived)
+            {
+                ++m_statistics.evaluated;
+                Assign(index, Evaluate(variable), nodes);
+            }
+        }
+
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        return nodes;
+    }
+
+    const std::wstring* BindingGraph::Value(const std::wstring& name) const
+    {
+        const ThemeIndex index = Find(name);
+        return (index != InvalidThemeIndex) ? &m_variables[index].value : nullptr;
+    }
+
+    const std::wstring* BindingGraph::ResolveValue(ThemeIndex value) const
+    {
+        if (value >= m_valueVariables.size() || m_valueVariables[value] == InvalidThemeIndex)
+        {
+            return nullptr;
+        }
+
+        return &m_variables[m_valueVariables[value]].value;
+    }
+
+    const BindingStatistics& BindingGraph::LastStatistics() const noexcept
+    {
+        return m_statistics;
+    }
+
+    ThemeIndex BindingGraph::Find(const std::wstring& name) const
+    {
+        const auto found = m_byName.find(ToLower(name));
+        return (found != m_byName.end()) ? found->second : InvalidThemeIndex;
+    }
+
+    ThemeIndex BindingGraph::FindOrAdd(const std::wstring& name)
+    {
+        const std::wstring key = ToLower(name);
+
+        const auto found = m_byName.find(key);
+        if (found != m_byName.end())
+        {
+            return found->second;
+        }
+
+        const ThemeIndex index = static_cast<ThemeIndex>(m_variables.size());
+
+        Variable variable;
+        variable.name = name;
+        variable.derived = false;
+        variable.rank = 0;
+        variable.queued = false;
+        variable.pendingSet = InvalidThemeIndex;
+
+        m_variables.push_back(std::move(variable));
+        m_byName.emplace(key, index);
+        return index;
+    }
+
+    // Whether variable is built from target, directly or not
+    bool BindingGraph::DependsOn(ThemeIndex variable, ThemeIndex target) const
+    {
+        std::vector<bool> visited(m_variables.size(), false);
+        std::vector<ThemeIndex> stack(1, variable);
+
+        while (!stack.empty())
+        {
+            const ThemeIndex index = stack.back();
+            stack.pop_back();
+
+            if (index == target)
+            {
+                return true;
+            }
+
+            if (visited[index])
+            {
+                continue;
+            }
+
+            visited[index] = true;
+            stack.insert(stack.end(), m_variables[index].dependencies.begin(), m_variables[index].dependencies.end());
+        }
+
+        return false;
+    }
+
+    void BindingGraph::Unlink(ThemeIndex variable)
+    {
+        for (ThemeIndex dependency : m_variables[variable].dependencies)
+        {
+            std::vector<ThemeIndex>& dependents = m_variables[dependency].dependents;
+            dependents.erase(std::find(dependents.begin(), dependents.end(), variable));
+        }
+
+        m_variables[variable].dependencies.clear();
+    }
+
+    // Ranks a variable one above the highest of its inputs, and moves its
+    // dependents along with it. The graph has no cycles, so this ends.
+    void BindingGraph::UpdateRank(ThemeIndex variable)
+    {
+        unsigned rank = 0;
+        for (ThemeIndex dependency : m_variables[variable].dependencies)
+        {
+            rank = std::max(rank, m_variables[dependency].rank + 1);
+        }
+
+        if (rank == m_variables[variable].rank)
+        {
+            return;
+        }
+
+        m_variables[variable].rank = rank;
+
+        // Copied, the recursion does not touch the list but may grow
+        // m_variables
+        const std::vector<ThemeIndex> dependents = m_variables[variable].dependents;
+        for (ThemeIndex dependent : dependents)
+        {
+            UpdateRank(dependent);
+        }
+    }
+
+    std::wstring BindingGraph::Evaluate(const Variable& variable) const
+    {
+        std::wstring value;
+        for (const TemplatePart& part : variable.parts)
+        {
+            value += (part.variable != InvalidThemeIndex) ? m_variables[part.variable].value : part.text;
+        }
+        return value;
+    }
+
+    void BindingGraph::Enqueue(ThemeIndex variable)
+    {
+        if (!m_variables[variable].queued)
+        {
+            m_variables[variable].queued = true;
+            m_queue.push(std::make_pair(m_variables[variable].rank, variable));
+        }
+    }
+
+    // Takes a new value, and if it is different, reports the bound nodes
+    // and queues the dependents
+    void BindingGraph::Assign(ThemeIndex index, std::wstring value, std::vector<ThemeIndex>& nodes)
+    {
+        Variable& variable = m_variables[index];
+        if (variable.value == value)
+        {
+            return;
+        }
+
+        variable.value = std::move(value);
+        ++m_statistics.changed;
+        nodes.insert(nodes.end(), variable.nodes.begin(), variable.nodes.end());
+
+        for (ThemeIndex dependent : variable.dependents)
+        {
+            Enqueue(dependent);
+        }
+    }
+
+    // Binds a value and, for objects and arrays, everything inside it
+    void BindingGraph::BindValues(const ThemeDocument& document, ThemeIndex value, ThemeIndex node,
+        const DefaultResolver& defaults)
+    {
+        const ValueRecord& record = document.values[value];
+
+        if (record.kind == ValueKind::Object)
+        {
+            for (ThemeIndex property = record.members.first;
+                property < record.members.first + record.members.count; ++property)
+            {
+                BindValues(document, document.properties[property].value, node, defaults);
+            }
+        }
+        else if (record.kind == ValueKind::Array)
+        {
+            for (ThemeIndex member = record.members.first;
+                member < record.members.first + record.members.count; ++member)
+            {
+                BindValues(document, member, node, defaults);
+            }
+        }
+        else if (record.kind == ValueKind::Reference && record.text.length != 0)
+        {
+            const std::wstring name(document.String(record.text), record.text.length);
+
+            ThemeIndex index = Find(name);
+            if (index == InvalidThemeIndex)
+            {
+                index = FindOrAdd(name);
+
+                std::wstring initial;
+                if (defaults && defaults(name.c_str(), initial))
+                {
+                    m_variables[index].value = std::move(initial);
+                }
+            }
+
+            m_valueVariables[value] = index;
+
+            std::vector<ThemeIndex>& nodes = m_variables[index].nodes;
+            if (nodes.empty() || nodes.back() != node)
+            {
+                nodes.push_back(node);
+            }
+        }
+    }
+}
+}
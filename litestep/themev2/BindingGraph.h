@@ -0,0 +1,133 @@
+#pragma once
+
+#include "ThemeDocument.h"
+
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // Work done by the last Flush
+    struct BindingStatistics
+    {
+        std::size_t evaluated;      // derived variables recomputed
+        std::size_t changed;        // variables that took a new value
+    };
+
+    // Keeps the Reference values of a theme (@clockText) bound to named
+    // variables, and works out which nodes a change reaches.
+    //
+    // A variable is either a source, whose value hosts set (the time, the
+    // track that is playing, ...), or derived from others through a
+    // template such as "@hour:@minute". Variables form a graph, ranked so
+    // that a variable ranks above everything it is built from. Sets are
+    // held until Flush, so a burst of them costs one propagation, which
+    // visits the changed variables in rank order and recomputes each
+    // dependent once, after all of its inputs. A variable whose value
+    // comes out the same stops the propagation there, so only nodes whose
+    // values really changed are reported.
+    //
+    // Names ignore case. Not thread safe, the engine uses it on the
+    // LiteStep thread only.
+    class BindingGraph
+    {
+    public:
+        // Initial value of a variable the theme uses before anything set
+        // it, false if there is none
+        typedef std::function<bool(const wchar_t* name, std::wstring& value)> DefaultResolver;
+
+        BindingGraph();
+
+        // Makes a variable a source with this value, as of the next Flush.
+        // A later set in the same frame replaces an earlier one.
+        void Set(const std::wstring& name, const std::wstring& value);
+
+        // Makes a variable derived from a template, in which @name stands
+        // for another variable and @@ for a single @. False, with nothing
+        // changed, if the variable would end up depending on itself.
+        bool Define(const std::wstring& name, const std::wstring& expression);
+
+        // Binds the Reference values of a document, replacing the bindings
+        // of the previous one. Variables and their values are kept.
+        void Compile(const ThemeDocument& document, const DefaultResolver& defaults);
+        void Clear();
+
+        bool HasPending() const noexcept;
+
+        // Applies the pending sets and definitions. Returns the nodes with
+        // a bound value that changed, in index order.
+        std::vector<ThemeIndex> Flush();
+
+        // Current value of a variable, null if there is no such variable
+        const std::wstring* Value(const std::wstring& name) const;
+
+        // Current value of a Reference value of the compiled document, null
+        // if the index is not one
+        const std::wstring* ResolveValue(ThemeIndex value) const;
+
+        const BindingStatistics& LastStatistics() const noexcept;
+
+    private:
+        BindingGraph(const BindingGraph&);
+        BindingGraph& operator=(const BindingGraph&);
+
+        // A piece of a template, either text or a variable
+        struct TemplatePart
+        {
+            std::wstring text;
+            ThemeIndex variable;
+        };
+
+        struct Variable
+        {
+            std::wstring name;
+            std::wstring value;
+            bool derived;
+            std::vector<TemplatePart> parts;
+            std::vector<ThemeIndex> dependencies;
+            std::vector<ThemeIndex> dependents;
+            std::vector<ThemeIndex> nodes;          // nodes with a value bound to it
+            unsigned rank;
+            bool queued;
+            ThemeIndex pendingSet;          // into m_pendingSets
+        };
+
+        typedef std::pair<unsigned, ThemeIndex> RankedVariable;
+
+        ThemeIndex Find(const std::wstring& name) const;
+        ThemeIndex FindOrAdd(const std::wstring& name);
+
+        bool DependsOn(ThemeIndex variable, ThemeIndex target) const;
+        void Unlink(ThemeIndex variable);
+        void UpdateRank(ThemeIndex variable);
+        std::wstring Evaluate(const Variable& variable) const;
+
+        void Enqueue(ThemeIndex variable);
+        void Assign(ThemeIndex variable, std::wstring value, std::vector<ThemeIndex>& nodes);
+        void BindValues(const ThemeDocument& document, ThemeIndex value, ThemeIndex node,
+            const DefaultResolver& defaults);
+
+        std::vector<Variable> m_variables;
+        std::unordered_map<std::wstring, ThemeIndex> m_byName;     // lower-case names
+
+        // Sets and definitions waiting for Flush
+        std::vector<std::pair<ThemeIndex, std::wstring>> m_pendingSets;
+        std::vector<ThemeIndex> m_pendingDefinitions;
+
+        // For every value of the compiled document, its variable, or
+        // InvalidThemeIndex if it is not a Reference
+        std::vector<ThemeIndex> m_valueVariables;
+
+        // Min-heap on rank, for Flush
+        std::priority_queue<RankedVariable, std::vector<RankedVariable>, std::greater<RankedVariable>> m_queue;
+
+        BindingStatistics m_statistics;
+    };
+}
+}
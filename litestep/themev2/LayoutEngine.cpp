@@ -0,0 +1,730 @@
+#include "LayoutEngine.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        LayoutLength MakeLength(LayoutUnit unit, float value)
+        {
+            LayoutLength length = { unit, value };
+            return length;
+        }
+
+        bool IsText(const ValueView& value)
+        {
+            return value.Kind() == ValueKind::String || value.Kind() == ValueKind::Identifier;
+        }
+
+        // The whole text as a number, optionally followed by "px"
+        bool ParseNumberText(const wchar_t* text, float& value)
+        {
+            wchar_t* end = nullptr;
+            value = std::wcstof(text, &end);
+            if (end == text)
+            {
+                return false;
+            }
+
+            while (iswspace(*end))
+            {
+                ++end;
+            }
+
+            if (_wcsnicmp(end, L"px", 2) == 0)
+            {
+                end += 2;
+            }
+
+            return *end == L'\0';
+        }
+
+        bool ParseNumber(const ValueView& value, const LayoutEngine::ConstantResolver& constants, float& number)
+        {
+            switch (value.Kind())
+            {
+            case ValueKind::Number:
+                number = static_cast<float>(value.Number());
+                return true;
+            case ValueKind::String:
+                return ParseNumberText(value.Text(), number);
+            case ValueKind::Identifier:
+                return constants && constants(value.Text(), number);
+            default:
+                return false;
+            }
+        }
+
+        // "left", "bottom right", "center", "top center", ...
+        void ParseAlign(const wchar_t* text, LayoutAlign align[2])
+        {
+            std::wstring word;
+            bool center = false;
+
+            for (const wchar_t* cursor = text; ; ++cursor)
+            {
+                if (*cursor != L'\0' && !iswspace(*cursor) && *cursor != L',')
+                {
+                    word.push_back(static_cast<wchar_t>(towlower(*cursor)));
+                    continue;
+                }
+
+                if (word == L"left")
+                {
+                    align[0] = LayoutAlign::Start;
+                }
+                else if (word == L"right")
+                {
+                    align[0] = LayoutAlign::End;
+                }
+                else if (word == L"top")
+                {
+                    align[1] = LayoutAlign::Start;
+                }
+                else if (word == L"bottom")
+                {
+                    align[1] = LayoutAlign::End;
+                }
+                else if (word == L"center")
+                {
+                    center = true;
+                }
+
+                word.clear();
+
+                if (*cursor == L'\0')
+                {
+                    break;
+                }
+            }
+
+            // center takes the axes no other word named
+            for (unsigned axis = 0; axis < 2 && center; ++axis)
+            {
+                if (align[axis] == LayoutAlign::Stretch)
+                {
+                    align[axis] = LayoutAlign::Center;
+                }
+            }
+        }
+
+        float Offset(LayoutAlign align, float free)
+        {
+            switch (align)
+            {
+            case LayoutAlign::Center:
+                return free / 2.0f;
+            case LayoutAlign::End:
+                return free;
+            default:
+                return 0.0f;
+            }
+        }
+
+        bool SameRect(const float left[4], const float right[4])
+        {
+            return left[0] == right[0] && left[1] == right[1] && left[2] == right[2] && left[3] == right[3];
+        }
+    }
+
+    LayoutEngine::LayoutEngine()
+        : m_nodes(), m_roots(), m_statistics()
+    {
+        m_roots.first = 0;
+        m_roots.count = 0;
+    }
+
+    void LayoutEngine::Build(const ThemeDocument& document, const ConstantResolver& constants)
+    {
+        Node blank = {};
+        blank.parent = InvalidThemeIndex;
+        blank.kind = LayoutKind::Stack;
+        blank.mainAxis = 1;
+        blank.size[0] = MakeLength(LayoutUnit::Auto, 0.0f);
+        blank.size[1] = MakeLength(LayoutUnit::Auto, 0.0f);
+        blank.align[0] = LayoutAlign::Stretch;
+        blank.align[1] = LayoutAlign::Stretch;
+        blank.measureDirty = true;
+        blank.arrangeDirty = true;
+
+        m_nodes.assign(document.NodeCount(), blank);
+        m_roots = document.roots;
+
+        for (ThemeIndex index = 0; index < m_nodes.size(); ++index)
+        {
+            Node& node = m_nodes[index];
+            const NodeView view = document.Node(index);
+
+            node.children = document.nodes[index].children;
+            for (ThemeIndex child = node.children.first; child < node.children.first + node.children.count; ++child)
+            {
+                m_nodes[child].parent = index;
+            }
+
+            AttributeView attribute(nullptr, 0);
+
+            if (view.FindAttribute(L"width", &attribute))
+            {
+                node.size[0] = ParseLength(attribute.Value(), constants);
+            }
+
+            if (view.FindAttribute(L"height", &attribute))
+            {
+                node.size[1] = ParseLength(attribute.Value(), constants);
+            }
+
+            if (view.FindAttribute(L"layout", &attribute) && IsText(attribute.Value()) &&
+                _wcsicmp(attribute.Value().Text(), L"grid") == 0)
+            {
+                node.kind = LayoutKind::Grid;
+            }
+
+            if (!view.FindAttribute(L"layoutParams", &attribute))
+            {
+                continue;
+            }
+
+            float columns = 0.0f;
+            float rows = 0.0f;
+
+            for (PropertyView property : attribute.Value().Properties())
+            {
+                const wchar_t* key = property.Key();
+                const ValueView value = property.Value();
+
+                if (_wcsicmp(key, L"direction") == 0 && IsText(value))
+                {
+                    node.mainAxis = (_wcsicmp(value.Text(), L"horizontal") == 0 ||
+                        _wcsicmp(value.Text(), L"row") == 0) ? 0 : 1;
+                }
+                else if (_wcsicmp(key, L"align") == 0 && IsText(value))
+                {
+                    ParseAlign(value.Text(), node.align);
+                }
+                else if (_wcsicmp(key, L"padding") == 0)
+                {
+                    ParseNumber(value, constants, node.padding);
+                }
+                else if (_wcsicmp(key, L"margin") == 0)
+                {
+                    ParseNumber(value, constants, node.margin);
+                }
+                else if (_wcsicmp(key, L"spacing") == 0)
+                {
+                    ParseNumber(value, constants, node.spacing);
+                }
+                else if (_wcsicmp(key, L"columns") == 0)
+                {
+                    ParseNumber(value, constants, columns);
+                }
+                else if (_wcsicmp(key, L"rows") == 0)
+                {
+                    ParseNumber(value, constants, rows);
+                }
+            }
+
+            const float cells = (node.mainAxis == 0) ? columns : rows;
+            node.lineLength = (cells >= 1.0f) ? static_cast<unsigned>(cells) : 0;
+        }
+    }
+
+    void LayoutEngine::Clear()
+    {
+        m_nodes.clear();
+        m_roots.first = 0;
+        m_roots.count = 0;
+        m_statistics = LayoutStatistics();
+    }
+
+    void LayoutEngine::Update(const LayoutSize& viewport)
+    {
+        m_statistics = LayoutStatistics();
+
+        const float available[2] = { viewport.width, viewport.height };
+        const float slot[4] = { 0.0f, 0.0f, viewport.width, viewport.height };
+
+        for (ThemeIndex root = m_roots.first; root < m_roots.first + m_roots.count; ++root)
+        {
+            Measure(root, available);
+        }
+
+        for (ThemeIndex root = m_roots.first; root < m_roots.first + m_roots.count; ++root)
+        {
+            Arrange(root, slot, available);
+        }
+    }
+
+    void LayoutEngine::SetWidth(ThemeIndex node, const LayoutLength& width)
+    {
+        LayoutLength& current = m_nodes[node].size[0];
+        if (current.unit != width.unit || current.value != width.value)
+        {
+            current = width;
+            Invalidate(node);
+        }
+    }
+
+    void LayoutEngine::SetHeight(ThemeIndex node, const LayoutLength& height)
+    {
+        LayoutLength& current = m_nodes[node].size[1];
+        if (current.unit != height.unit || current.value != height.value)
+        {
+            current = height;
+            Invalidate(node);
+        }
+    }
+
+    void LayoutEngine::SetContentSize(ThemeIndex node, const LayoutSize& size)
+    {
+        float* content = m_nodes[node].content;
+        if (content[0] != size.width || content[1] != size.height)
+        {
+            content[0] = size.width;
+            content[1] = size.height;
+            Invalidate(node);
+        }
+    }
+
+    std::size_t LayoutEngine::NodeCount() const noexcept
+    {
+        return m_nodes.size();
+    }
+
+    LayoutRect LayoutEngine::Bounds(ThemeIndex node) const noexcept
+    {
+        const float* bounds = m_nodes[node].bounds;
+        LayoutRect rect = { bounds[0], bounds[1], bounds[2], bounds[3] };
+        return rect;
+    }
+
+    const LayoutStatistics& LayoutEngine::LastStatistics() const noexcept
+    {
+        return m_statistics;
+    }
+
+    LayoutLength LayoutEngine::ParseLength(ValueView value, const ConstantResolver& constants)
+    {
+        if (value.Kind() == ValueKind::Number)
+        {
+            return MakeLength(LayoutUnit::Pixels, static_cast<float>(value.Number()));
+        }
+
+        if (!IsText(value))
+        {
+            return MakeLength(LayoutUnit::Auto, 0.0f);
+        }
+
+        const wchar_t* text = value.Text();
+        const std::size_t length = value.TextLength();
+
+        if (_wcsicmp(text, L"fill") == 0)
+        {
+            return MakeLength(LayoutUnit::Fill, 0.0f);
+        }
+
+        float number = 0.0f;
+
+        if (length > 1 && text[length - 1] == L'%')
+        {
+            const std::wstring percentage(text, length - 1);
+            if (ParseNumberText(percentage.c_str(), number))
+            {
+                return MakeLength(LayoutUnit::Percent, number);
+            }
+        }
+        else if (ParseNumber(value, constants, number))
+        {
+            return MakeLength(LayoutUnit::Pixels, number);
+        }
+
+        return MakeLength(LayoutUnit::Auto, 0.0f);
+    }
+
+    // The node and its ancestors need measuring and arranging again. An
+    // ancestor that already does has had the rest of the path marked too.
+    void LayoutEngine::Invalidate(ThemeIndex index)
+    {
+        for (ThemeIndex current = index; current != InvalidThemeIndex; current = m_nodes[current].parent)
+        {
+            Node& node = m_nodes[current];
+            if (current != index && node.measureDirty && node.arrangeDirty)
+            {
+                break;
+            }
+
+            node.measureDirty = true;
+            node.arrangeDirty = true;
+        }
+    }
+
+    void LayoutEngine::InvalidateArrange(ThemeIndex index)
+    {
+        m_nodes[index].arrangeDirty = true;
+
+        for (ThemeIndex current = m_nodes[index].parent; current != InvalidThemeIndex; current = m_nodes[current].parent)
+        {
+            if (m_nodes[current].arrangeDirty)
+            {
+                break;
+            }
+
+            m_nodes[current].arrangeDirty = true;
+        }
+    }
+
+    void LayoutEngine::Measure(ThemeIndex index, const float available[2])
+    {
+        Node& node = m_nodes[index];
+
+        if (!node.measureDirty && node.available[0] == available[0] && node.available[1] == available[1])
+        {
+            return;
+        }
+
+        float own[2] = { 0.0f, 0.0f };
+        bool sized[2] = { false, false };
+        float content[2] = { 0.0f, 0.0f };
+
+        for (unsigned axis = 0; axis < 2; ++axis)
+        {
+            const float inner = std::max(0.0f, available[axis] - 2.0f * node.margin);
+
+            switch (node.size[axis].unit)
+            {
+            case LayoutUnit::Pixels:
+                own[axis] = node.size[axis].value;
+                sized[axis] = true;
+                break;
+            case LayoutUnit::Percent:
+                own[axis] = available[axis] * node.size[axis].value / 100.0f;
+                sized[axis] = true;
+                break;
+            default:
+                // Fill and Auto want their content, arranging stretches them
+                break;
+            }
+
+            content[axis] = std::max(0.0f, (sized[axis] ? own[axis] : inner) - 2.0f * node.padding);
+        }
+
+        float children[2] = { 0.0f, 0.0f };
+        MeasureChildren(node, content, children);
+
+        bool changed = false;
+
+        for (unsigned axis = 0; axis < 2; ++axis)
+        {
+            if (!sized[axis])
+            {
+                own[axis] = std::max(node.content[axis], children[axis]) + 2.0f * node.padding;
+            }
+
+            changed = changed || node.desired[axis] != own[axis] + 2.0f * node.margin;
+            node.desired[axis] = own[axis] + 2.0f * node.margin;
+            node.available[axis] = available[axis];
+        }
+
+        node.measureDirty = false;
+        ++m_statistics.measured;
+
+        // A new constraint can change the size of a node that is not
+        // dirty itself, its parent has to place it again
+        if (changed)
+        {
+            InvalidateArrange(index);
+        }
+    }
+
+    void LayoutEngine::MeasureChildren(const Node& node, const float available[2], float measured[2])
+    {
+        const ThemeIndex count = node.children.count;
+        if (count == 0)
+        {
+            return;
+        }
+
+        const unsigned main = node.mainAxis;
+        const unsigned cross = 1 - main;
+        const ThemeIndex lineLength = (node.kind == LayoutKind::Grid && node.lineLength != 0) ?
+            std::min<ThemeIndex>(node.lineLength, count) : count;
+
+        for (ThemeIndex child = node.children.first; child < node.children.first + count; ++child)
+        {
+            Measure(child, available);
+        }
+
+        if (lineLength == count)
+        {
+            // A single line, as every stack is
+            for (ThemeIndex child = node.children.first; child < node.children.first + count; ++child)
+            {
+                measured[main] += m_nodes[child].desired[main];
+                measured[cross] = std::max(measured[cross], m_nodes[child].desired[cross]);
+            }
+
+            measured[main] += node.spacing * (count - 1);
+            return;
+        }
+
+        // Widest cell of each column and tallest cell of each line
+        std::vector<float> tracks(lineLength, 0.0f);
+        float line = 0.0f;
+
+        for (ThemeIndex offset = 0; offset < count; ++offset)
+        {
+            const Node& child = m_nodes[node.children.first + offset];
+            tracks[offset % lineLength] = std::max(tracks[offset % lineLength], child.desired[main]);
+            line = std::max(line, child.desired[cross]);
+
+            if (offset % lineLength == lineLength - 1 || offset + 1 == count)
+            {
+                measured[cross] += line;
+                line = 0.0f;
+            }
+        }
+
+        for (float track : tracks)
+        {
+            measured[main] += track;
+        }
+
+        const ThemeIndex lines = (count + lineLength - 1) / lineLength;
+        measured[main] += node.spacing * (lineLength - 1);
+        measured[cross] += node.spacing * (lines - 1);
+    }
+
+    void LayoutEngine::Arrange(ThemeIndex index, const float slot[4], const float base[2])
+    {
+        Node& node = m_nodes[index];
+
+        if (!node.arrangeDirty && SameRect(node.slot, slot) && node.base[0] == base[0] && node.base[1] == base[1])
+        {
+            return;
+        }
+
+        std::copy(slot, slot + 4, node.slot);
+        std::copy(base, base + 2, node.base);
+
+        float content[4] = {};
+
+        for (unsigned axis = 0; axis < 2; ++axis)
+        {
+            const float start = slot[axis] + node.margin;
+            const float inner = std::max(0.0f, slot[2 + axis] - 2.0f * node.margin);
+
+            float size = 0.0f;
+            switch (node.size[axis].unit)
+            {
+            case LayoutUnit::Pixels:
+                size = node.size[axis].value;
+                break;
+            case LayoutUnit::Percent:
+                size = base[axis] * node.size[axis].value / 100.0f;
+                break;
+            case LayoutUnit::Fill:
+                size = inner;
+                break;
+            case LayoutUnit::Auto:
+                size = (node.align[axis] == LayoutAlign::Stretch) ?
+                    inner : std::min(inner, node.desired[axis] - 2.0f * node.margin);
+                break;
+            }
+
+            node.bounds[axis] = start + Offset(node.align[axis], inner - size);
+            node.bounds[2 + axis] = size;
+
+            content[axis] = node.bounds[axis] + node.padding;
+            content[2 + axis] = std::max(0.0f, size - 2.0f * node.padding);
+        }
+
+        node.arrangeDirty = false;
+        ++m_statistics.arranged;
+
+        if (node.children.count == 0)
+        {
+            return;
+        }
+
+        if (node.kind == LayoutKind::Grid)
+        {
+            ArrangeGrid(node, content);
+        }
+        else
+        {
+            ArrangeStack(node, content);
+        }
+    }
+
+    void LayoutEngine::ArrangeStack(const Node& node, const float content[4])
+    {
+        const unsigned main = node.mainAxis;
+        const unsigned cross = 1 - main;
+        const float base[2] = { content[2], content[3] };
+
+        float used = node.spacing * (node.children.count - 1);
+        unsigned fills = 0;
+
+        for (ThemeIndex child = node.children.first; child < node.children.first + node.children.count; ++child)
+        {
+            if (m_nodes[child].size[main].unit == LayoutUnit::Fill)
+            {
+                ++fills;
+            }
+            else
+            {
+                used += OuterSize(m_nodes[child], main, base[main]);
+            }
+        }
+
+        const float free = std::max(0.0f, content[2 + main] - used);
+        const float fillSize = (fills != 0) ? free / fills : 0.0f;
+
+        float position = content[main] + ((fills == 0) ? Offset(node.align[main], free) : 0.0f);
+
+        for (ThemeIndex child = node.children.first; child < node.children.first + node.children.count; ++child)
+        {
+            const float size = (m_nodes[child].size[main].unit == LayoutUnit::Fill) ?
+                fillSize : OuterSize(m_nodes[child], main, base[main]);
+
+            float slot[4];
+            slot[main] = position;
+            slot[2 + main] = size;
+            slot[cross] = content[cross];
+            slot[2 + cross] = content[2 + cross];
+
+            Arrange(child, slot, base);
+            position += size + node.spacing;
+        }
+    }
+
+    // Cells are filled line by line. A column is as wide as its widest
+    // cell, and columns with a "fill" cell share what is left; lines work
+    // the same way across. A single line spans the whole cross axis.
+    void LayoutEngine::ArrangeGrid(const Node& node, const float content[4])
+    {
+        const unsigned main = node.mainAxis;
+        const unsigned cross = 1 - main;
+        const float base[2] = { content[2], content[3] };
+
+        const ThemeIndex count = node.children.count;
+        const ThemeIndex lineLength = (node.lineLength != 0) ? std::min<ThemeIndex>(node.lineLength, count) : count;
+        const ThemeIndex lineCount = (count + lineLength - 1) / lineLength;
+
+        // Lines are tracks too, after the columns
+        std::vector<float> tracks(lineLength + lineCount, 0.0f);
+        std::vector<bool> fills(lineLength + lineCount, false);
+
+        for (ThemeIndex offset = 0; offset < count; ++offset)
+        {
+            const Node& child = m_nodes[node.children.first + offset];
+            const ThemeIndex column = offset % lineLength;
+            const ThemeIndex line = lineLength + offset / lineLength;
+
+            if (child.size[main].unit == LayoutUnit::Fill)
+            {
+                fills[column] = true;
+            }
+            else
+            {
+                tracks[column] = std::max(tracks[column], OuterSize(child, main, base[main]));
+            }
+
+            if (child.size[cross].unit == LayoutUnit::Fill)
+            {
+                fills[line] = true;
+            }
+            else
+            {
+                tracks[line] = std::max(tracks[line], OuterSize(child, cross, base[cross]));
+            }
+        }
+
+        if (lineCount == 1)
+        {
+            fills[lineLength] = false;
+            tracks[lineLength] = content[2 + cross];
+        }
+
+        float offsets[2] = { 0.0f, 0.0f };
+        const ThemeIndex firsts[2] = { 0, lineLength };
+        const ThemeIndex ends[2] = { lineLength, lineLength + lineCount };
+        const unsigned axes[2] = { main, cross };
+
+        for (unsigned group = 0; group < 2; ++group)
+        {
+            float used = node.spacing * (ends[group] - firsts[group] - 1);
+            unsigned fillCount = 0;
+
+            for (ThemeIndex track = firsts[group]; track < ends[group]; ++track)
+            {
+                if (fills[track])
+                {
+                    tracks[track] = 0.0f;
+                    ++fillCount;
+                }
+
+                used += tracks[track];
+            }
+
+            const float free = std::max(0.0f, content[2 + axes[group]] - used);
+
+            if (fillCount == 0)
+            {
+                offsets[group] = Offset(node.align[axes[group]], free);
+                continue;
+            }
+
+            for (ThemeIndex track = firsts[group]; track < ends[group]; ++track)
+            {
+                if (fills[track])
+                {
+                    tracks[track] = free / fillCount;
+                }
+            }
+        }
+
+        float position[2] = { content[main] + offsets[0], content[cross] + offsets[1] };
+        const float lineStart = position[0];
+
+        for (ThemeIndex offset = 0; offset < count; ++offset)
+        {
+            const ThemeIndex column = offset % lineLength;
+            const ThemeIndex line = lineLength + offset / lineLength;
+
+            float slot[4];
+            slot[main] = position[0];
+            slot[2 + main] = tracks[column];
+            slot[cross] = position[1];
+            slot[2 + cross] = tracks[line];
+
+            Arrange(node.children.first + offset, slot, base);
+
+            position[0] += tracks[column] + node.spacing;
+            if (column == lineLength - 1)
+            {
+                position[0] = lineStart;
+                position[1] += tracks[line] + node.spacing;
+            }
+        }
+    }
+
+    float LayoutEngine::OuterSize(const Node& child, unsigned axis, float base) const
+    {
+        switch (child.size[axis].unit)
+        {
+        case LayoutUnit::Pixels:
+            return child.size[axis].value + 2.0f * child.margin;
+        case LayoutUnit::Percent:
+            return base * child.size[axis].value / 100.0f + 2.0f * child.margin;
+        default:
+            return child.desired[axis];
+        }
+    }
+}
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "ThemeDocument.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // Lays out the nodes of a theme document with a measure pass (desired
+    // sizes, bottom-up) and an arrange pass (final rectangles, top-down).
+    // Nothing in here draws or talks to Windows.
+    //
+    // A node reads these attributes:
+    //
+    //     width, height    120, "120px", "50%" (of the parent's content
+    //                      box), "fill" (the rest of the parent's space) or
+    //                      "auto" (the default: its content, or all of the
+    //                      space it is given unless aligned on that axis)
+    //     layout           "stack" (the default) or "grid"
+    //     layoutParams     { direction = "vertical" | "horizontal",
+    //                        align = "left top", "center", ...,
+    //                        padding, margin, spacing = number,
+    //                        columns | rows = cells per line of a grid }
+    //
+    // align pulls a node towards an edge of the space it is given, and
+    // the children it packs towards the same edge of its own. Identifiers
+    // like SPACING_SMALL are looked up through the constant resolver.
+    //
+    // Every node caches the constraint it was last measured with and the
+    // slot it was last arranged in. A change marks the node and its
+    // ancestors dirty; the next Update measures only that path again, and
+    // skips arranging every subtree whose slot did not move.
+
+    enum class LayoutUnit
+    {
+        Auto,
+        Pixels,
+        Percent,
+        Fill
+    };
+
+    struct LayoutLength
+    {
+        LayoutUnit unit;
+        float value;
+    };
+
+    enum class LayoutKind
+    {
+        Stack,
+        Grid
+    };
+
+    enum class LayoutAlign
+    {
+        Stretch,
+        Start,
+        Center,
+        End
+    };
+
+    struct LayoutSize
+    {
+        float width;
+        float height;
+    };
+
+    struct LayoutRect
+    {
+        float x;
+        float y;
+        float width;
+        float height;
+    };
+
+    // Work done by the last Update
+    struct LayoutStatistics
+    {
+        std::size_t measured;
+        std::size_t arranged;
+    };
+
+    class LayoutEngine
+    {
+    public:
+        // Value of a named constant, false if there is none
+        typedef std::function<bool(const wchar_t* name, float& value)> ConstantResolver;
+
+        LayoutEngine();
+
+        // Reads the layout attributes of every node, the whole tree is
+        // dirty afterwards
+        void Build(const ThemeDocument& document, const ConstantResolver& constants);
+        void Clear();
+
+        // Lays the roots out over the viewport, each on its own
+        void Update(const LayoutSize& viewport);
+
+        void SetWidth(ThemeIndex node, const LayoutLength& width);
+        void SetHeight(ThemeIndex node, const LayoutLength& height);
+
+        // Size of what the node shows itself, such as its text, without
+        // padding. Zero unless the host measured something.
+        void SetContentSize(ThemeIndex node, const LayoutSize& size);
+
+        std::size_t NodeCount() const noexcept;
+
+        // Border box of a node in viewport coordinates, as of the last
+        // Update
+        LayoutRect Bounds(ThemeIndex node) const noexcept;
+
+        const LayoutStatistics& LastStatistics() const noexcept;
+
+        static LayoutLength ParseLength(ValueView value, const ConstantResolver& constants);
+
+    private:
+        // Sizes and positions are indexed by axis, 0 is horizontal
+        struct Node
+        {
+            ThemeIndex parent;
+            IndexRange children;
+            LayoutKind kind;
+            unsigned mainAxis;          // the axis children are packed along
+            unsigned lineLength;        // grid cells per line, 0 for one line
+            LayoutLength size[2];
+            LayoutAlign align[2];
+            float padding;
+            float margin;
+            float spacing;
+            float content[2];
+
+            bool measureDirty;
+            bool arrangeDirty;
+            float available[2];         // constraint of the last measure
+            float desired[2];           // margin included
+            float slot[4];              // x, y, width, height of the last arrange
+            float base[2];              // what percentages were taken of
+            float bounds[4];
+        };
+
+        void Invalidate(ThemeIndex index);
+        void InvalidateArrange(ThemeIndex index);
+
+        void Measure(ThemeIndex index, const float available[2]);
+        void MeasureChildren(const Node& node, const float available[2], float measured[2]);
+        void Arrange(ThemeIndex index, const float slot[4], const float base[2]);
+        void ArrangeStack(const Node& node, const float content[4]);
+        void ArrangeGrid(const Node& node, const float content[4]);
+
+        // Size of a child along an axis with its margin, as its parent
+        // packs it. Fill children are sized by the parent instead.
+        float OuterSize(const Node& child, unsigned axis, float base) const;
+
+        std::vector<Node> m_nodes;
+        IndexRange m_roots;
+        LayoutStatistics m_statistics;
+    };
+}
+}
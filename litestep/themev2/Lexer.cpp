@@ -2,13 +2,15 @@
 
 #include <cwctype>
 #include <cstdlib>
+#include <algorithm>
+#include <cwchar>
 
 namespace litestep
 {
 namespace themev2
 {
     Lexer::Lexer(const SourceDocument& document)
-        : m_document(document), m_offset(0), m_length(document.content.length())
+        : m_document(document), m_offset(0), m_length(document.content.length()), m_segment(0)
     {
     }
 
@@ -18,7 +20,7 @@ namespace themev2
 
         if (IsAtEnd())
         {
-            return MakeToken(TokenType::EndOfFile, m_offset, 0, std::wstring());
+            return MakeToken(TokenType::EndOfFile, m_offset, 0);
         }
 
         const wchar_t current = Peek();
@@ -148,8 +150,6 @@ namespace themev2
         const std::size_t start = m_offset;
         Advance();
 
-        std::wstring value;
-
         while (!IsAtEnd())
         {
             const wchar_t ch = Advance();
@@ -160,27 +160,12 @@ namespace themev2
 
             if (ch == L'\\' && !IsAtEnd())
             {
-                const wchar_t escaped = Advance();
-                switch (escaped)
-                {
-                case L'"': value.push_back(L'"'); break;
-                case L'\\': value.push_back(L'\\'); break;
-                case L'n': value.push_back(L'\n'); break;
-                case L'r': value.push_back(L'\r'); break;
-                case L't': value.push_back(L'\t'); break;
-                default:
-                    value.push_back(escaped);
-                    break;
-                }
-            }
-            else
-            {
-                value.push_back(ch);
+                Advance();
             }
         }
 
         const std::size_t length = m_offset - start;
-        return MakeToken(TokenType::String, start, length, value);
+        return MakeToken(TokenType::String, start, length);
     }
 
     Token Lexer::LexNumber()
@@ -228,8 +213,7 @@ namespace themev2
         }
 
         const std::size_t length = m_offset - start;
-        std::wstring lexeme = m_document.content.substr(start, length);
-        return MakeToken(TokenType::Number, start, length, lexeme);
+        return MakeToken(TokenType::Number, start, length);
     }
 
     Token Lexer::LexIdentifier()
@@ -250,69 +234,96 @@ namespace themev2
         }
 
         const std::size_t length = m_offset - start;
-        std::wstring lexeme = m_document.content.substr(start, length);
-        return MakeToken(TokenType::Identifier, start, length, lexeme);
+        return MakeToken(TokenType::Identifier, start, length);
     }
 
     Token Lexer::LexPunctuation(TokenType type, std::size_t startOffset, std::size_t length)
     {
-        std::wstring lexeme;
-        if (startOffset + length <= m_document.content.length())
+        if (startOffset + length > m_length)
         {
-            lexeme = m_document.content.substr(startOffset, length);
+            length = 0;
         }
-        return MakeToken(type, startOffset, length, lexeme);
+        return MakeToken(type, startOffset, length);
     }
 
-    Token Lexer::MakeToken(TokenType type, std::size_t startOffset, std::size_t length, const std::wstring& lexeme)
+    Token Lexer::MakeToken(TokenType type, std::size_t startOffset, std::size_t length)
     {
+        const auto& segments = m_document.segments;
+        while (m_segment + 1 < segments.size() && segments[m_segment + 1].startOffset <= startOffset)
+        {
+            ++m_segment;
+        }
+
         Token token;
         token.type = type;
-        token.lexeme = lexeme;
+        token.fileId = segments.empty() ? 0 : segments[m_segment].fileId;
         token.startOffset = startOffset;
         token.length = length;
-        token.location = BuildLocation(startOffset);
         return token;
     }
 
-    SourceLocation Lexer::BuildLocation(std::size_t startOffset) const
+    std::wstring Lexer::Text(const Token& token) const
+    {
+        if (token.startOffset >= m_length)
+        {
+            return std::wstring();
+        }
+        return m_document.content.substr(token.startOffset, token.length);
+    }
+
+    std::wstring Lexer::StringValue(const Token& token) const
+    {
+        std::wstring value;
+        AppendStringValue(token, value);
+        return value;
+    }
+
+    void Lexer::AppendStringValue(const Token& token, std::wstring& out) const
     {
-        if (m_document.segments.empty())
+        if (token.type != TokenType::String || token.length == 0)
         {
-            return SourceLocation(m_document.primaryFile, 0, 0);
+            return;
         }
 
-        const SourceDocumentSegment* segment = &m_document.segments.front();
-        for (const auto& candidate : m_document.segments)
+        // Skip the opening quote, stop at the closing one (if any)
+        std::size_t index = token.startOffset + 1;
+        const std::size_t end = std::min(token.startOffset + token.length, m_length);
+        while (index < end)
         {
-            if (candidate.startOffset <= startOffset)
-            {
-                segment = &candidate;
-            }
-            else
+            const wchar_t ch = m_document.content[index++];
+            if (ch == L'"')
             {
                 break;
             }
-        }
 
-        const std::size_t segmentStart = segment->startOffset;
-        std::size_t line = segment->lineStart;
-        std::size_t lastLineStart = segmentStart;
-        const std::size_t length = m_document.content.length();
-        const std::size_t limit = (startOffset < length) ? startOffset : length;
-
-        for (std::size_t index = segmentStart; index < limit; ++index)
-        {
-            if (m_document.content[index] == L'\n')
+            if (ch == L'\\' && index < end)
             {
-                ++line;
-                lastLineStart = index + 1;
+                const wchar_t escaped = m_document.content[index++];
+                switch (escaped)
+                {
+                case L'"': out.push_back(L'"'); break;
+                case L'\\': out.push_back(L'\\'); break;
+                case L'n': out.push_back(L'\n'); break;
+                case L'r': out.push_back(L'\r'); break;
+                case L't': out.push_back(L'\t'); break;
+                default:
+                    out.push_back(escaped);
+                    break;
+                }
+            }
+            else
+            {
+                out.push_back(ch);
             }
         }
+    }
 
-        const std::size_t column = (startOffset >= lastLineStart) ? (startOffset - lastLineStart + 1) : 1;
-        const std::wstring& filePath = segment->filePath.empty() ? m_document.primaryFile : segment->filePath;
-        return SourceLocation(filePath, line, column);
+    bool Lexer::TextEquals(const Token& token, const wchar_t* text) const
+    {
+        const std::size_t textLength = wcslen(text);
+        return token.length == textLength &&
+            token.startOffset + textLength <= m_length &&
+            _wcsnicmp(m_document.content.c_str() + token.startOffset, text, textLength) == 0;
     }
 
     wchar_t Lexer::Peek() const
@@ -14,18 +14,29 @@ namespace themev2
         Token NextToken();
         std::size_t CurrentOffset() const noexcept;
 
+        // Copies of a token's text. StringValue strips the quotes of a
+        // String token and resolves its escapes.
+        std::wstring Text(const Token& token) const;
+        std::wstring StringValue(const Token& token) const;
+        void AppendStringValue(const Token& token, std::wstring& out) const;
+
+        // Case-insensitive comparison of a token's text, without a copy.
+        bool TextEquals(const Token& token, const wchar_t* text) const;
+
     private:
         const SourceDocument& m_document;
         std::size_t m_offset;
         std::size_t m_length;
 
+        // Segment the last token started in, tokens come in offset order
+        std::size_t m_segment;
+
         void SkipWhitespaceAndComments();
         Token LexString();
         Token LexNumber();
         Token LexIdentifier();
         Token LexPunctuation(TokenType type, std::size_t startOffset, std::size_t length);
-        Token MakeToken(TokenType type, std::size_t startOffset, std::size_t length, const std::wstring& lexeme);
-        SourceLocation BuildLocation(std::size_t startOffset) const;
+        Token MakeToken(TokenType type, std::size_t startOffset, std::size_t length);
 
         wchar_t Peek() const;
         wchar_t PeekNext() const;
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cwchar>
+#include <cwctype>
 
 namespace litestep
 {
@@ -9,72 +10,40 @@ namespace themev2
 {
     namespace
     {
-        std::wstring TrimLeft(const std::wstring& value)
+        // Moves [mark, end) of a stack to the end of a document array
+        template <typename T>
+        IndexRange Commit(std::vector<T>& stack, std::size_t mark, std::vector<T>& target)
         {
-            std::wstring::size_type index = 0;
-            while (index < value.length() && iswspace(value[index]))
-            {
-                ++index;
-            }
-            return value.substr(index);
+            IndexRange range = { static_cast<ThemeIndex>(target.size()), static_cast<ThemeIndex>(stack.size() - mark) };
+            target.insert(target.end(), stack.begin() + mark, stack.end());
+            stack.resize(mark);
+            return range;
         }
 
-        std::wstring TrimRight(const std::wstring& value)
+        ValueRecord MakeValue(ValueKind kind, const SourcePosition& location)
         {
-            std::wstring::size_type index = value.length();
-            while (index > 0 && iswspace(value[index - 1]))
-            {
-                --index;
-            }
-            return value.substr(0, index);
+            ValueRecord value = {};
+            value.kind = kind;
+            value.location = location;
+            return value;
         }
 
-        std::wstring Trim(const std::wstring& value)
+        bool IsTextValue(const ValueRecord& value)
         {
-            return TrimRight(TrimLeft(value));
-        }
-
-        void AppendClassName(const std::wstring& name, std::vector<std::wstring>& classes)
-        {
-            if (name.empty())
-            {
-                return;
-            }
-
-            if (std::find(classes.begin(), classes.end(), name) == classes.end())
-            {
-                classes.push_back(name);
-            }
-        }
-
-        void SplitClassString(const std::wstring& text, std::vector<std::wstring>& classes)
-        {
-            std::wstring current;
-            for (wchar_t ch : text)
-            {
-                if (iswspace(ch))
-                {
-                    AppendClassName(current, classes);
-                    current.clear();
-                }
-                else
-                {
-                    current.push_back(ch);
-                }
-            }
-
-            AppendClassName(current, classes);
+            return value.kind == ValueKind::String || value.kind == ValueKind::Identifier;
         }
     }
 
     Parser::Parser(const SourceDocument& document, std::vector<Diagnostic>& diagnostics)
-        : m_document(document), m_lexer(document), m_diagnostics(diagnostics), m_tokens(), m_cursor(0)
+        : m_document(document), m_lexer(document), m_diagnostics(diagnostics), m_tokens(), m_cursor(0),
+          m_output(nullptr)
     {
     }
 
     ThemeDocument Parser::Parse()
     {
         ThemeDocument document;
+        m_output = &document;
 
         while (!IsAtEnd())
         {
@@ -87,11 +56,11 @@ namespace themev2
 
                 if (next.type == TokenType::Identifier && third.type == TokenType::LBrace)
                 {
-                    document.rootNodes.push_back(ParseComponent());
+                    ParseComponent();
                 }
                 else
                 {
-                    document.directives.push_back(ParseDirective());
+                    ParseDirective();
                 }
             }
             else if (token.type == TokenType::EndOfFile)
@@ -105,6 +74,10 @@ namespace themev2
             }
         }
 
+        // The root nodes went last, after all of their descendants
+        document.roots = Commit(m_nodeStack, 0, document.nodes);
+        m_output = nullptr;
+
         return document;
     }
 
@@ -168,24 +141,25 @@ namespace themev2
         return LookAhead(0).type == TokenType::EndOfFile;
     }
 
-    Directive Parser::ParseDirective()
+    void Parser::ParseDirective()
     {
         const Token& hashToken = LookAhead(0);
         Match(TokenType::Hash);
 
+        DirectiveRecord directive = {};
+        directive.location = hashToken.Position();
+
         const Token& nameToken = LookAhead(0);
         if (!Expect(TokenType::Identifier, L"Expected directive identifier."))
         {
             Synchronize();
-            Directive directive;
-            directive.location = hashToken.location;
-            return directive;
+            m_output->directives.push_back(directive);
+            return;
         }
 
-        Directive directive;
-        directive.name = nameToken.lexeme;
-        directive.location = hashToken.location;
+        directive.name = AddTokenText(nameToken);
         directive.argument = ExtractDirectiveArgument(hashToken, nameToken);
+        m_output->directives.push_back(directive);
 
         std::size_t lineEnd = m_document.content.find(L'\n', hashToken.startOffset);
         if (lineEnd == std::wstring::npos)
@@ -197,30 +171,34 @@ namespace themev2
         {
             Advance();
         }
-
-        return directive;
     }
 
-    ComponentNode Parser::ParseComponent()
+    void Parser::ParseComponent()
     {
         Match(TokenType::Hash);
         const Token& nameToken = LookAhead(0);
+
+        NodeRecord node = {};
+        node.location = nameToken.Position();
+
         if (!Expect(TokenType::Identifier, L"Expected component name after '#'."))
         {
             Synchronize();
-            ComponentNode empty;
-            empty.location = nameToken.location;
-            return empty;
+            m_nodeStack.push_back(node);
+            return;
         }
 
-        ComponentNode node;
-        node.component = nameToken.lexeme;
-        node.location = nameToken.location;
+        node.component = AddTokenText(nameToken);
+
+        const std::size_t classMark = m_classStack.size();
+        const std::size_t attributeMark = m_attributeStack.size();
+        const std::size_t childMark = m_nodeStack.size();
 
         if (!Expect(TokenType::LBrace, L"Expected '{' to start component body."))
         {
             Synchronize();
-            return node;
+            m_nodeStack.push_back(node);
+            return;
         }
 
         while (!IsAtEnd())
@@ -239,44 +217,45 @@ namespace themev2
                 const Token& third = LookAhead(2);
                 if (next.type == TokenType::Identifier && third.type == TokenType::LBrace)
                 {
-                    node.children.push_back(ParseComponent());
+                    ParseComponent();
                     continue;
                 }
             }
 
             if (token.type == TokenType::Identifier && LookAhead(1).type == TokenType::Equals)
             {
-                Attribute attribute = ParseAttribute();
+                const AttributeRecord attribute = ParseAttribute();
+                const ValueRecord value = m_output->values[attribute.value];
+                const wchar_t* name = m_output->String(attribute.name);
 
-                if (_wcsicmp(attribute.name.c_str(), L"id") == 0 &&
-                    (attribute.value.kind == ValueKind::String || attribute.value.kind == ValueKind::Identifier))
+                if (_wcsicmp(name, L"id") == 0 && IsTextValue(value))
                 {
-                    node.id = attribute.value.text;
+                    node.id = value.text;
                 }
-                else if (_wcsicmp(attribute.name.c_str(), L"name") == 0 &&
-                    (attribute.value.kind == ValueKind::String || attribute.value.kind == ValueKind::Identifier))
+                else if (_wcsicmp(name, L"name") == 0 && IsTextValue(value))
                 {
-                    node.name = attribute.value.text;
+                    node.name = value.text;
                 }
-                else if (_wcsicmp(attribute.name.c_str(), L"class") == 0)
+                else if (_wcsicmp(name, L"class") == 0)
                 {
-                    if (attribute.value.kind == ValueKind::String || attribute.value.kind == ValueKind::Identifier)
+                    if (IsTextValue(value))
                     {
-                        SplitClassString(attribute.value.text, node.classes);
+                        AddClasses(value.text, classMark);
                     }
-                    else if (attribute.value.kind == ValueKind::Array)
+                    else if (value.kind == ValueKind::Array)
                     {
-                        for (const Value& entry : attribute.value.arrayValues)
+                        for (ThemeIndex index = 0; index < value.members.count; ++index)
                         {
-                            if (entry.kind == ValueKind::String || entry.kind == ValueKind::Identifier)
+                            const ValueRecord entry = m_output->values[value.members.first + index];
+                            if (IsTextValue(entry))
                             {
-                                SplitClassString(entry.text, node.classes);
+                                AddClasses(entry.text, classMark);
                             }
                         }
                     }
                 }
 
-                node.attributes.push_back(attribute);
+                m_attributeStack.push_back(attribute);
                 continue;
             }
 
@@ -284,25 +263,28 @@ namespace themev2
             Advance();
         }
 
-        return node;
+        node.classes = Commit(m_classStack, classMark, m_output->classes);
+        node.attributes = Commit(m_attributeStack, attributeMark, m_output->attributes);
+        node.children = Commit(m_nodeStack, childMark, m_output->nodes);
+        m_nodeStack.push_back(node);
     }
 
-    Attribute Parser::ParseAttribute()
+    AttributeRecord Parser::ParseAttribute()
     {
         const Token& nameToken = LookAhead(0);
         Match(TokenType::Identifier);
 
-        Attribute attribute;
-        attribute.name = nameToken.lexeme;
-        attribute.location = nameToken.location;
+        AttributeRecord attribute = {};
+        attribute.name = AddTokenText(nameToken);
+        attribute.location = nameToken.Position();
 
         if (!Expect(TokenType::Equals, L"Expected '=' after attribute name."))
         {
-            attribute.value = Value();
+            attribute.value = AddValue(MakeValue(ValueKind::Null, SourcePosition()));
             return attribute;
         }
 
-        attribute.value = ParseValue();
+        attribute.value = AddValue(ParseValue());
 
         if (Check(TokenType::Comma))
         {
@@ -312,37 +294,45 @@ namespace themev2
         return attribute;
     }
 
-    Value Parser::ParseValue()
+    ValueRecord Parser::ParseValue()
     {
         const Token& token = LookAhead(0);
         switch (token.type)
         {
         case TokenType::String:
+        {
+            ValueRecord value = MakeValue(ValueKind::String, token.Position());
+            value.text.offset = static_cast<std::uint32_t>(m_output->strings.length());
+            m_lexer.AppendStringValue(token, m_output->strings);
+            value.text.length = static_cast<std::uint32_t>(m_output->strings.length() - value.text.offset);
+            m_output->strings.push_back(L'\0');
             Advance();
-            return Value::CreateString(token.lexeme, token.location);
+            return value;
+        }
         case TokenType::Number:
         {
+            ValueRecord value = MakeValue(ValueKind::Number, token.Position());
+            value.text = AddTokenText(token);
             wchar_t* endPtr = nullptr;
-            double numericValue = std::wcstod(token.lexeme.c_str(), &endPtr);
+            value.numberValue = std::wcstod(m_output->String(value.text), &endPtr);
             Advance();
-            return Value::CreateNumber(token.lexeme, numericValue, token.location);
+            return value;
         }
         case TokenType::Identifier:
         {
-            if (_wcsicmp(token.lexeme.c_str(), L"true") == 0)
-            {
-                Advance();
-                return Value::CreateBoolean(true, token.location);
-            }
-
-            if (_wcsicmp(token.lexeme.c_str(), L"false") == 0)
+            if (m_lexer.TextEquals(token, L"true") || m_lexer.TextEquals(token, L"false"))
             {
+                ValueRecord value = MakeValue(ValueKind::Boolean, token.Position());
+                value.boolValue = m_lexer.TextEquals(token, L"true");
+                value.text = value.boolValue ? m_output->AddString(L"true", 4) : m_output->AddString(L"false", 5);
                 Advance();
-                return Value::CreateBoolean(false, token.location);
+                return value;
             }
 
+            ValueRecord value = MakeValue(ValueKind::Identifier, token.Position());
+            value.text = AddTokenText(token);
             Advance();
-            return Value::CreateIdentifier(token.lexeme, token.location);
+            return value;
         }
         case TokenType::LBrace:
             return ParseObjectLiteral();
@@ -353,16 +343,17 @@ namespace themev2
         default:
             ReportError(token, L"Unexpected token in value expression.");
             Advance();
-            return Value();
+            return MakeValue(ValueKind::Null, SourcePosition());
         }
     }
 
-    Value Parser::ParseObjectLiteral()
+    ValueRecord Parser::ParseObjectLiteral()
     {
         const Token& openToken = LookAhead(0);
         Match(TokenType::LBrace);
 
-        Value object = Value::CreateObject(openToken.location);
+        ValueRecord object = MakeValue(ValueKind::Object, openToken.Position());
+        const std::size_t propertyMark = m_propertyStack.size();
 
         while (!IsAtEnd())
         {
@@ -386,8 +377,11 @@ namespace themev2
                 break;
             }
 
-            Value propertyValue = ParseValue();
-            object.objectProperties.push_back(ObjectProperty(keyToken.lexeme, propertyValue, keyToken.location));
+            PropertyRecord property = {};
+            property.key = AddTokenText(keyToken);
+            property.location = keyToken.Position();
+            property.value = AddValue(ParseValue());
+            m_propertyStack.push_back(property);
 
             if (Check(TokenType::Comma))
             {
@@ -395,15 +389,17 @@ namespace themev2
             }
         }
 
+        object.members = Commit(m_propertyStack, propertyMark, m_output->properties);
         return object;
     }
 
-    Value Parser::ParseArrayLiteral()
+    ValueRecord Parser::ParseArrayLiteral()
     {
         const Token& openToken = LookAhead(0);
         Match(TokenType::LBracket);
 
-        Value array = Value::CreateArray(openToken.location);
+        ValueRecord array = MakeValue(ValueKind::Array, openToken.Position());
+        const std::size_t valueMark = m_valueStack.size();
 
         while (!IsAtEnd())
         {
@@ -413,8 +409,7 @@ namespace themev2
                 break;
             }
 
-            Value element = ParseValue();
-            array.arrayValues.push_back(element);
+            m_valueStack.push_back(ParseValue());
 
             if (Check(TokenType::Comma))
             {
@@ -422,22 +417,94 @@ namespace themev2
             }
         }
 
+        array.members = Commit(m_valueStack, valueMark, m_output->values);
         return array;
     }
 
-    Value Parser::ParseReference()
+    ValueRecord Parser::ParseReference()
     {
         const Token& atToken = LookAhead(0);
         Match(TokenType::At);
 
+        ValueRecord reference = MakeValue(ValueKind::Reference, atToken.Position());
+
         const Token& identifierToken = LookAhead(0);
         if (!Match(TokenType::Identifier))
         {
             ReportError(identifierToken, L"Expected identifier after '@'.");
-            return Value::CreateReference(std::wstring(), atToken.location);
+            return reference;
         }
 
-        return Value::CreateReference(identifierToken.lexeme, atToken.location);
+        reference.text = AddTokenText(identifierToken);
+        return reference;
+    }
+
+    ThemeIndex Parser::AddValue(const ValueRecord& value)
+    {
+        m_output->values.push_back(value);
+        return static_cast<ThemeIndex>(m_output->values.size() - 1);
+    }
+
+    StringRef Parser::AddTokenText(const Token& token)
+    {
+        if (token.startOffset >= m_document.content.length())
+        {
+            return m_output->AddString(nullptr, 0);
+        }
+
+        const std::size_t length = std::min(token.length, m_document.content.length() - token.startOffset);
+        return m_output->AddString(m_document.content.c_str() + token.startOffset, length);
+    }
+
+    // Splits a class attribute at whitespace, skipping names the node
+    // already has. A value that is a single name is shared, not copied.
+    void Parser::AddClasses(const StringRef& text, std::size_t classMark)
+    {
+        const std::size_t end = text.offset + text.length;
+        std::size_t index = text.offset;
+
+        while (index < end)
+        {
+            while (index < end && iswspace(m_output->strings[index]))
+            {
+                ++index;
+            }
+
+            const std::size_t start = index;
+            while (index < end && !iswspace(m_output->strings[index]))
+            {
+                ++index;
+            }
+
+            const std::size_t length = index - start;
+            if (length == 0)
+            {
+                break;
+            }
+
+            auto existing = std::find_if(m_classStack.begin() + classMark, m_classStack.end(),
+                [this, start, length](const StringRef& candidate)
+                {
+                    return candidate.length == length &&
+                        m_output->strings.compare(candidate.offset, length, m_output->strings, start, length) == 0;
+                });
+
+            if (existing != m_classStack.end())
+            {
+                continue;
+            }
+
+            if (length == text.length)
+            {
+                m_classStack.push_back(text);
+            }
+            else
+            {
+                // Copied through a temporary, the pool may grow while appending
+                const std::wstring name = m_output->strings.substr(start, length);
+                m_classStack.push_back(m_output->AddString(name.c_str(), length));
+            }
+        }
     }
 
     void Parser::Synchronize()
@@ -459,11 +526,11 @@ namespace themev2
         Diagnostic diagnostic;
         diagnostic.severity = DiagnosticSeverity::Error;
         diagnostic.message = message;
-        diagnostic.location = token.location;
+        diagnostic.location = m_document.Locate(token.startOffset);
         m_diagnostics.push_back(diagnostic);
     }
 
-    std::wstring Parser::ExtractDirectiveArgument(const Token& hashToken, const Token& nameToken) const
+    StringRef Parser::ExtractDirectiveArgument(const Token& hashToken, const Token& nameToken)
     {
         std::size_t lineEnd = m_document.content.find(L'\n', hashToken.startOffset);
         if (lineEnd == std::wstring::npos)
@@ -471,15 +538,23 @@ namespace themev2
             lineEnd = m_document.content.length();
         }
 
-        const std::size_t argumentStart = nameToken.startOffset + nameToken.length;
+        std::size_t argumentStart = nameToken.startOffset + nameToken.length;
+        while (argumentStart < lineEnd && iswspace(m_document.content[argumentStart]))
+        {
+            ++argumentStart;
+        }
+
+        while (lineEnd > argumentStart && iswspace(m_document.content[lineEnd - 1]))
+        {
+            --lineEnd;
+        }
+
         if (argumentStart >= lineEnd)
         {
-            return std::wstring();
+            return m_output->AddString(nullptr, 0);
         }
 
-        std::wstring argument = m_document.content.substr(argumentStart, lineEnd - argumentStart);
-        return Trim(argument);
+        return m_output->AddString(m_document.content.c_str() + argumentStart, lineEnd - argumentStart);
     }
 }
 }
-
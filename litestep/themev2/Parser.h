@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Lexer.h"
+#include "ThemeDocument.h"
 
+#include <deque>
 #include <vector>
 
 namespace litestep
@@ -19,7 +21,9 @@ namespace themev2
         const SourceDocument& m_document;
         Lexer m_lexer;
         std::vector<Diagnostic>& m_diagnostics;
-        std::vector<Token> m_tokens;
+        // A deque, so that references from LookAhead stay valid while more
+        // tokens are read
+        std::deque<Token> m_tokens;
         std::size_t m_cursor;
 
         const Token& LookAhead(std::size_t distance);
@@ -30,17 +34,32 @@ namespace themev2
         void Advance();
         bool IsAtEnd();
 
-        Directive ParseDirective();
-        ComponentNode ParseComponent();
-        Attribute ParseAttribute();
-        Value ParseValue();
-        Value ParseObjectLiteral();
-        Value ParseArrayLiteral();
-        Value ParseReference();
+        // Records of unfinished nodes, objects and arrays wait on these
+        // stacks until their parent is done, and are then moved to the
+        // document in one block, which keeps the members of every parent
+        // contiguous.
+        ThemeDocument* m_output;
+        std::vector<NodeRecord> m_nodeStack;
+        std::vector<StringRef> m_classStack;
+        std::vector<AttributeRecord> m_attributeStack;
+        std::vector<ValueRecord> m_valueStack;
+        std::vector<PropertyRecord> m_propertyStack;
+
+        void ParseDirective();
+        void ParseComponent();
+        AttributeRecord ParseAttribute();
+        ValueRecord ParseValue();
+        ValueRecord ParseObjectLiteral();
+        ValueRecord ParseArrayLiteral();
+        ValueRecord ParseReference();
+
+        ThemeIndex AddValue(const ValueRecord& value);
+        StringRef AddTokenText(const Token& token);
+        void AddClasses(const StringRef& text, std::size_t classMark);
 
         void Synchronize();
         void ReportError(const Token& token, const std::wstring& message);
-        std::wstring ExtractDirectiveArgument(const Token& hashToken, const Token& nameToken) const;
+        StringRef ExtractDirectiveArgument(const Token& hashToken, const Token& nameToken);
     };
 }
 }
@@ -39,7 +39,7 @@ namespace themev2
     }
 
     SourceManager::SourceManager(std::wstring baseDirectory)
-        : m_baseDirectory(std::move(baseDirectory)), m_cache()
+        : m_baseDirectory(std::move(baseDirectory)), m_cache(), m_files()
     {
     }
 
@@ -50,19 +50,71 @@ namespace themev2
         return m_baseDirectory;
     }
 
-    bool SourceManager::LoadStructuredDocument(
-        const std::wstring& entryFile,
-        SourceDocument& outDocument,
-        std::vector<Diagnostic>& diagnostics)
+    void SourceManager::Reset()
     {
-        LoadContext context;
+        m_cache.clear();
+        m_files.clear();
+    }
 
-        std::wstring entryPath = entryFile;
-        if (entryPath.empty())
+    std::vector<std::wstring> SourceManager::InvalidateChanged()
+    {
+        std::vector<std::wstring> changed;
+        std::unordered_set<std::wstring> stale;
+
+        for (auto iter = m_files.begin(); iter != m_files.end();)
+        {
+            ContentStamp current;
+            if (!ReadStamp(iter->second.path, current) ||
+                current.size != iter->second.stamp.size ||
+                current.hash != iter->second.stamp.hash)
+            {
+                changed.push_back(iter->second.path);
+                stale.insert(iter->first);
+                iter = m_files.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        // A spliced document holds the old text of everything it includes,
+        // directly or not
+        bool grew = !stale.empty();
+        while (grew)
+        {
+            grew = false;
+
+            for (const auto& file : m_files)
+            {
+                if (stale.count(file.first) != 0)
+                {
+                    continue;
+                }
+
+                for (const std::wstring& include : file.second.includes)
+                {
+                    if (stale.count(include) != 0)
+                    {
+                        stale.insert(file.first);
+                        grew = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (const std::wstring& key : stale)
         {
-            entryPath.assign(L"theme.lsx");
+            m_cache.erase(key);
         }
 
+        return changed;
+    }
+
+    std::wstring SourceManager::ResolveEntryPath(const std::wstring& entryFile) const
+    {
+        std::wstring entryPath = entryFile;
         if (PathIsRelativeW(entryPath.c_str()))
         {
             wchar_t combined[MAX_PATH] = { 0 };
@@ -71,7 +123,78 @@ namespace themev2
             entryPath.assign(combined);
         }
 
-        const std::wstring normalized = NormalizePath(entryPath);
+        return NormalizePath(entryPath);
+    }
+
+    bool SourceManager::LoadedStamp(const std::wstring& absolutePath, ContentStamp& stamp) const
+    {
+        auto iter = m_files.find(ToLookupKey(absolutePath));
+        if (iter == m_files.end())
+        {
+            return false;
+        }
+
+        stamp = iter->second.stamp;
+        return true;
+    }
+
+    bool SourceManager::ReadStamp(const std::wstring& absolutePath, ContentStamp& stamp)
+    {
+        HANDLE file = CreateFileW(absolutePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size = { 0 };
+        bool success = GetFileSizeEx(file, &size) != FALSE;
+
+        std::vector<unsigned char> buffer;
+        if (success)
+        {
+            buffer.resize(static_cast<std::size_t>(size.QuadPart));
+
+            DWORD read = 0;
+            success = buffer.empty() ||
+                (ReadFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &read, nullptr) &&
+                 read == buffer.size());
+        }
+
+        CloseHandle(file);
+
+        if (success)
+        {
+            stamp.size = buffer.size();
+            stamp.hash = HashContent(buffer.data(), buffer.size());
+        }
+
+        return success;
+    }
+
+    std::uint64_t SourceManager::HashContent(const void* data, std::size_t length) noexcept
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        std::uint64_t hash = 14695981039346656037ULL;
+
+        for (std::size_t index = 0; index < length; ++index)
+        {
+            hash ^= bytes[index];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    bool SourceManager::LoadStructuredDocument(
+        const std::wstring& entryFile,
+        SourceDocument& outDocument,
+        std::vector<Diagnostic>& diagnostics)
+    {
+        LoadContext context;
+
+        const std::wstring entryPath = entryFile.empty() ? std::wstring(L"theme.lsx") : entryFile;
+        const std::wstring normalized = ResolveEntryPath(entryPath);
         if (normalized.empty())
         {
             AppendDiagnostic(diagnostics, DiagnosticSeverity::Error,
@@ -95,16 +218,7 @@ namespace themev2
     {
         LoadContext context;
 
-        std::wstring entryPath = entryFile;
-        if (PathIsRelativeW(entryPath.c_str()))
-        {
-            wchar_t combined[MAX_PATH] = { 0 };
-            StringCchCopyW(combined, MAX_PATH, m_baseDirectory.c_str());
-            PathAppendW(combined, entryPath.c_str());
-            entryPath.assign(combined);
-        }
-
-        const std::wstring normalized = NormalizePath(entryPath);
+        const std::wstring normalized = ResolveEntryPath(entryFile);
         if (normalized.empty())
         {
             AppendDiagnostic(diagnostics, DiagnosticSeverity::Error,
@@ -153,13 +267,26 @@ namespace themev2
 
         context.activeStack.insert(lookupKey);
 
-        std::wstring fileContents;
-        if (!LoadDocumentFromDisk(canonicalPath, fileContents, diagnostics))
+        // Only the splicing is redone for a file that is still unchanged
+        auto fileIter = m_files.find(lookupKey);
+        if (fileIter == m_files.end())
         {
-            context.activeStack.erase(lookupKey);
-            return false;
+            LoadedFile file;
+            file.path = canonicalPath;
+            if (!LoadDocumentFromDisk(canonicalPath, file.contents, file.stamp, diagnostics))
+            {
+                context.activeStack.erase(lookupKey);
+                return false;
+            }
+
+            fileIter = m_files.insert(std::make_pair(lookupKey, std::move(file))).first;
         }
 
+        fileIter->second.includes.clear();
+
+        // Copied, as includes may add to m_files while it is processed
+        const std::wstring fileContents = fileIter->second.contents;
+
         SourceDocument localDocument;
         localDocument.primaryFile = canonicalPath;
 
@@ -185,6 +312,7 @@ namespace themev2
     bool SourceManager::LoadDocumentFromDisk(
         const std::wstring& absolutePath,
         std::wstring& outContents,
+        ContentStamp& outStamp,
         std::vector<Diagnostic>& diagnostics) const
     {
         FILE* file = nullptr;
@@ -225,6 +353,9 @@ namespace themev2
 
         fclose(file);
 
+        outStamp.size = buffer.size();
+        outStamp.hash = HashContent(buffer.data(), buffer.size());
+
         if (buffer.empty())
         {
             outContents.clear();
@@ -287,6 +418,8 @@ namespace themev2
         SourceDocument& outDocument,
         std::vector<Diagnostic>& diagnostics)
     {
+        const FileId fileId = outDocument.InternFile(absolutePath);
+
         std::wstring chunk;
         std::size_t chunkLineStart = 0;
         std::size_t currentLine = 1;
@@ -296,7 +429,7 @@ namespace themev2
             if (!chunk.empty())
             {
                 SourceDocumentSegment segment;
-                segment.filePath = absolutePath;
+                segment.fileId = fileId;
                 segment.startOffset = outDocument.content.size();
                 segment.lineStart = chunkLineStart;
                 outDocument.segments.push_back(segment);
@@ -360,7 +493,7 @@ namespace themev2
                     if (hadNewline && !includeEndsWithNewline)
                     {
                         SourceDocumentSegment newlineSegment;
-                        newlineSegment.filePath = absolutePath;
+                        newlineSegment.fileId = fileId;
                         newlineSegment.startOffset = outDocument.content.size();
                         newlineSegment.lineStart = currentLine;
                         outDocument.segments.push_back(newlineSegment);
@@ -394,7 +527,7 @@ namespace themev2
         if (outDocument.segments.empty())
         {
             SourceDocumentSegment segment;
-            segment.filePath = absolutePath;
+            segment.fileId = fileId;
             segment.startOffset = 0;
             segment.lineStart = 1;
             outDocument.segments.push_back(segment);
@@ -451,6 +584,12 @@ namespace themev2
             return false;
         }
 
+        auto requesting = m_files.find(ToLookupKey(requestingPath));
+        if (requesting != m_files.end())
+        {
+            requesting->second.includes.push_back(ToLookupKey(normalized));
+        }
+
         SourceDocument includedDocument;
         if (!LoadDocumentRecursive(normalized, context, includedDocument, diagnostics))
         {
@@ -463,6 +602,7 @@ namespace themev2
         for (auto segment : includedDocument.segments)
         {
             segment.startOffset += insertionOffset;
+            segment.fileId = outDocument.InternFile(includedDocument.FilePath(segment.fileId));
             outDocument.segments.push_back(segment);
         }
 
@@ -9,6 +9,13 @@ namespace litestep
 {
 namespace themev2
 {
+    // Size and hash of a file's raw bytes, to tell whether it changed
+    struct ContentStamp
+    {
+        std::uint64_t size;
+        std::uint64_t hash;
+    };
+
     class SourceManager
     {
     public:
@@ -17,6 +24,28 @@ namespace themev2
 
         const std::wstring& BaseDirectory() const noexcept;
 
+        // Forgets all loaded files, so the next load reads them again
+        void Reset();
+
+        // Re-stamps every loaded file and forgets the ones whose content
+        // changed, together with the spliced documents of the files that
+        // include them. Unchanged files are not read again by the next
+        // load. Returns the paths of the changed files.
+        std::vector<std::wstring> InvalidateChanged();
+
+        // Absolute, normalized path of an entry file, relative paths are
+        // taken from the base directory. Empty if it can not be resolved.
+        std::wstring ResolveEntryPath(const std::wstring& entryFile) const;
+
+        // Stamp of a file as it was when it was loaded
+        bool LoadedStamp(const std::wstring& absolutePath, ContentStamp& stamp) const;
+
+        // Stamp of a file as it is on disk now
+        static bool ReadStamp(const std::wstring& absolutePath, ContentStamp& stamp);
+
+        // 64-bit FNV-1a
+        static std::uint64_t HashContent(const void* data, std::size_t length) noexcept;
+
         bool LoadStructuredDocument(
             const std::wstring& entryFile,
             SourceDocument& outDocument,
@@ -33,8 +62,18 @@ namespace themev2
             std::unordered_set<std::wstring> activeStack;
         };
 
+        // A file as it was read from disk, before its includes are spliced in
+        struct LoadedFile
+        {
+            std::wstring path;
+            ContentStamp stamp;
+            std::wstring contents;
+            std::vector<std::wstring> includes;     // lookup keys
+        };
+
         std::wstring m_baseDirectory;
         std::unordered_map<std::wstring, SourceDocument> m_cache;
+        std::unordered_map<std::wstring, LoadedFile> m_files;
 
         bool LoadDocumentRecursive(
             const std::wstring& absolutePath,
@@ -45,6 +84,7 @@ namespace themev2
         bool LoadDocumentFromDisk(
             const std::wstring& absolutePath,
             std::wstring& outContents,
+            ContentStamp& outStamp,
             std::vector<Diagnostic>& diagnostics) const;
 
         bool ProcessFileContent(
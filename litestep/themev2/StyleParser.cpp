@@ -0,0 +1,500 @@
+#include "StyleParser.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        // Name token, '(' and ')' of one link of a call chain
+        struct CallTokens
+        {
+            std::size_t name;
+            std::size_t open;
+            std::size_t close;
+        };
+    }
+
+    StyleParser::StyleParser(const SourceDocument& document, std::vector<Diagnostic>& diagnostics)
+        : m_document(document), m_lexer(document), m_diagnostics(diagnostics), m_tokens(), m_cursor(0),
+          m_output(nullptr), m_selectors()
+    {
+        for (;;)
+        {
+            m_tokens.push_back(m_lexer.NextToken());
+            if (m_tokens.back().type == TokenType::EndOfFile)
+            {
+                break;
+            }
+        }
+    }
+
+    StyleSheet StyleParser::Parse()
+    {
+        StyleSheet sheet;
+        m_output = &sheet;
+        m_cursor = 0;
+
+        while (!IsAtEnd())
+        {
+            if (IsDirective())
+            {
+                SkipLine();
+                continue;
+            }
+
+            ParseRule();
+        }
+
+        m_output = nullptr;
+        return sheet;
+    }
+
+    const Token& StyleParser::Current() const
+    {
+        return m_tokens[m_cursor];
+    }
+
+    const Token& StyleParser::Next() const
+    {
+        return m_tokens[std::min(m_cursor + 1, m_tokens.size() - 1)];
+    }
+
+    void StyleParser::Advance()
+    {
+        if (!IsAtEnd())
+        {
+            ++m_cursor;
+        }
+    }
+
+    bool StyleParser::IsAtEnd() const
+    {
+        return Current().type == TokenType::EndOfFile;
+    }
+
+    void StyleParser::ParseRule()
+    {
+        m_selectors.clear();
+
+        for (;;)
+        {
+            StyleRuleRecord selector = {};
+            selector.location = Current().Position();
+
+            if (!ParseSelector(selector))
+            {
+                SkipBlock();
+                return;
+            }
+
+            m_selectors.push_back(selector);
+
+            if (Current().type != TokenType::Comma)
+            {
+                break;
+            }
+
+            Advance();
+        }
+
+        if (Current().type != TokenType::LBrace)
+        {
+            ReportError(Current(), L"Expected '{' after style selector.");
+            SkipBlock();
+            return;
+        }
+
+        Advance();
+
+        const ThemeIndex first = static_cast<ThemeIndex>(m_output->declarations.size());
+
+        while (!IsAtEnd() && Current().type != TokenType::RBrace)
+        {
+            ParseDeclaration();
+        }
+
+        if (IsAtEnd())
+        {
+            ReportError(Current(), L"Expected '}' to close style rule.");
+        }
+        else
+        {
+            Advance();
+        }
+
+        IndexRange declarations = { first, static_cast<ThemeIndex>(m_output->declarations.size()) - first };
+        for (StyleRuleRecord& selector : m_selectors)
+        {
+            selector.declarations = declarations;
+            m_output->rules.push_back(selector);
+        }
+    }
+
+    bool StyleParser::ParseSelector(StyleRuleRecord& selector)
+    {
+        const ThemeIndex classMark = static_cast<ThemeIndex>(m_output->classes.size());
+        bool parsed = false;
+
+        for (;;)
+        {
+            const Token& token = Current();
+
+            if ((token.type == TokenType::Hash || token.type == TokenType::Dot) &&
+                Next().type == TokenType::Identifier)
+            {
+                if (token.type == TokenType::Dot)
+                {
+                    m_output->classes.push_back(AddTokenText(Next()));
+                }
+                else if (selector.id.length != 0)
+                {
+                    ReportError(token, L"A style selector can have only one id.");
+                    return false;
+                }
+                else
+                {
+                    selector.id = AddTokenText(Next());
+                }
+
+                Advance();
+            }
+            else if (token.type == TokenType::Identifier && !parsed)
+            {
+                if (!m_lexer.TextEquals(token, L"all"))
+                {
+                    selector.component = AddTokenText(token);
+                }
+            }
+            else if (token.type != TokenType::Star || parsed)
+            {
+                break;
+            }
+
+            Advance();
+            parsed = true;
+        }
+
+        if (!parsed)
+        {
+            ReportError(Current(), L"Expected a style selector.");
+            return false;
+        }
+
+        selector.classes.first = classMark;
+        selector.classes.count = static_cast<ThemeIndex>(m_output->classes.size()) - classMark;
+        selector.specificity = StyleSpecificity(selector.id.length != 0, selector.classes.count,
+            selector.component.length != 0);
+        return true;
+    }
+
+    void StyleParser::ParseDeclaration()
+    {
+        const Token& nameToken = Current();
+
+        if (nameToken.type != TokenType::Identifier || Next().type != TokenType::Equals)
+        {
+            ReportError(nameToken, L"Expected 'property = value' in style rule.");
+
+            Advance();
+            while (!IsAtEnd() && Current().type != TokenType::RBrace && !StartsLine(m_cursor))
+            {
+                Advance();
+            }
+            return;
+        }
+
+        StyleDeclarationRecord declaration = {};
+        declaration.property = AddTokenText(nameToken);
+        declaration.location = nameToken.Position();
+
+        Advance();
+        Advance();
+
+        const std::size_t first = m_cursor;
+        bool separator = false;
+        int depth = 0;
+
+        while (!IsAtEnd())
+        {
+            const Token& token = Current();
+
+            if (depth == 0)
+            {
+                if (token.type == TokenType::RBrace)
+                {
+                    break;
+                }
+
+                if (token.type == TokenType::Unknown && m_document.content[token.startOffset] == L';')
+                {
+                    separator = true;
+                    break;
+                }
+
+                // A chain may go on on the next line, as long as the line
+                // break is next to a '.' or a ','
+                if (m_cursor > first && StartsLine(m_cursor) && token.type != TokenType::Dot &&
+                    m_tokens[m_cursor - 1].type != TokenType::Dot &&
+                    m_tokens[m_cursor - 1].type != TokenType::Comma)
+                {
+                    break;
+                }
+            }
+
+            if (token.type == TokenType::LParen)
+            {
+                ++depth;
+            }
+            else if (token.type == TokenType::RParen && depth > 0)
+            {
+                --depth;
+            }
+
+            Advance();
+        }
+
+        const std::size_t last = m_cursor;
+
+        if (first == last)
+        {
+            ReportError(nameToken, L"Expected a value after '='.");
+        }
+        else if (last - first == 1 && m_tokens[first].type == TokenType::String)
+        {
+            declaration.value.offset = static_cast<std::uint32_t>(m_output->strings.length());
+            m_lexer.AppendStringValue(m_tokens[first], m_output->strings);
+            declaration.value.length = static_cast<std::uint32_t>(m_output->strings.length() - declaration.value.offset);
+            m_output->strings.push_back(L'\0');
+        }
+        else
+        {
+            const Token& lastToken = m_tokens[last - 1];
+            declaration.value = AddValueText(m_tokens[first].startOffset, lastToken.startOffset + lastToken.length);
+            ParseCalls(first, last, declaration);
+        }
+
+        m_output->declarations.push_back(declaration);
+
+        if (separator)
+        {
+            Advance();
+        }
+    }
+
+    // Splits name(...).name(...) into its calls. Anything else is left as
+    // a plain value, with no calls.
+    void StyleParser::ParseCalls(std::size_t first, std::size_t last, StyleDeclarationRecord& declaration)
+    {
+        std::vector<CallTokens> chain;
+        std::size_t index = first;
+
+        for (;;)
+        {
+            if (index + 1 >= last || m_tokens[index].type != TokenType::Identifier ||
+                m_tokens[index + 1].type != TokenType::LParen)
+            {
+                return;
+            }
+
+            CallTokens call = { index, index + 1, 0 };
+
+            int depth = 0;
+            for (std::size_t scan = call.open; scan < last && call.close == 0; ++scan)
+            {
+                if (m_tokens[scan].type == TokenType::LParen)
+                {
+                    ++depth;
+                }
+                else if (m_tokens[scan].type == TokenType::RParen && --depth == 0)
+                {
+                    call.close = scan;
+                }
+            }
+
+            if (call.close == 0)
+            {
+                return;
+            }
+
+            chain.push_back(call);
+            index = call.close + 1;
+
+            if (index == last)
+            {
+                break;
+            }
+
+            if (m_tokens[index].type != TokenType::Dot)
+            {
+                return;
+            }
+
+            ++index;
+        }
+
+        declaration.calls.first = static_cast<ThemeIndex>(m_output->calls.size());
+        declaration.calls.count = static_cast<ThemeIndex>(chain.size());
+
+        for (const CallTokens& call : chain)
+        {
+            StyleCallRecord record = {};
+            record.name = AddTokenText(m_tokens[call.name]);
+
+            if (call.close > call.open + 1)
+            {
+                const Token& lastArgument = m_tokens[call.close - 1];
+                record.arguments = AddValueText(m_tokens[call.open + 1].startOffset,
+                    lastArgument.startOffset + lastArgument.length);
+            }
+
+            m_output->calls.push_back(record);
+        }
+    }
+
+    // #name that does not go on as a selector, like #lstheme
+    bool StyleParser::IsDirective() const
+    {
+        if (Current().type != TokenType::Hash || Next().type != TokenType::Identifier)
+        {
+            return false;
+        }
+
+        const TokenType type = m_tokens[std::min(m_cursor + 2, m_tokens.size() - 1)].type;
+        return type != TokenType::LBrace && type != TokenType::Comma &&
+            type != TokenType::Dot && type != TokenType::Hash;
+    }
+
+    bool StyleParser::StartsLine(std::size_t index) const
+    {
+        if (index == 0)
+        {
+            return true;
+        }
+
+        const Token& previous = m_tokens[index - 1];
+        const std::size_t start = std::min(previous.startOffset + previous.length, m_document.content.length());
+        const std::size_t end = std::min(m_tokens[index].startOffset, m_document.content.length());
+
+        return start < end && m_document.content.find(L'\n', start) < end;
+    }
+
+    void StyleParser::SkipLine()
+    {
+        Advance();
+        while (!IsAtEnd() && !StartsLine(m_cursor))
+        {
+            Advance();
+        }
+    }
+
+    // Skips to the end of the current rule, or to the next line if the
+    // rule never opened a block
+    void StyleParser::SkipBlock()
+    {
+        const std::size_t start = m_cursor;
+
+        while (!IsAtEnd() && Current().type != TokenType::LBrace)
+        {
+            if (m_cursor > start && StartsLine(m_cursor))
+            {
+                return;
+            }
+
+            Advance();
+        }
+
+        int depth = 0;
+        while (!IsAtEnd())
+        {
+            const TokenType type = Current().type;
+            Advance();
+
+            if (type == TokenType::LBrace)
+            {
+                ++depth;
+            }
+            else if (type == TokenType::RBrace && --depth == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    StringRef StyleParser::AddTokenText(const Token& token)
+    {
+        return AddSourceText(token.startOffset, token.startOffset + token.length);
+    }
+
+    StringRef StyleParser::AddSourceText(std::size_t startOffset, std::size_t endOffset)
+    {
+        endOffset = std::min(endOffset, m_document.content.length());
+        if (startOffset >= endOffset)
+        {
+            return m_output->AddString(nullptr, 0);
+        }
+
+        return m_output->AddString(m_document.content.c_str() + startOffset, endOffset - startOffset);
+    }
+
+    // Source text with the line breaks of a value that goes on over several
+    // lines taken out, and any other run of whitespace made a single space
+    StringRef StyleParser::AddValueText(std::size_t startOffset, std::size_t endOffset)
+    {
+        const std::wstring& content = m_document.content;
+        endOffset = std::min(endOffset, content.length());
+
+        const StringRef text = AddSourceText(startOffset, endOffset);
+        if (content.find(L'\n', startOffset) >= endOffset)
+        {
+            return text;
+        }
+
+        // Rewritten in place, the text only gets shorter
+        wchar_t* output = &m_output->strings[text.offset];
+        const wchar_t* input = output;
+        const wchar_t* const end = input + text.length;
+
+        while (input < end)
+        {
+            if (!iswspace(*input))
+            {
+                *output++ = *input++;
+                continue;
+            }
+
+            bool lineBreak = false;
+            while (input < end && iswspace(*input))
+            {
+                lineBreak = lineBreak || *input == L'\n';
+                ++input;
+            }
+
+            if (!lineBreak)
+            {
+                *output++ = L' ';
+            }
+        }
+
+        const std::size_t length = output - &m_output->strings[text.offset];
+        m_output->strings.resize(text.offset + length);
+        m_output->strings.push_back(L'\0');
+
+        StringRef normalized = { text.offset, static_cast<std::uint32_t>(length) };
+        return normalized;
+    }
+
+    void StyleParser::ReportError(const Token& token, const std::wstring& message)
+    {
+        Diagnostic diagnostic;
+        diagnostic.severity = DiagnosticSeverity::Error;
+        diagnostic.message = message;
+        diagnostic.location = m_document.Locate(token.startOffset);
+        m_diagnostics.push_back(diagnostic);
+    }
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Lexer.h"
+#include "StyleSheet.h"
+
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // Parses a spliced .lsxstyle document. A declaration ends at the end of
+    // its line, unless a parenthesis is still open or the next line goes on
+    // with ".call()". Other #directives are skipped.
+    class StyleParser
+    {
+    public:
+        StyleParser(const SourceDocument& document, std::vector<Diagnostic>& diagnostics);
+
+        StyleSheet Parse();
+
+    private:
+        const SourceDocument& m_document;
+        Lexer m_lexer;
+        std::vector<Diagnostic>& m_diagnostics;
+        // Style files are small, so they are read in one go
+        std::vector<Token> m_tokens;
+        std::size_t m_cursor;
+
+        StyleSheet* m_output;
+        std::vector<StyleRuleRecord> m_selectors;
+
+        const Token& Current() const;
+        const Token& Next() const;
+        void Advance();
+        bool IsAtEnd() const;
+
+        void ParseRule();
+        bool ParseSelector(StyleRuleRecord& selector);
+        void ParseDeclaration();
+        void ParseCalls(std::size_t first, std::size_t last, StyleDeclarationRecord& declaration);
+
+        bool IsDirective() const;
+        bool StartsLine(std::size_t index) const;
+        void SkipLine();
+        void SkipBlock();
+
+        StringRef AddTokenText(const Token& token);
+        StringRef AddSourceText(std::size_t startOffset, std::size_t endOffset);
+        StringRef AddValueText(std::size_t startOffset, std::size_t endOffset);
+        void ReportError(const Token& token, const std::wstring& message);
+    };
+}
+}
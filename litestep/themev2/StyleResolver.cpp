@@ -0,0 +1,298 @@
+#include "StyleResolver.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        void AssignLower(std::wstring& target, const wchar_t* text, std::size_t length)
+        {
+            target.assign(text, length);
+            for (wchar_t& ch : target)
+            {
+                ch = static_cast<wchar_t>(std::towlower(ch));
+            }
+        }
+
+        std::wstring ToLower(const StyleSheet& sheet, const StringRef& ref)
+        {
+            std::wstring lower;
+            AssignLower(lower, sheet.String(ref), ref.length);
+            return lower;
+        }
+
+        // Adds a lower-cased name to a list, unless it is empty or listed
+        void AddName(std::vector<std::wstring>& names, std::size_t& count, const wchar_t* text)
+        {
+            const std::size_t length = std::wcslen(text);
+            if (length == 0)
+            {
+                return;
+            }
+
+            if (names.size() <= count)
+            {
+                names.resize(count + 1);
+            }
+
+            AssignLower(names[count], text, length);
+
+            if (std::find(names.begin(), names.begin() + count, names[count]) == names.begin() + count)
+            {
+                ++count;
+            }
+        }
+
+        void AppendNames(std::wstring& key, const std::vector<std::wstring>& names,
+            const std::unordered_set<std::wstring>& known)
+        {
+            for (const std::wstring& name : names)
+            {
+                if (known.count(name) != 0)
+                {
+                    key.append(name);
+                    key.push_back(L'\x2');
+                }
+            }
+        }
+    }
+
+    StyleResolver::StyleResolver(const StyleSheet& sheet)
+        : m_sheet(sheet)
+    {
+        m_rules.reserve(sheet.rules.size());
+
+        for (ThemeIndex index = 0; index < sheet.rules.size(); ++index)
+        {
+            const StyleRuleRecord& record = sheet.rules[index];
+
+            IndexedRule rule;
+            rule.component = ToLower(sheet, record.component);
+            rule.id = ToLower(sheet, record.id);
+
+            for (ThemeIndex classIndex = 0; classIndex < record.classes.count; ++classIndex)
+            {
+                rule.classes.push_back(ToLower(sheet, sheet.classes[record.classes.first + classIndex]));
+                m_knownClasses.insert(rule.classes.back());
+            }
+
+            if (!rule.id.empty())
+            {
+                m_knownIds.insert(rule.id);
+                m_byId[rule.id].push_back(index);
+            }
+            else if (!rule.classes.empty())
+            {
+                m_byClass[rule.classes.front()].push_back(index);
+            }
+            else if (!rule.component.empty())
+            {
+                m_byComponent[rule.component].push_back(index);
+            }
+            else
+            {
+                m_universal.push_back(index);
+            }
+
+            m_rules.push_back(std::move(rule));
+        }
+    }
+
+    const StyleSheet& StyleResolver::Sheet() const noexcept
+    {
+        return m_sheet;
+    }
+
+    ThemeIndex StyleResolver::Resolve(NodeView node)
+    {
+        const wchar_t* component = node.Component();
+        AssignLower(m_component, component, std::wcslen(component));
+
+        std::size_t idCount = 0;
+        AddName(m_ids, idCount, node.Id());
+        AddName(m_ids, idCount, node.Name());
+
+        AttributeView styleAttribute(nullptr, 0);
+        if (node.FindAttribute(L"style", &styleAttribute) &&
+            (styleAttribute.Value().Kind() == ValueKind::String || styleAttribute.Value().Kind() == ValueKind::Identifier))
+        {
+            AddName(m_ids, idCount, styleAttribute.Value().Text());
+        }
+
+        m_ids.resize(idCount);
+
+        std::size_t classCount = 0;
+        for (ClassView nodeClass : node.Classes())
+        {
+            AddName(m_classes, classCount, nodeClass.Name());
+        }
+
+        m_classes.resize(classCount);
+        std::sort(m_classes.begin(), m_classes.end());
+        std::sort(m_ids.begin(), m_ids.end());
+
+        m_key.assign(m_component);
+        m_key.push_back(L'\x1');
+        AppendNames(m_key, m_ids, m_knownIds);
+        m_key.push_back(L'\x1');
+        AppendNames(m_key, m_classes, m_knownClasses);
+
+        auto memo = m_memo.find(m_key);
+        if (memo != m_memo.end())
+        {
+            return memo->second;
+        }
+
+        const ThemeIndex style = Cascade();
+        m_memo.emplace(m_key, style);
+        return style;
+    }
+
+    std::vector<ThemeIndex> StyleResolver::ResolveAll(const ThemeDocument& document)
+    {
+        std::vector<ThemeIndex> styles(document.NodeCount(), InvalidThemeIndex);
+
+        for (ThemeIndex index = 0; index < styles.size(); ++index)
+        {
+            styles[index] = Resolve(document.Node(index));
+        }
+
+        return styles;
+    }
+
+    std::size_t StyleResolver::StyleCount() const noexcept
+    {
+        return m_styles.size();
+    }
+
+    std::size_t StyleResolver::DeclarationCount(ThemeIndex style) const noexcept
+    {
+        return m_styles[style].count;
+    }
+
+    const StyleDeclarationRecord& StyleResolver::Declaration(ThemeIndex style, std::size_t index) const noexcept
+    {
+        return m_sheet.declarations[m_declarations[m_styles[style].first + index]];
+    }
+
+    // Styles have a handful of properties, a scan beats a lookup structure
+    const StyleDeclarationRecord* StyleResolver::Find(ThemeIndex style, const wchar_t* property) const noexcept
+    {
+        for (std::size_t index = 0; index < m_styles[style].count; ++index)
+        {
+            const StyleDeclarationRecord& declaration = Declaration(style, index);
+            if (_wcsicmp(m_sheet.String(declaration.property), property) == 0)
+            {
+                return &declaration;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool StyleResolver::Matches(const IndexedRule& rule) const
+    {
+        if (!rule.component.empty() && rule.component != m_component)
+        {
+            return false;
+        }
+
+        if (!rule.id.empty() && std::find(m_ids.begin(), m_ids.end(), rule.id) == m_ids.end())
+        {
+            return false;
+        }
+
+        for (const std::wstring& ruleClass : rule.classes)
+        {
+            if (!std::binary_search(m_classes.begin(), m_classes.end(), ruleClass))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void StyleResolver::AddCandidates(const RuleBuckets& buckets, const std::wstring& name)
+    {
+        auto bucket = buckets.find(name);
+        if (bucket == buckets.end())
+        {
+            return;
+        }
+
+        for (ThemeIndex rule : bucket->second)
+        {
+            if (Matches(m_rules[rule]))
+            {
+                m_candidates.push_back(rule);
+            }
+        }
+    }
+
+    // Applies the matching rules from the weakest to the strongest, the
+    // last declaration of a property wins
+    ThemeIndex StyleResolver::Cascade()
+    {
+        m_candidates.assign(m_universal.begin(), m_universal.end());
+        AddCandidates(m_byComponent, m_component);
+
+        for (const std::wstring& id : m_ids)
+        {
+            AddCandidates(m_byId, id);
+        }
+
+        for (const std::wstring& nodeClass : m_classes)
+        {
+            AddCandidates(m_byClass, nodeClass);
+        }
+
+        // Every rule sits in one bucket and the names are distinct, so
+        // there are no duplicates to remove
+        std::sort(m_candidates.begin(), m_candidates.end(),
+            [this](ThemeIndex left, ThemeIndex right)
+            {
+                const std::uint32_t leftSpecificity = m_sheet.rules[left].specificity;
+                const std::uint32_t rightSpecificity = m_sheet.rules[right].specificity;
+                return leftSpecificity != rightSpecificity ? leftSpecificity < rightSpecificity : left < right;
+            });
+
+        m_winners.clear();
+
+        for (ThemeIndex rule : m_candidates)
+        {
+            const IndexRange& declarations = m_sheet.rules[rule].declarations;
+            for (ThemeIndex index = declarations.first; index < declarations.first + declarations.count; ++index)
+            {
+                m_winners.push_back(std::make_pair(ToLower(m_sheet, m_sheet.declarations[index].property), index));
+            }
+        }
+
+        // Stable, so the later of two declarations stays last
+        std::stable_sort(m_winners.begin(), m_winners.end(),
+            [](const std::pair<std::wstring, ThemeIndex>& left, const std::pair<std::wstring, ThemeIndex>& right)
+            {
+                return left.first < right.first;
+            });
+
+        IndexRange style = { static_cast<ThemeIndex>(m_declarations.size()), 0 };
+
+        for (std::size_t index = 0; index < m_winners.size(); ++index)
+        {
+            if (index + 1 == m_winners.size() || m_winners[index].first != m_winners[index + 1].first)
+            {
+                m_declarations.push_back(m_winners[index].second);
+                ++style.count;
+            }
+        }
+
+        m_styles.push_back(style);
+        return static_cast<ThemeIndex>(m_styles.size() - 1);
+    }
+}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "StyleSheet.h"
+#include "ThemeDocument.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // Resolves the cascade of a style sheet for the nodes of a theme.
+    //
+    // Every rule is filed once, under the most selective part of its
+    // selector, in hashed buckets for ids, classes and components, so a
+    // node only looks at the rules filed under its own names. A "#name"
+    // selector matches a node's id, its name and its style attribute,
+    // ignoring case like the rest of the selector.
+    //
+    // Resolved styles are memoized by the parts of a node that some rule
+    // can match: its component and, of its ids and classes, those that a
+    // selector mentions. Nodes that only differ in names no rule uses, such
+    // as thousands of buttons sharing their classes, resolve once.
+    class StyleResolver
+    {
+    public:
+        // The sheet has to outlive the resolver
+        explicit StyleResolver(const StyleSheet& sheet);
+
+        const StyleSheet& Sheet() const noexcept;
+
+        // Index of the node's resolved style
+        ThemeIndex Resolve(NodeView node);
+
+        // The resolved style of every node of a document, by node index
+        std::vector<ThemeIndex> ResolveAll(const ThemeDocument& document);
+
+        // Number of distinct resolved styles so far
+        std::size_t StyleCount() const noexcept;
+
+        // The winning declaration of each property, ordered by property
+        std::size_t DeclarationCount(ThemeIndex style) const noexcept;
+        const StyleDeclarationRecord& Declaration(ThemeIndex style, std::size_t index) const noexcept;
+
+        // The winning declaration of a property (case-insensitive), if any
+        const StyleDeclarationRecord* Find(ThemeIndex style, const wchar_t* property) const noexcept;
+
+    private:
+        StyleResolver(const StyleResolver&);
+        StyleResolver& operator=(const StyleResolver&);
+
+        // A rule with its selector in lower case
+        struct IndexedRule
+        {
+            std::wstring component;
+            std::wstring id;
+            std::vector<std::wstring> classes;
+        };
+
+        typedef std::unordered_map<std::wstring, std::vector<ThemeIndex>> RuleBuckets;
+
+        bool Matches(const IndexedRule& rule) const;
+        void AddCandidates(const RuleBuckets& buckets, const std::wstring& name);
+        ThemeIndex Cascade();
+
+        const StyleSheet& m_sheet;
+        std::vector<IndexedRule> m_rules;
+
+        RuleBuckets m_byId;
+        RuleBuckets m_byClass;
+        RuleBuckets m_byComponent;
+        std::vector<ThemeIndex> m_universal;
+
+        // Every name any selector mentions, in any part
+        std::unordered_set<std::wstring> m_knownIds;
+        std::unordered_set<std::wstring> m_knownClasses;
+
+        std::unordered_map<std::wstring, ThemeIndex> m_memo;
+        std::vector<ThemeIndex> m_declarations;     // into m_sheet.declarations
+        std::vector<IndexRange> m_styles;           // into m_declarations
+
+        // The node being resolved, reused between nodes
+        std::wstring m_component;
+        std::vector<std::wstring> m_ids;
+        std::vector<std::wstring> m_classes;
+        std::wstring m_key;
+        std::vector<ThemeIndex> m_candidates;
+        std::vector<std::pair<std::wstring, ThemeIndex>> m_winners;
+    };
+}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "ThemeDocument.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // A parsed .lsxstyle file, stored flat like ThemeDocument. The text of
+    // every record lives in StyleSheet::strings.
+    //
+    //     all { radius = 4 }
+    //     panel.glass, #topbar {
+    //        background = alpha(90).blur(30)
+    //     }
+    //
+    // A rule is written once per selector of its selector list; all of them
+    // share the declarations of the block.
+
+    // One link of a value like alpha(90).blur(30)
+    struct StyleCallRecord
+    {
+        StringRef name;
+        StringRef arguments;        // raw text between the parentheses
+    };
+
+    struct StyleDeclarationRecord
+    {
+        StringRef property;
+        // The value as written, or the text of a single string literal
+        StringRef value;
+        // Into StyleSheet::calls, empty unless the value is a call chain
+        IndexRange calls;
+        SourcePosition location;
+    };
+
+    // A compound selector: an optional component, an optional #id and any
+    // number of .classes. Every part that is present has to match; a rule
+    // without any parts ("all", "*") matches every node.
+    struct StyleRuleRecord
+    {
+        StringRef component;
+        StringRef id;
+        IndexRange classes;         // into StyleSheet::classes
+        IndexRange declarations;    // into StyleSheet::declarations
+        std::uint32_t specificity;
+        SourcePosition location;
+    };
+
+    // Ids outweigh any number of classes, which outweigh a component.
+    // Ties go to the rule written last.
+    inline std::uint32_t StyleSpecificity(bool hasId, std::uint32_t classCount, bool hasComponent) noexcept
+    {
+        return (hasId ? 0x10000u : 0u) | ((classCount < 0x7FFFu ? classCount : 0x7FFFu) << 1) |
+            (hasComponent ? 1u : 0u);
+    }
+
+    class StyleSheet
+    {
+    public:
+        StyleSheet();
+
+        const wchar_t* String(const StringRef& ref) const noexcept;
+
+        // Copies text into the pool
+        StringRef AddString(const wchar_t* text, std::size_t length);
+
+        void Clear();
+
+        std::wstring strings;
+        std::vector<StyleRuleRecord> rules;     // in source order
+        std::vector<StringRef> classes;
+        std::vector<StyleDeclarationRecord> declarations;
+        std::vector<StyleCallRecord> calls;
+    };
+
+    inline StyleSheet::StyleSheet()
+    {
+        // Offset 0 is the empty string, for fields that were never set
+        strings.push_back(L'\0');
+    }
+
+    inline const wchar_t* StyleSheet::String(const StringRef& ref) const noexcept
+    {
+        return strings.c_str() + ref.offset;
+    }
+
+    inline StringRef StyleSheet::AddString(const wchar_t* text, std::size_t length)
+    {
+        if (length == 0)
+        {
+            StringRef empty = { 0, 0 };
+            return empty;
+        }
+
+        StringRef ref = { static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(length) };
+        strings.append(text, length);
+        strings.push_back(L'\0');
+        return ref;
+    }
+
+    inline void StyleSheet::Clear()
+    {
+        *this = StyleSheet();
+    }
+}
+}
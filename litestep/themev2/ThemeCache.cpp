@@ -0,0 +1,426 @@
+#include "ThemeCache.h"
+
+#include "../utility/logger.h"
+
+#include <Windows.h>
+#include <Shlwapi.h>
+#include <strsafe.h>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        const std::uint32_t CacheMagic = 0x4358534C;  // "LSXC"
+
+        // Bump whenever the parser or the records change what a document
+        // looks like, so older caches are rebuilt
+        const std::uint16_t CacheVersion = 2;
+
+        enum Section
+        {
+            SectionFiles,
+            SectionPaths,
+            SectionStrings,
+            SectionNodes,
+            SectionClasses,
+            SectionAttributes,
+            SectionValues,
+            SectionProperties,
+            SectionDirectives,
+            SectionStyleStrings,
+            SectionStyleRules,
+            SectionStyleClasses,
+            SectionStyleDeclarations,
+            SectionStyleCalls,
+            SectionCount
+        };
+
+        // The records are stored as they are in memory. recordSize catches
+        // a cache written by a build with a different layout, e.g. x86 and
+        // x64 sharing a theme folder.
+        struct SectionHeader
+        {
+            std::uint64_t offset;
+            std::uint32_t count;
+            std::uint32_t recordSize;
+        };
+
+        struct CacheHeader
+        {
+            std::uint32_t magic;
+            std::uint16_t version;
+            std::uint16_t headerSize;
+            std::uint64_t totalSize;
+            std::uint64_t checksum;     // of everything after the header
+            IndexRange roots;
+            std::uint32_t structureFiles;   // the first ones in SectionFiles, the rest are styles
+            SectionHeader sections[SectionCount];
+        };
+
+        struct FileEntry
+        {
+            std::uint64_t size;
+            std::uint64_t hash;
+            std::uint32_t pathOffset;   // into SectionPaths, in characters
+            std::uint32_t pathLength;
+        };
+
+        template <typename T>
+        void AppendSection(std::vector<unsigned char>& image, CacheHeader& header, Section section,
+            const T* records, std::size_t count)
+        {
+            // Every section starts 8-byte aligned, so the records can be
+            // read in place
+            image.resize((image.size() + 7) & ~static_cast<std::size_t>(7));
+
+            header.sections[section].offset = image.size();
+            header.sections[section].count = static_cast<std::uint32_t>(count);
+            header.sections[section].recordSize = sizeof(T);
+
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(records);
+            image.insert(image.end(), bytes, bytes + count * sizeof(T));
+        }
+
+        template <typename T>
+        const T* SectionData(const unsigned char* image, const CacheHeader& header, Section section)
+        {
+            return reinterpret_cast<const T*>(image + header.sections[section].offset);
+        }
+
+        template <typename T>
+        bool IsValidSection(const CacheHeader& header, Section section)
+        {
+            const SectionHeader& entry = header.sections[section];
+            return entry.recordSize == sizeof(T) &&
+                (entry.offset % 8) == 0 &&
+                entry.offset >= sizeof(CacheHeader) &&
+                entry.offset <= header.totalSize &&
+                static_cast<std::uint64_t>(entry.count) * sizeof(T) <= header.totalSize - entry.offset;
+        }
+
+        // The files of a source, stamped by the SourceManager that loaded it
+        bool AppendFiles(const SourceDocument& source, const SourceManager& sourceManager,
+            std::vector<FileEntry>& files, std::wstring& paths)
+        {
+            for (const std::wstring& path : source.files)
+            {
+                ContentStamp stamp;
+                if (!sourceManager.LoadedStamp(path, stamp))
+                {
+                    return false;
+                }
+
+                FileEntry entry = { stamp.size, stamp.hash,
+                    static_cast<std::uint32_t>(paths.length()), static_cast<std::uint32_t>(path.length()) };
+                files.push_back(entry);
+                paths.append(path);
+            }
+
+            return true;
+        }
+
+        template <typename T>
+        void ReadSection(const unsigned char* image, const CacheHeader& header, Section section,
+            std::vector<T>& records)
+        {
+            const T* first = SectionData<T>(image, header, section);
+            records.assign(first, first + header.sections[section].count);
+        }
+
+        class MappedFile
+        {
+        public:
+            MappedFile() : m_view(nullptr), m_size(0)
+            {
+            }
+
+            ~MappedFile()
+            {
+                if (m_view != nullptr)
+                {
+                    UnmapViewOfFile(m_view);
+                }
+            }
+
+            bool Open(const std::wstring& path)
+            {
+                HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                {
+                    return false;
+                }
+
+                LARGE_INTEGER size = { 0 };
+                HANDLE mapping = nullptr;
+
+                if (GetFileSizeEx(file, &size) && size.QuadPart >= static_cast<LONGLONG>(sizeof(CacheHeader)))
+                {
+                    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                }
+
+                if (mapping != nullptr)
+                {
+                    m_view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                    m_size = static_cast<std::uint64_t>(size.QuadPart);
+                    CloseHandle(mapping);
+                }
+
+                CloseHandle(file);
+                return m_view != nullptr;
+            }
+
+            const unsigned char* Data() const noexcept
+            {
+                return m_view;
+            }
+
+            std::uint64_t Size() const noexcept
+            {
+                return m_size;
+            }
+
+        private:
+            MappedFile(const MappedFile&);
+            MappedFile& operator=(const MappedFile&);
+
+            const unsigned char* m_view;
+            std::uint64_t m_size;
+        };
+
+        bool WriteWholeFile(const std::wstring& path, const std::vector<unsigned char>& image)
+        {
+            // Written to the side first, a cache that is there is complete
+            const std::wstring tempPath = path + L".tmp";
+
+            HANDLE file = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+
+            DWORD written = 0;
+            const bool success = WriteFile(file, image.data(), static_cast<DWORD>(image.size()), &written, nullptr) &&
+                written == image.size();
+
+            CloseHandle(file);
+
+            if (!success || !MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+            {
+                DeleteFileW(tempPath.c_str());
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    ThemeCache::ThemeCache(std::wstring cachePath)
+        : m_path(std::move(cachePath))
+    {
+    }
+
+    const std::wstring& ThemeCache::Path() const noexcept
+    {
+        return m_path;
+    }
+
+    bool ThemeCache::Load(SourceDocument& outSource, ThemeDocument& outDocument,
+        SourceDocument& outStyleSource, StyleSheet& outStyles) const
+    {
+        MappedFile mapped;
+        if (!mapped.Open(m_path))
+        {
+            return false;
+        }
+
+        const unsigned char* image = mapped.Data();
+
+        CacheHeader header;
+        memcpy(&header, image, sizeof(header));
+
+        if (header.magic != CacheMagic ||
+            header.version != CacheVersion ||
+            header.headerSize != sizeof(CacheHeader) ||
+            header.totalSize != mapped.Size())
+        {
+            LS_LOG_DEBUG(ThemeEngineV2, L"ThemeEngineV2: ignoring cache '%ls', it is from another version or truncated.", m_path.c_str());
+            return false;
+        }
+
+        if (header.checksum != SourceManager::HashContent(image + sizeof(header),
+            static_cast<std::size_t>(header.totalSize - sizeof(header))))
+        {
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: cache '%ls' is damaged.", m_path.c_str());
+            return false;
+        }
+
+        if (!IsValidSection<FileEntry>(header, SectionFiles) ||
+            !IsValidSection<wchar_t>(header, SectionPaths) ||
+            !IsValidSection<wchar_t>(header, SectionStrings) ||
+            !IsValidSection<NodeRecord>(header, SectionNodes) ||
+            !IsValidSection<StringRef>(header, SectionClasses) ||
+            !IsValidSection<AttributeRecord>(header, SectionAttributes) ||
+            !IsValidSection<ValueRecord>(header, SectionValues) ||
+            !IsValidSection<PropertyRecord>(header, SectionProperties) ||
+            !IsValidSection<DirectiveRecord>(header, SectionDirectives) ||
+            !IsValidSection<wchar_t>(header, SectionStyleStrings) ||
+            !IsValidSection<StyleRuleRecord>(header, SectionStyleRules) ||
+            !IsValidSection<StringRef>(header, SectionStyleClasses) ||
+            !IsValidSection<StyleDeclarationRecord>(header, SectionStyleDeclarations) ||
+            !IsValidSection<StyleCallRecord>(header, SectionStyleCalls) ||
+            header.structureFiles == 0 ||
+            header.structureFiles > header.sections[SectionFiles].count ||
+            header.sections[SectionStrings].count == 0 ||
+            header.sections[SectionStyleStrings].count == 0 ||
+            header.roots.first + static_cast<std::uint64_t>(header.roots.count) > header.sections[SectionNodes].count)
+        {
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: cache '%ls' has an invalid layout.", m_path.c_str());
+            return false;
+        }
+
+        // Every file must still be what it was when the cache was built
+        const FileEntry* files = SectionData<FileEntry>(image, header, SectionFiles);
+        const wchar_t* paths = SectionData<wchar_t>(image, header, SectionPaths);
+        const std::uint32_t pathsLength = header.sections[SectionPaths].count;
+
+        std::vector<std::wstring> filePaths;
+        filePaths.reserve(header.sections[SectionFiles].count);
+
+        for (std::uint32_t index = 0; index < header.sections[SectionFiles].count; ++index)
+        {
+            const FileEntry& entry = files[index];
+            if (entry.pathOffset > pathsLength || entry.pathLength > pathsLength - entry.pathOffset)
+            {
+                return false;
+            }
+
+            filePaths.push_back(std::wstring(paths + entry.pathOffset, entry.pathLength));
+
+            ContentStamp stamp;
+            if (!SourceManager::ReadStamp(filePaths.back(), stamp) ||
+                stamp.size != entry.size || stamp.hash != entry.hash)
+            {
+                LS_LOG_DEBUG(ThemeEngineV2, L"ThemeEngineV2: cache is out of date, '%ls' changed.",
+                    filePaths.back().c_str());
+                return false;
+            }
+        }
+
+        // One bulk copy per section, see the class comment
+        const wchar_t* strings = SectionData<wchar_t>(image, header, SectionStrings);
+        outDocument.strings.assign(strings, header.sections[SectionStrings].count);
+        ReadSection(image, header, SectionNodes, outDocument.nodes);
+        ReadSection(image, header, SectionClasses, outDocument.classes);
+        ReadSection(image, header, SectionAttributes, outDocument.attributes);
+        ReadSection(image, header, SectionValues, outDocument.values);
+        ReadSection(image, header, SectionProperties, outDocument.properties);
+        ReadSection(image, header, SectionDirectives, outDocument.directives);
+        outDocument.roots = header.roots;
+
+        const wchar_t* styleStrings = SectionData<wchar_t>(image, header, SectionStyleStrings);
+        outStyles.strings.assign(styleStrings, header.sections[SectionStyleStrings].count);
+        ReadSection(image, header, SectionStyleRules, outStyles.rules);
+        ReadSection(image, header, SectionStyleClasses, outStyles.classes);
+        ReadSection(image, header, SectionStyleDeclarations, outStyles.declarations);
+        ReadSection(image, header, SectionStyleCalls, outStyles.calls);
+
+        outStyleSource = SourceDocument();
+        outStyleSource.files.assign(filePaths.begin() + header.structureFiles, filePaths.end());
+        if (!outStyleSource.files.empty())
+        {
+            outStyleSource.primaryFile = outStyleSource.files.front();
+        }
+
+        filePaths.resize(header.structureFiles);
+
+        outSource = SourceDocument();
+        outSource.primaryFile = filePaths.front();
+        outSource.files.swap(filePaths);
+
+        return true;
+    }
+
+    bool ThemeCache::Store(const SourceDocument& source, const ThemeDocument& document,
+        const SourceDocument& styleSource, const StyleSheet& styles,
+        const SourceManager& sourceManager) const
+    {
+        // FileIds in the records index SourceDocument::files, and Load
+        // takes the first file of each source as its primary one
+        if (source.files.empty() || source.files.front() != source.primaryFile ||
+            (!styleSource.files.empty() && styleSource.files.front() != styleSource.primaryFile))
+        {
+            return false;
+        }
+
+        std::vector<FileEntry> files;
+        std::wstring paths;
+
+        if (!AppendFiles(source, sourceManager, files, paths) ||
+            !AppendFiles(styleSource, sourceManager, files, paths))
+        {
+            return false;
+        }
+
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = CacheMagic;
+        header.version = CacheVersion;
+        header.headerSize = sizeof(CacheHeader);
+        header.roots = document.roots;
+        header.structureFiles = static_cast<std::uint32_t>(source.files.size());
+
+        std::vector<unsigned char> image(sizeof(CacheHeader));
+        AppendSection(image, header, SectionFiles, files.data(), files.size());
+        AppendSection(image, header, SectionPaths, paths.data(), paths.length());
+        AppendSection(image, header, SectionStrings, document.strings.data(), document.strings.length());
+        AppendSection(image, header, SectionNodes, document.nodes.data(), document.nodes.size());
+        AppendSection(image, header, SectionClasses, document.classes.data(), document.classes.size());
+        AppendSection(image, header, SectionAttributes, document.attributes.data(), document.attributes.size());
+        AppendSection(image, header, SectionValues, document.values.data(), document.values.size());
+        AppendSection(image, header, SectionProperties, document.properties.data(), document.properties.size());
+        AppendSection(image, header, SectionDirectives, document.directives.data(), document.directives.size());
+        AppendSection(image, header, SectionStyleStrings, styles.strings.data(), styles.strings.length());
+        AppendSection(image, header, SectionStyleRules, styles.rules.data(), styles.rules.size());
+        AppendSection(image, header, SectionStyleClasses, styles.classes.data(), styles.classes.size());
+        AppendSection(image, header, SectionStyleDeclarations, styles.declarations.data(), styles.declarations.size());
+        AppendSection(image, header, SectionStyleCalls, styles.calls.data(), styles.calls.size());
+
+        header.totalSize = image.size();
+        header.checksum = SourceManager::HashContent(image.data() + sizeof(header), image.size() - sizeof(header));
+        memcpy(image.data(), &header, sizeof(header));
+
+        if (!WriteWholeFile(m_path, image))
+        {
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: failed to write cache '%ls'.", m_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    void ThemeCache::Remove() const
+    {
+        DeleteFileW(m_path.c_str());
+    }
+
+    std::wstring ThemeCache::PathFor(const std::wstring& themeFile)
+    {
+        wchar_t buffer[MAX_PATH] = { 0 };
+        if (FAILED(StringCchCopyW(buffer, MAX_PATH, themeFile.c_str())) ||
+            !PathRenameExtensionW(buffer, L".lsxc"))
+        {
+            return themeFile + L"c";
+        }
+
+        return buffer;
+    }
+}
+}
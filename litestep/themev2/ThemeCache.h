@@ -0,0 +1,54 @@
+#pragma once
+
+#include "SourceManager.h"
+#include "StyleSheet.h"
+#include "ThemeDocument.h"
+#include "ThemeTypes.h"
+
+#include <string>
+
+namespace litestep
+{
+namespace themev2
+{
+    // A compiled theme (.lsxc): the parsed ThemeDocument and StyleSheet
+    // together with the size and content hash of every file that went into
+    // them. Loading maps the file, checks it, and re-hashes the source
+    // files; if any of them changed, or the cache was written by a
+    // different build, the caller parses the theme as usual and stores a
+    // new cache.
+    //
+    // Load copies each section out of the mapping with a single memcpy,
+    // so the document and style sheet own their memory like parsed ones
+    // and the cache file can be replaced while the theme runs. What the
+    // cache saves is the parse and the many small allocations it makes,
+    // not the copy.
+    class ThemeCache
+    {
+    public:
+        explicit ThemeCache(std::wstring cachePath);
+
+        const std::wstring& Path() const noexcept;
+
+        // On success the document and style sheet are complete, and the
+        // sources only list their files, without content. The style
+        // source lists no files if the theme had no style sheet.
+        bool Load(SourceDocument& outSource, ThemeDocument& outDocument,
+            SourceDocument& outStyleSource, StyleSheet& outStyles) const;
+
+        // Takes the file stamps from the SourceManager that loaded the
+        // sources, so they describe exactly what was parsed.
+        bool Store(const SourceDocument& source, const ThemeDocument& document,
+            const SourceDocument& styleSource, const StyleSheet& styles,
+            const SourceManager& sourceManager) const;
+
+        void Remove() const;
+
+        // theme.lsx -> theme.lsxc
+        static std::wstring PathFor(const std::wstring& themeFile);
+
+    private:
+        std::wstring m_path;
+    };
+}
+}
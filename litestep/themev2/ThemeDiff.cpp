@@ -0,0 +1,236 @@
+#include "ThemeDiff.h"
+
+#include <cwchar>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        bool SameString(const ThemeDocument& left, const StringRef& leftRef,
+            const ThemeDocument& right, const StringRef& rightRef)
+        {
+            return leftRef.length == rightRef.length &&
+                wmemcmp(left.String(leftRef), right.String(rightRef), leftRef.length) == 0;
+        }
+
+        // numberValue is parsed from text, so the text covers it
+        bool SameValue(const ThemeDocument& left, ThemeIndex leftIndex,
+            const ThemeDocument& right, ThemeIndex rightIndex)
+        {
+            const ValueRecord& leftValue = left.values[leftIndex];
+            const ValueRecord& rightValue = right.values[rightIndex];
+
+            if (leftValue.kind != rightValue.kind ||
+                leftValue.boolValue != rightValue.boolValue ||
+                leftValue.members.count != rightValue.members.count ||
+                !SameString(left, leftValue.text, right, rightValue.text))
+            {
+                return false;
+            }
+
+            for (ThemeIndex index = 0; index < leftValue.members.count; ++index)
+            {
+                if (leftValue.kind == ValueKind::Object)
+                {
+                    const PropertyRecord& leftProperty = left.properties[leftValue.members.first + index];
+                    const PropertyRecord& rightProperty = right.properties[rightValue.members.first + index];
+
+                    if (!SameString(left, leftProperty.key, right, rightProperty.key) ||
+                        !SameValue(left, leftProperty.value, right, rightProperty.value))
+                    {
+                        return false;
+                    }
+                }
+                else if (leftValue.kind == ValueKind::Array)
+                {
+                    if (!SameValue(left, leftValue.members.first + index, right, rightValue.members.first + index))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        // Compares a node itself, not its children
+        bool SameNode(const ThemeDocument& left, const NodeRecord& leftNode,
+            const ThemeDocument& right, const NodeRecord& rightNode)
+        {
+            if (!SameString(left, leftNode.component, right, rightNode.component) ||
+                !SameString(left, leftNode.id, right, rightNode.id) ||
+                !SameString(left, leftNode.name, right, rightNode.name) ||
+                leftNode.classes.count != rightNode.classes.count ||
+                leftNode.attributes.count != rightNode.attributes.count)
+            {
+                return false;
+            }
+
+            for (ThemeIndex index = 0; index < leftNode.classes.count; ++index)
+            {
+                if (!SameString(left, left.classes[leftNode.classes.first + index],
+                    right, right.classes[rightNode.classes.first + index]))
+                {
+                    return false;
+                }
+            }
+
+            for (ThemeIndex index = 0; index < leftNode.attributes.count; ++index)
+            {
+                const AttributeRecord& leftAttribute = left.attributes[leftNode.attributes.first + index];
+                const AttributeRecord& rightAttribute = right.attributes[rightNode.attributes.first + index];
+
+                if (!SameString(left, leftAttribute.name, right, rightAttribute.name) ||
+                    !SameValue(left, leftAttribute.value, right, rightAttribute.value))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool SameDirectives(const ThemeDocument& left, const ThemeDocument& right)
+        {
+            if (left.directives.size() != right.directives.size())
+            {
+                return false;
+            }
+
+            for (std::size_t index = 0; index < left.directives.size(); ++index)
+            {
+                if (!SameString(left, left.directives[index].name, right, right.directives[index].name) ||
+                    !SameString(left, left.directives[index].argument, right, right.directives[index].argument))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        class Differ
+        {
+        public:
+            Differ(const ThemeDocument& before, const ThemeDocument& after, ThemeDiff& diff)
+                : m_before(before), m_after(after), m_diff(diff)
+            {
+            }
+
+            void Children(IndexRange oldRange, IndexRange newRange, ThemeIndex newParent)
+            {
+                std::unordered_map<std::wstring, ThemeIndex> oldByKey;
+                std::unordered_map<std::wstring, unsigned> occurrences;
+
+                for (ThemeIndex index = oldRange.first; index < oldRange.first + oldRange.count; ++index)
+                {
+                    oldByKey.emplace(Key(m_before, index, occurrences), index);
+                }
+
+                occurrences.clear();
+
+                std::vector<std::pair<ThemeIndex, ThemeIndex>> matches;
+                bool reordered = false;
+                bool matchedAny = false;
+                ThemeIndex lastMatch = 0;
+
+                for (ThemeIndex index = newRange.first; index < newRange.first + newRange.count; ++index)
+                {
+                    auto match = oldByKey.find(Key(m_after, index, occurrences));
+                    if (match == oldByKey.end())
+                    {
+                        matches.push_back(std::make_pair(InvalidThemeIndex, index));
+                        continue;
+                    }
+
+                    reordered = reordered || (matchedAny && lastMatch > match->second);
+                    matchedAny = true;
+                    lastMatch = match->second;
+
+                    matches.push_back(std::make_pair(match->second, index));
+                    m_diff.nodeMap[match->second] = index;
+                }
+
+                if (reordered)
+                {
+                    Emit(NodeChangeKind::Reordered, InvalidThemeIndex, newParent);
+                }
+
+                for (const auto& match : matches)
+                {
+                    if (match.first == InvalidThemeIndex)
+                    {
+                        Emit(NodeChangeKind::Added, InvalidThemeIndex, match.second);
+                        continue;
+                    }
+
+                    const NodeRecord& oldNode = m_before.nodes[match.first];
+                    const NodeRecord& newNode = m_after.nodes[match.second];
+
+                    if (!SameNode(m_before, oldNode, m_after, newNode))
+                    {
+                        Emit(NodeChangeKind::Changed, match.first, match.second);
+                    }
+
+                    Children(oldNode.children, newNode.children, match.second);
+                }
+
+                for (ThemeIndex index = oldRange.first; index < oldRange.first + oldRange.count; ++index)
+                {
+                    if (m_diff.nodeMap[index] == InvalidThemeIndex)
+                    {
+                        Emit(NodeChangeKind::Removed, index, InvalidThemeIndex);
+                    }
+                }
+            }
+
+        private:
+            // Component and id (or name), plus the position among the
+            // siblings that share both
+            static std::wstring Key(const ThemeDocument& document, ThemeIndex index,
+                std::unordered_map<std::wstring, unsigned>& occurrences)
+            {
+                const NodeRecord& node = document.nodes[index];
+                const StringRef& identity = (node.id.length != 0) ? node.id : node.name;
+
+                std::wstring key(document.String(node.component), node.component.length);
+                key.push_back(L'\x1');
+                key.append(document.String(identity), identity.length);
+
+                const unsigned occurrence = occurrences[key]++;
+                key.push_back(L'\x2');
+                key.append(std::to_wstring(occurrence));
+                return key;
+            }
+
+            void Emit(NodeChangeKind kind, ThemeIndex oldNode, ThemeIndex newNode)
+            {
+                NodeChange change = { kind, oldNode, newNode };
+                m_diff.changes.push_back(change);
+            }
+
+            const ThemeDocument& m_before;
+            const ThemeDocument& m_after;
+            ThemeDiff& m_diff;
+        };
+    }
+
+    ThemeDiff DiffDocuments(const ThemeDocument& before, const ThemeDocument& after)
+    {
+        ThemeDiff diff;
+        diff.nodeMap.assign(before.nodes.size(), InvalidThemeIndex);
+        diff.directivesChanged = !SameDirectives(before, after);
+
+        Differ differ(before, after, diff);
+        differ.Children(before.roots, after.roots, InvalidThemeIndex);
+
+        return diff;
+    }
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ThemeDocument.h"
+
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    enum class NodeChangeKind
+    {
+        Added,      // newNode and its subtree are new
+        Removed,    // oldNode and its subtree are gone
+        Changed,    // component, id, name, classes or attributes differ
+        Reordered   // the children of newNode (the roots if it is invalid) moved
+    };
+
+    struct NodeChange
+    {
+        NodeChangeKind kind;
+        ThemeIndex oldNode;
+        ThemeIndex newNode;
+    };
+
+    // What changed between two versions of a theme document. Nodes are
+    // matched under the same parent by component and id (or name), and by
+    // their order among siblings that have neither. Source positions are
+    // not compared, so an edit does not "change" every node after it.
+    struct ThemeDiff
+    {
+        // For every node of the old document, its node in the new one, or
+        // InvalidThemeIndex if it was removed
+        std::vector<ThemeIndex> nodeMap;
+
+        // Parents come before their children
+        std::vector<NodeChange> changes;
+
+        bool directivesChanged;
+
+        // Set by ThemeEngineV2 when the style sheet changed, which may
+        // change the style of any node
+        bool stylesChanged;
+
+        ThemeDiff();
+
+        bool IsEmpty() const noexcept;
+    };
+
+    ThemeDiff DiffDocuments(const ThemeDocument& before, const ThemeDocument& after);
+
+    inline ThemeDiff::ThemeDiff() : nodeMap(), changes(), directivesChanged(false), stylesChanged(false)
+    {
+    }
+
+    inline bool ThemeDiff::IsEmpty() const noexcept
+    {
+        return changes.empty() && !directivesChanged && !stylesChanged;
+    }
+}
+}
@@ -0,0 +1,551 @@
+#pragma once
+
+#include "ThemeTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // The parsed theme is stored flat: every node, attribute, value and
+    // object property lives in one array per kind, and all text lives in a
+    // single pool. Records refer to each other by index, and the members of
+    // a node, object or array are always contiguous, so a record only needs
+    // a first index and a count. Destroying or resetting a document frees a
+    // handful of buffers, no matter how large the tree is.
+    //
+    // The records are meant for the parser and for code that stores the
+    // document as a whole. Everything else reads it through the views at
+    // the end of this file.
+
+    typedef std::uint32_t ThemeIndex;
+
+    const ThemeIndex InvalidThemeIndex = 0xFFFFFFFF;
+
+    // [offset, offset + length) of ThemeDocument::strings. The pool keeps a
+    // NUL after every string, so pointers into it are valid C strings.
+    struct StringRef
+    {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    struct IndexRange
+    {
+        ThemeIndex first;
+        ThemeIndex count;
+    };
+
+    struct NodeRecord
+    {
+        StringRef component;
+        StringRef id;
+        StringRef name;
+        IndexRange classes;         // into ThemeDocument::classes
+        IndexRange attributes;      // into ThemeDocument::attributes
+        IndexRange children;        // into ThemeDocument::nodes
+        SourcePosition location;
+    };
+
+    struct AttributeRecord
+    {
+        StringRef name;
+        ThemeIndex value;           // into ThemeDocument::values
+        SourcePosition location;
+    };
+
+    struct ValueRecord
+    {
+        ValueKind kind;
+        bool boolValue;
+        StringRef text;
+        double numberValue;
+        // Into ThemeDocument::properties for an Object, and into
+        // ThemeDocument::values for an Array
+        IndexRange members;
+        SourcePosition location;
+    };
+
+    struct PropertyRecord
+    {
+        StringRef key;
+        ThemeIndex value;           // into ThemeDocument::values
+        SourcePosition location;
+    };
+
+    struct DirectiveRecord
+    {
+        StringRef name;
+        StringRef argument;
+        SourcePosition location;
+    };
+
+    class ThemeDocument;
+
+    // Iterates the views over a contiguous range of records
+    template <typename TView>
+    class ThemeRange
+    {
+    public:
+        class Iterator
+        {
+        public:
+            Iterator(const ThemeDocument* document, ThemeIndex index) noexcept
+                : m_document(document), m_index(index)
+            {
+            }
+
+            TView operator*() const noexcept
+            {
+                return TView(m_document, m_index);
+            }
+
+            Iterator& operator++() noexcept
+            {
+                ++m_index;
+                return *this;
+            }
+
+            bool operator!=(const Iterator& other) const noexcept
+            {
+                return m_index != other.m_index;
+            }
+
+        private:
+            const ThemeDocument* m_document;
+            ThemeIndex m_index;
+        };
+
+        ThemeRange(const ThemeDocument* document, IndexRange range) noexcept
+            : m_document(document), m_range(range)
+        {
+        }
+
+        std::size_t size() const noexcept
+        {
+            return m_range.count;
+        }
+
+        bool empty() const noexcept
+        {
+            return m_range.count == 0;
+        }
+
+        TView operator[](std::size_t index) const noexcept
+        {
+            return TView(m_document, m_range.first + static_cast<ThemeIndex>(index));
+        }
+
+        Iterator begin() const noexcept
+        {
+            return Iterator(m_document, m_range.first);
+        }
+
+        Iterator end() const noexcept
+        {
+            return Iterator(m_document, m_range.first + m_range.count);
+        }
+
+    private:
+        const ThemeDocument* m_document;
+        IndexRange m_range;
+    };
+
+    class PropertyView;
+
+    class ValueView
+    {
+    public:
+        ValueView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        ValueKind Kind() const noexcept;
+        const wchar_t* Text() const noexcept;
+        std::size_t TextLength() const noexcept;
+        double Number() const noexcept;
+        bool Boolean() const noexcept;
+        const SourcePosition& Location() const noexcept;
+
+        // Empty unless the value is an Object or an Array, respectively
+        ThemeRange<PropertyView> Properties() const noexcept;
+        ThemeRange<ValueView> Elements() const noexcept;
+
+        ThemeIndex Index() const noexcept;
+
+    private:
+        const ValueRecord& Record() const noexcept;
+
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class PropertyView
+    {
+    public:
+        PropertyView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        const wchar_t* Key() const noexcept;
+        ValueView Value() const noexcept;
+        const SourcePosition& Location() const noexcept;
+
+    private:
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class AttributeView
+    {
+    public:
+        AttributeView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        const wchar_t* Name() const noexcept;
+        ValueView Value() const noexcept;
+        const SourcePosition& Location() const noexcept;
+
+    private:
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class ClassView
+    {
+    public:
+        ClassView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        const wchar_t* Name() const noexcept;
+
+    private:
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class NodeView
+    {
+    public:
+        NodeView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        const wchar_t* Component() const noexcept;
+        const wchar_t* Id() const noexcept;
+        const wchar_t* Name() const noexcept;
+        const SourcePosition& Location() const noexcept;
+
+        ThemeRange<ClassView> Classes() const noexcept;
+        ThemeRange<AttributeView> Attributes() const noexcept;
+        ThemeRange<NodeView> Children() const noexcept;
+
+        // The first attribute with this name (case-insensitive), if any
+        bool FindAttribute(const wchar_t* name, AttributeView* attribute) const noexcept;
+
+        ThemeIndex Index() const noexcept;
+
+    private:
+        const NodeRecord& Record() const noexcept;
+
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class DirectiveView
+    {
+    public:
+        DirectiveView(const ThemeDocument* document, ThemeIndex index) noexcept;
+
+        const wchar_t* Name() const noexcept;
+        const wchar_t* Argument() const noexcept;
+        const SourcePosition& Location() const noexcept;
+
+    private:
+        const ThemeDocument* m_document;
+        ThemeIndex m_index;
+    };
+
+    class ThemeDocument
+    {
+    public:
+        ThemeDocument();
+
+        ThemeRange<DirectiveView> Directives() const noexcept;
+        ThemeRange<NodeView> RootNodes() const noexcept;
+
+        // Number of nodes at any depth
+        std::size_t NodeCount() const noexcept;
+        NodeView Node(ThemeIndex index) const noexcept;
+
+        const wchar_t* String(const StringRef& ref) const noexcept;
+
+        // Copies text into the pool
+        StringRef AddString(const wchar_t* text, std::size_t length);
+
+        void Clear();
+
+        std::wstring strings;
+        std::vector<NodeRecord> nodes;
+        std::vector<StringRef> classes;
+        std::vector<AttributeRecord> attributes;
+        std::vector<ValueRecord> values;
+        std::vector<PropertyRecord> properties;
+        std::vector<DirectiveRecord> directives;
+        IndexRange roots;
+    };
+
+    inline ThemeDocument::ThemeDocument()
+    {
+        roots.first = 0;
+        roots.count = 0;
+
+        // Offset 0 is the empty string, for fields that were never set
+        strings.push_back(L'\0');
+    }
+
+    inline ThemeRange<DirectiveView> ThemeDocument::Directives() const noexcept
+    {
+        IndexRange range = { 0, static_cast<ThemeIndex>(directives.size()) };
+        return ThemeRange<DirectiveView>(this, range);
+    }
+
+    inline ThemeRange<NodeView> ThemeDocument::RootNodes() const noexcept
+    {
+        return ThemeRange<NodeView>(this, roots);
+    }
+
+    inline std::size_t ThemeDocument::NodeCount() const noexcept
+    {
+        return nodes.size();
+    }
+
+    inline NodeView ThemeDocument::Node(ThemeIndex index) const noexcept
+    {
+        return NodeView(this, index);
+    }
+
+    inline const wchar_t* ThemeDocument::String(const StringRef& ref) const noexcept
+    {
+        return strings.c_str() + ref.offset;
+    }
+
+    inline StringRef ThemeDocument::AddString(const wchar_t* text, std::size_t length)
+    {
+        if (length == 0)
+        {
+            StringRef empty = { 0, 0 };
+            return empty;
+        }
+
+        StringRef ref = { static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(length) };
+        strings.append(text, length);
+        strings.push_back(L'\0');
+        return ref;
+    }
+
+    inline void ThemeDocument::Clear()
+    {
+        *this = ThemeDocument();
+    }
+
+    inline ValueView::ValueView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const ValueRecord& ValueView::Record() const noexcept
+    {
+        return m_document->values[m_index];
+    }
+
+    inline ValueKind ValueView::Kind() const noexcept
+    {
+        return Record().kind;
+    }
+
+    inline const wchar_t* ValueView::Text() const noexcept
+    {
+        return m_document->String(Record().text);
+    }
+
+    inline std::size_t ValueView::TextLength() const noexcept
+    {
+        return Record().text.length;
+    }
+
+    inline double ValueView::Number() const noexcept
+    {
+        return Record().numberValue;
+    }
+
+    inline bool ValueView::Boolean() const noexcept
+    {
+        return Record().boolValue;
+    }
+
+    inline const SourcePosition& ValueView::Location() const noexcept
+    {
+        return Record().location;
+    }
+
+    inline ThemeRange<PropertyView> ValueView::Properties() const noexcept
+    {
+        IndexRange range = { 0, 0 };
+        if (Record().kind == ValueKind::Object)
+        {
+            range = Record().members;
+        }
+        return ThemeRange<PropertyView>(m_document, range);
+    }
+
+    inline ThemeRange<ValueView> ValueView::Elements() const noexcept
+    {
+        IndexRange range = { 0, 0 };
+        if (Record().kind == ValueKind::Array)
+        {
+            range = Record().members;
+        }
+        return ThemeRange<ValueView>(m_document, range);
+    }
+
+    inline ThemeIndex ValueView::Index() const noexcept
+    {
+        return m_index;
+    }
+
+    inline PropertyView::PropertyView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const wchar_t* PropertyView::Key() const noexcept
+    {
+        return m_document->String(m_document->properties[m_index].key);
+    }
+
+    inline ValueView PropertyView::Value() const noexcept
+    {
+        return ValueView(m_document, m_document->properties[m_index].value);
+    }
+
+    inline const SourcePosition& PropertyView::Location() const noexcept
+    {
+        return m_document->properties[m_index].location;
+    }
+
+    inline AttributeView::AttributeView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const wchar_t* AttributeView::Name() const noexcept
+    {
+        return m_document->String(m_document->attributes[m_index].name);
+    }
+
+    inline ValueView AttributeView::Value() const noexcept
+    {
+        return ValueView(m_document, m_document->attributes[m_index].value);
+    }
+
+    inline const SourcePosition& AttributeView::Location() const noexcept
+    {
+        return m_document->attributes[m_index].location;
+    }
+
+    inline ClassView::ClassView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const wchar_t* ClassView::Name() const noexcept
+    {
+        return m_document->String(m_document->classes[m_index]);
+    }
+
+    inline NodeView::NodeView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const NodeRecord& NodeView::Record() const noexcept
+    {
+        return m_document->nodes[m_index];
+    }
+
+    inline const wchar_t* NodeView::Component() const noexcept
+    {
+        return m_document->String(Record().component);
+    }
+
+    inline const wchar_t* NodeView::Id() const noexcept
+    {
+        return m_document->String(Record().id);
+    }
+
+    inline const wchar_t* NodeView::Name() const noexcept
+    {
+        return m_document->String(Record().name);
+    }
+
+    inline const SourcePosition& NodeView::Location() const noexcept
+    {
+        return Record().location;
+    }
+
+    inline ThemeRange<ClassView> NodeView::Classes() const noexcept
+    {
+        return ThemeRange<ClassView>(m_document, Record().classes);
+    }
+
+    inline ThemeRange<AttributeView> NodeView::Attributes() const noexcept
+    {
+        return ThemeRange<AttributeView>(m_document, Record().attributes);
+    }
+
+    inline ThemeRange<NodeView> NodeView::Children() const noexcept
+    {
+        return ThemeRange<NodeView>(m_document, Record().children);
+    }
+
+    inline bool NodeView::FindAttribute(const wchar_t* name, AttributeView* attribute) const noexcept
+    {
+        for (AttributeView candidate : Attributes())
+        {
+            if (_wcsicmp(candidate.Name(), name) == 0)
+            {
+                if (attribute != nullptr)
+                {
+                    *attribute = candidate;
+                }
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline ThemeIndex NodeView::Index() const noexcept
+    {
+        return m_index;
+    }
+
+    inline DirectiveView::DirectiveView(const ThemeDocument* document, ThemeIndex index) noexcept
+        : m_document(document), m_index(index)
+    {
+    }
+
+    inline const wchar_t* DirectiveView::Name() const noexcept
+    {
+        return m_document->String(m_document->directives[m_index].name);
+    }
+
+    inline const wchar_t* DirectiveView::Argument() const noexcept
+    {
+        return m_document->String(m_document->directives[m_index].argument);
+    }
+
+    inline const SourcePosition& DirectiveView::Location() const noexcept
+    {
+        return m_document->directives[m_index].location;
+    }
+}
+}
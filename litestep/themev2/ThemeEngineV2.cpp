@@ -1,17 +1,67 @@
 #include "ThemeEngineV2.h"
 
 #include "Parser.h"
+#include "StyleParser.h"
 
 #include "../utility/logger.h"
 #include "../lsapi/lsapi.h"
 
+#include <Shlwapi.h>
+#include <strsafe.h>
+
 #include <algorithm>
 #include <cwctype>
+#include <limits>
 
 namespace litestep
 {
 namespace themev2
 {
+    namespace
+    {
+        bool SameRef(const StringRef& left, const StringRef& right) noexcept
+        {
+            return left.offset == right.offset && left.length == right.length;
+        }
+
+        bool SameRange(const IndexRange& left, const IndexRange& right) noexcept
+        {
+            return left.first == right.first && left.count == right.count;
+        }
+
+        // Records into the same pool refer to the same text by the same
+        // offsets. Source positions are not compared, as in ThemeDiff.
+        bool SameStyles(const StyleSheet& left, const StyleSheet& right)
+        {
+            return left.strings == right.strings &&
+                std::equal(left.rules.begin(), left.rules.end(), right.rules.begin(), right.rules.end(),
+                    [](const StyleRuleRecord& leftRule, const StyleRuleRecord& rightRule)
+                    {
+                        return SameRef(leftRule.component, rightRule.component) &&
+                            SameRef(leftRule.id, rightRule.id) &&
+                            SameRange(leftRule.classes, rightRule.classes) &&
+                            SameRange(leftRule.declarations, rightRule.declarations) &&
+                            leftRule.specificity == rightRule.specificity;
+                    }) &&
+                std::equal(left.classes.begin(), left.classes.end(), right.classes.begin(), right.classes.end(),
+                    SameRef) &&
+                std::equal(left.declarations.begin(), left.declarations.end(),
+                    right.declarations.begin(), right.declarations.end(),
+                    [](const StyleDeclarationRecord& leftDeclaration, const StyleDeclarationRecord& rightDeclaration)
+                    {
+                        return SameRef(leftDeclaration.property, rightDeclaration.property) &&
+                            SameRef(leftDeclaration.value, rightDeclaration.value) &&
+                            SameRange(leftDeclaration.calls, rightDeclaration.calls);
+                    }) &&
+                std::equal(left.calls.begin(), left.calls.end(), right.calls.begin(), right.calls.end(),
+                    [](const StyleCallRecord& leftCall, const StyleCallRecord& rightCall)
+                    {
+                        return SameRef(leftCall.name, rightCall.name) &&
+                            SameRef(leftCall.arguments, rightCall.arguments);
+                    });
+        }
+    }
+
     ThemeEngineV2* ThemeEngineV2::s_instance = nullptr;
 
     ThemeEngineV2::ThemeEngineV2()
@@ -20,9 +70,26 @@ namespace themev2
           m_themeRoot(),
           m_structureFile(L"theme.lsx"),
           m_sourceManager(),
+          m_cache(),
+          m_watcher(),
+          m_watchedFiles(),
           m_structureSource(),
           m_document(),
-          m_diagnostics()
+          m_diagnostics(),
+          m_styleFile(),
+          m_styleSource(),
+          m_styleSheet(),
+          m_styleResolver(),
+          m_nodeStyles(),
+          m_layout(),
+          m_bindings(),
+          m_bindingFlushPosted(false),
+          m_lastDiff(),
+          m_loadedFromCache(false),
+          m_lastLoadFailed(false),
+          m_listeners(),
+          m_bindingListeners(),
+          m_lastListenerId(0)
     {
     }
 
@@ -38,14 +105,14 @@ namespace themev2
 
         if (!m_enabled)
         {
-            Logger::Log(L"ThemeEngineV2: disabled (LSTHEME_V2_ENABLED not set).");
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: disabled (LSTHEME_V2_ENABLED not set).");
             return S_FALSE;
         }
 
         wchar_t pathBuffer[MAX_PATH] = { 0 };
         if (!LSGetLitestepPathW(pathBuffer, MAX_PATH))
         {
-            Logger::Log(L"ThemeEngineV2: failed to resolve LiteStep root path.");
+            LS_LOG_ERROR(ThemeEngineV2, L"ThemeEngineV2: failed to resolve LiteStep root path.");
             return E_FAIL;
         }
 
@@ -53,7 +120,21 @@ namespace themev2
         m_sourceManager = std::make_unique<SourceManager>(m_themeRoot);
         m_structureFile = ResolveThemeFilePath();
 
-        const HRESULT hr = LoadStructure();
+        const std::wstring structurePath = m_sourceManager->ResolveEntryPath(m_structureFile);
+        if (!structurePath.empty())
+        {
+            m_cache = std::make_unique<ThemeCache>(ThemeCache::PathFor(structurePath));
+
+            // The style sheet sits next to the structure, theme.lsxstyle
+            wchar_t stylePath[MAX_PATH] = { 0 };
+            if (SUCCEEDED(StringCchCopyW(stylePath, MAX_PATH, structurePath.c_str())) &&
+                PathRenameExtensionW(stylePath, L".lsxstyle"))
+            {
+                m_styleFile = stylePath;
+            }
+        }
+
+        const HRESULT hr = Update(true);
         if (SUCCEEDED(hr))
         {
             RegisterBangs();
@@ -65,7 +146,15 @@ namespace themev2
     void ThemeEngineV2::Shutdown()
     {
         UnregisterBangs();
+        m_watcher.Stop();
+        m_watchedFiles.clear();
         ClearState();
+        m_layout.Clear();
+        m_bindings.Clear();
+        m_bindingFlushPosted = false;
+        m_lastDiff = ThemeDiff();
+        m_styleFile.clear();
+        m_cache.reset();
         m_sourceManager.reset();
         m_enabled = false;
 
@@ -79,25 +168,370 @@ namespace themev2
     {
         if (!m_enabled)
         {
-            Logger::Log(L"ThemeEngineV2: reload requested but engine is disabled.");
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: reload requested but engine is disabled.");
             return S_FALSE;
         }
 
-        const HRESULT hr = LoadStructure();
+        m_sourceManager->InvalidateChanged();
+
+        const HRESULT hr = Update(true);
         if (FAILED(hr))
         {
-            Logger::Log(L"ThemeEngineV2: reload failed (hr=0x%08X).", hr);
+            LS_LOG_ERROR(ThemeEngineV2, L"ThemeEngineV2: reload failed (hr=0x%08X).", hr);
         }
         else
         {
-            Logger::Log(L"ThemeEngineV2: reload completed (nodes=%u, directives=%u).",
-                static_cast<unsigned>(m_document.rootNodes.size()),
-                static_cast<unsigned>(m_document.directives.size()));
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: reload completed (nodes=%u, directives=%u, changes=%u).",
+                static_cast<unsigned>(m_document.RootNodes().size()),
+                static_cast<unsigned>(m_document.Directives().size()),
+                static_cast<unsigned>(m_lastDiff.changes.size()));
+        }
+
+        return hr;
+    }
+
+    HRESULT ThemeEngineV2::Update(bool useCache)
+    {
+        ThemeDocument previous(std::move(m_document));
+        const StyleSheet previousStyles(std::move(m_styleSheet));
+
+        HRESULT hr = LoadStructure(useCache);
+
+        const HRESULT styles = LoadStyles();
+        if (hr == S_OK && styles != S_OK)
+        {
+            hr = S_FALSE;
+        }
+
+        m_lastLoadFailed = (hr != S_OK);
+
+        // Only loads without errors are cached, a theme with errors is
+        // parsed again so they are reported every time
+        if (m_cache && !m_loadedFromCache)
+        {
+            const bool hasErrors = FAILED(hr) || std::any_of(
+                m_diagnostics.begin(),
+                m_diagnostics.end(),
+                [](const Diagnostic& diagnostic)
+                {
+                    return diagnostic.severity == DiagnosticSeverity::Error;
+                });
+
+            if (hasErrors)
+            {
+                m_cache->Remove();
+            }
+            else
+            {
+                m_cache->Store(m_structureSource, m_document, m_styleSource, m_styleSheet, *m_sourceManager);
+            }
+        }
+
+        BuildLayout();
+        CompileBindings();
+
+        m_lastDiff = DiffDocuments(previous, m_document);
+        m_lastDiff.stylesChanged = !SameStyles(previousStyles, m_styleSheet);
+        WatchFiles();
+
+        if (!m_lastDiff.IsEmpty())
+        {
+            // Copied, so a listener can remove itself
+            const std::vector<std::pair<std::size_t, DocumentListener>> listeners = m_listeners;
+            for (const auto& listener : listeners)
+            {
+                listener.second(m_document, m_lastDiff);
+            }
         }
 
         return hr;
     }
 
+    void ThemeEngineV2::BuildLayout()
+    {
+        m_layout.Build(m_document, [](const wchar_t* name, float& value)
+        {
+            // Constants like SPACING_SMALL are ordinary RC settings
+            const float missing = std::numeric_limits<float>::quiet_NaN();
+            value = GetRCFloatW(name, missing);
+            return value == value;
+        });
+
+        LayoutSize viewport = {
+            static_cast<float>(GetSystemMetrics(SM_CXSCREEN)),
+            static_cast<float>(GetSystemMetrics(SM_CYSCREEN))
+        };
+        m_layout.Update(viewport);
+
+        LS_LOG_DEBUG(ThemeEngineV2, L"ThemeEngineV2: laid out %u nodes over %ux%u.",
+            static_cast<unsigned>(m_layout.LastStatistics().arranged),
+            static_cast<unsigned>(viewport.width),
+            static_cast<unsigned>(viewport.height));
+    }
+
+    void ThemeEngineV2::CompileBindings()
+    {
+        m_bindings.Compile(m_document, [](const wchar_t* name, std::wstring& value)
+        {
+            // Until a host sets it, @name is the RC variable of that name
+            wchar_t buffer[MAX_LINE_LENGTH] = { 0 };
+            if (!LSGetVariableExW(name, buffer, MAX_LINE_LENGTH))
+            {
+                return false;
+            }
+
+            value = buffer;
+            return true;
+        });
+    }
+
+    void ThemeEngineV2::SetBinding(const std::wstring& name, const std::wstring& value)
+    {
+        m_bindings.Set(name, value);
+        ScheduleBindingFlush();
+    }
+
+    bool ThemeEngineV2::DefineBinding(const std::wstring& name, const std::wstring& expression)
+    {
+        if (!m_bindings.Define(name, expression))
+        {
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: binding '%ls' would depend on itself through '%ls'.",
+                name.c_str(), expression.c_str());
+            return false;
+        }
+
+        ScheduleBindingFlush();
+        return true;
+    }
+
+    const BindingGraph& ThemeEngineV2::Bindings() const noexcept
+    {
+        return m_bindings;
+    }
+
+    // The first change of a frame posts the flush, the ones after it ride
+    // along. The task has nothing to run, its completion comes back to the
+    // LiteStep thread once the messages already queued are handled.
+    void ThemeEngineV2::ScheduleBindingFlush()
+    {
+        if (m_bindingFlushPosted || !m_enabled)
+        {
+            return;
+        }
+
+        if (LSPostTask(NoOp, nullptr, BindingsChanged, nullptr) == 0)
+        {
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: failed to post binding update, applying it now.");
+            FlushBindings();
+            return;
+        }
+
+        m_bindingFlushPosted = true;
+    }
+
+    void CALLBACK ThemeEngineV2::NoOp(LPVOID)
+    {
+    }
+
+    void CALLBACK ThemeEngineV2::BindingsChanged(LPVOID, BOOL cancelled)
+    {
+        if (s_instance == nullptr)
+        {
+            return;
+        }
+
+        s_instance->m_bindingFlushPosted = false;
+
+        if (!cancelled && s_instance->m_enabled)
+        {
+            s_instance->FlushBindings();
+        }
+    }
+
+    void ThemeEngineV2::FlushBindings()
+    {
+        if (!m_bindings.HasPending())
+        {
+            return;
+        }
+
+        LS_TRACE_SCOPE(ThemeEngineV2, FlushBindings);
+
+        const std::vector<ThemeIndex> nodes = m_bindings.Flush();
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        LS_LOG_DEBUG(ThemeEngineV2, L"ThemeEngineV2: bindings changed %u nodes.",
+            static_cast<unsigned>(nodes.size()));
+
+        // Copied, so a listener can remove itself
+        const std::vector<std::pair<std::size_t, BindingListener>> listeners = m_bindingListeners;
+        for (const auto& listener : listeners)
+        {
+            listener.second(nodes);
+        }
+    }
+
+    std::size_t ThemeEngineV2::AddBindingListener(BindingListener listener)
+    {
+        const std::size_t id = ++m_lastListenerId;
+        m_bindingListeners.push_back(std::make_pair(id, std::move(listener)));
+        return id;
+    }
+
+    void ThemeEngineV2::RemoveBindingListener(std::size_t id)
+    {
+        m_bindingListeners.erase(std::remove_if(m_bindingListeners.begin(), m_bindingListeners.end(),
+            [id](const std::pair<std::size_t, BindingListener>& listener)
+            {
+                return listener.first == id;
+            }),
+            m_bindingListeners.end());
+    }
+
+    void ThemeEngineV2::WatchFiles()
+    {
+        std::vector<std::wstring> files = m_structureSource.files;
+        if (files.empty())
+        {
+            // Nothing loaded, wait for the entry file to be fixed
+            files.push_back(m_sourceManager->ResolveEntryPath(m_structureFile));
+        }
+
+        files.insert(files.end(), m_styleSource.files.begin(), m_styleSource.files.end());
+        if (m_styleSource.files.empty() && !m_styleFile.empty())
+        {
+            files.push_back(m_styleFile);
+        }
+
+        // A file that failed to load is named by its diagnostic, and the
+        // load is worth repeating once it changes
+        if (m_lastLoadFailed)
+        {
+            for (const Diagnostic& diagnostic : m_diagnostics)
+            {
+                if (!diagnostic.location.file.empty())
+                {
+                    files.push_back(diagnostic.location.file);
+                }
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        m_watchedFiles.clear();
+        for (const std::wstring& file : files)
+        {
+            WatchedFile watched = { file, false, {} };
+            watched.exists = SourceManager::ReadStamp(file, watched.stamp);
+            m_watchedFiles.push_back(watched);
+        }
+
+        m_watcher.Watch(files, ThemeFilesChanged, nullptr);
+    }
+
+    std::vector<std::wstring> ThemeEngineV2::ChangedWatchedFiles() const
+    {
+        std::vector<std::wstring> changed;
+
+        for (const WatchedFile& watched : m_watchedFiles)
+        {
+            ContentStamp stamp = {};
+            const bool exists = SourceManager::ReadStamp(watched.path, stamp);
+
+            if (exists != watched.exists ||
+                (exists && (stamp.size != watched.stamp.size || stamp.hash != watched.stamp.hash)))
+            {
+                changed.push_back(watched.path);
+            }
+        }
+
+        return changed;
+    }
+
+    void CALLBACK ThemeEngineV2::ThemeFilesChanged(LPVOID, BOOL cancelled)
+    {
+        if (!cancelled && s_instance != nullptr && s_instance->m_enabled)
+        {
+            s_instance->ApplyFileChanges();
+        }
+    }
+
+    void ThemeEngineV2::ApplyFileChanges()
+    {
+        // The folders also report files the theme does not use, and the
+        // SourceManager holds none of the files after a load from the
+        // compiled cache, so the watched files are compared instead. This
+        // holds after a failed load too, which is not repeated until one
+        // of the files it tried to use changes.
+        const std::vector<std::wstring> changed = ChangedWatchedFiles();
+        if (changed.empty())
+        {
+            return;
+        }
+
+        m_sourceManager->InvalidateChanged();
+
+        for (const std::wstring& file : changed)
+        {
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: '%ls' changed.", file.c_str());
+        }
+
+        const HRESULT hr = Update(m_loadedFromCache);
+        if (FAILED(hr))
+        {
+            LS_LOG_ERROR(ThemeEngineV2, L"ThemeEngineV2: update failed (hr=0x%08X).", hr);
+        }
+        else if (!m_lastDiff.IsEmpty())
+        {
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: updated '%ls' (changes=%u, directives %ls, styles %ls).",
+                m_structureFile.c_str(),
+                static_cast<unsigned>(m_lastDiff.changes.size()),
+                m_lastDiff.directivesChanged ? L"changed" : L"unchanged",
+                m_lastDiff.stylesChanged ? L"changed" : L"unchanged");
+        }
+    }
+
+    std::size_t ThemeEngineV2::AddDocumentListener(DocumentListener listener)
+    {
+        const std::size_t id = ++m_lastListenerId;
+        m_listeners.push_back(std::make_pair(id, std::move(listener)));
+        return id;
+    }
+
+    void ThemeEngineV2::RemoveDocumentListener(std::size_t id)
+    {
+        m_listeners.erase(std::remove_if(m_listeners.begin(), m_listeners.end(),
+            [id](const std::pair<std::size_t, DocumentListener>& listener)
+            {
+                return listener.first == id;
+            }),
+            m_listeners.end());
+    }
+
+    const ThemeDiff& ThemeEngineV2::LastDiff() const noexcept
+    {
+        return m_lastDiff;
+    }
+
+    const StyleResolver* ThemeEngineV2::Styles() const noexcept
+    {
+        return m_styleResolver.get();
+    }
+
+    ThemeIndex ThemeEngineV2::NodeStyle(ThemeIndex node) const noexcept
+    {
+        return (node < m_nodeStyles.size()) ? m_nodeStyles[node] : InvalidThemeIndex;
+    }
+
+    LayoutEngine& ThemeEngineV2::Layout() noexcept
+    {
+        return m_layout;
+    }
+
     bool ThemeEngineV2::IsEnabled() const noexcept
     {
         return m_enabled;
@@ -125,7 +559,7 @@ namespace themev2
     {
         if (s_instance == nullptr)
         {
-            Logger::Log(L"ThemeEngineV2: inspect requested but engine not initialized.");
+            LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: inspect requested but engine not initialized.");
             return;
         }
 
@@ -138,9 +572,12 @@ namespace themev2
                 return diagnostic.severity == DiagnosticSeverity::Error;
             });
 
-        Logger::Log(L"ThemeEngineV2: components=%u directives=%u diagnostics=%u (errors=%u).",
-            static_cast<unsigned>(engine.m_document.rootNodes.size()),
-            static_cast<unsigned>(engine.m_document.directives.size()),
+        LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: components=%u (total=%u) directives=%u style rules=%u (styles=%u) diagnostics=%u (errors=%u).",
+            static_cast<unsigned>(engine.m_document.RootNodes().size()),
+            static_cast<unsigned>(engine.m_document.NodeCount()),
+            static_cast<unsigned>(engine.m_document.Directives().size()),
+            static_cast<unsigned>(engine.m_styleSheet.rules.size()),
+            static_cast<unsigned>(engine.m_styleResolver ? engine.m_styleResolver->StyleCount() : 0),
             static_cast<unsigned>(engine.m_diagnostics.size()),
             static_cast<unsigned>(errorCount));
     }
@@ -223,8 +660,10 @@ namespace themev2
         return normalized;
     }
 
-    HRESULT ThemeEngineV2::LoadStructure()
+    HRESULT ThemeEngineV2::LoadStructure(bool useCache)
     {
+        LS_TRACE_SCOPE(ThemeEngineV2, LoadStructure, m_structureFile);
+
         if (!m_sourceManager)
         {
             return E_FAIL;
@@ -232,6 +671,27 @@ namespace themev2
 
         ClearState();
 
+        m_loadedFromCache = useCache && m_cache &&
+            m_cache->Load(m_structureSource, m_document, m_styleSource, m_styleSheet);
+
+        // The cache checks the style files it was built with, but can not
+        // know about a style sheet added since
+        if (m_loadedFromCache && m_styleSource.files.empty() &&
+            !m_styleFile.empty() && PathFileExistsW(m_styleFile.c_str()))
+        {
+            m_loadedFromCache = false;
+            ClearState();
+        }
+
+        if (m_loadedFromCache)
+        {
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: loaded '%ls' from '%ls'.",
+                m_structureFile.c_str(), m_cache->Path().c_str());
+            return S_OK;
+        }
+
+        // Files the SourceManager still holds are unchanged, callers
+        // invalidate the others first
         SourceDocument document;
         std::vector<Diagnostic> diagnostics;
 
@@ -244,7 +704,7 @@ namespace themev2
 
         if (!loaded)
         {
-            LogDiagnostics();
+            LogDiagnostics(m_structureFile, 0);
             return E_FAIL;
         }
 
@@ -253,7 +713,7 @@ namespace themev2
         Parser parser(m_structureSource, m_diagnostics);
         m_document = parser.Parse();
 
-        LogDiagnostics();
+        LogDiagnostics(m_structureFile, 0);
 
         const bool hasErrors = std::any_of(
             m_diagnostics.begin(),
@@ -266,6 +726,58 @@ namespace themev2
         return hasErrors ? S_FALSE : S_OK;
     }
 
+    HRESULT ThemeEngineV2::LoadStyles()
+    {
+        LS_TRACE_SCOPE(ThemeEngineV2, LoadStyles, m_styleFile);
+
+        m_nodeStyles.clear();
+        m_styleResolver.reset();
+
+        const std::size_t first = m_diagnostics.size();
+
+        if (m_loadedFromCache)
+        {
+            // LoadStructure took the style sheet from the cache as well
+            if (m_styleSource.files.empty())
+            {
+                return S_OK;
+            }
+        }
+        else
+        {
+            m_styleSheet.Clear();
+            m_styleSource = SourceDocument();
+
+            // A theme does not need a style sheet
+            if (!m_sourceManager || m_styleFile.empty() || !PathFileExistsW(m_styleFile.c_str()))
+            {
+                return S_OK;
+            }
+
+            if (!m_sourceManager->LoadStyleDocument(m_styleFile, m_styleSource, m_diagnostics))
+            {
+                LogDiagnostics(m_styleFile, first);
+                return E_FAIL;
+            }
+
+            StyleParser parser(m_styleSource, m_diagnostics);
+            m_styleSheet = parser.Parse();
+
+            LogDiagnostics(m_styleFile, first);
+        }
+
+        m_styleResolver = std::make_unique<StyleResolver>(m_styleSheet);
+        m_nodeStyles = m_styleResolver->ResolveAll(m_document);
+
+        LS_LOG_DEBUG(ThemeEngineV2, L"ThemeEngineV2: resolved '%ls' (rules=%u, nodes=%u, styles=%u).",
+            m_styleFile.c_str(),
+            static_cast<unsigned>(m_styleSheet.rules.size()),
+            static_cast<unsigned>(m_nodeStyles.size()),
+            static_cast<unsigned>(m_styleResolver->StyleCount()));
+
+        return (m_diagnostics.size() == first) ? S_OK : S_FALSE;
+    }
+
     void ThemeEngineV2::RegisterBangs()
     {
         if (m_bangsRegistered)
@@ -280,7 +792,7 @@ namespace themev2
         }
         else
         {
-            Logger::Log(L"ThemeEngineV2: failed to register bangs.");
+            LS_LOG_ERROR(ThemeEngineV2, L"ThemeEngineV2: failed to register bangs.");
         }
     }
 
@@ -298,36 +810,40 @@ namespace themev2
 
     void ThemeEngineV2::ClearState()
     {
-        m_document = ThemeDocument();
+        m_document.Clear();
         m_structureSource = SourceDocument();
         m_diagnostics.clear();
     }
 
-    void ThemeEngineV2::LogDiagnostics() const
+    void ThemeEngineV2::LogDiagnostics(const std::wstring& file, std::size_t first) const
     {
-        if (m_diagnostics.empty())
+        if (m_diagnostics.size() == first)
         {
-            Logger::Log(L"ThemeEngineV2: parsed '%ls' with no diagnostics.", m_structureFile.c_str());
+            LS_LOG_NOTICE(ThemeEngineV2, L"ThemeEngineV2: parsed '%ls' with no diagnostics.", file.c_str());
             return;
         }
 
-        for (const Diagnostic& diagnostic : m_diagnostics)
+        for (std::size_t index = first; index < m_diagnostics.size(); ++index)
         {
+            const Diagnostic& diagnostic = m_diagnostics[index];
             const wchar_t* severity = L"info";
+            Logger::Level level = Logger::Level::Notice;
             switch (diagnostic.severity)
             {
             case DiagnosticSeverity::Warning:
                 severity = L"warning";
+                level = Logger::Level::Warning;
                 break;
             case DiagnosticSeverity::Error:
                 severity = L"error";
+                level = Logger::Level::Error;
                 break;
             default:
                 severity = L"info";
                 break;
             }
 
-            Logger::Log(L"ThemeEngineV2 %ls: %ls (file=%ls line=%u column=%u)",
+            LS_LOG(level, ThemeEngineV2, L"ThemeEngineV2 %ls: %ls (file=%ls line=%u column=%u)",
                 severity,
                 diagnostic.message.c_str(),
                 diagnostic.location.file.c_str(),
@@ -2,9 +2,18 @@
 #include <Windows.h>
 #include <string>
 
+#include "BindingGraph.h"
+#include "LayoutEngine.h"
+#include "ThemeCache.h"
+#include "ThemeDiff.h"
+#include "ThemeDocument.h"
+#include "ThemeFileWatcher.h"
 #include "ThemeTypes.h"
 #include "SourceManager.h"
+#include "StyleResolver.h"
+#include "StyleSheet.h"
 
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -15,6 +24,14 @@ namespace themev2
     class ThemeEngineV2
     {
     public:
+        // Runs on the LiteStep thread after every load that changed the
+        // document, with the diff against the previous version
+        typedef std::function<void(const ThemeDocument&, const ThemeDiff&)> DocumentListener;
+
+        // Runs on the LiteStep thread once per frame that changed bindings,
+        // with the nodes of Document() whose bound values changed
+        typedef std::function<void(const std::vector<ThemeIndex>&)> BindingListener;
+
         ThemeEngineV2();
         ~ThemeEngineV2();
 
@@ -25,29 +42,91 @@ namespace themev2
         bool IsEnabled() const noexcept;
         const ThemeDocument& Document() const noexcept;
         const std::vector<Diagnostic>& Diagnostics() const noexcept;
+        const ThemeDiff& LastDiff() const noexcept;
+
+        // Null without a style sheet
+        const StyleResolver* Styles() const noexcept;
+
+        // Resolved style of a node of Document(), InvalidThemeIndex
+        // without a style sheet
+        ThemeIndex NodeStyle(ThemeIndex node) const noexcept;
+
+        // Laid out over the primary monitor after every load. Hosts report
+        // content sizes to it and call Update again.
+        LayoutEngine& Layout() noexcept;
+
+        std::size_t AddDocumentListener(DocumentListener listener);
+        void RemoveDocumentListener(std::size_t id);
+
+        // Values the theme refers to as @name. Changes made during one turn
+        // of the message loop are applied together on the next, LiteStep
+        // thread only.
+        void SetBinding(const std::wstring& name, const std::wstring& value);
+        bool DefineBinding(const std::wstring& name, const std::wstring& expression);
+        const BindingGraph& Bindings() const noexcept;
+
+        std::size_t AddBindingListener(BindingListener listener);
+        void RemoveBindingListener(std::size_t id);
 
     private:
+        // A file the theme uses, as it was when the theme was last loaded
+        struct WatchedFile
+        {
+            std::wstring path;
+            bool exists;
+            ContentStamp stamp;
+        };
+
         static ThemeEngineV2* s_instance;
 
         static void BangReloadThemeV2(HWND caller, LPCWSTR args);
         static void BangInspectThemeV2(HWND caller, LPCWSTR args);
+        static void CALLBACK ThemeFilesChanged(LPVOID context, BOOL cancelled);
+        static void CALLBACK NoOp(LPVOID context);
+        static void CALLBACK BindingsChanged(LPVOID context, BOOL cancelled);
 
         bool ResolveEnvironmentFlag() const;
         std::wstring ResolveThemeFilePath() const;
-        HRESULT LoadStructure();
+        HRESULT Update(bool useCache);
+        HRESULT LoadStructure(bool useCache);
+        HRESULT LoadStyles();
+        void BuildLayout();
+        void CompileBindings();
+        void ScheduleBindingFlush();
+        void FlushBindings();
+        void WatchFiles();
+        std::vector<std::wstring> ChangedWatchedFiles() const;
+        void ApplyFileChanges();
         void RegisterBangs();
         void UnregisterBangs();
         void ClearState();
-        void LogDiagnostics() const;
+        void LogDiagnostics(const std::wstring& file, std::size_t first) const;
 
         bool m_enabled;
         bool m_bangsRegistered;
         std::wstring m_themeRoot;
         std::wstring m_structureFile;
         std::unique_ptr<SourceManager> m_sourceManager;
+        std::unique_ptr<ThemeCache> m_cache;
+        ThemeFileWatcher m_watcher;
+        std::vector<WatchedFile> m_watchedFiles;
         SourceDocument m_structureSource;
         ThemeDocument m_document;
         std::vector<Diagnostic> m_diagnostics;
+        std::wstring m_styleFile;
+        SourceDocument m_styleSource;
+        StyleSheet m_styleSheet;
+        std::unique_ptr<StyleResolver> m_styleResolver;
+        std::vector<ThemeIndex> m_nodeStyles;
+        LayoutEngine m_layout;
+        BindingGraph m_bindings;
+        bool m_bindingFlushPosted;
+        ThemeDiff m_lastDiff;
+        bool m_loadedFromCache;
+        bool m_lastLoadFailed;
+        std::vector<std::pair<std::size_t, DocumentListener>> m_listeners;
+        std::vector<std::pair<std::size_t, BindingListener>> m_bindingListeners;
+        std::size_t m_lastListenerId;
     };
 }
 }
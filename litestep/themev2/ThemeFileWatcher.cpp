@@ -0,0 +1,173 @@
+#include "ThemeFileWatcher.h"
+
+#include "../utility/logger.h"
+#include "../lsapi/lsapi.h"
+
+#include <Shlwapi.h>
+#include <strsafe.h>
+
+namespace litestep
+{
+namespace themev2
+{
+    namespace
+    {
+        // Editors tend to save in several steps (temp file, rename, touch)
+        const DWORD SettleDelay = 200;
+
+        // Between attempts to post a change that could not be posted
+        const DWORD RetryDelay = 1000;
+
+        const DWORD WatchFilter =
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+    }
+
+    ThemeFileWatcher::ThemeFileWatcher()
+        : m_handles(), m_stopEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr)),
+          m_callback(nullptr), m_context(nullptr), m_thread()
+    {
+    }
+
+    ThemeFileWatcher::~ThemeFileWatcher()
+    {
+        Stop();
+
+        if (m_stopEvent != nullptr)
+        {
+            CloseHandle(m_stopEvent);
+        }
+    }
+
+    void ThemeFileWatcher::Watch(const std::vector<std::wstring>& files, LSTASKCOMPLETIONPROC callback, LPVOID context)
+    {
+        Stop();
+
+        if (m_stopEvent == nullptr)
+        {
+            return;
+        }
+
+        std::vector<std::wstring> folders;
+        for (const std::wstring& file : files)
+        {
+            wchar_t folder[MAX_PATH] = { 0 };
+            if (FAILED(StringCchCopyW(folder, MAX_PATH, file.c_str())) || !PathRemoveFileSpecW(folder))
+            {
+                continue;
+            }
+
+            bool known = false;
+            for (const std::wstring& existing : folders)
+            {
+                known = known || _wcsicmp(existing.c_str(), folder) == 0;
+            }
+
+            if (!known)
+            {
+                folders.push_back(folder);
+            }
+        }
+
+        m_handles.push_back(m_stopEvent);
+
+        for (const std::wstring& folder : folders)
+        {
+            if (m_handles.size() == MAXIMUM_WAIT_OBJECTS)
+            {
+                LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: theme files span too many folders, not watching '%ls'.",
+                    folder.c_str());
+                continue;
+            }
+
+            HANDLE change = FindFirstChangeNotificationW(folder.c_str(), FALSE, WatchFilter);
+            if (change == INVALID_HANDLE_VALUE)
+            {
+                LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: can not watch '%ls' (error %u).",
+                    folder.c_str(), GetLastError());
+                continue;
+            }
+
+            m_handles.push_back(change);
+        }
+
+        if (m_handles.size() == 1)
+        {
+            m_handles.clear();
+            return;
+        }
+
+        m_callback = callback;
+        m_context = context;
+
+        ResetEvent(m_stopEvent);
+        m_thread = std::thread(&ThemeFileWatcher::ThreadProc, this);
+    }
+
+    void ThemeFileWatcher::Stop()
+    {
+        if (m_thread.joinable())
+        {
+            SetEvent(m_stopEvent);
+            m_thread.join();
+        }
+
+        // [0] is the stop event, which lives as long as the watcher
+        for (std::size_t index = 1; index < m_handles.size(); ++index)
+        {
+            FindCloseChangeNotification(m_handles[index]);
+        }
+
+        m_handles.clear();
+    }
+
+    bool ThemeFileWatcher::IsWatching() const noexcept
+    {
+        return m_thread.joinable();
+    }
+
+    void CALLBACK ThemeFileWatcher::NoOp(LPVOID)
+    {
+    }
+
+    void ThemeFileWatcher::ThreadProc()
+    {
+        const DWORD count = static_cast<DWORD>(m_handles.size());
+
+        for (;;)
+        {
+            DWORD result = WaitForMultipleObjects(count, m_handles.data(), FALSE, INFINITE);
+
+            // Wait for the folders to settle, each change restarts the delay
+            while (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + count)
+            {
+                FindNextChangeNotification(m_handles[result - WAIT_OBJECT_0]);
+                result = WaitForMultipleObjects(count, m_handles.data(), FALSE, SettleDelay);
+            }
+
+            if (result != WAIT_TIMEOUT)
+            {
+                // Stopped, or the handles went bad
+                break;
+            }
+
+            // The callback has to run on the LiteStep thread and the task
+            // is the only way there, so keep trying until the change gets
+            // through or the watcher is stopped
+            bool warned = false;
+            while (LSPostTask(NoOp, nullptr, m_callback, m_context) == 0)
+            {
+                if (!warned)
+                {
+                    LS_LOG_WARNING(ThemeEngineV2, L"ThemeEngineV2: failed to post theme file change, retrying.");
+                    warned = true;
+                }
+
+                if (WaitForSingleObject(m_stopEvent, RetryDelay) != WAIT_TIMEOUT)
+                {
+                    return;
+                }
+            }
+        }
+    }
+}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <Windows.h>
+
+#include "../lsapi/lsapidefines.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace litestep
+{
+namespace themev2
+{
+    // Watches the folders of the theme files on a thread of its own. Once
+    // a folder has been quiet for a moment after a change, the callback is
+    // posted to the LiteStep thread as the completion of an empty task, so
+    // it runs there like any other task completion. The callback has to
+    // find out itself whether a theme file actually changed; the folders
+    // also report unrelated files, including the compiled theme cache.
+    class ThemeFileWatcher
+    {
+    public:
+        ThemeFileWatcher();
+        ~ThemeFileWatcher();
+
+        // Replaces the watched folders with the folders of these files
+        void Watch(const std::vector<std::wstring>& files, LSTASKCOMPLETIONPROC callback, LPVOID context);
+        void Stop();
+
+        bool IsWatching() const noexcept;
+
+    private:
+        ThemeFileWatcher(const ThemeFileWatcher&);
+        ThemeFileWatcher& operator=(const ThemeFileWatcher&);
+
+        static void CALLBACK NoOp(LPVOID context);
+        void ThreadProc();
+
+        // [0] is m_stopEvent, the rest are change notifications
+        std::vector<HANDLE> m_handles;
+        HANDLE m_stopEvent;
+        LSTASKCOMPLETIONPROC m_callback;
+        LPVOID m_context;
+        std::thread m_thread;
+    };
+}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <vector>
@@ -9,6 +11,11 @@ namespace litestep
 {
 namespace themev2
 {
+    // Index into SourceDocument::files
+    typedef std::uint32_t FileId;
+
+    // A resolved position, with the file path and 1-based line and column.
+    // Only built for diagnostics, see SourceDocument::Locate.
     struct SourceLocation
     {
         std::wstring file;
@@ -20,6 +27,17 @@ namespace themev2
         bool IsValid() const noexcept;
     };
 
+    // Where a token or node starts: the file it came from and its offset
+    // into SourceDocument::content.
+    struct SourcePosition
+    {
+        FileId fileId;
+        std::size_t offset;
+
+        SourcePosition() noexcept;
+        SourcePosition(FileId file, std::size_t startOffset) noexcept;
+    };
+
     enum class DiagnosticSeverity
     {
         Info,
@@ -67,13 +85,17 @@ namespace themev2
         Unknown
     };
 
+    // The text of a token is [startOffset, startOffset + length) of
+    // SourceDocument::content, Lexer::Text and Lexer::StringValue copy it
+    // out when it is needed.
     struct Token
     {
         TokenType type;
-        std::wstring lexeme;
-        SourceLocation location;
+        FileId fileId;
         std::size_t startOffset;
         std::size_t length;
+
+        SourcePosition Position() const noexcept;
     };
 
     enum class ValueKind
@@ -88,68 +110,9 @@ namespace themev2
         Array
     };
 
-    struct Value;
-
-    struct ObjectProperty
-    {
-        std::wstring key;
-        Value value;
-        SourceLocation location;
-
-        ObjectProperty();
-        ObjectProperty(const std::wstring& keyName, const Value& propertyValue, const SourceLocation& locationInfo);
-    };
-
-    struct Value
-    {
-        ValueKind kind;
-        std::wstring text;
-        double numberValue;
-        bool boolValue;
-        std::vector<ObjectProperty> objectProperties;
-        std::vector<Value> arrayValues;
-        SourceLocation location;
-
-        Value();
-        explicit Value(ValueKind kindValue);
-
-        static Value CreateString(const std::wstring& textValue, const SourceLocation& locationInfo);
-        static Value CreateNumber(const std::wstring& textValue, double numericValue, const SourceLocation& locationInfo);
-        static Value CreateBoolean(bool boolValue, const SourceLocation& locationInfo);
-        static Value CreateIdentifier(const std::wstring& identifier, const SourceLocation& locationInfo);
-        static Value CreateReference(const std::wstring& reference, const SourceLocation& locationInfo);
-        static Value CreateObject(const SourceLocation& locationInfo);
-        static Value CreateArray(const SourceLocation& locationInfo);
-    };
-
-    struct Attribute
-    {
-        std::wstring name;
-        Value value;
-        SourceLocation location;
-    };
-
-    struct ComponentNode
-    {
-        std::wstring component;
-        std::wstring id;
-        std::wstring name;
-        std::vector<std::wstring> classes;
-        std::vector<Attribute> attributes;
-        std::vector<ComponentNode> children;
-        SourceLocation location;
-    };
-
-    struct Directive
-    {
-        std::wstring name;
-        std::wstring argument;
-        SourceLocation location;
-    };
-
     struct SourceDocumentSegment
     {
-        std::wstring filePath;
+        FileId fileId;
         std::size_t startOffset;
         std::size_t lineStart;
     };
@@ -158,104 +121,103 @@ namespace themev2
     {
         std::wstring primaryFile;
         std::wstring content;
+        std::vector<std::wstring> files;
         std::vector<SourceDocumentSegment> segments;
-    };
 
-    struct ThemeDocument
-    {
-        std::vector<Directive> directives;
-        std::vector<ComponentNode> rootNodes;
-    };
-}
-}
-
-inline SourceLocation::SourceLocation() noexcept : line(0), column(0)
-{
-}
+        // Returns the id of a file path, adding it to files if needed.
+        FileId InternFile(const std::wstring& filePath);
+        const std::wstring& FilePath(FileId fileId) const noexcept;
 
-inline SourceLocation::SourceLocation(std::wstring filePath, std::size_t lineNumber, std::size_t columnNumber) noexcept
-    : file(std::move(filePath)), line(lineNumber), column(columnNumber)
-{
-}
+        // Index of the segment that contains an offset.
+        std::size_t SegmentAt(std::size_t offset) const noexcept;
 
-inline bool SourceLocation::IsValid() const noexcept
-{
-    return !file.empty();
-}
+        // Resolves an offset to file, line and column. Counts the lines from
+        // the start of the segment, so it is meant for diagnostics only.
+        SourceLocation Locate(std::size_t offset) const;
+    };
 
-inline ObjectProperty::ObjectProperty()
-    : key(), value(), location()
-{
-}
+    inline SourceLocation::SourceLocation() noexcept : line(0), column(0)
+    {
+    }
 
-inline ObjectProperty::ObjectProperty(const std::wstring& keyName, const Value& propertyValue, const SourceLocation& locationInfo)
-    : key(keyName), value(propertyValue), location(locationInfo)
-{
-}
+    inline SourceLocation::SourceLocation(std::wstring filePath, std::size_t lineNumber, std::size_t columnNumber) noexcept
+        : file(std::move(filePath)), line(lineNumber), column(columnNumber)
+    {
+    }
 
-inline Value::Value()
-    : kind(ValueKind::Null), text(), numberValue(0.0), boolValue(false), objectProperties(), arrayValues(), location()
-{
-}
+    inline bool SourceLocation::IsValid() const noexcept
+    {
+        return !file.empty();
+    }
 
-inline Value::Value(ValueKind kindValue)
-    : kind(kindValue), text(), numberValue(0.0), boolValue(false), objectProperties(), arrayValues(), location()
-{
-}
+    inline SourcePosition::SourcePosition() noexcept : fileId(0), offset(0)
+    {
+    }
 
-inline Value Value::CreateString(const std::wstring& textValue, const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::String);
-    value.text = textValue;
-    value.location = locationInfo;
-    return value;
-}
+    inline SourcePosition::SourcePosition(FileId file, std::size_t startOffset) noexcept
+        : fileId(file), offset(startOffset)
+    {
+    }
 
-inline Value Value::CreateNumber(const std::wstring& textValue, double numericValue, const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Number);
-    value.text = textValue;
-    value.numberValue = numericValue;
-    value.location = locationInfo;
-    return value;
-}
+    inline SourcePosition Token::Position() const noexcept
+    {
+        return SourcePosition(fileId, startOffset);
+    }
 
-inline Value Value::CreateBoolean(bool boolValueParam, const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Boolean);
-    value.boolValue = boolValueParam;
-    value.text = boolValueParam ? L"true" : L"false";
-    value.location = locationInfo;
-    return value;
-}
+    inline FileId SourceDocument::InternFile(const std::wstring& filePath)
+    {
+        for (std::size_t index = 0; index < files.size(); ++index)
+        {
+            if (files[index] == filePath)
+            {
+                return static_cast<FileId>(index);
+            }
+        }
+
+        files.push_back(filePath);
+        return static_cast<FileId>(files.size() - 1);
+    }
+
+    inline const std::wstring& SourceDocument::FilePath(FileId fileId) const noexcept
+    {
+        return (fileId < files.size()) ? files[fileId] : primaryFile;
+    }
 
-inline Value Value::CreateIdentifier(const std::wstring& identifier, const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Identifier);
-    value.text = identifier;
-    value.location = locationInfo;
-    return value;
-}
+    inline std::size_t SourceDocument::SegmentAt(std::size_t offset) const noexcept
+    {
+        auto segment = std::upper_bound(segments.begin(), segments.end(), offset,
+            [](std::size_t value, const SourceDocumentSegment& candidate)
+            {
+                return value < candidate.startOffset;
+            });
 
-inline Value Value::CreateReference(const std::wstring& reference, const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Reference);
-    value.text = reference;
-    value.location = locationInfo;
-    return value;
-}
+        return (segment == segments.begin()) ? 0 : static_cast<std::size_t>(segment - segments.begin() - 1);
+    }
 
-inline Value Value::CreateObject(const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Object);
-    value.location = locationInfo;
-    return value;
+    inline SourceLocation SourceDocument::Locate(std::size_t offset) const
+    {
+        if (segments.empty())
+        {
+            return SourceLocation(primaryFile, 0, 0);
+        }
+
+        const SourceDocumentSegment& segment = segments[SegmentAt(offset)];
+        std::size_t line = segment.lineStart;
+        std::size_t lastLineStart = segment.startOffset;
+        const std::size_t limit = (offset < content.length()) ? offset : content.length();
+
+        for (std::size_t index = segment.startOffset; index < limit; ++index)
+        {
+            if (content[index] == L'\n')
+            {
+                ++line;
+                lastLineStart = index + 1;
+            }
+        }
+
+        const std::size_t column = (offset >= lastLineStart) ? (offset - lastLineStart + 1) : 1;
+        const std::wstring& filePath = FilePath(segment.fileId);
+        return SourceLocation(filePath.empty() ? primaryFile : filePath, line, column);
+    }
 }
-
-inline Value Value::CreateArray(const SourceLocation& locationInfo)
-{
-    Value value(ValueKind::Array);
-    value.location = locationInfo;
-    return value;
 }
-
@@ -72,6 +72,8 @@ void FileParser::ParseFile(LPCTSTR ptzFileName)
     ASSERT(nullptr == m_phFile);
     ASSERT(nullptr != ptzFileName);
 
+    LS_TRACE_SCOPE(Config, ParseFile, ptzFileName);
+
     TCHAR tzExpandedPath[MAX_PATH_LENGTH];
 
     VarExpansionExW(tzExpandedPath, ptzFileName, MAX_PATH_LENGTH);
@@ -82,7 +84,7 @@ void FileParser::ParseFile(LPCTSTR ptzFileName)
 
     if (0 == dwLen || dwLen > MAX_PATH_LENGTH)
     {
-        Logger::Log(L"Config: Unable to resolve full path for \"%ls\" (expanded from \"%ls\").", tzExpandedPath, ptzFileName);
+        LS_LOG_ERROR(Config, L"Config: Unable to resolve full path for \"%ls\" (expanded from \"%ls\").", tzExpandedPath, ptzFileName);
         TRACE("Error: Can not get full path for \"%ls\"", tzExpandedPath);
         return;
     }
@@ -108,7 +110,7 @@ void FileParser::ParseFile(LPCTSTR ptzFileName)
         StringCchCat(trail, _countof(trail), _T("\""));
         StringCchCat(trail, _countof(trail), line);
 
-        Logger::Log(L"Config: Recursive include detected while processing \"%ls\" (from \"%ls\").", m_tzFullPath, ptzFileName);
+        LS_LOG_WARNING(Config, L"Config: Recursive include detected while processing \"%ls\" (from \"%ls\").", m_tzFullPath, ptzFileName);
         RESOURCE_STREX(
             GetModuleHandle(NULL), IDS_RECURSIVEINCLUDE,
             resourceTextBuffer, MAX_LINE_LENGTH,
@@ -134,13 +136,13 @@ void FileParser::ParseFile(LPCTSTR ptzFileName)
             StringCchCopyW(errnoText, _countof(errnoText), L"Unknown failure");
         }
 
-        Logger::Log(L"Config: Unable to open \"%ls\" (expanded from \"%ls\"): %ls (errno=%d).", m_tzFullPath, ptzFileName, errnoText, static_cast<int>(openResult));
+        LS_LOG_ERROR(Config, L"Config: Unable to open \"%ls\" (expanded from \"%ls\"): %ls (errno=%d).", m_tzFullPath, ptzFileName, errnoText, static_cast<int>(openResult));
         TRACE("Error: Can not open file \"%ls\" (Defined as \"%ls\").",
             m_tzFullPath, ptzFileName);
         return;
     }
 
-    Logger::Log(L"Config: Loaded \"%ls\".", m_tzFullPath);
+    LS_LOG_NOTICE(Config, L"Config: Loaded \"%ls\".", m_tzFullPath);
 
     TRACE("Parsing \"%ls\"", m_tzFullPath);
     m_trail.push_back(TrailItem(0, m_tzFullPath));
@@ -490,13 +492,13 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
 
         if (!GetTokenW(ptzValue, tzPath, NULL, FALSE))
         {
-            Logger::Log(L"Config: Include directive missing target in \"%ls:%u\".", m_tzFullPath, m_uLineNumber);
+            LS_LOG_ERROR(Config, L"Config: Include directive missing target in \"%ls:%u\".", m_tzFullPath, m_uLineNumber);
             TRACE("Syntax Error (%ls, %d): Empty \"Include\" directive",
                 m_tzFullPath, m_uLineNumber);
             return;
         }
 
-        Logger::Log(L"Config: Including \"%ls\" from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
+        LS_LOG_DEBUG(Config, L"Config: Including \"%ls\" from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
         TRACE("Include (%ls, line %d): \"%ls\"",
             m_tzFullPath, m_uLineNumber, tzPath);
 
@@ -516,7 +518,7 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
 
         PathUnquoteSpaces(tzPath); // strips quotation marks from string
 
-        Logger::Log(L"Config: IncludeFolder scanning \"%ls\" from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
+        LS_LOG_DEBUG(Config, L"Config: IncludeFolder scanning \"%ls\" from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
         TRACE("Searching IncludeFolder (%ls, line %d): \"%ls\"",
             m_tzFullPath, m_uLineNumber, tzPath);
 
@@ -572,7 +574,7 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
             m_trail.back().uLine = m_uLineNumber;
             if (tzFile == PathCombine(tzFile, tzPath, foundFiles.begin()->c_str()))
             {
-                Logger::Log(L"Config: Including \"%ls\" from IncludeFolder directive (%ls:%u).", tzFile, m_tzFullPath, m_uLineNumber);
+                LS_LOG_DEBUG(Config, L"Config: Including \"%ls\" from IncludeFolder directive (%ls:%u).", tzFile, m_tzFullPath, m_uLineNumber);
                 TRACE("Found and including: \"%ls\"", tzFile);
 
                 FileParser fpParser(m_pSettingsMap, m_trail);
@@ -585,7 +587,7 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
 
         if (!anyMatches)
         {
-            Logger::Log(L"Config: IncludeFolder \"%ls\" produced no matches when processed from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
+            LS_LOG_WARNING(Config, L"Config: IncludeFolder \"%ls\" produced no matches when processed from \"%ls:%u\".", tzPath, m_tzFullPath, m_uLineNumber);
         }
         TRACE("Done searching IncludeFolder (%ls, line %d): \"%ls\"",
             m_tzFullPath, m_uLineNumber, tzPath);
@@ -598,7 +600,7 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
 
         if (!GetTokenW(ptzValue, tzVariable, &pszNext, FALSE) || tzVariable[0] == L'\0')
         {
-            Logger::Log(L"Config: !SetVar directive missing variable name in \"%ls:%u\".", m_tzFullPath, m_uLineNumber);
+            LS_LOG_ERROR(Config, L"Config: !SetVar directive missing variable name in \"%ls:%u\".", m_tzFullPath, m_uLineNumber);
             TRACE("Syntax Error (%ls, %d): !SetVar missing variable name", m_tzFullPath, m_uLineNumber);
             return;
         }
@@ -656,7 +658,7 @@ void FileParser::_ProcessLine(LPCTSTR ptzName, LPCTSTR ptzValue)
     {
         if (_wcsicmp(ptzName, L"*NetInstallModule") == 0 || _wcsicmp(ptzName, L"*NetLoadModule") == 0)
         {
-            Logger::Log(L"Config: Encountered %ls directive targeting \"%ls\" in \"%ls:%u\".", ptzName, ptzValue, m_tzFullPath, m_uLineNumber);
+            LS_LOG_DEBUG(Config, L"Config: Encountered %ls directive targeting \"%ls\" in \"%ls:%u\".", ptzName, ptzValue, m_tzFullPath, m_uLineNumber);
         }
         m_pSettingsMap->insert(SettingsMap::value_type(ptzName, SettingValue(ptzValue, false)));
     }
@@ -676,7 +678,7 @@ void FileParser::_ProcessIf(LPCTSTR ptzExpression)
 
     if (!MathEvaluateBool(*m_pSettingsMap, ptzExpression, result))
     {
-        Logger::Log(L"Config: Failed to evaluate expression \"%ls\" in \"%ls:%u\".", ptzExpression, m_tzFullPath, m_uLineNumber);
+        LS_LOG_ERROR(Config, L"Config: Failed to evaluate expression \"%ls\" in \"%ls:%u\".", ptzExpression, m_tzFullPath, m_uLineNumber);
         TRACE("Error parsing expression \"%ls\" (%ls, line %d)",
             ptzExpression, m_tzFullPath, m_uLineNumber);
 
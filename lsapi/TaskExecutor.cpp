@@ -2,11 +2,28 @@
 
 #include "lsapidefines.h"
 
+#include <algorithm>
 #include <chrono>
 
 namespace {
-constexpr size_t kMinThreads = 2;
-constexpr size_t kMaxThreads = 4;
+    typedef std::chrono::steady_clock Clock;
+
+    UINT64 MicrosecondsSince(Clock::time_point start) {
+        auto elapsed = Clock::now() - start;
+        if (elapsed.count() <= 0) {
+            return 0;
+        }
+        return UINT64(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    size_t BucketFor(UINT64 value) {
+        size_t bucket = 0;
+        while (value != 0 && bucket < LSTASKSTATS_BUCKETS - 1) {
+            value >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
 }
 
 struct TaskExecutor::TaskRecord {
@@ -15,10 +32,30 @@ struct TaskExecutor::TaskRecord {
     LPVOID executeContext = nullptr;
     LSTASKCOMPLETIONPROC completionProc = nullptr;
     LPVOID completionContext = nullptr;
+    PoolKind pool = CpuPool;
+    Metrics* poolMetrics = nullptr;
+    Metrics* namedMetrics = nullptr;
+    Clock::time_point queuedAt;
+    Clock::time_point completionPostedAt;
     std::atomic<bool> cancelled{ false };
     std::mutex stateMutex;
     std::condition_variable stateCv;
     bool finished = false;
+
+    // Dependency graph state, guarded by TaskExecutor::m_mutex. A record stays
+    // in m_tasks until it is finalized and every dependent has been finalized
+    // too, so that cancelling a root still reaches the rest of its graph.
+    size_t pendingDependencies = 0;
+    size_t liveDependents = 0;
+    std::vector<std::shared_ptr<TaskRecord>> dependents;
+    std::vector<std::weak_ptr<TaskRecord>> dependencies;
+    // Tasks submitted together with this group record by SubmitBatch. A
+    // cancelled member only counts as finished for its group, it does not
+    // cancel the group or what comes after it.
+    std::vector<std::shared_ptr<TaskRecord>> members;
+    bool group = false;
+    bool executed = false;
+    bool finalized = false;
 };
 
 struct TaskExecutor::CompletionPayload {
@@ -26,29 +63,39 @@ struct TaskExecutor::CompletionPayload {
     BOOL cancelled = FALSE;
 };
 
-TaskExecutor::TaskExecutor()
+TaskExecutor::TaskExecutor(const TaskExecutorConfig& config)
     : m_stopping(false)
     , m_nextId(1) {
-    size_t hardware = std::thread::hardware_concurrency();
-    size_t workerCount = 3;
-    if (hardware > 0) {
-        size_t suggested = hardware / 2;
-        if (suggested < kMinThreads) {
-            suggested = kMinThreads;
-        }
-        if (suggested > kMaxThreads) {
-            suggested = kMaxThreads;
-        }
-        workerCount = suggested;
+    size_t cpuThreads = config.cpuThreads;
+    if (cpuThreads == 0) {
+        cpuThreads = std::thread::hardware_concurrency();
+    }
+    if (cpuThreads == 0) {
+        cpuThreads = 2;
     }
 
-    if (workerCount == 0) {
-        workerCount = kMinThreads;
+    Pool& cpu = m_pools[CpuPool];
+    cpu.name = L"CPU";
+    cpu.minThreads = cpuThreads;
+    cpu.maxThreads = cpuThreads;
+
+    // Blocking tasks get their own pool, so shell I/O can not starve compute
+    // work. It grows while all of its workers are busy and shrinks again once
+    // they have been idle for a while.
+    Pool& io = m_pools[IoPool];
+    io.name = L"I/O";
+    io.minThreads = config.ioMinThreads;
+    io.maxThreads = config.ioMaxThreads < 1 ? 1 : config.ioMaxThreads;
+    if (io.minThreads > io.maxThreads) {
+        io.minThreads = io.maxThreads;
     }
+    io.idleTimeoutMs = config.ioIdleTimeoutMs;
 
-    m_workers.reserve(workerCount);
-    for (size_t i = 0; i < workerCount; ++i) {
-        m_workers.emplace_back(&TaskExecutor::WorkerLoop, this);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Pool& pool : m_pools) {
+        for (size_t i = 0; i < pool.minThreads; ++i) {
+            SpawnWorkerLocked(pool);
+        }
     }
 }
 
@@ -60,10 +107,28 @@ LSTASKHANDLE TaskExecutor::Submit(LSTASKEXECUTEPROC executeProc,
                                   LPVOID executeContext,
                                   LSTASKCOMPLETIONPROC completionProc,
                                   LPVOID completionContext) {
+    if (!executeProc) {
+        return 0;
+    }
+
+    return SubmitAfter(nullptr, 0, 0, nullptr, executeProc, executeContext, completionProc, completionContext);
+}
+
+LSTASKHANDLE TaskExecutor::SubmitAfter(const LSTASKHANDLE* dependencies,
+                                       UINT dependencyCount,
+                                       DWORD flags,
+                                       LPCWSTR name,
+                                       LSTASKEXECUTEPROC executeProc,
+                                       LPVOID executeContext,
+                                       LSTASKCOMPLETIONPROC completionProc,
+                                       LPVOID completionContext) {
     if (m_stopping.load(std::memory_order_acquire)) {
         return 0;
     }
-    if (!executeProc) {
+    if (dependencyCount > 0 && !dependencies) {
+        return 0;
+    }
+    if (!executeProc && dependencyCount == 0) {
         return 0;
     }
 
@@ -73,32 +138,145 @@ LSTASKHANDLE TaskExecutor::Submit(LSTASKEXECUTEPROC executeProc,
     task->executeContext = executeContext;
     task->completionProc = completionProc;
     task->completionContext = completionContext;
+    task->pool = (flags & LSTASK_BLOCKING) ? IoPool : CpuPool;
+    task->poolMetrics = &m_pools[task->pool].metrics;
+    if (name) {
+        task->namedMetrics = &FindMetrics(task->pool, name)->metrics;
+    }
+    Record(*task, &Metrics::submitted);
 
+    Wakeups wakeups;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
         if (m_stopping.load(std::memory_order_acquire)) {
             return 0;
         }
-        m_queue.push_back(task);
+
+        // Handles that are no longer tracked belong to tasks whose graph has
+        // already drained, so they count as satisfied.
+        for (UINT i = 0; i < dependencyCount; ++i) {
+            auto it = m_tasks.find(dependencies[i]);
+            if (it == m_tasks.end()) {
+                continue;
+            }
+
+            const std::shared_ptr<TaskRecord>& dependency = it->second;
+            if (dependency->cancelled.load(std::memory_order_acquire)) {
+                task->cancelled.store(true, std::memory_order_release);
+            }
+            if (!dependency->executed) {
+                dependency->dependents.push_back(task);
+                ++task->pendingDependencies;
+            }
+            ++dependency->liveDependents;
+            task->dependencies.push_back(dependency);
+        }
+
         m_tasks.emplace(task->id, task);
+        if (task->pendingDependencies == 0) {
+            EnqueueLocked(task, wakeups);
+            ScheduleLocked(wakeups);
+        }
     }
+    WakeWorkers(wakeups);
 
-    m_cv.notify_one();
     return task->id;
 }
 
-bool TaskExecutor::Cancel(LSTASKHANDLE handle) {
-    std::shared_ptr<TaskRecord> task;
+LSTASKHANDLE TaskExecutor::SubmitBatch(const LSTASKDESC* tasks,
+                                       UINT taskCount,
+                                       LSTASKHANDLE* handles) {
+    if (m_stopping.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    if (!tasks || taskCount == 0) {
+        return 0;
+    }
+    for (UINT i = 0; i < taskCount; ++i) {
+        if (!tasks[i].executeProc) {
+            return 0;
+        }
+    }
+
+    // Everything is allocated up front so the lock is only held for the
+    // bookkeeping. The group is a join over the members with nothing to
+    // execute, it finishes once every member has executed. It is not a task
+    // the caller submitted, so it stays out of the metrics.
+    auto group = std::make_shared<TaskRecord>();
+    group->id = m_nextId.fetch_add(taskCount + 1, std::memory_order_relaxed);
+    group->group = true;
+    group->members.reserve(taskCount);
+    group->dependencies.reserve(taskCount);
+    for (UINT i = 0; i < taskCount; ++i) {
+        auto task = std::make_shared<TaskRecord>();
+        task->id = group->id + 1 + i;
+        task->executeProc = tasks[i].executeProc;
+        task->executeContext = tasks[i].executeContext;
+        task->completionProc = tasks[i].completionProc;
+        task->completionContext = tasks[i].completionContext;
+        task->pool = (tasks[i].dwFlags & LSTASK_BLOCKING) ? IoPool : CpuPool;
+        task->poolMetrics = &m_pools[task->pool].metrics;
+        if (tasks[i].pwzName) {
+            task->namedMetrics = &FindMetrics(task->pool, tasks[i].pwzName)->metrics;
+        }
+        Record(*task, &Metrics::submitted);
+        task->dependents.push_back(group);
+        task->liveDependents = 1;
+        group->dependencies.push_back(task);
+        group->members.push_back(std::move(task));
+    }
+    group->pendingDependencies = taskCount;
+
+    Wakeups wakeups;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        auto it = m_tasks.find(handle);
-        if (it == m_tasks.end()) {
-            return false;
+        if (m_stopping.load(std::memory_order_acquire)) {
+            return 0;
+        }
+
+        m_tasks.emplace(group->id, group);
+        for (auto& task : group->members) {
+            m_tasks.emplace(task->id, task);
+            EnqueueLocked(task, wakeups);
+        }
+        ScheduleLocked(wakeups);
+    }
+    WakeWorkers(wakeups);
+
+    if (handles) {
+        for (UINT i = 0; i < taskCount; ++i) {
+            handles[i] = group->id + 1 + i;
+        }
+    }
+    return group->id;
+}
+
+bool TaskExecutor::Cancel(LSTASKHANDLE handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tasks.find(handle);
+    if (it == m_tasks.end()) {
+        return false;
+    }
+
+    // Dependents added after this point inherit the flag in SubmitAfter, so a
+    // record that is already cancelled does not need to be walked again.
+    // Cancelling a group reaches its members, cancelling a member only reaches
+    // what depends on it other than its group.
+    std::vector<std::shared_ptr<TaskRecord>> pending{ it->second };
+    pending.insert(pending.end(), it->second->members.begin(), it->second->members.end());
+    while (!pending.empty()) {
+        std::shared_ptr<TaskRecord> task = std::move(pending.back());
+        pending.pop_back();
+        if (task->cancelled.exchange(true, std::memory_order_acq_rel)) {
+            continue;
+        }
+        for (auto& dependent : task->dependents) {
+            if (!dependent->group) {
+                pending.push_back(dependent);
+            }
         }
-        task = it->second;
     }
 
-    task->cancelled.store(true, std::memory_order_release);
     return true;
 }
 
@@ -132,6 +310,9 @@ void TaskExecutor::ProcessCompletionPayload(void* payload) {
 
     std::unique_ptr<CompletionPayload> holder(static_cast<CompletionPayload*>(payload));
     auto task = holder->task;
+    if (task) {
+        Record(*task, &Metrics::completionLatency, MicrosecondsSince(task->completionPostedAt));
+    }
     if (task && task->completionProc) {
         task->completionProc(task->completionContext, holder->cancelled);
     }
@@ -140,28 +321,98 @@ void TaskExecutor::ProcessCompletionPayload(void* payload) {
     }
 }
 
+HRESULT TaskExecutor::EnumPools(LSENUMTASKPOOLSPROCW callback, LPARAM lParam) {
+    LSTASKPOOLSTATS stats[PoolCount] = {};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < PoolCount; ++i) {
+            const Pool& pool = m_pools[i];
+            stats[i].cbSize = sizeof(LSTASKPOOLSTATS);
+            stats[i].uThreads = UINT(pool.liveThreads);
+            stats[i].uIdleThreads = UINT(pool.idleThreads);
+            stats[i].uPeakThreads = UINT(pool.peakThreads);
+            stats[i].uMinThreads = UINT(pool.minThreads);
+            stats[i].uMaxThreads = UINT(pool.maxThreads);
+            stats[i].uQueued = UINT(pool.queue.size());
+            stats[i].ullExecuted = pool.executed;
+        }
+    }
+
+    for (int i = 0; i < PoolCount; ++i) {
+        if (!callback(m_pools[i].name, &stats[i], lParam)) {
+            return S_FALSE;
+        }
+    }
+    return S_OK;
+}
+
+HRESULT TaskExecutor::EnumStats(LSENUMTASKSTATSPROCW callback, LPARAM lParam) {
+    // The counters are read without stopping the workers, so an entry is a
+    // close approximation rather than an exact snapshot.
+    for (const Pool& pool : m_pools) {
+        LSTASKSTATS stats;
+        pool.metrics.Read(stats);
+        if (!callback(pool.name, nullptr, &stats, lParam)) {
+            return S_FALSE;
+        }
+
+        std::vector<const NamedMetrics*> named;
+        {
+            std::lock_guard<std::mutex> lock(m_metricsMutex);
+            for (const auto& entry : pool.named) {
+                named.push_back(entry.get());
+            }
+        }
+        for (const NamedMetrics* entry : named) {
+            entry->metrics.Read(stats);
+            if (!callback(pool.name, entry->name.c_str(), &stats, lParam)) {
+                return S_FALSE;
+            }
+        }
+    }
+    return S_OK;
+}
+
 void TaskExecutor::Shutdown() {
     bool expected = false;
     if (!m_stopping.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
         return;
     }
 
-    m_cv.notify_all();
-    for (auto& worker : m_workers) {
+    // Workers drain their queues before exiting. Dependents released while
+    // draining are still queued, but no new threads are spawned.
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Pool& pool : m_pools) {
+            pool.cv.notify_all();
+            for (auto& worker : pool.threads) {
+                workers.push_back(std::move(worker));
+            }
+            pool.threads.clear();
+            pool.exited.clear();
+        }
+    }
+    for (auto& worker : workers) {
         if (worker.joinable()) {
             worker.join();
         }
     }
-    m_workers.clear();
 
     std::vector<std::shared_ptr<TaskRecord>> remaining;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
         for (auto& pair : m_tasks) {
-            remaining.push_back(pair.second);
+            if (!pair.second->finalized) {
+                remaining.push_back(pair.second);
+            }
+            pair.second->dependents.clear();
+            pair.second->members.clear();
         }
         m_tasks.clear();
-        m_queue.clear();
+        for (Pool& pool : m_pools) {
+            pool.queue.clear();
+        }
     }
 
     for (auto& task : remaining) {
@@ -176,37 +427,146 @@ void TaskExecutor::Shutdown() {
     }
 }
 
-void TaskExecutor::WorkerLoop() {
+void TaskExecutor::WorkerLoop(Pool* pool) {
+    std::unique_lock<std::mutex> lock(m_mutex);
     for (;;) {
-        std::shared_ptr<TaskRecord> task;
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            m_cv.wait(lock, [&] { return m_stopping.load(std::memory_order_acquire) || !m_queue.empty(); });
-
-            if (m_stopping.load(std::memory_order_acquire) && m_queue.empty()) {
-                return;
+        ++pool->idleThreads;
+        bool retire = false;
+        while (!m_stopping.load(std::memory_order_acquire) && pool->queue.empty()) {
+            if (pool->idleTimeoutMs == 0 || pool->liveThreads <= pool->minThreads) {
+                pool->cv.wait(lock);
+                continue;
+            }
+            if (pool->cv.wait_for(lock, std::chrono::milliseconds(pool->idleTimeoutMs)) == std::cv_status::timeout &&
+                pool->queue.empty() && pool->liveThreads > pool->minThreads) {
+                retire = true;
+                break;
             }
+        }
+        --pool->idleThreads;
 
-            if (!m_queue.empty()) {
-                task = std::move(m_queue.front());
-                m_queue.pop_front();
+        if (retire || (m_stopping.load(std::memory_order_acquire) && pool->queue.empty())) {
+            --pool->liveThreads;
+            if (retire) {
+                // Joined by the next SpawnWorkerLocked, or by Shutdown.
+                pool->exited.push_back(std::this_thread::get_id());
             }
+            return;
         }
 
-        if (!task) {
-            continue;
+        std::shared_ptr<TaskRecord> task = std::move(pool->queue.front());
+        pool->queue.pop_front();
+        if (!task->group) {
+            ++pool->executed;
         }
+        lock.unlock();
 
-        if (!task->cancelled.load(std::memory_order_acquire)) {
+        Record(*task, &Metrics::waitTime, MicrosecondsSince(task->queuedAt));
+        if (!task->cancelled.load(std::memory_order_acquire) && task->executeProc) {
+            Clock::time_point start = Clock::now();
             task->executeProc(task->executeContext);
+            Record(*task, &Metrics::executeTime, MicrosecondsSince(start));
+            Record(*task, &Metrics::executed);
         }
 
+        BOOL cancelled = task->cancelled.load(std::memory_order_acquire) ? TRUE : FALSE;
+        if (cancelled) {
+            Record(*task, &Metrics::cancelled);
+        }
+        ReleaseDependents(task);
+
         if (task->completionProc) {
-            EnqueueCompletion(task, task->cancelled.load(std::memory_order_acquire));
+            EnqueueCompletion(task, cancelled);
         } else {
             FinalizeTask(task);
         }
+
+        task.reset();
+        lock.lock();
+    }
+}
+
+void TaskExecutor::SpawnWorkerLocked(Pool& pool) {
+    for (const std::thread::id& id : pool.exited) {
+        auto it = std::find_if(pool.threads.begin(), pool.threads.end(),
+            [&](const std::thread& thread) { return thread.get_id() == id; });
+        if (it != pool.threads.end()) {
+            it->join();
+            pool.threads.erase(it);
+        }
+    }
+    pool.exited.clear();
+
+    pool.threads.emplace_back(&TaskExecutor::WorkerLoop, this, &pool);
+    ++pool.liveThreads;
+    if (pool.liveThreads > pool.peakThreads) {
+        pool.peakThreads = pool.liveThreads;
+    }
+}
+
+void TaskExecutor::EnqueueLocked(const std::shared_ptr<TaskRecord>& task, Wakeups& wakeups) {
+    Pool& pool = m_pools[task->pool];
+    task->queuedAt = Clock::now();
+    pool.queue.push_back(task);
+    ++wakeups.ready[task->pool];
+    Record(*task, &Metrics::queueDepth, pool.queue.size());
+}
+
+void TaskExecutor::ScheduleLocked(Wakeups& wakeups) {
+    for (int i = 0; i < PoolCount; ++i) {
+        Pool& pool = m_pools[i];
+        size_t ready = wakeups.ready[i];
+        if (ready == 0) {
+            continue;
+        }
+
+        // Only wake idle workers that are not already on their way to an item
+        // queued before these. When every worker is busy (typically blocked in
+        // the shell) an elastic pool adds threads for the rest instead.
+        size_t earlier = pool.queue.size() - ready;
+        size_t available = pool.idleThreads > earlier ? pool.idleThreads - earlier : 0;
+        wakeups.wake[i] = std::min(ready, available);
+        wakeups.all[i] = wakeups.wake[i] > 1 && wakeups.wake[i] == pool.idleThreads;
+
+        for (size_t spawn = ready - wakeups.wake[i]; spawn > 0; --spawn) {
+            if (pool.liveThreads >= pool.maxThreads || m_stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+            SpawnWorkerLocked(pool);
+        }
+    }
+}
+
+void TaskExecutor::WakeWorkers(const Wakeups& wakeups) {
+    for (int i = 0; i < PoolCount; ++i) {
+        if (wakeups.all[i]) {
+            m_pools[i].cv.notify_all();
+            continue;
+        }
+        for (size_t wake = 0; wake < wakeups.wake[i]; ++wake) {
+            m_pools[i].cv.notify_one();
+        }
+    }
+}
+
+void TaskExecutor::ReleaseDependents(const std::shared_ptr<TaskRecord>& task) {
+    Wakeups wakeups;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        task->executed = true;
+
+        bool cancelled = task->cancelled.load(std::memory_order_acquire);
+        for (auto& dependent : task->dependents) {
+            if (cancelled && !dependent->group) {
+                dependent->cancelled.store(true, std::memory_order_release);
+            }
+            if (--dependent->pendingDependencies == 0) {
+                EnqueueLocked(dependent, wakeups);
+            }
+        }
+        ScheduleLocked(wakeups);
     }
+    WakeWorkers(wakeups);
 }
 
 void TaskExecutor::EnqueueCompletion(const std::shared_ptr<TaskRecord>& task, BOOL cancelled) {
@@ -221,6 +581,7 @@ void TaskExecutor::EnqueueCompletion(const std::shared_ptr<TaskRecord>& task, BO
 
     payload->task = task;
     payload->cancelled = cancelled;
+    task->completionPostedAt = Clock::now();
 
     HWND target = GetLitestepWnd();
     if (!target || !PostMessage(target, LM_ASYNCTASKCOMPLETE, reinterpret_cast<WPARAM>(payload), 0)) {
@@ -231,7 +592,8 @@ void TaskExecutor::EnqueueCompletion(const std::shared_ptr<TaskRecord>& task, BO
 void TaskExecutor::FinalizeTask(const std::shared_ptr<TaskRecord>& task) {
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_tasks.erase(task->id);
+        task->finalized = true;
+        RetireLocked(task);
     }
 
     {
@@ -240,3 +602,89 @@ void TaskExecutor::FinalizeTask(const std::shared_ptr<TaskRecord>& task) {
     }
     task->stateCv.notify_all();
 }
+
+void TaskExecutor::RetireLocked(const std::shared_ptr<TaskRecord>& task) {
+    if (!task->finalized || task->liveDependents > 0) {
+        return;
+    }
+
+    // Every dependent has retired by now, so the edges to them are no longer
+    // needed to carry a cancellation.
+    m_tasks.erase(task->id);
+    task->dependents.clear();
+    task->members.clear();
+
+    std::vector<std::weak_ptr<TaskRecord>> dependencies;
+    dependencies.swap(task->dependencies);
+    for (auto& weak : dependencies) {
+        if (auto dependency = weak.lock()) {
+            --dependency->liveDependents;
+            RetireLocked(dependency);
+        }
+    }
+}
+
+TaskExecutor::NamedMetrics* TaskExecutor::FindMetrics(PoolKind pool, LPCWSTR name) {
+    // Names are expected to come from a small fixed set, so a linear search
+    // is cheaper than hashing.
+    std::lock_guard<std::mutex> lock(m_metricsMutex);
+    auto& named = m_pools[pool].named;
+    for (auto& entry : named) {
+        if (entry->name == name) {
+            return entry.get();
+        }
+    }
+
+    named.push_back(std::make_unique<NamedMetrics>());
+    named.back()->name = name;
+    return named.back().get();
+}
+
+void TaskExecutor::Record(const TaskRecord& task, std::atomic<UINT64> Metrics::*counter) {
+    if (task.poolMetrics) {
+        (task.poolMetrics->*counter).fetch_add(1, std::memory_order_relaxed);
+    }
+    if (task.namedMetrics) {
+        (task.namedMetrics->*counter).fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void TaskExecutor::Record(const TaskRecord& task, Histogram Metrics::*histogram, UINT64 value) {
+    if (task.poolMetrics) {
+        (task.poolMetrics->*histogram).Record(value);
+    }
+    if (task.namedMetrics) {
+        (task.namedMetrics->*histogram).Record(value);
+    }
+}
+
+void TaskExecutor::Histogram::Record(UINT64 value) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    buckets[BucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+
+    UINT64 current = max.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void TaskExecutor::Histogram::Read(LSTASKHISTOGRAM& histogram) const {
+    histogram.ullCount = count.load(std::memory_order_relaxed);
+    histogram.ullTotal = total.load(std::memory_order_relaxed);
+    histogram.ullMax = max.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < LSTASKSTATS_BUCKETS; ++i) {
+        histogram.aullBuckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+void TaskExecutor::Metrics::Read(LSTASKSTATS& stats) const {
+    stats.cbSize = sizeof(LSTASKSTATS);
+    stats.ullSubmitted = submitted.load(std::memory_order_relaxed);
+    stats.ullExecuted = executed.load(std::memory_order_relaxed);
+    stats.ullCancelled = cancelled.load(std::memory_order_relaxed);
+    queueDepth.Read(stats.queueDepth);
+    waitTime.Read(stats.waitTime);
+    executeTime.Read(stats.executeTime);
+    completionLatency.Read(stats.completionLatency);
+}
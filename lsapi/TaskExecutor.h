@@ -8,13 +8,24 @@
 #include <deque>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+struct TaskExecutorConfig {
+    // Workers for ordinary tasks. 0 sizes the pool to the number of cores.
+    size_t cpuThreads = 0;
+    // Bounds of the elastic pool that runs LSTASK_BLOCKING tasks.
+    size_t ioMinThreads = 1;
+    size_t ioMaxThreads = 8;
+    // How long an I/O worker above ioMinThreads may sit idle before it exits.
+    DWORD ioIdleTimeoutMs = 30000;
+};
+
 class TaskExecutor {
 public:
-    TaskExecutor();
+    explicit TaskExecutor(const TaskExecutorConfig& config = TaskExecutorConfig());
     ~TaskExecutor();
 
     LSTASKHANDLE Submit(LSTASKEXECUTEPROC executeProc,
@@ -22,24 +33,119 @@ public:
                         LSTASKCOMPLETIONPROC completionProc,
                         LPVOID completionContext);
 
+    // Queues a task that runs once every task in dependencies has executed.
+    // executeProc may be null, in which case the task is a pure join that only
+    // delivers its completion. A cancelled dependency cancels the new task.
+    // LSTASK_BLOCKING in flags routes the task to the I/O pool. A non-null
+    // name also accounts the task under that name in EnumStats.
+    LSTASKHANDLE SubmitAfter(const LSTASKHANDLE* dependencies,
+                             UINT dependencyCount,
+                             DWORD flags,
+                             LPCWSTR name,
+                             LSTASKEXECUTEPROC executeProc,
+                             LPVOID executeContext,
+                             LSTASKCOMPLETIONPROC completionProc,
+                             LPVOID completionContext);
+
+    // Queues every task in tasks under a single lock and returns the handle of
+    // a group that finishes once all of them have executed. Waiting on or
+    // cancelling the group applies to every member, while a cancelled member
+    // only counts as finished for the group. The member handles are written
+    // to handles when it is not null.
+    LSTASKHANDLE SubmitBatch(const LSTASKDESC* tasks,
+                             UINT taskCount,
+                             LSTASKHANDLE* handles);
+
     bool Cancel(LSTASKHANDLE handle);
     bool Wait(LSTASKHANDLE handle, DWORD timeoutMs);
     void ProcessCompletionPayload(void* payload);
+    HRESULT EnumPools(LSENUMTASKPOOLSPROCW callback, LPARAM lParam);
+    HRESULT EnumStats(LSENUMTASKSTATSPROCW callback, LPARAM lParam);
     void Shutdown();
 
 private:
     struct TaskRecord;
     struct CompletionPayload;
 
-    void WorkerLoop();
+    // Log2-bucketed histogram that can be recorded into from any thread
+    // without taking a lock.
+    struct Histogram {
+        std::atomic<UINT64> count{ 0 };
+        std::atomic<UINT64> total{ 0 };
+        std::atomic<UINT64> max{ 0 };
+        std::atomic<UINT64> buckets[LSTASKSTATS_BUCKETS] = {};
+
+        void Record(UINT64 value);
+        void Read(LSTASKHISTOGRAM& histogram) const;
+    };
+
+    struct Metrics {
+        std::atomic<UINT64> submitted{ 0 };
+        std::atomic<UINT64> executed{ 0 };
+        std::atomic<UINT64> cancelled{ 0 };
+        Histogram queueDepth;
+        Histogram waitTime;
+        Histogram executeTime;
+        Histogram completionLatency;
+
+        void Read(LSTASKSTATS& stats) const;
+    };
+
+    struct NamedMetrics {
+        std::wstring name;
+        Metrics metrics;
+    };
+
+    enum PoolKind {
+        CpuPool,
+        IoPool,
+        PoolCount
+    };
+
+    // Pool state is guarded by m_mutex.
+    struct Pool {
+        LPCWSTR name = nullptr;
+        std::deque<std::shared_ptr<TaskRecord>> queue;
+        std::condition_variable cv;
+        std::vector<std::thread> threads;
+        std::vector<std::thread::id> exited;
+        size_t minThreads = 0;
+        size_t maxThreads = 0;
+        size_t liveThreads = 0;
+        size_t idleThreads = 0;
+        size_t peakThreads = 0;
+        DWORD idleTimeoutMs = 0;
+        UINT64 executed = 0;
+        Metrics metrics;
+        // Appended to under m_metricsMutex, entries are never removed.
+        std::vector<std::unique_ptr<NamedMetrics>> named;
+    };
+
+    // Tasks queued per pool under one hold of m_mutex, and the workers to
+    // wake for them once it is released.
+    struct Wakeups {
+        size_t ready[PoolCount] = {};
+        size_t wake[PoolCount] = {};
+        bool all[PoolCount] = {};
+    };
+
+    void WorkerLoop(Pool* pool);
+    void SpawnWorkerLocked(Pool& pool);
+    void EnqueueLocked(const std::shared_ptr<TaskRecord>& task, Wakeups& wakeups);
+    void ScheduleLocked(Wakeups& wakeups);
+    void WakeWorkers(const Wakeups& wakeups);
+    void ReleaseDependents(const std::shared_ptr<TaskRecord>& task);
     void EnqueueCompletion(const std::shared_ptr<TaskRecord>& task, BOOL cancelled);
     void FinalizeTask(const std::shared_ptr<TaskRecord>& task);
+    void RetireLocked(const std::shared_ptr<TaskRecord>& task);
+    NamedMetrics* FindMetrics(PoolKind pool, LPCWSTR name);
+    static void Record(const TaskRecord& task, std::atomic<UINT64> Metrics::*counter);
+    static void Record(const TaskRecord& task, Histogram Metrics::*histogram, UINT64 value);
 
     std::mutex m_mutex;
-    std::condition_variable m_cv;
-    std::deque<std::shared_ptr<TaskRecord>> m_queue;
+    std::mutex m_metricsMutex;
+    Pool m_pools[PoolCount];
     std::unordered_map<LSTASKHANDLE, std::shared_ptr<TaskRecord>> m_tasks;
-    std::vector<std::thread> m_workers;
     std::atomic<bool> m_stopping;
     std::atomic_uint64_t m_nextId;
 };
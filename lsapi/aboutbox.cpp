@@ -48,6 +48,7 @@ static void AboutModules(HWND hListView);
 static void AboutRevIDs(HWND hListView);
 static void AboutSysInfo(HWND hListView);
 static void AboutPerformance(HWND hListView);
+static void AboutTimeline(HWND hListView);
 
 // Utility
 static HFONT CreateSimpleFont(LPCWSTR pszName, int nSizeInPoints, bool bBold);
@@ -68,6 +69,7 @@ enum
     ,ABOUT_MODULES
     ,ABOUT_PERFORMANCE
     ,ABOUT_REVIDS
+    ,ABOUT_TIMELINE
     ,ABOUT_SYSINFO
 };
 
@@ -84,6 +86,7 @@ static const g_aboutOptions[] = \
     ,{ L"Loaded Modules",     AboutModules     }
     ,{ L"Performance",        AboutPerformance }
     ,{ L"Revision IDs",       AboutRevIDs      }
+    ,{ L"Startup Timeline",   AboutTimeline    }
     ,{ L"System Information", AboutSysInfo     }
 };
 
@@ -322,7 +325,7 @@ static INT_PTR OnCommand(
         ListView_DeleteAllItems(hListView);
 
         // Delete listview columns
-        for (int nCol = 3; nCol >= 0; --nCol)
+        for (int nCol = 4; nCol >= 0; --nCol)
         {
             ListView_DeleteColumn(hListView, nCol);
         }
@@ -344,6 +347,7 @@ static INT_PTR OnCommand(
         case ABOUT_DEVTEAM:
         case ABOUT_MODULES:
         case ABOUT_PERFORMANCE:
+        case ABOUT_TIMELINE:
         case ABOUT_SYSINFO:
             // set the current display to the list view
             g_aboutOptions[i].function(hListView);
@@ -643,6 +647,112 @@ static void AboutPerformance(HWND hListView)
 }
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// FormatPhases
+// Helper for TimelineCallback. Formats one or two phase times in ms, e.g.
+// "12.5 - 40.1 ms", or "-" if the module has not reached them.
+//
+static void FormatPhases(UINT64 ullStart, UINT64 ullEnd, LPWSTR pwzBuffer, size_t cchBuffer)
+{
+    if (ullStart == LSMODULEPHASE_NONE)
+    {
+        StringCchCopyW(pwzBuffer, cchBuffer, L"-");
+    }
+    else if (ullEnd == LSMODULEPHASE_NONE || ullEnd == ullStart)
+    {
+        StringCchPrintfW(pwzBuffer, cchBuffer, L"%.1f ms", ullStart / 1000.0);
+    }
+    else
+    {
+        StringCchPrintfW(pwzBuffer, cchBuffer, L"%.1f - %.1f ms",
+            ullStart / 1000.0, ullEnd / 1000.0);
+    }
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// TimelineCallback
+// Used by AboutTimeline
+//
+static BOOL CALLBACK TimelineCallback(LPCWSTR pszPath, const LSMODULETIMELINE* pTimeline, LPARAM lParam)
+{
+    CallbackInfo* pCi = (CallbackInfo*)lParam;
+    const UINT64* pullPhases = pTimeline->aullPhases;
+
+    wchar_t szText[MAX_PATH] = { 0 };
+    StringCchCopy(szText, _countof(szText), pszPath);
+    PathStripPath(szText);
+
+    LVITEM itemInfo;
+    itemInfo.mask = LVIF_TEXT;
+    itemInfo.iItem = pCi->nItem;
+    itemInfo.pszText = szText;
+    itemInfo.iSubItem = 0;
+
+    ListView_InsertItem(pCi->hListView, &itemInfo);
+
+    // LoadLibrary and the entry point lookup
+    FormatPhases(pullPhases[LSMODULEPHASE_LOADSTART], pullPhases[LSMODULEPHASE_RESOLVED],
+        szText, _countof(szText));
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 1, szText);
+
+    FormatPhases(pullPhases[LSMODULEPHASE_INITSTART], pullPhases[LSMODULEPHASE_INITDONE],
+        szText, _countof(szText));
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 2, szText);
+
+    FormatPhases(pullPhases[LSMODULEPHASE_FIRSTMESSAGE], LSMODULEPHASE_NONE,
+        szText, _countof(szText));
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 3, szText);
+
+    FormatPhases(pullPhases[LSMODULEPHASE_FIRSTPAINT], LSMODULEPHASE_NONE,
+        szText, _countof(szText));
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 4, szText);
+
+    ++pCi->nItem;
+    return TRUE;
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// AboutTimeline
+// When each module reached each startup phase, relative to the start of
+// module loading
+//
+static void AboutTimeline(HWND hListView)
+{
+    LVCOLUMN columnInfo;
+    wchar_t text[32];
+
+    static const wchar_t* const columns[] =
+    {
+        L"Module", L"Load", L"Init", L"First Message", L"First Paint"
+    };
+
+    int width = GetClientWidth(hListView) - GetSystemMetrics(SM_CXVSCROLL);
+
+    columnInfo.mask = LVCF_FMT | LVCF_WIDTH | LVCF_TEXT | LVCF_SUBITEM;
+    columnInfo.fmt = LVCFMT_LEFT;
+
+    for (int i = 0; i < (int)COUNTOF(columns); ++i)
+    {
+        StringCchCopy(text, _countof(text), columns[i]);
+        columnInfo.cx = (i == 0) ? width - 4 * (width / 5) : width / 5;
+        columnInfo.pszText = text;
+        columnInfo.iSubItem = i;
+
+        ListView_InsertColumn(hListView, i, &columnInfo);
+    }
+
+    CallbackInfo ci = { 0 };
+    ci.hListView = hListView;
+
+    EnumLSDataW(ELD_MODULETIMELINE, (FARPROC)TimelineCallback, (LPARAM)&ci);
+}
+
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //
 // RevIDCallback
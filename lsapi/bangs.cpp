@@ -20,6 +20,8 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "../utility/core.hpp"
+#include <algorithm>
+#include <string>
 
 
 extern DWORD WINAPI AboutBoxThread(LPVOID);
@@ -42,6 +44,7 @@ static void BangRun (HWND hCaller, LPCWSTR pwzArgs);
 static void BangShowModules (HWND hCaller, LPCWSTR pwzArgs);
 static void BangShutdown(HWND hCaller, LPCWSTR pwzArgs);
 static void BangSwitchUser(HWND hCaller, LPCWSTR pwzArgs);
+static void BangTaskStats(HWND hCaller, LPCWSTR pwzArgs);
 static void BangTileWindowsH(HWND hCaller, LPCWSTR pwzArgs);
 static void BangTileWindowsV(HWND hCaller, LPCWSTR pwzArgs);
 static void BangToggleModules (HWND hCaller, LPCWSTR pwzArgs);
@@ -68,6 +71,7 @@ void SetupBangs(void)
     AddBangCommandW(L"!ShowModules",      BangShowModules);
     AddBangCommandW(L"!Shutdown",         BangShutdown);
     AddBangCommandW(L"!SwitchUser",       BangSwitchUser);
+    AddBangCommandW(L"!TaskStats",        BangTaskStats);
     AddBangCommandW(L"!TileWindowsH",     BangTileWindowsH);
     AddBangCommandW(L"!TileWindowsV",     BangTileWindowsV);
     AddBangCommandW(L"!ToggleModules",    BangToggleModules);
@@ -230,14 +234,31 @@ static void BangQuit(HWND /* hCaller */, LPCWSTR /* pwzArgs */)
 
 //
 // BangRecycle(HWND hCaller, LPCSTR pwzArgs)
+// "!Recycle soft" keeps modules that support it loaded, "!Recycle full"
+// reloads everything. Without arguments LSSoftRecycle decides.
 //
-static void BangRecycle(HWND /* hCaller */, LPCWSTR /* pwzArgs */)
+static void BangRecycle(HWND /* hCaller */, LPCWSTR pwzArgs)
 {
     HWND hLiteStep = GetLitestepWnd();
 
     if (hLiteStep)
     {
-        PostMessage(hLiteStep, LM_RECYCLE, LR_RECYCLE, 0);
+        wchar_t wzMode[MAX_LINE_LENGTH] = { 0 };
+        bool bSoft = GetRCBoolDefW(L"LSSoftRecycle", FALSE) != FALSE;
+
+        if (GetTokenW(pwzArgs, wzMode, nullptr, FALSE))
+        {
+            if (_wcsicmp(wzMode, L"soft") == 0)
+            {
+                bSoft = true;
+            }
+            else if (_wcsicmp(wzMode, L"full") == 0)
+            {
+                bSoft = false;
+            }
+        }
+
+        PostMessage(hLiteStep, LM_RECYCLE, bSoft ? LR_SOFTRECYCLE : LR_RECYCLE, 0);
     }
 }
 
@@ -413,6 +434,113 @@ static void BangSwitchUser(HWND /* hCaller */, LPCWSTR /* pwzArgs */)
 }
 
 
+//
+// TaskStatsPercentile
+// Upper bound of the bucket that holds the given percentile of a histogram
+//
+static UINT64 TaskStatsPercentile(const LSTASKHISTOGRAM& histogram, UINT uPercent)
+{
+    UINT64 ullTarget = (histogram.ullCount * uPercent + 99) / 100;
+    UINT64 ullSeen = 0;
+
+    for (UINT i = 0; i < LSTASKSTATS_BUCKETS; ++i)
+    {
+        ullSeen += histogram.aullBuckets[i];
+
+        if (ullSeen >= ullTarget && ullSeen > 0)
+        {
+            return (i == 0) ? 0 : (std::min)((1ull << i) - 1, histogram.ullMax);
+        }
+    }
+
+    return histogram.ullMax;
+}
+
+
+//
+// TaskStatsAppendHistogram
+//
+static void TaskStatsAppendHistogram(std::wstring& report, LPCWSTR pwzLabel,
+                                     const LSTASKHISTOGRAM& histogram)
+{
+    wchar_t wzLine[MAX_LINE_LENGTH] = { 0 };
+
+    StringCchPrintfW(wzLine, _countof(wzLine),
+        L"    %-20ls n=%-8I64u avg=%-8I64u p50<=%-8I64u p90<=%-8I64u p99<=%-8I64u max=%I64u\r\n",
+        pwzLabel, histogram.ullCount,
+        histogram.ullCount ? histogram.ullTotal / histogram.ullCount : 0,
+        TaskStatsPercentile(histogram, 50), TaskStatsPercentile(histogram, 90),
+        TaskStatsPercentile(histogram, 99), histogram.ullMax);
+
+    report += wzLine;
+}
+
+
+//
+// TaskStatsCallback
+// Used by BangTaskStats
+//
+static BOOL CALLBACK TaskStatsCallback(LPCWSTR pwzPool, LPCWSTR pwzName,
+                                       const LSTASKSTATS* pStats, LPARAM lParam)
+{
+    std::wstring& report = *(std::wstring*)lParam;
+    wchar_t wzLine[MAX_LINE_LENGTH] = { 0 };
+
+    StringCchPrintfW(wzLine, _countof(wzLine),
+        L"%ls%ls%ls: %I64u submitted, %I64u executed, %I64u cancelled\r\n",
+        pwzPool, pwzName ? L" / " : L"", pwzName ? pwzName : L"",
+        pStats->ullSubmitted, pStats->ullExecuted, pStats->ullCancelled);
+
+    report += wzLine;
+    TaskStatsAppendHistogram(report, L"queue depth", pStats->queueDepth);
+    TaskStatsAppendHistogram(report, L"wait (us)", pStats->waitTime);
+    TaskStatsAppendHistogram(report, L"execute (us)", pStats->executeTime);
+    TaskStatsAppendHistogram(report, L"completion (us)", pStats->completionLatency);
+
+    return TRUE;
+}
+
+
+//
+// BangTaskStats(HWND hCaller, LPCWSTR pwzArgs)
+// Dumps the task executor statistics to the file named by the first argument,
+// or shows them in a message box when no file is given
+//
+static void BangTaskStats(HWND hCaller, LPCWSTR pwzArgs)
+{
+    std::wstring report;
+
+    if (FAILED(EnumLSDataW(ELD_TASKSTATS, (FARPROC)TaskStatsCallback, (LPARAM)&report)))
+    {
+        return;
+    }
+
+    wchar_t wzPath[MAX_PATH] = { 0 };
+
+    if (!GetTokenW(pwzArgs, wzPath, nullptr, FALSE) || wzPath[0] == L'\0')
+    {
+        MessageBoxW(hCaller, report.c_str(), L"LiteStep Task Statistics", MB_OK | MB_TOPMOST);
+        return;
+    }
+
+    int nBytes = WideCharToMultiByte(CP_UTF8, 0, report.c_str(), (int)report.length(),
+        nullptr, 0, nullptr, nullptr);
+    std::string utf8((size_t)nBytes, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, report.c_str(), (int)report.length(),
+        &utf8[0], nBytes, nullptr, nullptr);
+
+    HANDLE hFile = CreateFileW(wzPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        DWORD dwWritten = 0;
+        WriteFile(hFile, utf8.data(), (DWORD)utf8.size(), &dwWritten, nullptr);
+        CloseHandle(hFile);
+    }
+}
+
+
 //
 // BangTileWindowsH(HWND hCaller, LPCWSTR pszArgs)
 //
@@ -24,6 +24,7 @@
 #include "TaskExecutor.h"
 #include "BangCommand.h"
 #include "../utility/core.hpp"
+#include "../utility/logger.h"
 
 static int _Tokenize(LPCSTR pszString, LPSTR* lpszBuffers, DWORD dwNumBuffers,
                      LPSTR pszExtraParameters, BOOL bUseBrackets);
@@ -81,6 +82,12 @@ void LSAPISetCOMFactory(IClassFactory *pFactory)
 }
 
 
+void LSAPISetLogSink(LPVOID pSink)
+{
+    Logger::AttachSink(static_cast<Logger::Sink*>(pSink));
+}
+
+
 template<typename BangType>
 static BOOL AddBangCommandWorker(LPCWSTR pwzCommand, BangType pfnBangCommand)
 {
@@ -155,6 +162,71 @@ LSTASKHANDLE LSPostTask(LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
     return executor->Submit(executeProc, executeContext, completionProc, completionContext);
 }
 
+LSTASKHANDLE LSPostTaskAfter(const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+    LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
+    LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext)
+{
+    TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+    if (!executor || executeProc == nullptr)
+    {
+        return 0;
+    }
+
+    return executor->SubmitAfter(pDependencies, uDependencyCount, 0, nullptr,
+        executeProc, executeContext, completionProc, completionContext);
+}
+
+LSTASKHANDLE LSPostTaskEx(DWORD dwFlags, const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+    LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
+    LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext)
+{
+    TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+    if (!executor || executeProc == nullptr)
+    {
+        return 0;
+    }
+
+    return executor->SubmitAfter(pDependencies, uDependencyCount, dwFlags, nullptr,
+        executeProc, executeContext, completionProc, completionContext);
+}
+
+LSTASKHANDLE LSPostTaskDesc(const LSTASKDESC* pTask,
+    const LSTASKHANDLE* pDependencies, UINT uDependencyCount)
+{
+    TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+    if (!executor || pTask == nullptr || pTask->executeProc == nullptr)
+    {
+        return 0;
+    }
+
+    return executor->SubmitAfter(pDependencies, uDependencyCount, pTask->dwFlags, pTask->pwzName,
+        pTask->executeProc, pTask->executeContext, pTask->completionProc, pTask->completionContext);
+}
+
+LSTASKHANDLE LSPostTaskWhenAll(const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+    LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext)
+{
+    TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+    if (!executor || pDependencies == nullptr || uDependencyCount == 0)
+    {
+        return 0;
+    }
+
+    return executor->SubmitAfter(pDependencies, uDependencyCount, 0, nullptr,
+        nullptr, nullptr, completionProc, completionContext);
+}
+
+LSTASKHANDLE LSPostTasks(const LSTASKDESC* pTasks, UINT uTaskCount, LSTASKHANDLE* pHandles)
+{
+    TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+    if (!executor || pTasks == nullptr || uTaskCount == 0)
+    {
+        return 0;
+    }
+
+    return executor->SubmitBatch(pTasks, uTaskCount, pHandles);
+}
+
 BOOL LSCancelTask(LSTASKHANDLE handle)
 {
     TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
@@ -1202,6 +1274,48 @@ HRESULT EnumLSDataW(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
             }
             break;
 
+        case ELD_TASKPOOLS:
+            {
+                TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+                if (executor)
+                {
+                    hr = executor->EnumPools((LSENUMTASKPOOLSPROCW)pfnCallback, lParam);
+                }
+                else
+                {
+                    hr = E_FAIL;
+                }
+            }
+            break;
+
+        case ELD_TASKSTATS:
+            {
+                TaskExecutor* executor = g_LSAPIManager.GetTaskExecutor();
+                if (executor)
+                {
+                    hr = executor->EnumStats((LSENUMTASKSTATSPROCW)pfnCallback, lParam);
+                }
+                else
+                {
+                    hr = E_FAIL;
+                }
+            }
+            break;
+
+        case ELD_MESSAGESTATS:
+            {
+                hr = (HRESULT)SendMessage(GetLitestepWnd(), LM_ENUMMESSAGESTATS,
+                    (WPARAM)pfnCallback, lParam);
+            }
+            break;
+
+        case ELD_MODULETIMELINE:
+            {
+                hr = (HRESULT)SendMessage(GetLitestepWnd(), LM_ENUMMODULETIMELINE,
+                    (WPARAM)pfnCallback, lParam);
+            }
+            break;
+
         default:
             {
                 // do nothing
@@ -1248,6 +1362,28 @@ static BOOL CALLBACK EnumLSDataPerformanceANSIIWrapper(LPCWSTR pwzModule, DWORD
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
     return LSENUMPERFORMANCEPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzModule)).get(), dwLoadTime, pData->lParam);
 }
+static BOOL CALLBACK EnumLSDataTaskPoolsANSIIWrapper(LPCWSTR pwzPool, const LSTASKPOOLSTATS* pStats, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    return LSENUMTASKPOOLSPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzPool)).get(), pStats, pData->lParam);
+}
+static BOOL CALLBACK EnumLSDataTaskStatsANSIIWrapper(LPCWSTR pwzPool, LPCWSTR pwzName, const LSTASKSTATS* pStats, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    std::unique_ptr<char> name(pwzName ? MBSFromWCS(pwzName) : nullptr);
+    return LSENUMTASKSTATSPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzPool)).get(), name.get(), pStats, pData->lParam);
+}
+static BOOL CALLBACK EnumLSDataMessageStatsANSIIWrapper(LPCWSTR pwzModule, const LSMESSAGESTATS* pStats, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    std::unique_ptr<char> module(pwzModule ? MBSFromWCS(pwzModule) : nullptr);
+    return LSENUMMESSAGESTATSPROCA(pData->fnCallback)(module.get(), pStats, pData->lParam);
+}
+static BOOL CALLBACK EnumLSDataModuleTimelineANSIIWrapper(LPCWSTR pwzModule, const LSMODULETIMELINE* pTimeline, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    return LSENUMMODULETIMELINEPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzModule)).get(), pTimeline, pData->lParam);
+}
 
 
 //
@@ -1304,6 +1440,30 @@ HRESULT EnumLSDataA(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
                 pfnCallback = FARPROC(EnumLSDataPerformanceANSIIWrapper);
             }
             break;
+
+        case ELD_TASKPOOLS:
+            {
+                pfnCallback = FARPROC(EnumLSDataTaskPoolsANSIIWrapper);
+            }
+            break;
+
+        case ELD_TASKSTATS:
+            {
+                pfnCallback = FARPROC(EnumLSDataTaskStatsANSIIWrapper);
+            }
+            break;
+
+        case ELD_MESSAGESTATS:
+            {
+                pfnCallback = FARPROC(EnumLSDataMessageStatsANSIIWrapper);
+            }
+            break;
+
+        case ELD_MODULETIMELINE:
+            {
+                pfnCallback = FARPROC(EnumLSDataModuleTimelineANSIIWrapper);
+            }
+            break;
         }
 
         if (nullptr != pfnCallback)
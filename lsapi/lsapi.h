@@ -155,6 +155,22 @@ extern "C"
     LSAPI int GetRCCoordinate(LPCSTR pszKeyName, int nDefault, int nMaxVal);
     LSAPI int ParseCoordinate(LPCSTR szString, int nDefault, int nMaxVal);
 
+    LSAPI LSTASKHANDLE LSPostTask(LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
+        LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext);
+    LSAPI LSTASKHANDLE LSPostTaskAfter(const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+        LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
+        LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext);
+    LSAPI LSTASKHANDLE LSPostTaskEx(DWORD dwFlags, const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+        LSTASKEXECUTEPROC executeProc, LPVOID executeContext,
+        LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext);
+    LSAPI LSTASKHANDLE LSPostTaskDesc(const LSTASKDESC* pTask,
+        const LSTASKHANDLE* pDependencies, UINT uDependencyCount);
+    LSAPI LSTASKHANDLE LSPostTaskWhenAll(const LSTASKHANDLE* pDependencies, UINT uDependencyCount,
+        LSTASKCOMPLETIONPROC completionProc, LPVOID completionContext);
+    LSAPI LSTASKHANDLE LSPostTasks(const LSTASKDESC* pTasks, UINT uTaskCount, LSTASKHANDLE* pHandles);
+    LSAPI BOOL LSCancelTask(LSTASKHANDLE handle);
+    LSAPI BOOL LSWaitTask(LSTASKHANDLE handle, DWORD timeoutMs);
+
     LSAPI HRESULT EnumLSDataA(UINT uInfo, FARPROC pfnCallback, LPARAM lParam);
     LSAPI HRESULT EnumLSDataW(UINT uInfo, FARPROC pfnCallback, LPARAM lParam);
 
@@ -167,6 +183,7 @@ extern "C"
     LSAPI void LSAPIReloadSettings(void);
     LSAPI void LSAPISetLitestepWindow(HWND hLitestepWnd);
     LSAPI void LSAPISetCOMFactory(IClassFactory *pFactory);
+    LSAPI void LSAPISetLogSink(LPVOID pSink);
     LSAPI BOOL InternalExecuteBangCommand(HWND hCaller, LPCWSTR pszCommand, LPCWSTR pwzArgs);
 #endif /* LSAPI_PRIVATE */
 
@@ -109,7 +109,14 @@ void LSAPIInit::Initialize(LPCWSTR pwzLitestepPath, LPCWSTR pwzRcPath)
 
         // Add our internal bang commands to the Bang Manager.
         SetupBangs();
-        m_taskExecutor = std::make_unique<TaskExecutor>();
+
+        // Size the task executor's pools
+        TaskExecutorConfig taskConfig;
+        taskConfig.cpuThreads = (size_t)std::max(0, GetRCIntW(L"LSTaskThreads", 0));
+        taskConfig.ioMinThreads = (size_t)std::max(0, GetRCIntW(L"LSTaskIOMinThreads", 1));
+        taskConfig.ioMaxThreads = (size_t)std::max(1, GetRCIntW(L"LSTaskIOMaxThreads", 8));
+        taskConfig.ioIdleTimeoutMs = (DWORD)std::max(0, GetRCIntW(L"LSTaskIOIdleTimeout", 30000));
+        m_taskExecutor = std::make_unique<TaskExecutor>(taskConfig);
     }
     catch(LSAPIException& lse)
     {
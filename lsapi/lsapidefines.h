@@ -62,6 +62,8 @@
 #define LM_BRINGTOFRONT             8891
 #define LM_SAVEDATA                 8892
 #define LM_RESTOREDATA              8893
+#define LM_SAVEDATAEX               8894  // lParam: LSDATAITEM*
+#define LM_RESTOREDATAEX            8895  // lParam: LSDATAITEM*
 #define LM_POPUP                    9182
 #define LM_HIDEPOPUP                9183
 #define LM_FIRSTDESKTOPPAINT        9184 // Deprecated
@@ -96,6 +98,7 @@
 #define LM_RELOADMODULEA            9267
 #define LM_REGISTERHOOKMESSAGE      9268  // Deprecated
 #define LM_UNREGISTERHOOKMESSAGE    9269  // Deprecated
+#define LM_MODULEFIRSTPAINT         9270  // wParam: module's HINSTANCE, lParam: low 32 bits of QueryPerformanceCounter at the paint
 #define LM_SHADETOGGLE              9300
 #define LM_REFRESH                  9305
 
@@ -105,6 +108,7 @@
 #define LM_THREADREADY              9311
 #define LM_THREADFINISHED           9312
 #define LM_ASYNCTASKCOMPLETE        9313
+#define LM_THREAD_REFRESHMODULE     9314
 #endif
 
 // VWM Messages
@@ -128,9 +132,12 @@
 #define LM_DATASTORE                9410 // Deprecated
 #define LM_MESSAGEMANAGER           9411 // Deprecated
 #define LM_BANGCOMMANDA             9420
+#define LM_LAZYBANGCOMMAND          9421
 #define LM_ENUMREVIDS               9430
 #define LM_ENUMMODULES              9431
 #define LM_ENUMPERFORMANCE          9432
+#define LM_ENUMMESSAGESTATS         9433
+#define LM_ENUMMODULETIMELINE       9434
 #endif
 
 
@@ -229,6 +236,10 @@ typedef struct THUMBBUTTONLIST {
 typedef int  (__cdecl* initModuleProc)(HWND, HINSTANCE, LPCWSTR);
 typedef int  (__cdecl* initModuleProcA)(HWND, HINSTANCE, LPCSTR);
 typedef void (__cdecl* quitModuleProc)(HINSTANCE);
+// Optional. Called on a soft recycle instead of quitModule/initModuleEx,
+// after settings have been reloaded and all bang commands removed. Should
+// re-read settings and re-register bang commands, and return 0 if it did.
+typedef int  (__cdecl* refreshModuleProc)(HINSTANCE);
 
 
 //-----------------------------------------------------------------------------
@@ -246,6 +257,20 @@ typedef void (__cdecl *BangCommandExW) \
 typedef UINT64 LSTASKHANDLE;
 typedef void (CALLBACK *LSTASKEXECUTEPROC)(LPVOID context);
 typedef void (CALLBACK *LSTASKCOMPLETIONPROC)(LPVOID context, BOOL cancelled);
+
+// Task flags
+#define LSTASK_BLOCKING             0x0001  // may block on I/O, runs on the I/O pool
+
+typedef struct LSTASKDESC
+{
+    LSTASKEXECUTEPROC executeProc;
+    LPVOID executeContext;
+    LSTASKCOMPLETIONPROC completionProc;
+    LPVOID completionContext;
+    DWORD dwFlags;
+    LPCWSTR pwzName;    // optional tag that groups the task in ELD_TASKSTATS
+    //
+} LSTASKDESC;
 #endif
 
 typedef struct _LMBANGCOMMANDA
@@ -275,6 +300,22 @@ typedef struct _LMBANGCOMMANDW
 #endif // _UNICODE
 
 
+//-----------------------------------------------------------------------------
+// LM_SAVEDATAEX/LM_RESTOREDATAEX DEFINES
+//-----------------------------------------------------------------------------
+// Same as LM_SAVEDATA and LM_RESTOREDATA, without their 64 KB limit. On
+// LM_RESTOREDATAEX dwLength is the size of the buffer at pvData, and
+// receives the number of bytes copied into it.
+typedef struct LSDATAITEM
+{
+    UINT cbSize;
+    WORD wIdent;
+    DWORD dwLength;
+    LPVOID pvData;
+    //
+} LSDATAITEM;
+
+
 //-----------------------------------------------------------------------------
 // LM_SYSTRAYINFOEVENT DEFINES
 //-----------------------------------------------------------------------------
@@ -304,6 +345,7 @@ typedef struct LSDESKTOPINFO
 #define LR_QUIT                     2
 #define LR_MSSHUTDOWN               3
 #define LR_EXPLORER                 4
+#define LR_SOFTRECYCLE              5
 
 
 //-----------------------------------------------------------------------------
@@ -330,6 +372,10 @@ typedef struct LSDESKTOPINFO
 #define ELD_REVIDS                  3
 #define ELD_BANGS_V2                4
 #define ELD_PERFORMANCE             5
+#define ELD_TASKPOOLS               6
+#define ELD_TASKSTATS               7
+#define ELD_MESSAGESTATS            8
+#define ELD_MODULETIMELINE          9
 
 // ELD_MODULES: possible dwFlags values
 #define LS_MODULE_THREADED          0x0001
@@ -346,4 +392,96 @@ typedef BOOL (CALLBACK* LSENUMMODULESPROCW)(LPCWSTR, DWORD, LPARAM);
 typedef BOOL (CALLBACK* LSENUMPERFORMANCEPROCA)(LPCSTR, DWORD, LPARAM);
 typedef BOOL (CALLBACK* LSENUMPERFORMANCEPROCW)(LPCWSTR, DWORD, LPARAM);
 
+// ELD_TASKPOOLS: live state of one task executor thread pool
+typedef struct LSTASKPOOLSTATS
+{
+    UINT cbSize;
+    UINT uThreads;
+    UINT uIdleThreads;
+    UINT uPeakThreads;
+    UINT uMinThreads;
+    UINT uMaxThreads;
+    UINT uQueued;
+    UINT64 ullExecuted;
+    //
+} LSTASKPOOLSTATS;
+
+typedef BOOL (CALLBACK* LSENUMTASKPOOLSPROCA)(LPCSTR, const LSTASKPOOLSTATS*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMTASKPOOLSPROCW)(LPCWSTR, const LSTASKPOOLSTATS*, LPARAM);
+
+// ELD_TASKSTATS: task executor timings, one entry per pool and one per pool
+// and task name. Bucket 0 counts samples of 0, bucket i > 0 counts samples
+// in [2^(i-1), 2^i). The last bucket also takes everything above that.
+#define LSTASKSTATS_BUCKETS         32
+
+typedef struct LSTASKHISTOGRAM
+{
+    UINT64 ullCount;
+    UINT64 ullTotal;
+    UINT64 ullMax;
+    UINT64 aullBuckets[LSTASKSTATS_BUCKETS];
+    //
+} LSTASKHISTOGRAM;
+
+typedef struct LSTASKSTATS
+{
+    UINT cbSize;
+    UINT64 ullSubmitted;
+    UINT64 ullExecuted;
+    UINT64 ullCancelled;
+    LSTASKHISTOGRAM queueDepth;         // queue length after each enqueue
+    LSTASKHISTOGRAM waitTime;           // us from becoming runnable to starting
+    LSTASKHISTOGRAM executeTime;        // us spent in the execute procedure
+    LSTASKHISTOGRAM completionLatency;  // us from posting to delivering the completion
+    //
+} LSTASKSTATS;
+
+// Pool name, task name (NULL for the pool totals), stats
+typedef BOOL (CALLBACK* LSENUMTASKSTATSPROCA)(LPCSTR, LPCSTR, const LSTASKSTATS*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMTASKSTATSPROCW)(LPCWSTR, LPCWSTR, const LSTASKSTATS*, LPARAM);
+
+// ELD_MESSAGESTATS: how long registered windows take to handle broadcast
+// messages, collected while LSMessageProfiling is enabled. There is one
+// entry per message (hWnd is NULL, the name is NULL) and one per window
+// (uMsg is 0, the name is the module that owns the window) while the window
+// is registered for any message. Times are in us and use the LSTASKHISTOGRAM
+// buckets.
+typedef struct LSMESSAGESTATS
+{
+    UINT cbSize;
+    UINT uMsg;
+    HWND hWnd;
+    UINT64 ullOutliers;                 // handling times over the threshold
+    LSTASKHISTOGRAM handlingTime;
+    //
+} LSMESSAGESTATS;
+
+typedef BOOL (CALLBACK* LSENUMMESSAGESTATSPROCA)(LPCSTR, const LSMESSAGESTATS*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMMESSAGESTATSPROCW)(LPCWSTR, const LSMESSAGESTATS*, LPARAM);
+
+// ELD_MODULETIMELINE: when each loaded module reached each startup phase, in
+// us since the module manager started loading the modules in step.rc.
+// Phases a module has not reached (yet) are LSMODULEPHASE_NONE.
+#define LSMODULEPHASE_LOADSTART     0   // LoadLibrary called
+#define LSMODULEPHASE_LOADED        1   // LoadLibrary returned
+#define LSMODULEPHASE_RESOLVED      2   // entry points looked up
+#define LSMODULEPHASE_INITSTART     3   // initModuleEx called
+#define LSMODULEPHASE_INITDONE      4   // initModuleEx returned
+#define LSMODULEPHASE_FIRSTMESSAGE  5   // first queued message for one of its windows handled
+#define LSMODULEPHASE_FIRSTPAINT    6   // first paint, reported with LM_MODULEFIRSTPAINT
+#define LSMODULEPHASE_COUNT         7
+
+#define LSMODULEPHASE_NONE          ((UINT64)-1)
+
+typedef struct LSMODULETIMELINE
+{
+    UINT cbSize;
+    DWORD dwFlags;                      // LS_MODULE_* flags
+    UINT64 aullPhases[LSMODULEPHASE_COUNT];
+    //
+} LSMODULETIMELINE;
+
+typedef BOOL (CALLBACK* LSENUMMODULETIMELINEPROCA)(LPCSTR, const LSMODULETIMELINE*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMMODULETIMELINEPROCW)(LPCWSTR, const LSMODULETIMELINE*, LPARAM);
+
 #endif // LSAPIDEFINES_H
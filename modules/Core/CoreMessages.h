@@ -6,10 +6,6 @@
 //-------------------------------------------------------------------------------------------------
 #pragma once
 
-// Internal nCore messages
-#define NCORE_FILE_SYSTEM_LOAD_COMPLETE             0x0500
-#define NCORE_FILE_SYSTEM_ITEM_LOAD_COMPLETE        0x0501
-
 // nCore -> Modules
 #define NCORE_DISPLAYCHANGE                         0x9000
 #define NCORE_SETTINGCHANGE                         0x9001
@@ -8,7 +8,6 @@
 //   - void CancelLoad(UINT64 id)
 //   - UINT64 LoadFolder(LoadFolderRequest&, FileSystemLoaderResponseHandler*)
 //-------------------------------------------------------------------------------------------------
-#include "CoreMessages.h"
 #include "FileSystemLoader.h"
 
 #include "../Utilities/Macros.h"
@@ -20,12 +19,12 @@
 #include <Shlwapi.h>
 #include <atomic>
 #include <memory>
-#include <thread>
 #include <Thumbcache.h>
 #include <unordered_map>
 #include <vector>
 
-extern HWND ghWndMsgHandler;
+// The number of tasks which extract thumbnails for a single folder in parallel.
+static const UINT sThumbnailStages = 4;
 
 struct RequestData {
   explicit RequestData(FileSystemLoaderResponseHandler *handler)
@@ -38,34 +37,35 @@ struct RequestData {
   LiteStep::TaskHandle taskHandle;
 };
 
-struct LoadFolderTaskContext {
-  LoadFolderRequest request;
-  UINT64 requestId;
-  std::shared_ptr<std::atomic<bool>> abort;
-  HWND hwnd;
-  bool executed = false;
-};
+/// <summary>
+/// State shared by the enumerate -> thumbnails -> deliver task graph of a folder load.
+/// </summary>
+struct LoadFolderGraph {
+  LoadFolderGraph(LoadFolderRequest &request, UINT64 requestId, std::shared_ptr<std::atomic<bool>> abort)
+      : request(request),
+        requestId(requestId),
+        abort(std::move(abort)),
+        folderId(nullptr) {
+    this->request.folder->AddRef();
+  }
 
-struct LoadItemTaskContext {
-  LoadItemRequest request;
+  ~LoadFolderGraph();
+
+  LoadFolderRequest request;
   UINT64 requestId;
   std::shared_ptr<std::atomic<bool>> abort;
-  HWND hwnd;
-  bool executed = false;
+  // Lets each thumbnail stage bind a folder of its own, since an IShellFolder is not safe to call
+  // from several threads at once. Null if the folder has no ID list.
+  PIDLIST_ABSOLUTE folderId;
+  LoadFolderResponse response;
 };
 
-
-static void LoadFolderThread(LoadFolderRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd);
-static void LoadFolderItemThread(LoadItemRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd);
-
-static void CALLBACK LoadFolderTaskExecute(LPVOID context);
-static void CALLBACK LoadFolderTaskComplete(LPVOID context, BOOL cancelled);
-static void CALLBACK LoadItemTaskExecute(LPVOID context);
-static void CALLBACK LoadItemTaskComplete(LPVOID context, BOOL cancelled);
-
 static UINT64 sNextRequestId = 0;
 static std::unordered_map<UINT64, RequestData> sOutstandingRequests;
 
+static void LoadCompleted(UINT64 id, LPVOID result);
+static void LoadItemCompleted(UINT64 id, LPVOID result);
+
 
 /// <summary>
 /// Tries to load the icon using IThumbnailProvider.
@@ -185,119 +185,88 @@ static void LoadThumbnail(LoadThumbnailResponse &response, int iconSize, IShellF
 }
 
 
-static void LoadFolderItemThread(LoadItemRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd) {
-  CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
-
-  LoadItemResponse item;
-  item.id = request.id;
-  LoadThumbnail(item.thumbnail, request.targetIconWidth, request.folder, request.id);
-
-  if (!abort->load()) {
-    SendMessage(hwnd, NCORE_FILE_SYSTEM_ITEM_LOAD_COMPLETE, (WPARAM)requestId, (LPARAM)&item);
-  }
-
-  ILFree(item.id);
-  if (item.thumbnail.type == LoadThumbnailResponse::Type::HBITMAP) {
-    DeleteObject(item.thumbnail.thumbnail.bitmap);
-  } else if (item.thumbnail.type == LoadThumbnailResponse::Type::HICON) {
-    DestroyIcon(item.thumbnail.thumbnail.icon);
+static void FreeThumbnail(LoadThumbnailResponse &thumbnail) {
+  if (thumbnail.type == LoadThumbnailResponse::Type::HBITMAP) {
+    DeleteObject(thumbnail.thumbnail.bitmap);
+  } else if (thumbnail.type == LoadThumbnailResponse::Type::HICON) {
+    DestroyIcon(thumbnail.thumbnail.icon);
   } else {
     ASSERT(false);
   }
-
-  request.folder->Release();
-  CoUninitialize();
 }
 
-static void LoadFolderThread(LoadFolderRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd);
-static void LoadFolderItemThread(LoadItemRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd);
 
-static void CALLBACK LoadFolderTaskExecute(LPVOID context) {
-  auto ctx = static_cast<LoadFolderTaskContext*>(context);
-  if (!ctx) {
-    return;
-  }
-  ctx->executed = true;
-  LoadFolderThread(ctx->request, ctx->requestId, ctx->abort.get(), ctx->hwnd);
-  ctx->request.folder = nullptr;
-}
-
-static void CALLBACK LoadFolderTaskComplete(LPVOID context, BOOL cancelled) {
-  std::unique_ptr<LoadFolderTaskContext> ctx(static_cast<LoadFolderTaskContext*>(context));
-  if (!ctx) {
-    return;
-  }
-  if (!ctx->executed && ctx->request.folder) {
-    ctx->request.folder->Release();
-  }
-}
-
-static void CALLBACK LoadItemTaskExecute(LPVOID context) {
-  auto ctx = static_cast<LoadItemTaskContext*>(context);
-  if (!ctx) {
-    return;
-  }
-  ctx->executed = true;
-  LoadFolderItemThread(ctx->request, ctx->requestId, ctx->abort.get(), ctx->hwnd);
-  ctx->request.folder = nullptr;
-}
-
-static void CALLBACK LoadItemTaskComplete(LPVOID context, BOOL cancelled) {
-  std::unique_ptr<LoadItemTaskContext> ctx(static_cast<LoadItemTaskContext*>(context));
-  if (!ctx) {
-    return;
-  }
-  if (!ctx->executed && ctx->request.folder) {
-    ctx->request.folder->Release();
+LoadFolderGraph::~LoadFolderGraph() {
+  for (LoadItemResponse &item : response.items) {
+    CoTaskMemFree(item.id);
+    FreeThumbnail(item.thumbnail);
   }
+  ILFree(folderId);
+  request.folder->Release();
 }
 
 
-
-static void LoadFolderThread(LoadFolderRequest request, UINT64 requestId, std::atomic<bool> *abort, HWND hwnd) {
-  LoadFolderResponse response;
-
+/// <summary>
+/// First stage of a folder load. Collects the IDs of the items to show.
+/// </summary>
+static void EnumerateFolder(LoadFolderGraph &graph) {
   CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
 
   IEnumIDList *enumIdList;
-  if (SUCCEEDED(request.folder->EnumObjects(nullptr, SHCONTF_FOLDERS | SHCONTF_NONFOLDERS, &enumIdList))) {
+  if (SUCCEEDED(graph.request.folder->EnumObjects(nullptr, SHCONTF_FOLDERS | SHCONTF_NONFOLDERS, &enumIdList))) {
     PITEMID_CHILD idNext = nullptr;
-    while (!abort->load() && enumIdList->Next(1, &idNext, nullptr) != S_FALSE) {
+    while (!graph.abort->load() && enumIdList->Next(1, &idNext, nullptr) != S_FALSE) {
       STRRET ret;
-      if (SUCCEEDED(request.folder->GetDisplayNameOf(idNext, SHGDN_FORPARSING, &ret))) {
+      if (SUCCEEDED(graph.request.folder->GetDisplayNameOf(idNext, SHGDN_FORPARSING, &ret))) {
         WCHAR buffer[MAX_PATH];
         StrRetToBufW(&ret, idNext, buffer, _countof(buffer));
-        if (request.blackList.count(buffer) == 0) {
-          response.items.emplace_back();
-          LoadItemResponse &item = response.items.back();
+        if (graph.request.blackList.count(buffer) == 0) {
+          graph.response.items.emplace_back();
+          LoadItemResponse &item = graph.response.items.back();
           item.id = idNext;
-          LoadThumbnail(item.thumbnail, request.targetIconWidth, request.folder, idNext);
-          idNext = nullptr;
+          // Placeholder until the thumbnail stage runs, safe to pass to DestroyIcon.
+          item.thumbnail.type = LoadThumbnailResponse::Type::HICON;
+          item.thumbnail.thumbnail.icon = nullptr;
         } else {
           CoTaskMemFree(idNext);
-          idNext = nullptr;
         }
+        idNext = nullptr;
       }
     }
     enumIdList->Release();
   }
 
-  if (!abort->load()) {
-    SendMessage(hwnd, NCORE_FILE_SYSTEM_LOAD_COMPLETE, (WPARAM)requestId, (LPARAM)&response);
+  CoUninitialize();
+}
+
+
+/// <summary>
+/// Second stage of a folder load. Extracts every stageCount'th thumbnail, starting at stage.
+/// </summary>
+static void LoadFolderThumbnails(LoadFolderGraph &graph, UINT stage, UINT stageCount) {
+  CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+
+  // A single stage has the request's folder to itself.
+  IShellFolder2 *folder = nullptr;
+  if (stageCount == 1) {
+    folder = graph.request.folder;
+    folder->AddRef();
+  } else if (FAILED(SHBindToObject(nullptr, graph.folderId, nullptr, IID_PPV_ARGS(&folder)))) {
+    folder = nullptr;
   }
 
-  for (LoadItemResponse &item : response.items) {
-    CoTaskMemFree(item.id);
-    if (item.thumbnail.type == LoadThumbnailResponse::Type::HBITMAP) {
-      DeleteObject(item.thumbnail.thumbnail.bitmap);
-    } else if (item.thumbnail.type == LoadThumbnailResponse::Type::HICON) {
-      DestroyIcon(item.thumbnail.thumbnail.icon);
+  for (size_t i = stage; i < graph.response.items.size() && !graph.abort->load(); i += stageCount) {
+    LoadItemResponse &item = graph.response.items[i];
+    if (folder) {
+      LoadThumbnail(item.thumbnail, graph.request.targetIconWidth, folder, item.id);
     } else {
-      ASSERT(false);
+      item.thumbnail.thumbnail.icon = LoadIcon(nullptr, IDI_ERROR);
     }
   }
 
-  request.folder->Release();
+  if (folder) {
+    folder->Release();
+  }
 
   CoUninitialize();
 }
@@ -313,10 +282,54 @@ EXPORT_CDECL(UINT64) NCore_LoadFolder(LoadFolderRequest &request, FileSystemLoad
     std::forward_as_tuple(requestId),
     std::forward_as_tuple(handler)).first;
 
-  request.folder->AddRef();
+  auto graph = std::make_shared<LoadFolderGraph>(request, requestId, requestData->second.abort);
+
+  // Without an ID list to bind from, the stages would have to share the request's folder, so
+  // there is only one.
+  UINT stageCount = sThumbnailStages;
+  if (FAILED(SHGetIDListFromObject(request.folder, &graph->folderId))) {
+    graph->folderId = nullptr;
+    stageCount = 1;
+  }
 
-  std::thread(LoadFolderThread, request, requestId, requestData->second.abort.get(),
-    ghWndMsgHandler).detach();
+  // Enumerate, then split thumbnail extraction across a few tasks, then deliver the response on
+  // the main thread once all of them are done. Cancelling the root cancels the whole graph.
+  LiteStep::TaskHandle root = LiteStep::PostTask([graph] () {
+    EnumerateFolder(*graph);
+  }, std::function<void(bool)>(), LSTASK_BLOCKING, L"Core.EnumerateFolder");
+  if (root == 0) {
+    sOutstandingRequests.erase(requestData);
+    return 0;
+  }
+
+  std::vector<LiteStep::TaskHandle> stages;
+  for (UINT stage = 0; stage < stageCount; ++stage) {
+    LiteStep::TaskHandle handle = LiteStep::PostTaskAfter({ root }, [graph, stage, stageCount] () {
+      LoadFolderThumbnails(*graph, stage, stageCount);
+    }, std::function<void(bool)>(), LSTASK_BLOCKING, L"Core.FolderThumbnails");
+    if (handle != 0) {
+      stages.push_back(handle);
+    }
+  }
+  if (stages.empty()) {
+    stages.push_back(root);
+  }
+
+  LiteStep::TaskHandle join = LiteStep::WhenAll(stages, [graph] (bool cancelled) {
+    if (!cancelled && !graph->abort->load()) {
+      LoadCompleted(graph->requestId, &graph->response);
+    }
+  });
+
+  // Nothing would ever deliver the response, so the load ends here as a failed one.
+  if (join == 0) {
+    *graph->abort = true;
+    LiteStep::CancelTask(root);
+    sOutstandingRequests.erase(requestData);
+    return 0;
+  }
+
+  requestData->second.taskHandle = root;
   return requestId;
 }
 
@@ -333,8 +346,31 @@ EXPORT_CDECL(UINT64) NCore_LoadFolderItem(LoadItemRequest &request, FileSystemLo
 
   request.folder->AddRef();
 
-  std::thread(LoadFolderItemThread, request, requestId, requestData->second.abort.get(),
-    ghWndMsgHandler).detach();
+  auto item = std::make_shared<LoadItemResponse>();
+  item->id = request.id;
+  item->thumbnail.type = LoadThumbnailResponse::Type::HICON;
+  item->thumbnail.thumbnail.icon = nullptr;
+  std::shared_ptr<std::atomic<bool>> abort = requestData->second.abort;
+
+  LiteStep::TaskHandle handle = LiteStep::PostTask([request, item] () {
+    CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+    LoadThumbnail(item->thumbnail, request.targetIconWidth, request.folder, request.id);
+    CoUninitialize();
+  }, [request, item, abort, requestId] (bool cancelled) {
+    if (!cancelled && !abort->load()) {
+      LoadItemCompleted(requestId, item.get());
+    }
+    ILFree(item->id);
+    FreeThumbnail(item->thumbnail);
+    request.folder->Release();
+  }, LSTASK_BLOCKING, L"Core.LoadFolderItem");
+  if (handle == 0) {
+    request.folder->Release();
+    sOutstandingRequests.erase(requestData);
+    return 0;
+  }
+
+  requestData->second.taskHandle = handle;
   return requestId;
 }
 
@@ -346,14 +382,15 @@ EXPORT_CDECL(void) NCore_CancelLoad(UINT64 id) {
   auto request = sOutstandingRequests.find(id);
   ASSERT(request != sOutstandingRequests.end());
   *request->second.abort = true;
+  LiteStep::CancelTask(request->second.taskHandle);
   sOutstandingRequests.erase(request);
 }
 
 
 /// <summary>
-/// Called by nCores window procedure when it receives a message from the thread.
+/// Called on the main thread once every stage of a folder load has finished.
 /// </summary>
-void LoadCompleted(UINT64 id, LPVOID result) {
+static void LoadCompleted(UINT64 id, LPVOID result) {
   auto request = sOutstandingRequests.find(id);
   if (request != sOutstandingRequests.end()) {
     request->second.handler->FolderLoaded(id, (LoadFolderResponse*)result);
@@ -362,9 +399,9 @@ void LoadCompleted(UINT64 id, LPVOID result) {
 
 
 /// <summary>
-/// Called by nCores window procedure when it receives a message from the thread.
+/// Called on the main thread once a folder item has been loaded.
 /// </summary>
-void LoadItemCompleted(UINT64 id, LPVOID result) {
+static void LoadItemCompleted(UINT64 id, LPVOID result) {
   auto request = sOutstandingRequests.find(id);
   if (request != sOutstandingRequests.end()) {
     request->second.handler->ItemLoaded(id, (LoadItemResponse*)result);
@@ -0,0 +1,240 @@
+//-------------------------------------------------------------------------------------------------
+// /ModuleKit/AsyncTask.hpp
+// The nModules Project
+//
+// C++20 coroutine front end for the LSAPI task executor. Lets module code hop between the main
+// thread and the executor's workers with co_await instead of callback/context pairs.
+//
+//   LiteStep::AsyncAction Refresh(LiteStep::CancellationSource &cancel) {
+//     if (!co_await LiteStep::ResumeOnWorker(&cancel)) co_return;
+//     ... blocking work ...
+//     if (!co_await LiteStep::ResumeOnMainThread(&cancel)) co_return;
+//     ... touch windows ...
+//   }
+//
+// Awaiters live in the coroutine frame and add no allocation of their own, but every await that
+// suspends still posts one executor task. That costs the executor's task record, and an await
+// that resumes on the main thread also costs a completion payload for the posted message.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+#include "LiteStep.h"
+
+#if !defined(__cpp_impl_coroutine)
+#  error AsyncTask.hpp requires C++20 coroutines (/std:c++20)
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace LiteStep {
+  /// <summary>
+  /// Cancellation flag shared between the owner of some asynchronous work and the coroutine doing
+  /// it. The source must outlive every coroutine that awaits with it. At most one executor task
+  /// per source is cancelled eagerly; other awaits observe the flag when they resume.
+  /// </summary>
+  class CancellationSource {
+  public:
+    CancellationSource() : mCancelled(false), mPendingTask(0) {}
+    CancellationSource(const CancellationSource&) = delete;
+    CancellationSource &operator=(const CancellationSource&) = delete;
+
+  public:
+    void Cancel() {
+      mCancelled.store(true, std::memory_order_release);
+      TaskHandle pending = mPendingTask.exchange(0, std::memory_order_acq_rel);
+      if (pending != 0) {
+        CancelTask(pending);
+      }
+    }
+
+    void Reset() {
+      mCancelled.store(false, std::memory_order_release);
+    }
+
+    bool IsCancelled() const {
+      return mCancelled.load(std::memory_order_acquire);
+    }
+
+    void Track(TaskHandle handle) {
+      mPendingTask.store(handle, std::memory_order_release);
+    }
+
+  private:
+    std::atomic<bool> mCancelled;
+    std::atomic<TaskHandle> mPendingTask;
+  };
+
+  /// <summary>
+  /// Return type for fire-and-forget coroutines. The coroutine starts running immediately on the
+  /// calling thread and its frame is freed when it finishes.
+  /// </summary>
+  struct AsyncAction {
+    struct promise_type {
+      AsyncAction get_return_object() noexcept { return AsyncAction(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::terminate(); }
+    };
+  };
+
+  namespace detail {
+    inline bool IsCancelled(const CancellationSource *cancel) {
+      return cancel != nullptr && cancel->IsCancelled();
+    }
+
+    // If the executor could not post a completion to the LiteStep window it runs it inline on the
+    // worker, which must not look like a successful switch to the main thread.
+    inline bool OnMainThread() {
+      HWND litestep = GetLitestepWnd();
+      return litestep != nullptr && GetWindowThreadProcessId(litestep, nullptr) == GetCurrentThreadId();
+    }
+  }
+
+  /// <summary>
+  /// Continues the coroutine on an executor worker. Resolves to false, without switching threads,
+  /// if the work was cancelled or the executor is unavailable.
+  /// </summary>
+  class ResumeOnWorker {
+  public:
+    explicit ResumeOnWorker(CancellationSource *cancel = nullptr) : mCancel(cancel), mPosted(false) {}
+
+  public:
+    bool await_ready() const noexcept {
+      return detail::IsCancelled(mCancel);
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+      // Once the task is posted the frame, and this awaiter with it, may already be running on the
+      // worker, so nothing can be written after LSPostTask succeeds.
+      //
+      // The task is deliberately not tracked by the cancellation source. If the executor skipped
+      // the execute step nothing would ever resume the frame, so cancellation is observed in
+      // await_resume instead.
+      mPosted = true;
+      if (LSPostTask(Resume, handle.address(), nullptr, nullptr) == 0) {
+        mPosted = false;
+        return false;
+      }
+      return true;
+    }
+
+    bool await_resume() const noexcept {
+      return mPosted && !detail::IsCancelled(mCancel);
+    }
+
+  private:
+    static void CALLBACK Resume(LPVOID context) {
+      std::coroutine_handle<>::from_address(context).resume();
+    }
+
+    CancellationSource *mCancel;
+    bool mPosted;
+  };
+
+  /// <summary>
+  /// Continues the coroutine on the LiteStep main thread. Resolves to false if the work was
+  /// cancelled, or the executor shut down or failed to post before the switch happened. In that
+  /// case the coroutine may be running on a worker.
+  /// </summary>
+  class ResumeOnMainThread {
+  public:
+    explicit ResumeOnMainThread(CancellationSource *cancel = nullptr)
+      : mCancel(cancel), mCancelled(false) {}
+
+  public:
+    bool await_ready() const noexcept {
+      return detail::IsCancelled(mCancel);
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+      mHandle = handle;
+      // Completions are delivered through the LiteStep window, which is what moves us across.
+      if (LSPostTask(Nothing, nullptr, Resume, this) == 0) {
+        mCancelled = true;
+        return false;
+      }
+      return true;
+    }
+
+    bool await_resume() const noexcept {
+      return !mCancelled && !detail::IsCancelled(mCancel);
+    }
+
+  private:
+    static void CALLBACK Nothing(LPVOID) {}
+
+    static void CALLBACK Resume(LPVOID context, BOOL cancelled) {
+      auto self = static_cast<ResumeOnMainThread*>(context);
+      self->mCancelled = cancelled != FALSE || !detail::OnMainThread();
+      self->mHandle.resume();
+    }
+
+    CancellationSource *mCancel;
+    std::coroutine_handle<> mHandle;
+    bool mCancelled;
+  };
+
+  /// <summary>
+  /// Runs work on an executor worker and continues the coroutine on the main thread once it is
+  /// done. Cancelling the source skips the work if it has not started yet. Resolves to true if the
+  /// work ran to completion without being cancelled. Like ResumeOnMainThread, it resolves to false
+  /// if the completion could not be delivered on the main thread.
+  /// </summary>
+  template <typename Work>
+  class RunOnWorker {
+  public:
+    explicit RunOnWorker(Work &&work, CancellationSource *cancel = nullptr)
+      : mWork(std::forward<Work>(work)), mCancel(cancel), mCancelled(false) {}
+
+  public:
+    bool await_ready() const noexcept {
+      return detail::IsCancelled(mCancel);
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+      mHandle = handle;
+      CancellationSource *cancel = mCancel;
+      TaskHandle task = LSPostTask(Execute, this, Resume, this);
+      if (task == 0) {
+        mCancelled = true;
+        return false;
+      }
+      // The awaiter may be gone by now. A handle that is tracked after its task has already
+      // finished is harmless, cancelling it is a no-op.
+      if (cancel) {
+        cancel->Track(task);
+      }
+      return true;
+    }
+
+    bool await_resume() const noexcept {
+      return !mCancelled && !detail::IsCancelled(mCancel);
+    }
+
+  private:
+    static void CALLBACK Execute(LPVOID context) {
+      static_cast<RunOnWorker*>(context)->mWork();
+    }
+
+    // Only the completion resumes the coroutine, so a cancel that races with Execute can never
+    // resume the frame twice.
+    static void CALLBACK Resume(LPVOID context, BOOL cancelled) {
+      auto self = static_cast<RunOnWorker*>(context);
+      self->mCancelled = cancelled != FALSE || !detail::OnMainThread();
+      self->mHandle.resume();
+    }
+
+    Work mWork;
+    CancellationSource *mCancel;
+    std::coroutine_handle<> mHandle;
+    bool mCancelled;
+  };
+
+  template <typename Work>
+  RunOnWorker(Work&&, CancellationSource* = nullptr) -> RunOnWorker<Work>;
+}
@@ -12,6 +12,7 @@
 #include "../Utilities/Common.h"
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <functional>
 #include <ShlObj.h>
@@ -71,7 +72,13 @@ namespace LiteStep {
     return LSPostTask(executeProc, executeContext, completionProc, completionContext);
   }
 
-  inline TaskHandle PostTask(std::function<void()> work, std::function<void(bool)> completion)
+  /// <summary>
+  /// Runs work on the task executor and completion on the main thread. Pass LSTASK_BLOCKING in
+  /// flags for work that waits on the shell or the disk, so it runs on the elastic I/O pool. A
+  /// name groups the task's timings in !TaskStats, it should be a string that outlives the call.
+  /// </summary>
+  inline TaskHandle PostTask(std::function<void()> work, std::function<void(bool)> completion,
+      DWORD flags = 0, LPCWSTR name = nullptr)
   {
     if (!work) {
       return 0;
@@ -80,23 +87,90 @@ namespace LiteStep {
     if (!thunk) {
       return 0;
     }
-    TaskHandle handle = LSPostTask(detail::RunTaskThunk, thunk, detail::CompleteTaskThunk, thunk);
+    LSTASKDESC task = { detail::RunTaskThunk, thunk, detail::CompleteTaskThunk, thunk, flags, name };
+    TaskHandle handle = LSPostTaskDesc(&task, nullptr, 0);
     if (handle == 0) {
       delete thunk;
     }
     return handle;
   }
 
-  inline TaskHandle PostTask(std::function<void()> work, std::function<void()> completion)
+  inline TaskHandle PostTask(std::function<void()> work, std::function<void()> completion,
+      DWORD flags = 0, LPCWSTR name = nullptr)
   {
     if (!completion) {
-      return PostTask(std::move(work), std::function<void(bool)>());
+      return PostTask(std::move(work), std::function<void(bool)>(), flags, name);
     }
     return PostTask(std::move(work), [fn = std::move(completion)](bool cancelled) mutable {
       if (!cancelled) {
         fn();
       }
-    });
+    }, flags, name);
+  }
+
+  inline TaskHandle PostTaskAfter(const std::vector<TaskHandle> &dependencies,
+      std::function<void()> work, std::function<void(bool)> completion, DWORD flags = 0,
+      LPCWSTR name = nullptr)
+  {
+    if (!work) {
+      return 0;
+    }
+    auto thunk = new (std::nothrow) detail::TaskThunk{ std::move(work), std::move(completion) };
+    if (!thunk) {
+      return 0;
+    }
+    LSTASKDESC task = { detail::RunTaskThunk, thunk, detail::CompleteTaskThunk, thunk, flags, name };
+    TaskHandle handle = LSPostTaskDesc(&task, dependencies.data(), UINT(dependencies.size()));
+    if (handle == 0) {
+      delete thunk;
+    }
+    return handle;
+  }
+
+  inline TaskHandle WhenAll(const std::vector<TaskHandle> &dependencies,
+      std::function<void(bool)> completion)
+  {
+    auto thunk = new (std::nothrow) detail::TaskThunk{ nullptr, std::move(completion) };
+    if (!thunk) {
+      return 0;
+    }
+    TaskHandle handle = LSPostTaskWhenAll(dependencies.data(), UINT(dependencies.size()),
+      detail::CompleteTaskThunk, thunk);
+    if (handle == 0) {
+      delete thunk;
+    }
+    return handle;
+  }
+
+  /// <summary>
+  /// Queues a batch of work items at once. The returned group handle can be waited on or cancelled
+  /// as a unit; it finishes once every item has run.
+  /// </summary>
+  inline TaskHandle PostTasks(std::vector<std::function<void()>> work, DWORD flags = 0,
+      LPCWSTR name = nullptr)
+  {
+    std::vector<LSTASKDESC> tasks;
+    tasks.reserve(work.size());
+    for (auto &item : work) {
+      if (!item) {
+        continue;
+      }
+      auto thunk = new (std::nothrow) detail::TaskThunk{ std::move(item), nullptr };
+      if (!thunk) {
+        break;
+      }
+      tasks.push_back(LSTASKDESC{ detail::RunTaskThunk, thunk, detail::CompleteTaskThunk, thunk, flags, name });
+    }
+    if (tasks.empty()) {
+      return 0;
+    }
+    TaskHandle group = LSPostTasks(tasks.data(), UINT(tasks.size()), nullptr);
+    if (group == 0) {
+      for (auto &task : tasks) {
+        delete static_cast<detail::TaskThunk*>(task.executeContext);
+      }
+    }
+    return group;
   }
 
   inline bool CancelTask(TaskHandle handle) {
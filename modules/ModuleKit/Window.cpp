@@ -20,6 +20,7 @@
 #include "../Utilities/StringUtils.h"
 
 #include <algorithm>
+#include <atomic>
 #include <dwmapi.h>
 #include <dwrite.h>
 #include <strsafe.h>
@@ -29,6 +30,9 @@
 
 using std::map;
 
+// This module's own HINSTANCE.
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+
 
 /// <summary>
 /// Constructor used to create a DrawableWindow for a pre-existing window. Used by nDesk.
@@ -930,6 +934,19 @@ void Window::Move(Distance x, Distance y)
 /// </summary>
 void Window::Paint(bool &inAnimation, D2D1_RECT_F *updateRect)
 {
+    // Tells the core when this module first painted anything, for its startup timeline.
+    // ModuleKit is linked into each module, so this is once per module. Posted, since a
+    // module thread that blocks on the LiteStep thread can deadlock with it; the paint time
+    // goes along so the wait in the queue does not count.
+    static std::atomic<bool> firstPaintReported { false };
+    if (!firstPaintReported.exchange(true))
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        PostMessage(LiteStep::GetLitestepWnd(), LM_MODULEFIRSTPAINT, (WPARAM)&__ImageBase,
+            (LPARAM)now.LowPart);
+    }
+
     UpdateLock lock(this);
     if (this->visible && RectIntersectArea(updateRect, &this->drawingArea) > 0)
     {
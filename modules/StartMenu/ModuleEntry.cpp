@@ -326,7 +326,7 @@ protected:
         if (!mLoaded && !mLoading)
         {
             EnsurePlaceholder();
-            StartNextRequest();
+            StartPendingRequests();
         }
         else if (!mLoaded)
         {
@@ -376,7 +376,7 @@ protected:
             }
         }
 
-        StartNextRequest();
+        StartPendingRequests();
         return 0;
     }
 
@@ -449,7 +449,9 @@ private:
         return result;
     }
 
-    void StartNextRequest()
+    // Each folder load is its own task graph in nCore, so every pending folder is
+    // started at once and the popup is finalized when the last one reports back.
+    void StartPendingRequests()
     {
         while (!mPendingFolders.empty())
         {
@@ -474,7 +476,6 @@ private:
 
             mLoading = true;
             mActiveRequests.emplace(requestId, std::make_unique<FolderRequest>(folder));
-            return;
         }
 
         if (mActiveRequests.empty())
@@ -7,6 +7,7 @@
 *
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 #include "../ModuleKit/LiteStep.h"
+#include "../ModuleKit/AsyncTask.hpp"
 #include "ButtonSettings.hpp"
 #include "TaskButton.hpp"
 #include "Taskbar.hpp"
@@ -19,7 +20,6 @@
 #include <assert.h>
 #include <process.h>
 #include "Constants.h"
-#include <thread>
 #include <algorithm>
 #include <string>
 #include <cwctype>
@@ -31,7 +31,6 @@
 #pragma comment(lib, "dwmapi.lib")
 
 using std::vector;
-using std::thread;
 
 
 // All current taskbars
@@ -881,8 +880,12 @@ void WindowManager::UpdateIcon(HWND hWnd)
 /// </summary>
 void WindowManager::AddExisting()
 {
-    thread([] () -> void
+    [] () -> LiteStep::AsyncAction
     {
+        // Enumerating and classifying every top-level window is slow, keep it off the main thread.
+        // If no worker is available we just do it inline.
+        co_await LiteStep::ResumeOnWorker();
+
         EnumDesktopWindows(nullptr, (WNDENUMPROC)[] (HWND window, LPARAM) -> BOOL
         {
             if (IsTaskbarWindow(window))
@@ -893,7 +896,7 @@ void WindowManager::AddExisting()
         }, 0);
 
         PostMessage(gLSModule.GetMessageWindow(), WM_ADDED_EXISTING, 0, 0);
-    }).detach();
+    }();
 }
 
 
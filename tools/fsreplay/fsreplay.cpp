@@ -0,0 +1,292 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// fsreplay
+// Replays the fullscreen events LiteStep recorded (LSFullscreenRecord) and
+// prints what FullscreenState decides for each of them. Without a file it
+// replays built-in scenarios against known results.
+//
+//   fsreplay [fullscreen.rec]
+//
+// Exits with 1 if a scenario failed or a line could not be read.
+//
+#include "../../litestep/FullscreenState.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // One recorded line and the actions it should produce, sorted and
+    // separated by ", " since their order within one event is not fixed
+    struct Step
+    {
+        const wchar_t* event;
+        const wchar_t* actions;
+    };
+
+    struct Scenario
+    {
+        const char* name;
+        const Step* steps;
+        size_t stepCount;
+    };
+
+    const Step GameStartsAndExits[] =
+    {
+        { L"reset", L"" },
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" },
+        { L"window 0x100 0x1 foreground", L"" },
+        { L"window 0x100 0x0 foreground", L"show 0x1" }
+    };
+
+    const Step TwoWindowsOneMonitor[] =
+    {
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" },
+        { L"window 0x200 0x1 foreground", L"" },
+        { L"window 0x100 0x0 background", L"" },
+        { L"window 0x200 0x0 background", L"show 0x1" }
+    };
+
+    const Step WindowMovesMonitor[] =
+    {
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" },
+        { L"window 0x100 0x2 background", L"hide 0x2 by 0x100, show 0x1" },
+        { L"window 0x100 0x0 background", L"show 0x2" }
+    };
+
+    const Step BackgroundIsIgnored[] =
+    {
+        { L"window 0x100 0x1 background", L"" },
+        { L"window 0x100 0x0 foreground", L"" },
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" }
+    };
+
+    const Step LitestepActivated[] =
+    {
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" },
+        { L"window 0x200 0x2 foreground", L"hide 0x2 by 0x200" },
+        { L"activated", L"show 0x1, show 0x2" },
+        { L"window 0x100 0x0 background", L"" },
+        { L"rehide", L"" }
+    };
+
+    const Step ReHide[] =
+    {
+        { L"window 0x100 0x1 foreground", L"hide 0x1 by 0x100" },
+        { L"window 0x200 0x2 foreground", L"hide 0x2 by 0x200" },
+        { L"rehide", L"hide 0x1 by 0x100, hide 0x2 by 0x200" },
+        { L"reset", L"" },
+        { L"rehide", L"" }
+    };
+
+#define SCENARIO(steps) { #steps, steps, _countof(steps) }
+
+    const Scenario Scenarios[] =
+    {
+        SCENARIO(GameStartsAndExits),
+        SCENARIO(TwoWindowsOneMonitor),
+        SCENARIO(WindowMovesMonitor),
+        SCENARIO(BackgroundIsIgnored),
+        SCENARIO(LitestepActivated),
+        SCENARIO(ReHide)
+    };
+
+#undef SCENARIO
+
+
+    std::wstring FormatActions(const FullscreenState::ActionList& actions)
+    {
+        std::vector<std::wstring> lines;
+
+        for (const FullscreenState::Action& action : actions)
+        {
+            wchar_t wzAction[80];
+
+            if (action.type == FullscreenState::Action::Hide)
+            {
+                swprintf(wzAction, _countof(wzAction), L"hide 0x%llX by 0x%llX",
+                    (unsigned long long)(UINT_PTR)action.hMonitor,
+                    (unsigned long long)(UINT_PTR)action.hWnd);
+            }
+            else
+            {
+                swprintf(wzAction, _countof(wzAction), L"show 0x%llX",
+                    (unsigned long long)(UINT_PTR)action.hMonitor);
+            }
+
+            lines.push_back(wzAction);
+        }
+
+        std::sort(lines.begin(), lines.end());
+
+        std::wstring text;
+        for (const std::wstring& line : lines)
+        {
+            if (!text.empty())
+            {
+                text += L", ";
+            }
+            text += line;
+        }
+
+        return text;
+    }
+
+
+    // Also checks that every event survives a round trip through the
+    // recording format
+    bool RunScenario(const Scenario& scenario)
+    {
+        FullscreenState state;
+        bool bPassed = true;
+
+        for (size_t step = 0; step < scenario.stepCount; ++step)
+        {
+            const Step& expected = scenario.steps[step];
+
+            FullscreenState::Event event;
+            wchar_t wzFormatted[80];
+
+            if (!FullscreenState::ParseEvent(expected.event, event))
+            {
+                fprintf(stderr, "%s: cannot parse \"%ls\"\n", scenario.name, expected.event);
+                return false;
+            }
+
+            FullscreenState::FormatEvent(event, wzFormatted, _countof(wzFormatted));
+
+            if (wcscmp(wzFormatted, expected.event) != 0)
+            {
+                fprintf(stderr, "%s: \"%ls\" formats as \"%ls\"\n",
+                    scenario.name, expected.event, wzFormatted);
+                bPassed = false;
+            }
+
+            FullscreenState::ActionList actions;
+            state.Replay(event, actions);
+
+            const std::wstring result = FormatActions(actions);
+
+            if (result != expected.actions)
+            {
+                fprintf(stderr, "%s: \"%ls\" gave \"%ls\", expected \"%ls\"\n",
+                    scenario.name, expected.event, result.c_str(), expected.actions);
+                bPassed = false;
+            }
+        }
+
+        return bPassed;
+    }
+
+
+    int RunScenarios()
+    {
+        unsigned failures = 0;
+
+        for (const Scenario& scenario : Scenarios)
+        {
+            const bool bPassed = RunScenario(scenario);
+            printf("%-24s %s\n", scenario.name, bPassed ? "ok" : "FAILED");
+
+            if (!bPassed)
+            {
+                ++failures;
+            }
+        }
+
+        return failures == 0 ? 0 : 1;
+    }
+
+
+    int ReplayFile(const char* path)
+    {
+        std::ifstream file(path);
+
+        if (!file)
+        {
+            fprintf(stderr, "fsreplay: cannot open %s\n", path);
+            return 1;
+        }
+
+        FullscreenState state;
+        std::string line;
+        unsigned lineNumber = 0;
+        unsigned errors = 0;
+
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            // The recording format is plain ASCII
+            const std::wstring wideLine(line.begin(), line.end());
+            FullscreenState::Event event;
+
+            if (!FullscreenState::ParseEvent(wideLine.c_str(), event))
+            {
+                fprintf(stderr, "%s(%u): cannot parse \"%s\"\n", path, lineNumber, line.c_str());
+                ++errors;
+                continue;
+            }
+
+            FullscreenState::ActionList actions;
+            state.Replay(event, actions);
+
+            if (actions.empty())
+            {
+                printf("%5u  %s\n", lineNumber, line.c_str());
+            }
+            else
+            {
+                printf("%5u  %-40s -> %ls\n", lineNumber, line.c_str(),
+                    FormatActions(actions).c_str());
+            }
+        }
+
+        return errors == 0 ? 0 : 1;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: fsreplay [fullscreen.rec]\n");
+        return 2;
+    }
+
+    return argc == 2 ? ReplayFile(argv[1]) : RunScenarios();
+}
@@ -0,0 +1,191 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// logbench
+// Measures the logger under contention: 1, 2, 4, ... up to the given number
+// of threads log at the same time, once with every message written and once
+// with all of them filtered out.
+//
+//   logbench [threads] [messages per thread]
+//
+// The log goes to %TEMP%\logbench\logs\litestep.log.
+//
+#include "../../utility/logger.h"
+
+#include <Windows.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    // Starts every thread before any of them logs, so they all contend
+    // from the first message. Returns the time the last one finished.
+    template <typename Body>
+    Clock::time_point RunThreads(unsigned threads, Clock::time_point& start, Body body)
+    {
+        std::atomic<unsigned> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+
+        for (unsigned thread = 0; thread < threads; ++thread)
+        {
+            workers.emplace_back([&, thread]
+            {
+                ready.fetch_add(1);
+                while (!go.load())
+                {
+                    std::this_thread::yield();
+                }
+                body(thread);
+            });
+        }
+
+        while (ready.load() != threads)
+        {
+            std::this_thread::yield();
+        }
+
+        start = Clock::now();
+        go.store(true);
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        return Clock::now();
+    }
+
+    // Every message is written. The producer rate is how fast the threads
+    // got their messages into the queue, the written rate includes waiting
+    // for the flusher to reach the file.
+    void WrittenRun(unsigned threads, unsigned messages)
+    {
+        Logger::SetLevel(Logger::Category::Module, Logger::Level::Debug);
+
+        Clock::time_point start;
+        Clock::time_point produced = RunThreads(threads, start, [messages](unsigned thread)
+        {
+            for (unsigned message = 0; message < messages; ++message)
+            {
+                LS_LOG(Logger::Level::Debug, Module, L"thread %u message %u of %ls", thread, message, L"logbench");
+            }
+        });
+
+        Logger::Flush();
+        Clock::time_point written = Clock::now();
+
+        const double total = double(threads) * messages;
+        printf("  written   %2u threads  %12.0f msg/s produced  %12.0f msg/s written  %8.1f ns/call\n",
+            threads, total / Seconds(start, produced), total / Seconds(start, written),
+            Seconds(start, produced) * 1e9 * threads / total);
+    }
+
+    // Every message is filtered out, which is what most debug logging costs
+    // in a normal session
+    void FilteredRun(unsigned threads, unsigned messages)
+    {
+        Logger::SetLevel(Logger::Category::Module, Logger::Level::Error);
+        Logger::Flush();
+        const uint64_t before = Logger::GetSuppressedCount(Logger::Category::Module);
+
+        Clock::time_point start;
+        Clock::time_point end = RunThreads(threads, start, [messages](unsigned thread)
+        {
+            for (unsigned message = 0; message < messages; ++message)
+            {
+                LS_LOG(Logger::Level::Debug, Module, L"thread %u message %u of %ls", thread, message, L"logbench");
+            }
+        });
+
+        const double total = double(threads) * messages;
+        const uint64_t counted = Logger::GetSuppressedCount(Logger::Category::Module) - before;
+
+        printf("  filtered  %2u threads  %12.0f msg/s  %8.2f ns/call  %llu counted\n",
+            threads, total / Seconds(start, end), Seconds(start, end) * 1e9 * threads / total,
+            (unsigned long long)counted);
+    }
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    unsigned messages = 200000;
+
+    if (argc > 1)
+    {
+        maxThreads = wcstoul(argv[1], nullptr, 10);
+    }
+    if (argc > 2)
+    {
+        messages = wcstoul(argv[2], nullptr, 10);
+    }
+
+    if (maxThreads == 0 || messages == 0)
+    {
+        fprintf(stderr, "usage: logbench [threads] [messages per thread]\n");
+        return 1;
+    }
+
+    wchar_t temp[MAX_PATH] = { 0 };
+    GetTempPathW(MAX_PATH, temp);
+
+    std::wstring base = temp;
+    base += L"logbench";
+
+    // Rotated at 64 MB with one old file kept, so runs do not fill the disk
+    Logger::SetFileOptions(64 * 1024 * 1024, 1, 1000);
+    Logger::Initialize(base);
+
+    printf("%u messages per thread\n", messages);
+
+    for (unsigned threads = 1; ; threads *= 2)
+    {
+        if (threads > maxThreads)
+        {
+            threads = maxThreads;
+        }
+
+        WrittenRun(threads, messages);
+        FilteredRun(threads, messages);
+
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    Logger::Shutdown();
+    return 0;
+}
@@ -0,0 +1,259 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// msgbench
+// Measures MessageManager, the table LiteStep broadcasts shell hook and
+// tray messages through. Times registering modules with many messages,
+// lookups from 1, 2, 4, ... threads while another thread keeps registering
+// and unregistering, and SendMessage broadcasts to real windows.
+//
+//   msgbench [threads] [lookups per thread]
+//
+#include "../../litestep/MessageManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Registered messages start here, like the LM_ range
+    const UINT FirstMessage = WM_USER + 1000;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    // Windows are only compared until a message is sent, so registrations
+    // that are never sent to can use made up handles
+    HWND FakeWindow(UINT index)
+    {
+        return (HWND)(UINT_PTR)(0x10000 + index * 4);
+    }
+
+    // Registers one window per module for messagesPerModule messages, the
+    // way LM_REGISTERMESSAGE does
+    void RegisterRun(UINT modules, UINT messagesPerModule)
+    {
+        MessageManager manager;
+        std::vector<UINT> vecMessages(messagesPerModule + 1, 0);
+
+        const Clock::time_point start = Clock::now();
+
+        for (UINT module = 0; module < modules; ++module)
+        {
+            for (UINT message = 0; message < messagesPerModule; ++message)
+            {
+                vecMessages[message] = FirstMessage + module * 7 + message;
+            }
+
+            manager.AddMessages(FakeWindow(module), &vecMessages[0]);
+        }
+
+        const Clock::time_point end = Clock::now();
+
+        printf("  register  %3u modules x %3u messages  %8.1f us/module\n",
+            modules, messagesPerModule, Seconds(start, end) * 1e6 / modules);
+    }
+
+    // Broadcast lookups, optionally while registrations keep changing
+    void LookupRun(unsigned threads, unsigned lookups, bool bWriter)
+    {
+        MessageManager manager;
+        const UINT messageCount = 64;
+
+        for (UINT window = 0; window < 32; ++window)
+        {
+            for (UINT message = 0; message < messageCount; message += 1 + window % 3)
+            {
+                manager.AddMessage(FakeWindow(window), FirstMessage + message);
+            }
+        }
+
+        std::atomic<bool> stop(false);
+        std::atomic<unsigned> writes(0);
+        std::thread writer;
+
+        if (bWriter)
+        {
+            writer = std::thread([&]
+            {
+                for (UINT round = 0; !stop.load(); ++round)
+                {
+                    manager.AddMessage(FakeWindow(100), FirstMessage + round % messageCount);
+                    manager.RemoveMessage(FakeWindow(100), FirstMessage + round % messageCount);
+                    writes.fetch_add(2, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        std::atomic<unsigned> ready(0);
+        std::atomic<bool> go(false);
+        std::atomic<UINT_PTR> sink(0);
+        std::vector<std::thread> workers;
+
+        for (unsigned thread = 0; thread < threads; ++thread)
+        {
+            workers.emplace_back([&, thread]
+            {
+                ready.fetch_add(1);
+                while (!go.load())
+                {
+                    std::this_thread::yield();
+                }
+
+                UINT_PTR total = 0;
+                for (unsigned lookup = 0; lookup < lookups; ++lookup)
+                {
+                    MessageManager::WindowView view = manager.GetWindowsForMessage(
+                        FirstMessage + (lookup + thread) % messageCount);
+
+                    for (HWND window : view)
+                    {
+                        total += (UINT_PTR)window;
+                    }
+                }
+                sink.fetch_add(total);
+            });
+        }
+
+        while (ready.load() != threads)
+        {
+            std::this_thread::yield();
+        }
+
+        const Clock::time_point start = Clock::now();
+        go.store(true);
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        const Clock::time_point end = Clock::now();
+
+        stop.store(true);
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+
+        const double total = double(threads) * lookups;
+        printf("  lookup    %2u threads%-16s %12.0f lookups/s  %8.1f ns/lookup",
+            threads, bWriter ? " + a writer" : "", total / Seconds(start, end),
+            Seconds(start, end) * 1e9 * threads / total);
+
+        if (bWriter)
+        {
+            printf("  %u registrations", writes.load());
+        }
+        printf("\n");
+    }
+
+    // Full broadcasts to message-only windows on this thread, what LiteStep
+    // does for every shell hook message
+    void SendRun(unsigned broadcasts)
+    {
+        MessageManager manager;
+        std::vector<HWND> vecWindows;
+
+        for (UINT window = 0; window < 16; ++window)
+        {
+            HWND hWnd = CreateWindowExW(0, L"STATIC", L"msgbench", 0, 0, 0, 0, 0,
+                HWND_MESSAGE, nullptr, GetModuleHandle(nullptr), nullptr);
+
+            if (hWnd)
+            {
+                vecWindows.push_back(hWnd);
+                manager.AddMessage(hWnd, FirstMessage);
+            }
+        }
+
+        const Clock::time_point start = Clock::now();
+
+        for (unsigned broadcast = 0; broadcast < broadcasts; ++broadcast)
+        {
+            manager.SendMessage(FirstMessage, broadcast, 0);
+        }
+
+        const Clock::time_point end = Clock::now();
+
+        printf("  send      %2u windows  %12.0f broadcasts/s  %8.2f us/broadcast\n",
+            static_cast<unsigned>(vecWindows.size()), broadcasts / Seconds(start, end),
+            Seconds(start, end) * 1e6 / broadcasts);
+
+        for (HWND hWnd : vecWindows)
+        {
+            DestroyWindow(hWnd);
+        }
+    }
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    unsigned lookups = 2000000;
+
+    if (argc > 1)
+    {
+        maxThreads = wcstoul(argv[1], nullptr, 10);
+    }
+    if (argc > 2)
+    {
+        lookups = wcstoul(argv[2], nullptr, 10);
+    }
+
+    if (maxThreads == 0 || lookups == 0)
+    {
+        fprintf(stderr, "usage: msgbench [threads] [lookups per thread]\n");
+        return 1;
+    }
+
+    RegisterRun(40, 4);
+    RegisterRun(40, 64);
+
+    for (unsigned threads = 1; ; threads *= 2)
+    {
+        if (threads > maxThreads)
+        {
+            threads = maxThreads;
+        }
+
+        LookupRun(threads, lookups, false);
+        LookupRun(threads, lookups, true);
+
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    SendRun(lookups / 20);
+
+    return 0;
+}
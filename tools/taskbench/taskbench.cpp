@@ -0,0 +1,247 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// taskbench
+// Measures the LSAPI task executor. Queues many tiny tasks one LSPostTask
+// call at a time, then the same number through LSPostTasks in batches, and
+// reports how fast they were submitted and run. Then it times short CPU
+// tasks queued behind blocking ones, with the blocking tasks on the CPU
+// pool and then on the I/O pool (LSTASK_BLOCKING), and prints the pools.
+//
+//   taskbench [tasks] [batch size] [blocking tasks]
+//
+// The LSAPI is initialized with an empty step.rc in %TEMP%\taskbench, so the
+// pools have their default sizes.
+//
+#include "../../lsapi/lsapi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    // Counts executed tasks and signals once the expected number ran
+    struct Counter
+    {
+        std::atomic<unsigned> executed;
+        unsigned expected;
+        HANDLE hDone;
+    };
+
+    void CALLBACK CountTask(LPVOID context)
+    {
+        Counter* pCounter = (Counter*)context;
+
+        if (pCounter->executed.fetch_add(1) + 1 == pCounter->expected)
+        {
+            SetEvent(pCounter->hDone);
+        }
+    }
+
+    // Stands in for shell I/O, such as extracting a thumbnail
+    void CALLBACK BlockingTask(LPVOID context)
+    {
+        Sleep(20);
+        CountTask(context);
+    }
+
+    void PrintRun(const char* name, unsigned tasks, Clock::time_point start,
+        Clock::time_point submitted, Clock::time_point done)
+    {
+        printf("  %-12s %12.0f tasks/s submitted  %12.0f tasks/s run  %8.1f ns/submit\n",
+            name, tasks / Seconds(start, submitted), tasks / Seconds(start, done),
+            Seconds(start, submitted) * 1e9 / tasks);
+    }
+
+    // One lock round trip and one wake per task
+    void SingleRun(unsigned tasks)
+    {
+        Counter counter;
+        counter.executed = 0;
+        counter.expected = tasks;
+        counter.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        const Clock::time_point start = Clock::now();
+
+        for (unsigned task = 0; task < tasks; ++task)
+        {
+            LSPostTask(CountTask, &counter, nullptr, nullptr);
+        }
+
+        const Clock::time_point submitted = Clock::now();
+        WaitForSingleObject(counter.hDone, INFINITE);
+
+        PrintRun("single", tasks, start, submitted, Clock::now());
+        CloseHandle(counter.hDone);
+    }
+
+    // One lock round trip and at most one wake per worker for each batch
+    void BatchRun(unsigned tasks, unsigned batch)
+    {
+        Counter counter;
+        counter.executed = 0;
+        counter.expected = tasks;
+        counter.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        LSTASKDESC desc = { CountTask, &counter, nullptr, nullptr, 0, nullptr };
+        std::vector<LSTASKDESC> vecDescs(batch, desc);
+
+        const Clock::time_point start = Clock::now();
+
+        for (unsigned task = 0; task < tasks; task += batch)
+        {
+            LSPostTasks(&vecDescs[0], std::min(batch, tasks - task), nullptr);
+        }
+
+        const Clock::time_point submitted = Clock::now();
+        WaitForSingleObject(counter.hDone, INFINITE);
+
+        char name[32];
+        sprintf_s(name, "batch of %u", batch);
+        PrintRun(name, tasks, start, submitted, Clock::now());
+        CloseHandle(counter.hDone);
+    }
+
+    // How long CPU work waits when blocking tasks were queued just before
+    // it. On the CPU pool they hold every worker; on the I/O pool they
+    // should not delay it at all.
+    void BlockingRun(unsigned tasks, unsigned blocking, DWORD dwFlags)
+    {
+        Counter blocked;
+        blocked.executed = 0;
+        blocked.expected = blocking;
+        blocked.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        Counter counter;
+        counter.executed = 0;
+        counter.expected = tasks;
+        counter.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        const Clock::time_point start = Clock::now();
+
+        for (unsigned task = 0; task < blocking; ++task)
+        {
+            LSPostTaskEx(dwFlags, nullptr, 0, BlockingTask, &blocked, nullptr, nullptr);
+        }
+
+        for (unsigned task = 0; task < tasks; ++task)
+        {
+            LSPostTask(CountTask, &counter, nullptr, nullptr);
+        }
+
+        WaitForSingleObject(counter.hDone, INFINITE);
+        const Clock::time_point cpuDone = Clock::now();
+
+        WaitForSingleObject(blocked.hDone, INFINITE);
+        const Clock::time_point blockingDone = Clock::now();
+
+        printf("  %-12s %8.1f ms until the CPU tasks ran  %8.1f ms until the blocking ones did\n",
+            (dwFlags & LSTASK_BLOCKING) ? "I/O pool" : "CPU pool",
+            Seconds(start, cpuDone) * 1e3, Seconds(start, blockingDone) * 1e3);
+
+        CloseHandle(blocked.hDone);
+        CloseHandle(counter.hDone);
+    }
+
+    BOOL CALLBACK PrintPool(LPCWSTR pwzName, const LSTASKPOOLSTATS* pStats, LPARAM)
+    {
+        printf("  %-8ls %3u threads (%u to %u, peak %u), %u idle, %llu executed\n",
+            pwzName, pStats->uThreads, pStats->uMinThreads, pStats->uMaxThreads,
+            pStats->uPeakThreads, pStats->uIdleThreads, (unsigned long long)pStats->ullExecuted);
+        return TRUE;
+    }
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    unsigned tasks = 200000;
+    unsigned batch = 64;
+    unsigned blocking = 32;
+
+    if (argc > 1)
+    {
+        tasks = wcstoul(argv[1], nullptr, 10);
+    }
+    if (argc > 2)
+    {
+        batch = wcstoul(argv[2], nullptr, 10);
+    }
+    if (argc > 3)
+    {
+        blocking = wcstoul(argv[3], nullptr, 10);
+    }
+
+    if (tasks == 0 || batch == 0 || blocking == 0)
+    {
+        fprintf(stderr, "usage: taskbench [tasks] [batch size] [blocking tasks]\n");
+        return 1;
+    }
+
+    wchar_t wzTemp[MAX_PATH] = { 0 };
+    GetTempPathW(MAX_PATH, wzTemp);
+
+    std::wstring sDirectory = wzTemp;
+    sDirectory += L"taskbench\\";
+    CreateDirectoryW(sDirectory.c_str(), nullptr);
+
+    std::wstring sRcPath = sDirectory + L"step.rc";
+    HANDLE hRcFile = CreateFileW(sRcPath.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hRcFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hRcFile);
+    }
+
+    if (!LSAPIInitialize(sDirectory.c_str(), sRcPath.c_str()))
+    {
+        fprintf(stderr, "taskbench: could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    printf("%u tasks\n", tasks);
+
+    SingleRun(tasks);
+    BatchRun(tasks, batch);
+
+    const unsigned cpuTasks = std::max(1u, tasks / 100);
+    printf("\n%u CPU tasks behind %u blocking tasks of 20 ms\n", cpuTasks, blocking);
+
+    BlockingRun(cpuTasks, blocking, 0);
+    BlockingRun(cpuTasks, blocking, LSTASK_BLOCKING);
+
+    printf("\npools\n");
+    EnumLSDataW(ELD_TASKPOOLS, (FARPROC)PrintPool, 0);
+
+    return 0;
+}
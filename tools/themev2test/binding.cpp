@@ -0,0 +1,206 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// BindingGraph: propagation in rank order, the stop at a value that did not
+// change, cycles refused by Define, and sets replaced within a frame.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/BindingGraph.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    bool NoDefaults(const wchar_t*, std::wstring&)
+    {
+        return false;
+    }
+
+    bool ValueIs(const BindingGraph& graph, const wchar_t* name, const wchar_t* expected)
+    {
+        const std::wstring* value = graph.Value(name);
+        if (value != nullptr && *value == expected)
+        {
+            return true;
+        }
+
+        fprintf(stderr, "  @%ls is \"%ls\", expected \"%ls\"\n", name,
+            (value != nullptr) ? value->c_str() : L"(none)", expected);
+        return false;
+    }
+
+    // Defined last to first, so each Define has to move the ranks of
+    // variables defined before it. Out of rank order a variable would be
+    // evaluated against a stale input and then again.
+    void RankOrder()
+    {
+        BindingGraph graph;
+        CHECK(graph.Define(L"c", L"@b-"));
+        CHECK(graph.Define(L"b", L"@a+"));
+        CHECK(graph.Define(L"d", L"@a@c"));
+        graph.Set(L"a", L"1");
+        graph.Flush();
+
+        CHECK(ValueIs(graph, L"b", L"1+"));
+        CHECK(ValueIs(graph, L"c", L"1+-"));
+        CHECK(ValueIs(graph, L"d", L"11+-"));
+        CHECK(graph.LastStatistics().evaluated == 3);
+
+        graph.Set(L"A", L"2");
+        graph.Flush();
+
+        CHECK(ValueIs(graph, L"d", L"22+-"));
+        CHECK(graph.LastStatistics().evaluated == 3);
+        CHECK(graph.LastStatistics().changed == 4);
+    }
+
+    // b keeps its value when a and e swap, so nothing past it is evaluated
+    // or reported
+    void StopWhenUnchanged()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(
+            L"#panel { name=\"root\""
+            L"  #item { name=\"na\" text=@a }"
+            L"  #item { name=\"nb\" text=@b }"
+            L"  #item { name=\"nc\" text=@c }"
+            L"}");
+
+        BindingGraph graph;
+        graph.Compile(document, NoDefaults);
+        CHECK(graph.Define(L"b", L"@a@e"));
+        CHECK(graph.Define(L"c", L"@b!"));
+        graph.Set(L"a", L"1");
+
+        const std::vector<ThemeIndex> first = graph.Flush();
+        CHECK(first.size() == 3);
+        CHECK(ValueIs(graph, L"c", L"1!"));
+
+        graph.Set(L"a", L"");
+        graph.Set(L"e", L"1");
+
+        const std::vector<ThemeIndex> second = graph.Flush();
+        CHECK(second.size() == 1);
+        CHECK(!second.empty() && second[0] == themev2test::FindNode(document, L"na"));
+        CHECK(graph.LastStatistics().evaluated == 1);
+        CHECK(graph.LastStatistics().changed == 2);
+        CHECK(ValueIs(graph, L"c", L"1!"));
+
+        // Setting a variable to the value it has changes nothing
+        graph.Set(L"e", L"1");
+        CHECK(graph.Flush().empty());
+        CHECK(graph.LastStatistics().changed == 0);
+    }
+
+    void CycleRejected()
+    {
+        BindingGraph graph;
+        CHECK(graph.Define(L"x", L"@y"));
+        CHECK(graph.Define(L"y", L"@z"));
+        CHECK(!graph.Define(L"z", L"@x!"));
+        CHECK(!graph.Define(L"Z", L"@@@X"));
+        CHECK(!graph.Define(L"w", L"@w"));
+
+        // z is still a source, and the chain still follows it
+        graph.Set(L"z", L"1");
+        graph.Flush();
+        CHECK(ValueIs(graph, L"x", L"1"));
+        CHECK(ValueIs(graph, L"y", L"1"));
+
+        // Redefining x away from the chain frees z to use it
+        CHECK(graph.Define(L"x", L"@@"));
+        CHECK(graph.Define(L"z", L"@x!"));
+        graph.Flush();
+        CHECK(ValueIs(graph, L"y", L"@!"));
+    }
+
+    void PendingSetReplaced()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(
+            L"#panel { name=\"root\" #item { name=\"ns\" text=@s } }");
+
+        BindingGraph graph;
+        graph.Compile(document, NoDefaults);
+
+        graph.Set(L"s", L"1");
+        graph.Set(L"S", L"2");
+        CHECK(graph.HasPending());
+
+        const std::vector<ThemeIndex> nodes = graph.Flush();
+        CHECK(!graph.HasPending());
+        CHECK(nodes.size() == 1);
+        CHECK(graph.LastStatistics().changed == 1);
+        CHECK(ValueIs(graph, L"s", L"2"));
+
+        // A definition replaces a set from earlier in the frame
+        graph.Set(L"t", L"9");
+        CHECK(graph.Define(L"t", L"@s!"));
+        graph.Flush();
+        CHECK(ValueIs(graph, L"t", L"2!"));
+
+        // and a set replaces a definition
+        graph.Set(L"t", L"3");
+        graph.Set(L"s", L"4");
+        graph.Flush();
+        CHECK(ValueIs(graph, L"t", L"3"));
+        CHECK(graph.LastStatistics().evaluated == 0);
+    }
+}
+
+
+void BindingTests()
+{
+    RankOrder();
+    StopWhenUnchanged();
+    CycleRejected();
+    PendingSetReplaced();
+}
+
+
+void BindingBenchmarks()
+{
+    // One source feeding a chain of derived variables
+    const unsigned length = 1000;
+    const unsigned runs = 200;
+
+    BindingGraph graph;
+    std::wstring previous = L"v0";
+    for (unsigned link = 1; link < length; ++link)
+    {
+        const std::wstring name = L"v" + std::to_wstring(link);
+        graph.Define(name, L"@" + previous);
+        previous = name;
+    }
+
+    unsigned counter = 0;
+    const double chainMs = themev2test::TimeRuns(runs, [&]()
+    {
+        graph.Set(L"v0", std::to_wstring(++counter));
+        graph.Flush();
+    });
+
+    printf("  chain of %u  %9.4f ms  %u evaluated\n", length, chainMs,
+        unsigned(graph.LastStatistics().evaluated));
+}
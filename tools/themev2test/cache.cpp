@@ -0,0 +1,306 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// ThemeCache: a stored theme and style sheet load back unchanged, and a
+// cache is refused once a source file changed or the cache itself is
+// damaged. The benchmark compares loading the cache with parsing.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/Parser.h"
+#include "../../litestep/themev2/StyleParser.h"
+#include "../../litestep/themev2/ThemeCache.h"
+#include "../../litestep/themev2/ThemeDiff.h"
+
+#include <Windows.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    // A theme loaded and parsed the way ThemeEngineV2 does it
+    struct LoadedTheme
+    {
+        SourceDocument source;
+        ThemeDocument document;
+        SourceDocument styleSource;
+        StyleSheet styles;
+    };
+
+    void LoadTheme(SourceManager& sources, const std::wstring& styleFile, LoadedTheme& theme)
+    {
+        std::vector<Diagnostic> diagnostics;
+
+        CHECK(sources.LoadStructuredDocument(L"theme.lsx", theme.source, diagnostics));
+        Parser parser(theme.source, diagnostics);
+        theme.document = parser.Parse();
+
+        if (!styleFile.empty())
+        {
+            CHECK(sources.LoadStyleDocument(styleFile, theme.styleSource, diagnostics));
+            StyleParser styleParser(theme.styleSource, diagnostics);
+            theme.styles = styleParser.Parse();
+        }
+
+        CHECK(diagnostics.empty());
+    }
+
+    bool SameStyles(const StyleSheet& left, const StyleSheet& right)
+    {
+        if (left.strings != right.strings || left.rules.size() != right.rules.size() ||
+            left.classes.size() != right.classes.size() ||
+            left.declarations.size() != right.declarations.size() || left.calls.size() != right.calls.size())
+        {
+            return false;
+        }
+
+        for (std::size_t index = 0; index < left.rules.size(); ++index)
+        {
+            if (left.rules[index].specificity != right.rules[index].specificity ||
+                left.rules[index].declarations.count != right.rules[index].declarations.count)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    struct Files
+    {
+        std::wstring directory;
+        std::wstring theme;
+        std::wstring include;
+        std::wstring styles;
+        std::wstring cache;
+    };
+
+    Files WriteTheme(bool withStyles)
+    {
+        Files files;
+        files.directory = themev2test::ScratchDirectory(L"cache");
+        files.theme = files.directory + L"theme.lsx";
+        files.include = files.directory + L"include.lsx";
+        files.styles = withStyles ? files.directory + L"theme.lsxstyle" : std::wstring();
+        files.cache = ThemeCache::PathFor(files.theme);
+
+        themev2test::WriteScratchFile(files.theme,
+            "#include \"include.lsx\"\n"
+            "#panel { name=\"root\" class=\"bar top\" width=200 layoutParams={padding=10}\n"
+            "  #button { name=\"first\" tooltip=\"Desktop \\\"1\\\"\" ref=@accent }\n"
+            "}\n");
+        themev2test::WriteScratchFile(files.include, "#panel { name=\"included\" items=[1, 2] }\n");
+
+        if (withStyles)
+        {
+            themev2test::WriteScratchFile(files.styles,
+                "all { radius = 4 }\n"
+                "panel.bar, #root { background = alpha(90).blur(30) }\n");
+        }
+
+        return files;
+    }
+
+    void RemoveTheme(const Files& files)
+    {
+        DeleteFileW(files.theme.c_str());
+        DeleteFileW(files.include.c_str());
+        DeleteFileW(files.styles.c_str());
+        DeleteFileW(files.cache.c_str());
+        RemoveDirectoryW(files.directory.c_str());
+    }
+
+    void RoundTrip()
+    {
+        const Files files = WriteTheme(true);
+
+        SourceManager sources(files.directory);
+        LoadedTheme parsed;
+        LoadTheme(sources, files.styles, parsed);
+
+        const ThemeCache cache(files.cache);
+        CHECK(cache.Store(parsed.source, parsed.document, parsed.styleSource, parsed.styles, sources));
+
+        LoadedTheme loaded;
+        CHECK(cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+        CHECK(DiffDocuments(parsed.document, loaded.document).IsEmpty());
+        CHECK(loaded.document.strings == parsed.document.strings);
+        CHECK(loaded.document.NodeCount() == parsed.document.NodeCount());
+        CHECK(loaded.source.files == parsed.source.files);
+        CHECK(loaded.source.primaryFile == parsed.source.primaryFile);
+        CHECK(loaded.source.content.empty());
+
+        CHECK(SameStyles(loaded.styles, parsed.styles));
+        CHECK(loaded.styleSource.files == parsed.styleSource.files);
+        CHECK(loaded.styleSource.primaryFile == parsed.styleSource.primaryFile);
+
+        RemoveTheme(files);
+    }
+
+    // The style source lists no files, and the style sheet is empty
+    void WithoutStyles()
+    {
+        const Files files = WriteTheme(false);
+
+        SourceManager sources(files.directory);
+        LoadedTheme parsed;
+        LoadTheme(sources, std::wstring(), parsed);
+
+        const ThemeCache cache(files.cache);
+        CHECK(cache.Store(parsed.source, parsed.document, parsed.styleSource, parsed.styles, sources));
+
+        LoadedTheme loaded;
+        loaded.styleSource.files.push_back(L"stale.lsxstyle");
+        CHECK(cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+        CHECK(loaded.styleSource.files.empty());
+        CHECK(loaded.styles.rules.empty());
+        CHECK(loaded.styles.strings.size() == 1);
+        CHECK(loaded.source.files.size() == 2);
+
+        RemoveTheme(files);
+    }
+
+    void Refused()
+    {
+        const Files files = WriteTheme(true);
+
+        SourceManager sources(files.directory);
+        LoadedTheme parsed;
+        LoadTheme(sources, files.styles, parsed);
+
+        const ThemeCache cache(files.cache);
+        LoadedTheme loaded;
+
+        // An included file and the style sheet count as sources
+        const std::wstring sourcesChanged[] = { files.include, files.styles };
+        for (const std::wstring& path : sourcesChanged)
+        {
+            CHECK(cache.Store(parsed.source, parsed.document, parsed.styleSource, parsed.styles, sources));
+
+            const std::string original = themev2test::ReadScratchFile(path);
+            themev2test::WriteScratchFile(path, original + "\n");
+            CHECK(!cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+            themev2test::WriteScratchFile(path, original);
+            CHECK(cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+        }
+
+        const std::string image = themev2test::ReadScratchFile(files.cache);
+        CHECK(image.size() > 512);
+
+        std::string damaged = image;
+        damaged[image.size() / 2] ^= 0x55;
+        themev2test::WriteScratchFile(files.cache, damaged);
+        CHECK(!cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+        themev2test::WriteScratchFile(files.cache, image.substr(0, image.size() / 2));
+        CHECK(!cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+        // From an older build
+        std::string older = image;
+        older[4] = 1;
+        older[5] = 0;
+        themev2test::WriteScratchFile(files.cache, older);
+        CHECK(!cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+        cache.Remove();
+        CHECK(!cache.Load(loaded.source, loaded.document, loaded.styleSource, loaded.styles));
+
+        RemoveTheme(files);
+    }
+
+    std::string GenerateTheme(unsigned count)
+    {
+        std::string theme;
+
+        for (unsigned panel = 0; panel < count; ++panel)
+        {
+            theme += "#panel { name=\"panel" + std::to_string(panel) + "\" width=120 class=\"bar top\"\n"
+                "  layoutParams={ align=\"left\", spacing=4 }\n"
+                "  #button { tooltip=\"Desktop \\\"1\\\"\" items=[1, 2, 3] ref=@accent }\n"
+                "}\n";
+        }
+
+        return theme;
+    }
+}
+
+
+void CacheTests()
+{
+    RoundTrip();
+    WithoutStyles();
+    Refused();
+}
+
+
+void CacheBenchmarks()
+{
+    const std::wstring directory = themev2test::ScratchDirectory(L"cachebench");
+    const std::wstring themePath = directory + L"theme.lsx";
+    const std::wstring cachePath = ThemeCache::PathFor(themePath);
+    themev2test::WriteScratchFile(themePath, GenerateTheme(5000));
+
+    const unsigned runs = 10;
+    std::size_t allocations = themev2test::AllocationCount();
+
+    const double parseMs = themev2test::TimeRuns(runs, [&]()
+    {
+        SourceManager sources(directory);
+        LoadedTheme theme;
+        LoadTheme(sources, std::wstring(), theme);
+    });
+
+    const std::size_t parseAllocations = (themev2test::AllocationCount() - allocations) / runs;
+
+    {
+        SourceManager sources(directory);
+        LoadedTheme theme;
+        LoadTheme(sources, std::wstring(), theme);
+        ThemeCache(cachePath).Store(theme.source, theme.document, theme.styleSource, theme.styles, sources);
+    }
+
+    const ThemeCache cache(cachePath);
+    std::size_t nodes = 0;
+    allocations = themev2test::AllocationCount();
+
+    const double loadMs = themev2test::TimeRuns(runs, [&]()
+    {
+        LoadedTheme theme;
+        cache.Load(theme.source, theme.document, theme.styleSource, theme.styles);
+        nodes = theme.document.NodeCount();
+    });
+
+    const std::size_t loadAllocations = (themev2test::AllocationCount() - allocations) / runs;
+
+    printf("  %u nodes\n", unsigned(nodes));
+    printf("  parse  %9.3f ms  %8u allocations\n", parseMs, unsigned(parseAllocations));
+    printf("  cache  %9.3f ms  %8u allocations\n", loadMs, unsigned(loadAllocations));
+
+    DeleteFileW(themePath.c_str());
+    DeleteFileW(cachePath.c_str());
+    RemoveDirectoryW(directory.c_str());
+}
@@ -0,0 +1,287 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// ThemeDiff and SourceManager: each kind of node change and the order they
+// come in, and a changed file invalidating every file that includes it.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/SourceManager.h"
+#include "../../litestep/themev2/ThemeDiff.h"
+
+#include <Windows.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    const wchar_t* KindName(NodeChangeKind kind)
+    {
+        switch (kind)
+        {
+        case NodeChangeKind::Added:
+            return L"Added";
+        case NodeChangeKind::Removed:
+            return L"Removed";
+        case NodeChangeKind::Changed:
+            return L"Changed";
+        default:
+            return L"Reordered";
+        }
+    }
+
+    // Expected change, nodes given by name in the old and new document
+    struct Expected
+    {
+        NodeChangeKind kind;
+        const wchar_t* oldNode;
+        const wchar_t* newNode;
+    };
+
+    ThemeIndex NodeOrInvalid(const ThemeDocument& document, const wchar_t* name)
+    {
+        return (name != nullptr) ? themev2test::FindNode(document, name) : InvalidThemeIndex;
+    }
+
+    template <std::size_t Count>
+    void CheckChanges(const ThemeDocument& before, const ThemeDocument& after,
+        const ThemeDiff& diff, const Expected (&expected)[Count])
+    {
+        CHECK(diff.changes.size() == Count);
+
+        for (std::size_t index = 0; index < Count && index < diff.changes.size(); ++index)
+        {
+            const NodeChange& change = diff.changes[index];
+            const ThemeIndex oldNode = NodeOrInvalid(before, expected[index].oldNode);
+            const ThemeIndex newNode = NodeOrInvalid(after, expected[index].newNode);
+
+            if (change.kind != expected[index].kind || change.oldNode != oldNode || change.newNode != newNode)
+            {
+                fprintf(stderr, "  change %u is %ls %u -> %u, expected %ls %u -> %u\n", unsigned(index),
+                    KindName(change.kind), change.oldNode, change.newNode,
+                    KindName(expected[index].kind), oldNode, newNode);
+                CHECK(!"change as expected");
+            }
+        }
+    }
+
+    // Only source positions differ, which is not a change
+    void NoChanges()
+    {
+        const ThemeDocument before = themev2test::ParseTheme(
+            L"#style \"a.lss\"\n"
+            L"#panel { name=\"root\" width=200 layoutParams={padding=10} #item { name=\"a\" } }");
+        const ThemeDocument after = themev2test::ParseTheme(
+            L"\n\n#style \"a.lss\"\n"
+            L"#panel {\n  name=\"root\"\n  width=200\n  layoutParams={ padding=10 }\n  #item { name=\"a\" }\n}");
+
+        const ThemeDiff diff = DiffDocuments(before, after);
+        CHECK(diff.IsEmpty());
+        CHECK(diff.nodeMap.size() == before.NodeCount());
+        CHECK(diff.nodeMap[themev2test::FindNode(before, L"a")] == themev2test::FindNode(after, L"a"));
+    }
+
+    void EachKind()
+    {
+        const ThemeDocument before = themev2test::ParseTheme(
+            L"#panel { name=\"root\""
+            L"  #item { name=\"a\" text=\"x\" }"
+            L"  #item { name=\"b\" }"
+            L"  #item { name=\"c\" }"
+            L"}");
+        const ThemeDocument after = themev2test::ParseTheme(
+            L"#panel { name=\"root\""
+            L"  #item { name=\"c\" }"
+            L"  #item { name=\"a\" text=\"y\" }"
+            L"  #item { name=\"d\" }"
+            L"}");
+
+        const ThemeDiff diff = DiffDocuments(before, after);
+
+        const Expected expected[] =
+        {
+            { NodeChangeKind::Reordered, nullptr, L"root" },
+            { NodeChangeKind::Changed, L"a", L"a" },
+            { NodeChangeKind::Added, nullptr, L"d" },
+            { NodeChangeKind::Removed, L"b", nullptr }
+        };
+        CheckChanges(before, after, diff, expected);
+
+        CHECK(diff.nodeMap[themev2test::FindNode(before, L"b")] == InvalidThemeIndex);
+        CHECK(diff.nodeMap[themev2test::FindNode(before, L"c")] == themev2test::FindNode(after, L"c"));
+        CHECK(!diff.directivesChanged);
+    }
+
+    // A node's change comes before the changes below it, and an added or
+    // removed subtree is one change
+    void ParentFirst()
+    {
+        const ThemeDocument before = themev2test::ParseTheme(
+            L"#panel { name=\"root\" width=1"
+            L"  #group { name=\"g\""
+            L"    #item { name=\"deep\" text=\"1\" }"
+            L"    #group { name=\"gone\" #item { name=\"goneChild\" } }"
+            L"  }"
+            L"}");
+        const ThemeDocument after = themev2test::ParseTheme(
+            L"#panel { name=\"root\" width=2"
+            L"  #group { name=\"g\""
+            L"    #item { name=\"deep\" text=\"2\" }"
+            L"    #group { name=\"new\" #item { name=\"newChild\" } }"
+            L"  }"
+            L"}");
+
+        const ThemeDiff diff = DiffDocuments(before, after);
+
+        const Expected expected[] =
+        {
+            { NodeChangeKind::Changed, L"root", L"root" },
+            { NodeChangeKind::Changed, L"deep", L"deep" },
+            { NodeChangeKind::Added, nullptr, L"new" },
+            { NodeChangeKind::Removed, L"gone", nullptr }
+        };
+        CheckChanges(before, after, diff, expected);
+
+        CHECK(diff.nodeMap[themev2test::FindNode(before, L"goneChild")] == InvalidThemeIndex);
+    }
+
+    // Siblings without id or name match by their order
+    void Unnamed()
+    {
+        const ThemeDocument before = themev2test::ParseTheme(
+            L"#panel { name=\"root\" #item { text=\"1\" } #item { text=\"2\" } }");
+        const ThemeDocument after = themev2test::ParseTheme(
+            L"#style \"a.lss\"\n"
+            L"#panel { name=\"root\" #item { text=\"1\" } #item { text=\"3\" } #item { } }");
+
+        const ThemeDiff diff = DiffDocuments(before, after);
+        CHECK(diff.directivesChanged);
+        CHECK(diff.changes.size() == 2);
+
+        if (diff.changes.size() == 2)
+        {
+            CHECK(diff.changes[0].kind == NodeChangeKind::Changed);
+            CHECK(diff.changes[1].kind == NodeChangeKind::Added);
+        }
+    }
+
+    bool EndsWith(const std::wstring& text, const wchar_t* suffix)
+    {
+        const std::wstring::size_type length = wcslen(suffix);
+        return text.length() >= length && text.compare(text.length() - length, length, suffix) == 0;
+    }
+
+    std::wstring Load(SourceManager& sources, const wchar_t* entry)
+    {
+        SourceDocument document;
+        std::vector<Diagnostic> diagnostics;
+
+        CHECK(sources.LoadStructuredDocument(entry, document, diagnostics));
+        CHECK(diagnostics.empty());
+        return document.content;
+    }
+
+    // theme.lsx includes middle.lsx, which includes leaf.lsx. A change to
+    // the leaf has to reach the theme through the middle.
+    void TransitiveInvalidation()
+    {
+        const std::wstring directory = themev2test::ScratchDirectory(L"diff");
+        const std::wstring theme = directory + L"theme.lsx";
+        const std::wstring middle = directory + L"middle.lsx";
+        const std::wstring leaf = directory + L"leaf.lsx";
+
+        themev2test::WriteScratchFile(theme, "#include \"middle.lsx\"\n#panel { name=\"root\" }\n");
+        themev2test::WriteScratchFile(middle, "#include \"leaf.lsx\"\n#panel { name=\"middle\" }\n");
+        themev2test::WriteScratchFile(leaf, "#panel { name=\"leaf\" text=\"before\" }\n");
+
+        SourceManager sources(directory);
+        CHECK(Load(sources, L"theme.lsx").find(L"\"before\"") != std::wstring::npos);
+        CHECK(sources.InvalidateChanged().empty());
+
+        themev2test::WriteScratchFile(leaf, "#panel { name=\"leaf\" text=\"after\" }\n");
+
+        // Unchanged files keep the text they were loaded with, so this edit
+        // to middle.lsx is not seen until it is invalidated itself
+        const std::vector<std::wstring> changed = sources.InvalidateChanged();
+        themev2test::WriteScratchFile(middle, "#include \"leaf.lsx\"\n#panel { name=\"edited\" }\n");
+
+        CHECK(changed.size() == 1);
+        CHECK(changed.size() == 1 && EndsWith(changed[0], L"leaf.lsx"));
+
+        const std::wstring content = Load(sources, L"theme.lsx");
+        CHECK(content.find(L"\"after\"") != std::wstring::npos);
+        CHECK(content.find(L"\"before\"") == std::wstring::npos);
+        CHECK(content.find(L"\"middle\"") != std::wstring::npos);
+
+        CHECK(sources.InvalidateChanged().size() == 1);
+        CHECK(Load(sources, L"theme.lsx").find(L"\"edited\"") != std::wstring::npos);
+
+        DeleteFileW(theme.c_str());
+        DeleteFileW(middle.c_str());
+        DeleteFileW(leaf.c_str());
+        RemoveDirectoryW(directory.c_str());
+    }
+
+    // Siblings named n0, n1, ..., with every changedEvery-th width bumped
+    std::wstring WideTheme(unsigned count, unsigned changedEvery)
+    {
+        std::wstring text = L"#panel { name=\"root\"\n";
+        for (unsigned index = 0; index < count; ++index)
+        {
+            const unsigned value = (changedEvery != 0 && index % changedEvery == 0) ? index + 1 : index;
+            text += L"  #item { name=\"n" + std::to_wstring(index) + L"\" width=" + std::to_wstring(value) + L" }\n";
+        }
+        text += L"}\n";
+        return text;
+    }
+}
+
+
+void DiffTests()
+{
+    NoChanges();
+    EachKind();
+    ParentFirst();
+    Unnamed();
+    TransitiveInvalidation();
+}
+
+
+void DiffBenchmarks()
+{
+    const unsigned count = 2000;
+    const unsigned runs = 50;
+
+    const ThemeDocument before = themev2test::ParseTheme(WideTheme(count, 0));
+    const ThemeDocument after = themev2test::ParseTheme(WideTheme(count, 100));
+
+    std::size_t changes = 0;
+    const double diffMs = themev2test::TimeRuns(runs, [&]()
+    {
+        changes = DiffDocuments(before, after).changes.size();
+    });
+
+    printf("  %u siblings  %9.4f ms  %u changes\n", count, diffMs, unsigned(changes));
+}
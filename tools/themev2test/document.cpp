@@ -0,0 +1,263 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// ThemeDocument: the views over the flat records after a parse, strings
+// unescaped into the pool, and text the parser shares instead of copying.
+// The benchmark walks a large document and measures its buffers.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/Parser.h"
+
+#include <cstdio>
+#include <cwchar>
+#include <string>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    bool TextIs(const wchar_t* text, const wchar_t* expected)
+    {
+        if (wcscmp(text, expected) == 0)
+        {
+            return true;
+        }
+
+        fprintf(stderr, "  text is \"%ls\", expected \"%ls\"\n", text, expected);
+        return false;
+    }
+
+    // Whether text points into the document's string pool
+    bool InPool(const ThemeDocument& document, const wchar_t* text)
+    {
+        return text >= document.strings.c_str() && text < document.strings.c_str() + document.strings.size();
+    }
+
+    AttributeView Attribute(const NodeView& node, const wchar_t* name)
+    {
+        AttributeView attribute(nullptr, InvalidThemeIndex);
+        CHECK(node.FindAttribute(name, &attribute));
+        return attribute;
+    }
+
+    void Views()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(
+            L"#lstheme\n"
+            L"#style  \"styles.lss\"  \n"
+            L"#panel {\n"
+            L"  id=\"main\" width=120 visible=false layout=stack ref=@accent\n"
+            L"  layoutParams={ align=\"left\", spacing=4 }\n"
+            L"  items=[1, \"two\", three]\n"
+            L"  #button { name=\"first\" }\n"
+            L"  #button { name=\"second\" #label { } }\n"
+            L"}\n"
+            L"#panel { name=\"other\" }\n");
+
+        CHECK(document.Directives().size() == 2);
+        CHECK(TextIs(document.Directives()[0].Name(), L"lstheme"));
+        CHECK(TextIs(document.Directives()[0].Argument(), L""));
+        CHECK(TextIs(document.Directives()[1].Name(), L"style"));
+        CHECK(TextIs(document.Directives()[1].Argument(), L"\"styles.lss\""));
+
+        CHECK(document.RootNodes().size() == 2);
+        CHECK(document.NodeCount() == 5);
+
+        const NodeView panel = document.RootNodes()[0];
+        CHECK(TextIs(panel.Component(), L"panel"));
+        CHECK(TextIs(panel.Id(), L"main"));
+        CHECK(TextIs(panel.Name(), L""));
+        CHECK(panel.Attributes().size() == 7);
+        CHECK(panel.Children().size() == 2);
+
+        const ValueView width = Attribute(panel, L"WIDTH").Value();
+        CHECK(width.Kind() == ValueKind::Number);
+        CHECK(width.Number() == 120.0);
+        CHECK(TextIs(width.Text(), L"120"));
+
+        const ValueView visible = Attribute(panel, L"visible").Value();
+        CHECK(visible.Kind() == ValueKind::Boolean);
+        CHECK(!visible.Boolean());
+
+        CHECK(Attribute(panel, L"layout").Value().Kind() == ValueKind::Identifier);
+        CHECK(TextIs(Attribute(panel, L"layout").Value().Text(), L"stack"));
+
+        const ValueView reference = Attribute(panel, L"ref").Value();
+        CHECK(reference.Kind() == ValueKind::Reference);
+        CHECK(TextIs(reference.Text(), L"accent"));
+
+        const ValueView params = Attribute(panel, L"layoutParams").Value();
+        CHECK(params.Kind() == ValueKind::Object);
+        CHECK(params.Elements().empty());
+        CHECK(params.Properties().size() == 2);
+        CHECK(TextIs(params.Properties()[0].Key(), L"align"));
+        CHECK(TextIs(params.Properties()[0].Value().Text(), L"left"));
+        CHECK(TextIs(params.Properties()[1].Key(), L"spacing"));
+        CHECK(params.Properties()[1].Value().Number() == 4.0);
+
+        const ValueView items = Attribute(panel, L"items").Value();
+        CHECK(items.Kind() == ValueKind::Array);
+        CHECK(items.Properties().empty());
+        CHECK(items.Elements().size() == 3);
+        CHECK(items.Elements()[0].Kind() == ValueKind::Number);
+        CHECK(items.Elements()[1].Kind() == ValueKind::String);
+        CHECK(items.Elements()[2].Kind() == ValueKind::Identifier);
+
+        // Iterating visits the same records as indexing
+        unsigned index = 0;
+        for (const NodeView child : panel.Children())
+        {
+            CHECK(child.Index() == panel.Children()[index++].Index());
+            CHECK(TextIs(child.Component(), L"button"));
+        }
+
+        const NodeView second = panel.Children()[1];
+        CHECK(TextIs(second.Name(), L"second"));
+        CHECK(second.Children().size() == 1);
+        CHECK(TextIs(second.Children()[0].Component(), L"label"));
+        CHECK(second.Children()[0].Attributes().empty());
+
+        AttributeView missing(nullptr, InvalidThemeIndex);
+        CHECK(!second.FindAttribute(L"width", &missing));
+
+        CHECK(TextIs(document.RootNodes()[1].Name(), L"other"));
+    }
+
+    // Escapes are resolved once, into the pool, and the result is a C
+    // string of its own
+    void Unescaping()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(
+            LR"(#item { name="n" tooltip="Desktop \"1\"\tnext\\line\n" path="C:\\x" plain="a" })");
+
+        const NodeView item = document.RootNodes()[0];
+
+        const ValueView tooltip = Attribute(item, L"tooltip").Value();
+        CHECK(tooltip.Kind() == ValueKind::String);
+        CHECK(TextIs(tooltip.Text(), L"Desktop \"1\"\tnext\\line\n"));
+        CHECK(tooltip.TextLength() == wcslen(L"Desktop \"1\"\tnext\\line\n"));
+        CHECK(tooltip.Text()[tooltip.TextLength()] == L'\0');
+        CHECK(InPool(document, tooltip.Text()));
+
+        CHECK(TextIs(Attribute(item, L"path").Value().Text(), L"C:\\x"));
+        CHECK(TextIs(Attribute(item, L"plain").Value().Text(), L"a"));
+
+        const ThemeDocument empty = themev2test::ParseTheme(L"#item { text=\"\" }");
+        const ValueView text = Attribute(empty.RootNodes()[0], L"text").Value();
+        CHECK(text.Kind() == ValueKind::String);
+        CHECK(text.TextLength() == 0);
+        CHECK(TextIs(text.Text(), L""));
+    }
+
+    // id, name and a class that is a single name point at the text of
+    // their attribute value, unset fields at the empty string at offset 0
+    void SharedText()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(
+            L"#item { id=\"clock\" name=\"clock label\" class=\"solo\" }"
+            L"#item { class=\"a b a\" }");
+
+        const NodeView item = document.RootNodes()[0];
+        CHECK(item.Id() == Attribute(item, L"id").Value().Text());
+        CHECK(item.Name() == Attribute(item, L"name").Value().Text());
+        CHECK(item.Classes().size() == 1);
+        CHECK(item.Classes()[0].Name() == Attribute(item, L"class").Value().Text());
+
+        const NodeView split = document.RootNodes()[1];
+        CHECK(split.Id() == document.strings.c_str());
+        CHECK(split.Name() == document.strings.c_str());
+        CHECK(split.Classes().size() == 2);
+        CHECK(TextIs(split.Classes()[0].Name(), L"a"));
+        CHECK(TextIs(split.Classes()[1].Name(), L"b"));
+        CHECK(InPool(document, split.Classes()[1].Name()));
+
+        // A copy has a pool of its own, and its views read from it
+        const ThemeDocument copy = document;
+        CHECK(copy.RootNodes()[0].Id() != item.Id());
+        CHECK(InPool(copy, copy.RootNodes()[0].Id()));
+        CHECK(TextIs(copy.RootNodes()[0].Id(), L"clock"));
+
+        ThemeDocument cleared = document;
+        cleared.Clear();
+        CHECK(cleared.NodeCount() == 0);
+        CHECK(cleared.RootNodes().empty());
+        CHECK(cleared.strings.size() == 1);
+    }
+
+    std::wstring GenerateTheme(unsigned count)
+    {
+        std::wstring theme;
+
+        for (unsigned panel = 0; panel < count; ++panel)
+        {
+            theme += L"#panel { name=\"panel" + std::to_wstring(panel) + L"\" width=120 class=\"bar top\"\n"
+                L"  layoutParams={ align=\"left\", spacing=4 }\n"
+                L"  #button { tooltip=\"Desktop \\\"1\\\"\" items=[1, 2, 3] }\n"
+                L"}\n";
+        }
+
+        return theme;
+    }
+}
+
+
+void DocumentTests()
+{
+    Views();
+    Unescaping();
+    SharedText();
+}
+
+
+void DocumentBenchmarks()
+{
+    const ThemeDocument document = themev2test::ParseTheme(GenerateTheme(2000));
+
+    std::size_t allocations = themev2test::AllocationCount();
+    std::size_t attributes = 0;
+
+    const double walkMs = themev2test::TimeRuns(10, [&]()
+    {
+        for (const NodeView panel : document.RootNodes())
+        {
+            attributes += panel.Attributes().size();
+            for (const NodeView child : panel.Children())
+            {
+                attributes += child.Attributes().size();
+            }
+        }
+    });
+
+    allocations = themev2test::AllocationCount() - allocations;
+
+    const std::size_t bytes = document.strings.capacity() * sizeof(wchar_t) +
+        document.nodes.capacity() * sizeof(NodeRecord) +
+        document.classes.capacity() * sizeof(StringRef) +
+        document.attributes.capacity() * sizeof(AttributeRecord) +
+        document.values.capacity() * sizeof(ValueRecord) +
+        document.properties.capacity() * sizeof(PropertyRecord) +
+        document.directives.capacity() * sizeof(DirectiveRecord);
+
+    printf("  %u nodes, %u KB of records and text\n", unsigned(document.NodeCount()), unsigned(bytes / 1024));
+    printf("  walk   %9.4f ms  %u allocations  %u attributes\n", walkMs, unsigned(allocations),
+        unsigned(attributes / 10));
+}
@@ -0,0 +1,406 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// LayoutEngine: golden layouts for each kind of length and layout, the work
+// an incremental Update does, and incremental against full layout on a deep
+// tree.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/LayoutEngine.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    const LayoutSize Viewport = { 800.0f, 600.0f };
+
+    bool NoConstants(const wchar_t*, float&)
+    {
+        return false;
+    }
+
+    bool BoundsAre(const LayoutEngine& engine, ThemeIndex node, float x, float y, float width, float height)
+    {
+        const LayoutRect bounds = engine.Bounds(node);
+        if (bounds.x == x && bounds.y == y && bounds.width == width && bounds.height == height)
+        {
+            return true;
+        }
+
+        fprintf(stderr, "  node %u is [%g,%g %gx%g], expected [%g,%g %gx%g]\n", node,
+            bounds.x, bounds.y, bounds.width, bounds.height, x, y, width, height);
+        return false;
+    }
+
+    // Lays a theme out over the viewport and checks one node per expected
+    // rectangle
+    struct Golden
+    {
+        const wchar_t* name;
+        float x, y, width, height;
+    };
+
+    template <std::size_t Count>
+    void CheckLayout(const wchar_t* theme, const Golden (&expected)[Count])
+    {
+        const ThemeDocument document = themev2test::ParseTheme(theme);
+
+        LayoutEngine engine;
+        engine.Build(document, NoConstants);
+        engine.Update(Viewport);
+
+        for (const Golden& node : expected)
+        {
+            CHECK(BoundsAre(engine, themev2test::FindNode(document, node.name),
+                node.x, node.y, node.width, node.height));
+        }
+    }
+
+    void StackLayout()
+    {
+        const Golden vertical[] =
+        {
+            { L"root", 0, 0, 200, 100 },
+            { L"a", 10, 10, 180, 20 },
+            { L"b", 10, 35, 180, 30 }
+        };
+        CheckLayout(LR"(
+            #panel { name="root" width=200 height=100 layoutParams={padding=10, spacing=5}
+                #item { name="a" height=20 }
+                #item { name="b" height=30 }
+            })", vertical);
+
+        // The root goes right in the viewport, its children pack right
+        const Golden horizontal[] =
+        {
+            { L"root", 500, 0, 300, 40 },
+            { L"a", 710, 0, 50, 40 },
+            { L"b", 770, 0, 30, 10 }
+        };
+        CheckLayout(LR"(
+            #panel { name="root" width=300 height=40 layoutParams={direction="horizontal", align="right", spacing=10}
+                #item { name="a" width=50 }
+                #item { name="b" width=30 height=10 }
+            })", horizontal);
+    }
+
+    void GridLayout()
+    {
+        // Columns are as wide as their widest cell, rows as tall as their
+        // tallest
+        const Golden grid[] =
+        {
+            { L"a", 5, 5, 40, 20 },
+            { L"b", 55, 5, 60, 30 },
+            { L"c", 5, 45, 30, 10 },
+            { L"d", 55, 45, 10, 40 }
+        };
+        CheckLayout(LR"(
+            #panel { name="root" width=220 height=100 layout="grid" layoutParams={direction="horizontal", columns=2, spacing=10, padding=5}
+                #item { name="a" width=40 height=20 }
+                #item { name="b" width=60 height=30 }
+                #item { name="c" width=30 height=10 }
+                #item { name="d" width=10 height=40 }
+            })", grid);
+    }
+
+    void FillLayout()
+    {
+        const Golden fill[] =
+        {
+            { L"a", 0, 0, 100, 60 },
+            { L"b", 100, 0, 150, 60 },
+            { L"c", 250, 0, 50, 60 }
+        };
+        CheckLayout(LR"(
+            #panel { name="root" width=300 height=60 layoutParams={direction="horizontal"}
+                #item { name="a" width=100 }
+                #item { name="b" width="fill" }
+                #item { name="c" width=50 }
+            })", fill);
+    }
+
+    void PercentLayout()
+    {
+        // Percentages are of the parent's content box, 360x160 here
+        const Golden percent[] =
+        {
+            { L"a", 20, 20, 180, 40 },
+            { L"b", 20, 60, 360, 120 }
+        };
+        CheckLayout(LR"(
+            #panel { name="root" width=400 height=200 layoutParams={padding=20}
+                #item { name="a" width="50%" height="25%" layoutParams={align="left"} }
+                #item { name="b" width="fill" height="fill" }
+            })", percent);
+    }
+
+    // A width change measures the changed node and its ancestors again,
+    // and arranges only what moved
+    void IncrementalSetWidth()
+    {
+        const ThemeDocument document = themev2test::ParseTheme(LR"(
+            #panel { name="root" width=400 height=300 layoutParams={direction="horizontal"}
+                #panel { name="left" width=200
+                    #item { name="l1" height=20 }
+                    #item { name="l2" height=20 }
+                    #item { name="l3" height=20 }
+                }
+                #panel { name="right" width="fill"
+                    #item { name="r1" height=20 }
+                    #item { name="r2" height=20 }
+                }
+            })");
+
+        LayoutEngine engine;
+        engine.Build(document, NoConstants);
+        engine.Update(Viewport);
+
+        CHECK(engine.LastStatistics().measured == document.NodeCount());
+        CHECK(engine.LastStatistics().arranged == document.NodeCount());
+
+        engine.Update(Viewport);
+        CHECK(engine.LastStatistics().measured == 0);
+        CHECK(engine.LastStatistics().arranged == 0);
+
+        const LayoutLength width = { LayoutUnit::Pixels, 50.0f };
+        engine.SetWidth(themev2test::FindNode(document, L"l2"), width);
+        engine.Update(Viewport);
+
+        // l2, left and root; left keeps its size, so right and the other
+        // items are neither measured nor arranged again
+        CHECK(engine.LastStatistics().measured == 3);
+        CHECK(engine.LastStatistics().arranged == 3);
+        CHECK(BoundsAre(engine, themev2test::FindNode(document, L"l2"), 0, 20, 50, 20));
+        CHECK(BoundsAre(engine, themev2test::FindNode(document, L"l3"), 0, 40, 200, 20));
+        CHECK(BoundsAre(engine, themev2test::FindNode(document, L"r1"), 200, 0, 200, 20));
+    }
+
+    // Deterministic, so runs compare
+    class Random
+    {
+    public:
+        explicit Random(unsigned seed) : m_state(seed)
+        {
+        }
+
+        unsigned Next(unsigned bound)
+        {
+            m_state = m_state * 1103515245u + 12345u;
+            return (m_state >> 16) % bound;
+        }
+
+    private:
+        unsigned m_state;
+    };
+
+    // Nests every kind of length and layout, depth levels deep with fanout
+    // children per node near the top
+    void GenerateTree(Random& random, unsigned depth, unsigned maxDepth, unsigned fanout, unsigned& count,
+        std::wstring& theme)
+    {
+        theme += L"#n { name=\"n" + std::to_wstring(count++) + L"\" ";
+
+        switch (random.Next(4))
+        {
+        case 0:
+            theme += L"width=\"fill\" ";
+            break;
+        case 1:
+            theme += L"width=" + std::to_wstring(random.Next(50) + 1) + L" ";
+            break;
+        case 2:
+            theme += L"width=\"30%\" ";
+            break;
+        }
+
+        if (random.Next(2) == 0)
+        {
+            theme += L"layout=\"grid\" layoutParams={direction=\"horizontal\", columns=" +
+                std::to_wstring(random.Next(3) + 1) + L", spacing=2, padding=1} ";
+        }
+        else
+        {
+            theme += std::wstring(L"layoutParams={direction=\"") +
+                (random.Next(2) ? L"horizontal" : L"vertical") + L"\", align=\"" +
+                (random.Next(2) ? L"center" : L"right bottom") + L"\", margin=1} ";
+        }
+
+        if (depth < maxDepth)
+        {
+            const unsigned children = (depth < 3) ? fanout : random.Next(3);
+            for (unsigned child = 0; child < children; ++child)
+            {
+                GenerateTree(random, depth + 1, maxDepth, fanout, count, theme);
+            }
+        }
+
+        theme += L"}\n";
+    }
+
+    ThemeDocument DeepTree(unsigned maxDepth)
+    {
+        Random random(7);
+        unsigned count = 0;
+        std::wstring theme;
+
+        for (unsigned root = 0; root < 3; ++root)
+        {
+            GenerateTree(random, 0, maxDepth, 4, count, theme);
+        }
+
+        return themev2test::ParseTheme(theme);
+    }
+
+    struct Edit
+    {
+        ThemeIndex node;
+        unsigned kind;
+        float value;
+    };
+
+    void Apply(LayoutEngine& engine, const Edit& edit)
+    {
+        if (edit.kind == 0)
+        {
+            const LayoutSize size = { edit.value, edit.value / 3 };
+            engine.SetContentSize(edit.node, size);
+        }
+        else if (edit.kind == 1)
+        {
+            const LayoutLength width = { LayoutUnit::Pixels, edit.value };
+            engine.SetWidth(edit.node, width);
+        }
+        else
+        {
+            const LayoutLength height = { LayoutUnit::Percent, edit.value };
+            engine.SetHeight(edit.node, height);
+        }
+    }
+
+    Edit RandomEdit(Random& random, const ThemeDocument& document)
+    {
+        Edit edit = { ThemeIndex(random.Next(unsigned(document.NodeCount()))), random.Next(3),
+            float(random.Next(90)) };
+        return edit;
+    }
+
+    // After every edit, the incremental result has to match laying the
+    // edited tree out from scratch
+    void IncrementalMatchesFull()
+    {
+        const ThemeDocument document = DeepTree(8);
+        Random random(12345);
+
+        LayoutEngine incremental;
+        incremental.Build(document, NoConstants);
+        incremental.Update(Viewport);
+
+        std::vector<Edit> edits;
+        unsigned mismatches = 0;
+
+        for (unsigned round = 0; round < 40; ++round)
+        {
+            edits.push_back(RandomEdit(random, document));
+            Apply(incremental, edits.back());
+
+            // Now and then the viewport changes too
+            LayoutSize viewport = Viewport;
+            viewport.width = (round % 10 == 9) ? 640.0f : Viewport.width;
+            incremental.Update(viewport);
+
+            LayoutEngine full;
+            full.Build(document, NoConstants);
+            for (const Edit& edit : edits)
+            {
+                Apply(full, edit);
+            }
+            full.Update(viewport);
+
+            for (ThemeIndex node = 0; node < document.NodeCount(); ++node)
+            {
+                const LayoutRect expected = full.Bounds(node);
+                if (!BoundsAre(incremental, node, expected.x, expected.y, expected.width, expected.height))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+
+        CHECK(mismatches == 0);
+    }
+}
+
+
+void LayoutTests()
+{
+    StackLayout();
+    GridLayout();
+    FillLayout();
+    PercentLayout();
+    IncrementalSetWidth();
+    IncrementalMatchesFull();
+}
+
+
+void LayoutBenchmarks()
+{
+    const ThemeDocument document = DeepTree(12);
+    const unsigned runs = 200;
+
+    LayoutEngine full;
+    full.Build(document, NoConstants);
+
+    const double fullMs = themev2test::TimeRuns(runs, [&]()
+    {
+        // Build leaves the whole tree dirty
+        full.Build(document, NoConstants);
+        full.Update(Viewport);
+    });
+
+    LayoutEngine incremental;
+    incremental.Build(document, NoConstants);
+    incremental.Update(Viewport);
+
+    Random random(99);
+    std::size_t measured = 0;
+    std::size_t arranged = 0;
+
+    const double incrementalMs = themev2test::TimeRuns(runs, [&]()
+    {
+        Apply(incremental, RandomEdit(random, document));
+        incremental.Update(Viewport);
+
+        measured += incremental.LastStatistics().measured;
+        arranged += incremental.LastStatistics().arranged;
+    });
+
+    printf("  %u nodes\n", unsigned(document.NodeCount()));
+    printf("  full         %9.4f ms  %u measured  %u arranged\n", fullMs,
+        unsigned(document.NodeCount()), unsigned(document.NodeCount()));
+    printf("  incremental  %9.4f ms  %.1f measured  %.1f arranged (average of %u edits)\n",
+        incrementalMs, double(measured) / runs, double(arranged) / runs, runs);
+}
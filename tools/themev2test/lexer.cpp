@@ -0,0 +1,179 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// Lexer: tokens point into the source instead of owning their text, so
+// lexing allocates nothing, and locations are only worked out for
+// diagnostics. The benchmark counts allocations and time for a large
+// generated theme.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/Parser.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    // Roughly what a taskbar theme repeats, count times over
+    std::wstring GenerateTheme(unsigned count)
+    {
+        std::wstring theme = L"#lstheme\n";
+
+        for (unsigned panel = 0; panel < count; ++panel)
+        {
+            theme += L"#panel {\n"
+                L"  name = \"panel" + std::to_wstring(panel) + L"\"\n"
+                L"  width = 120\n"
+                L"  height = \"100%\"\n"
+                L"  layout = stack\n"
+                L"  layoutParams = {align=\"left\", direction=\"horizontal\", spacing=4}\n"
+                L"  #button { icon = \"desktop_1.png\" tooltip = \"Desktop \\\"1\\\"\" class = \"a b\" }\n"
+                L"  #button { icon = \"add.png\" tooltip = \"New\" ref = @accent }\n"
+                L"}\n";
+        }
+
+        return theme;
+    }
+
+    std::size_t CountLines(const std::wstring& text)
+    {
+        std::size_t lines = 0;
+        for (wchar_t ch : text)
+        {
+            lines += (ch == L'\n') ? 1 : 0;
+        }
+        return lines;
+    }
+
+    void TokenText()
+    {
+        const SourceDocument source = themev2test::MakeSource(LR"(#panel { name="a \"b\"" width=12 })");
+        Lexer lexer(source);
+
+        const TokenType expected[] =
+        {
+            TokenType::Hash, TokenType::Identifier, TokenType::LBrace, TokenType::Identifier,
+            TokenType::Equals, TokenType::String, TokenType::Identifier, TokenType::Equals,
+            TokenType::Number, TokenType::RBrace, TokenType::EndOfFile
+        };
+
+        std::vector<Token> tokens;
+        for (TokenType type : expected)
+        {
+            tokens.push_back(lexer.NextToken());
+            CHECK(tokens.back().type == type);
+        }
+
+        CHECK(lexer.Text(tokens[1]) == L"panel");
+        CHECK(lexer.TextEquals(tokens[1], L"PANEL"));
+        CHECK(lexer.Text(tokens[5]) == LR"("a \"b\"")");
+        CHECK(lexer.StringValue(tokens[5]) == L"a \"b\"");
+        CHECK(lexer.Text(tokens[8]) == L"12");
+    }
+
+    void LexingDoesNotAllocate()
+    {
+        const SourceDocument source = themev2test::MakeSource(GenerateTheme(100));
+        Lexer lexer(source);
+
+        const std::size_t before = themev2test::AllocationCount();
+        std::size_t tokens = 0;
+
+        while (lexer.NextToken().type != TokenType::EndOfFile)
+        {
+            ++tokens;
+        }
+
+        CHECK(themev2test::AllocationCount() == before);
+        CHECK(tokens > 100 * 40);
+    }
+
+    // Lines are only counted for diagnostics; they still have to come out
+    // right deep into the file
+    void DiagnosticLocation()
+    {
+        const std::wstring theme = GenerateTheme(50) + L"#panel { width = }\n";
+        const SourceDocument source = themev2test::MakeSource(theme);
+
+        std::vector<Diagnostic> diagnostics;
+        Parser parser(source, diagnostics);
+        parser.Parse();
+
+        CHECK(!diagnostics.empty());
+        if (!diagnostics.empty())
+        {
+            CHECK(diagnostics[0].location.file == L"test.lsx");
+            CHECK(diagnostics[0].location.line == CountLines(theme));
+        }
+    }
+}
+
+
+void LexerTests()
+{
+    TokenText();
+    LexingDoesNotAllocate();
+    DiagnosticLocation();
+}
+
+
+void LexerBenchmarks()
+{
+    const SourceDocument source = themev2test::MakeSource(GenerateTheme(2000));
+
+    std::size_t tokens = 0;
+    std::size_t allocations = themev2test::AllocationCount();
+
+    const double lexMs = themev2test::TimeRuns(1, [&]()
+    {
+        Lexer lexer(source);
+        while (lexer.NextToken().type != TokenType::EndOfFile)
+        {
+            ++tokens;
+        }
+    });
+
+    allocations = themev2test::AllocationCount() - allocations;
+
+    printf("  %u lines, %u tokens\n", unsigned(CountLines(source.content)), unsigned(tokens));
+    printf("  lex    %9.3f ms  %8u allocations\n", lexMs, unsigned(allocations));
+
+    allocations = themev2test::AllocationCount();
+    std::size_t bytes = themev2test::AllocatedBytes();
+    std::size_t nodes = 0;
+
+    const double parseMs = themev2test::TimeRuns(1, [&]()
+    {
+        std::vector<Diagnostic> diagnostics;
+        Parser parser(source, diagnostics);
+        nodes = parser.Parse().NodeCount();
+    });
+
+    allocations = themev2test::AllocationCount() - allocations;
+    bytes = themev2test::AllocatedBytes() - bytes;
+
+    printf("  parse  %9.3f ms  %8u allocations  %u KB  %u nodes\n", parseMs, unsigned(allocations),
+        unsigned(bytes / 1024), unsigned(nodes));
+}
@@ -0,0 +1,212 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// StyleParser and StyleResolver: which declaration wins the cascade, that
+// nodes only differing in names no rule uses share a resolved style, and
+// how long resolving a 10k-node theme takes.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/Parser.h"
+#include "../../litestep/themev2/StyleParser.h"
+#include "../../litestep/themev2/StyleResolver.h"
+
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+using namespace litestep::themev2;
+
+namespace
+{
+    StyleSheet ParseStyle(const std::wstring& text)
+    {
+        const SourceDocument source = themev2test::MakeSource(text);
+
+        std::vector<Diagnostic> diagnostics;
+        StyleParser parser(source, diagnostics);
+        StyleSheet sheet = parser.Parse();
+
+        for (const Diagnostic& diagnostic : diagnostics)
+        {
+            fprintf(stderr, "test.lsxstyle(%u): %ls\n",
+                unsigned(diagnostic.location.line), diagnostic.message.c_str());
+        }
+        CHECK(diagnostics.empty());
+
+        return sheet;
+    }
+
+    bool Resolves(StyleResolver& resolver, ThemeIndex style, const wchar_t* property, const wchar_t* value)
+    {
+        const StyleDeclarationRecord* declaration = resolver.Find(style, property);
+        if (declaration != nullptr && wcscmp(resolver.Sheet().String(declaration->value), value) == 0)
+        {
+            return true;
+        }
+
+        fprintf(stderr, "  %ls is '%ls', expected '%ls'\n", property,
+            declaration ? resolver.Sheet().String(declaration->value) : L"(none)", value);
+        return false;
+    }
+
+    const wchar_t* const CascadeStyle = LR"(
+        all { radius = 1; color = "white"; opacity = 1 }
+        button { radius = 2 }
+        .primary { color = "blue" }
+        button.primary { opacity = 0.5 }
+        .glass { color = "gray" }
+        #start { radius = 3 }
+        #START { color = "red" }
+    )";
+
+    void Cascade()
+    {
+        const StyleSheet sheet = ParseStyle(CascadeStyle);
+        const ThemeDocument document = themev2test::ParseTheme(LR"(
+            #panel { name="plain" }
+            #button { name="button" }
+            #button { name="primary" class="primary" }
+            #button { name="both" class="glass primary" }
+            #button { name="start" style="Start" class="primary" }
+        )");
+
+        StyleResolver resolver(sheet);
+        const std::vector<ThemeIndex> styles = resolver.ResolveAll(document);
+
+        // Only the universal rule
+        const ThemeIndex plain = styles[themev2test::FindNode(document, L"plain")];
+        CHECK(Resolves(resolver, plain, L"radius", L"1"));
+        CHECK(Resolves(resolver, plain, L"color", L"white"));
+
+        // A component outweighs the universal rule
+        CHECK(Resolves(resolver, styles[themev2test::FindNode(document, L"button")], L"radius", L"2"));
+
+        // A class outweighs a component, and a class with a component
+        // outweighs the class alone
+        const ThemeIndex primary = styles[themev2test::FindNode(document, L"primary")];
+        CHECK(Resolves(resolver, primary, L"color", L"blue"));
+        CHECK(Resolves(resolver, primary, L"opacity", L"0.5"));
+        CHECK(Resolves(resolver, primary, L"radius", L"2"));
+
+        // Equal weight goes to the rule written last
+        CHECK(Resolves(resolver, styles[themev2test::FindNode(document, L"both")], L"color", L"gray"));
+
+        // Ids match the style attribute, ignoring case, and outweigh the rest
+        const ThemeIndex start = styles[themev2test::FindNode(document, L"start")];
+        CHECK(Resolves(resolver, start, L"radius", L"3"));
+        CHECK(Resolves(resolver, start, L"color", L"red"));
+        CHECK(Resolves(resolver, start, L"opacity", L"0.5"));
+    }
+
+    // Thousands of nodes that differ only in names no selector uses
+    std::wstring GenerateButtons(unsigned count)
+    {
+        std::wstring theme;
+
+        for (unsigned panel = 0; panel < count / 10; ++panel)
+        {
+            theme += L"#panel { name=\"panel" + std::to_wstring(panel) + L"\"\n";
+
+            for (unsigned button = 0; button < 9; ++button)
+            {
+                const unsigned index = panel * 9 + button;
+                theme += L"  #button { name=\"button" + std::to_wstring(index) + L"\" class=\"" +
+                    ((index % 3) ? L"primary" : L"glass") + ((index % 7) ? L"" : L" ok") + L"\" }\n";
+            }
+
+            theme += L"}\n";
+        }
+
+        return theme;
+    }
+
+    void SharedStyles()
+    {
+        const StyleSheet sheet = ParseStyle(CascadeStyle);
+        const ThemeDocument document = themev2test::ParseTheme(GenerateButtons(200));
+
+        StyleResolver resolver(sheet);
+        const std::vector<ThemeIndex> styles = resolver.ResolveAll(document);
+
+        CHECK(styles.size() == document.NodeCount());
+
+        // The panel, and the primary and glass buttons; "ok" and the
+        // names are in no selector
+        CHECK(resolver.StyleCount() == 3);
+    }
+
+    // A rule for each of count ids, plus some for classes and components
+    std::wstring GenerateIdRules(unsigned count)
+    {
+        std::wstring style = CascadeStyle;
+
+        for (unsigned rule = 0; rule < count; ++rule)
+        {
+            style += L"#button" + std::to_wstring(rule * 10) + L" { radius = " +
+                std::to_wstring(rule) + L" }\n";
+        }
+
+        return style;
+    }
+}
+
+
+void StyleTests()
+{
+    Cascade();
+    SharedStyles();
+}
+
+
+void StyleBenchmarks()
+{
+    const ThemeDocument document = themev2test::ParseTheme(GenerateButtons(10000));
+
+    // Few distinct styles, nearly every node is a memo hit
+    const StyleSheet shared = ParseStyle(CascadeStyle);
+    std::size_t styleCount = 0;
+
+    const double sharedMs = themev2test::TimeRuns(20, [&]()
+    {
+        StyleResolver resolver(shared);
+        resolver.ResolveAll(document);
+        styleCount = resolver.StyleCount();
+    });
+
+    printf("  %u nodes\n", unsigned(document.NodeCount()));
+    printf("  %4u rules  %9.3f ms  %5u styles\n", unsigned(shared.rules.size()), sharedMs,
+        unsigned(styleCount));
+
+    // Every tenth button has a rule of its own
+    const StyleSheet ids = ParseStyle(GenerateIdRules(1000));
+
+    const double idsMs = themev2test::TimeRuns(20, [&]()
+    {
+        StyleResolver resolver(ids);
+        resolver.ResolveAll(document);
+        styleCount = resolver.StyleCount();
+    });
+
+    printf("  %4u rules  %9.3f ms  %5u styles\n", unsigned(ids.rules.size()), idsMs,
+        unsigned(styleCount));
+}
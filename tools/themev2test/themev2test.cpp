@@ -0,0 +1,257 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// themev2test
+// Checks the parts of the v2 theme engine that run without a shell (parser,
+// layout, styles, bindings, diffs, the compiled cache) against known
+// results, and with "bench" also times them.
+//
+//   themev2test [bench]
+//
+// Exits with 1 if any check failed. The diff and cache suites work on real
+// files in %TEMP%\themev2test.
+//
+#include "themev2test.h"
+#include "../../litestep/themev2/Parser.h"
+
+#include <Windows.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace
+{
+    struct Suite
+    {
+        const char* name;
+        void (*tests)();
+        void (*benchmarks)();
+    };
+
+    const Suite Suites[] =
+    {
+        { "lexer", LexerTests, LexerBenchmarks },
+        { "document", DocumentTests, DocumentBenchmarks },
+        { "style", StyleTests, StyleBenchmarks },
+        { "layout", LayoutTests, LayoutBenchmarks },
+        { "binding", BindingTests, BindingBenchmarks },
+        { "diff", DiffTests, DiffBenchmarks },
+        { "cache", CacheTests, CacheBenchmarks }
+    };
+
+    unsigned s_failures = 0;
+
+    // The tool is single-threaded
+    std::size_t s_allocations = 0;
+    std::size_t s_allocatedBytes = 0;
+}
+
+
+void* operator new(std::size_t size)
+{
+    ++s_allocations;
+    s_allocatedBytes += size;
+
+    void* memory = malloc(size != 0 ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+
+// std::stable_sort and friends ask for their buffers with this one, which
+// has to come from the same heap as the rest
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++s_allocations;
+    s_allocatedBytes += size;
+
+    return malloc(size != 0 ? size : 1);
+}
+
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    free(memory);
+}
+
+
+namespace themev2test
+{
+    void Fail(const char* file, int line, const char* expression)
+    {
+        fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+        ++s_failures;
+    }
+
+
+    SourceDocument MakeSource(const std::wstring& text)
+    {
+        SourceDocument source;
+        source.primaryFile = L"test.lsx";
+        source.content = text;
+
+        litestep::themev2::SourceDocumentSegment segment;
+        segment.fileId = source.InternFile(source.primaryFile);
+        segment.startOffset = 0;
+        segment.lineStart = 1;
+        source.segments.push_back(segment);
+
+        return source;
+    }
+
+
+    ThemeDocument ParseTheme(const std::wstring& text)
+    {
+        const SourceDocument source = MakeSource(text);
+
+        std::vector<litestep::themev2::Diagnostic> diagnostics;
+        litestep::themev2::Parser parser(source, diagnostics);
+        ThemeDocument document = parser.Parse();
+
+        for (const litestep::themev2::Diagnostic& diagnostic : diagnostics)
+        {
+            fprintf(stderr, "test.lsx(%u): %ls\n",
+                unsigned(diagnostic.location.line), diagnostic.message.c_str());
+        }
+        CHECK(diagnostics.empty());
+
+        return document;
+    }
+
+
+    ThemeIndex FindNode(const ThemeDocument& document, const wchar_t* name)
+    {
+        for (ThemeIndex index = 0; index < document.NodeCount(); ++index)
+        {
+            if (wcscmp(document.Node(index).Name(), name) == 0)
+            {
+                return index;
+            }
+        }
+
+        CHECK(!"node not found");
+        return litestep::themev2::InvalidThemeIndex;
+    }
+
+
+    std::wstring ScratchDirectory(const wchar_t* name)
+    {
+        wchar_t temp[MAX_PATH] = { 0 };
+        GetTempPathW(MAX_PATH, temp);
+
+        std::wstring directory = std::wstring(temp) + L"themev2test\\";
+        CreateDirectoryW(directory.c_str(), nullptr);
+
+        directory.append(name).append(L"\\");
+        CreateDirectoryW(directory.c_str(), nullptr);
+        return directory;
+    }
+
+
+    void WriteScratchFile(const std::wstring& path, const std::string& bytes)
+    {
+        FILE* file = nullptr;
+        if (_wfopen_s(&file, path.c_str(), L"wb") != 0 || file == nullptr)
+        {
+            fprintf(stderr, "  can not write %ls\n", path.c_str());
+            CHECK(!"scratch file written");
+            return;
+        }
+
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+    }
+
+
+    std::string ReadScratchFile(const std::wstring& path)
+    {
+        std::string bytes;
+
+        FILE* file = nullptr;
+        if (_wfopen_s(&file, path.c_str(), L"rb") == 0 && file != nullptr)
+        {
+            char buffer[4096];
+            std::size_t read = 0;
+            while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            {
+                bytes.append(buffer, read);
+            }
+            fclose(file);
+        }
+
+        return bytes;
+    }
+
+
+    std::size_t AllocationCount()
+    {
+        return s_allocations;
+    }
+
+
+    std::size_t AllocatedBytes()
+    {
+        return s_allocatedBytes;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const bool bench = (argc == 2 && strcmp(argv[1], "bench") == 0);
+
+    if (argc > 2 || (argc == 2 && !bench))
+    {
+        fprintf(stderr, "usage: themev2test [bench]\n");
+        return 2;
+    }
+
+    for (const Suite& suite : Suites)
+    {
+        const unsigned before = s_failures;
+        suite.tests();
+        printf("%-8s %s\n", suite.name, s_failures == before ? "ok" : "FAILED");
+    }
+
+    if (bench)
+    {
+        for (const Suite& suite : Suites)
+        {
+            printf("\n%s benchmarks\n", suite.name);
+            suite.benchmarks();
+        }
+    }
+
+    return s_failures == 0 ? 0 : 1;
+}
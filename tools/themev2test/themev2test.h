@@ -0,0 +1,92 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#pragma once
+
+#include "../../litestep/themev2/ThemeDocument.h"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace themev2test
+{
+    using litestep::themev2::SourceDocument;
+    using litestep::themev2::ThemeDocument;
+    using litestep::themev2::ThemeIndex;
+
+    // Records a failed check, the test goes on
+    void Fail(const char* file, int line, const char* expression);
+
+    // Theme source as one file, test.lsx
+    SourceDocument MakeSource(const std::wstring& text);
+
+    // Parses theme source, failing the test on any diagnostic
+    ThemeDocument ParseTheme(const std::wstring& text);
+
+    // Calls to operator new and the bytes they asked for, since the start.
+    // The tool replaces the global operator new to count them.
+    std::size_t AllocationCount();
+    std::size_t AllocatedBytes();
+
+    // First node with this name attribute, InvalidThemeIndex if none
+    ThemeIndex FindNode(const ThemeDocument& document, const wchar_t* name);
+
+    // %TEMP%\themev2test\<name>\, for suites that need real files
+    std::wstring ScratchDirectory(const wchar_t* name);
+
+    // Whole-file access, a failed write fails the test
+    void WriteScratchFile(const std::wstring& path, const std::string& bytes);
+    std::string ReadScratchFile(const std::wstring& path);
+
+    // Average milliseconds per call of body over runs calls
+    template <typename Body>
+    double TimeRuns(unsigned runs, Body body)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned run = 0; run < runs; ++run)
+        {
+            body();
+        }
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+    }
+}
+
+#define CHECK(expression) \
+    ((expression) ? (void)0 : themev2test::Fail(__FILE__, __LINE__, #expression))
+
+// Suites, one per file
+void BindingTests();
+void BindingBenchmarks();
+void CacheTests();
+void CacheBenchmarks();
+void DiffTests();
+void DiffBenchmarks();
+void DocumentTests();
+void DocumentBenchmarks();
+void LayoutTests();
+void LayoutBenchmarks();
+void LexerTests();
+void LexerBenchmarks();
+void StyleTests();
+void StyleBenchmarks();
@@ -0,0 +1,416 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// tracedecode
+// Converts a litestep.trace file into Chrome trace-event JSON, which can be
+// loaded into chrome://tracing, Perfetto or Speedscope.
+//
+//   tracedecode litestep.trace [litestep.json]
+//
+// Only uses the standard library, so it builds anywhere the trace is read.
+//
+#include "../../utility/traceformat.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+    struct EventName
+    {
+        std::string name;
+        std::vector<std::string> args;
+    };
+
+    struct Decoder
+    {
+        Trace::FileHeader header;
+        std::map<uint16_t, std::string> categories;
+        std::map<uint16_t, EventName> events;
+    };
+
+
+    //
+    // AppendUtf8
+    // Appends a code point as UTF-8.
+    //
+    void AppendUtf8(std::string& out, uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            out += char(cp);
+        }
+        else if (cp < 0x800)
+        {
+            out += char(0xC0 | (cp >> 6));
+            out += char(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            out += char(0xE0 | (cp >> 12));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += char(0xF0 | (cp >> 18));
+            out += char(0x80 | ((cp >> 12) & 0x3F));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+
+    std::string Utf16ToUtf8(const unsigned char* data, size_t count)
+    {
+        std::string out;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t unit = uint32_t(data[i * 2]) | (uint32_t(data[i * 2 + 1]) << 8);
+
+            if (unit >= 0xD800 && unit <= 0xDBFF && i + 1 < count)
+            {
+                uint32_t low = uint32_t(data[i * 2 + 2]) | (uint32_t(data[i * 2 + 3]) << 8);
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    ++i;
+                }
+            }
+
+            AppendUtf8(out, unit);
+        }
+
+        return out;
+    }
+
+
+    std::string JsonString(const std::string& text)
+    {
+        std::string out = "\"";
+
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                }
+                else
+                {
+                    out += c;
+                }
+                break;
+            }
+        }
+
+        return out + "\"";
+    }
+
+
+    //
+    // DecodeArgs
+    // Turns the argument payload into the body of a JSON object. Arguments
+    // the event table has no name for are called arg0, arg1, ...
+    //
+    std::string DecodeArgs(const unsigned char* data, size_t size, const EventName* event)
+    {
+        std::string out;
+        size_t offset = 0;
+
+        for (size_t index = 0; offset < size; ++index)
+        {
+            uint8_t type = data[offset++];
+            std::string value;
+
+            if (type == Trace::ArgWideString || type == Trace::ArgNarrowString)
+            {
+                if (offset + 2 > size)
+                {
+                    break;
+                }
+
+                uint16_t length = uint16_t(data[offset] | (data[offset + 1] << 8));
+                offset += 2;
+
+                size_t bytes = (type == Trace::ArgWideString) ? length * 2u : length;
+                if (offset + bytes > size)
+                {
+                    break;
+                }
+
+                if (type == Trace::ArgWideString)
+                {
+                    value = JsonString(Utf16ToUtf8(data + offset, length));
+                }
+                else
+                {
+                    value = JsonString(std::string((const char*)data + offset, length));
+                }
+                offset += bytes;
+            }
+            else
+            {
+                if (offset + 8 > size)
+                {
+                    break;
+                }
+
+                uint64_t raw = 0;
+                for (int i = 7; i >= 0; --i)
+                {
+                    raw = (raw << 8) | data[offset + i];
+                }
+                offset += 8;
+
+                char buffer[64];
+                switch (type)
+                {
+                case Trace::ArgSigned:
+                    snprintf(buffer, sizeof(buffer), "%lld", (long long)raw);
+                    break;
+
+                case Trace::ArgDouble:
+                    {
+                        double d;
+                        memcpy(&d, &raw, sizeof(d));
+                        snprintf(buffer, sizeof(buffer), "%.17g", d);
+                    }
+                    break;
+
+                case Trace::ArgPointer:
+                    snprintf(buffer, sizeof(buffer), "\"0x%llx\"", (unsigned long long)raw);
+                    break;
+
+                default:
+                    snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)raw);
+                    break;
+                }
+                value = buffer;
+            }
+
+            std::string name;
+            if (event && index < event->args.size())
+            {
+                name = event->args[index];
+            }
+            else
+            {
+                name = "arg" + std::to_string(index);
+            }
+
+            if (!out.empty())
+            {
+                out += ",";
+            }
+            out += JsonString(name) + ":" + value;
+        }
+
+        return out;
+    }
+
+
+    void ReadNames(const unsigned char* data, size_t size, std::vector<std::string>& names)
+    {
+        size_t start = 0;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (data[i] == 0)
+            {
+                names.push_back(std::string((const char*)data + start, i - start));
+                start = i + 1;
+            }
+        }
+    }
+
+
+    bool Decode(const std::vector<unsigned char>& trace, FILE* output)
+    {
+        Decoder decoder;
+
+        if (trace.size() < sizeof(Trace::FileHeader))
+        {
+            fprintf(stderr, "tracedecode: file is too short\n");
+            return false;
+        }
+
+        memcpy(&decoder.header, trace.data(), sizeof(decoder.header));
+
+        if (decoder.header.magic != Trace::Magic)
+        {
+            fprintf(stderr, "tracedecode: not a LiteStep trace\n");
+            return false;
+        }
+
+        if (decoder.header.version > Trace::Version)
+        {
+            fprintf(stderr, "tracedecode: unsupported trace version %u\n",
+                unsigned(decoder.header.version));
+            return false;
+        }
+
+        const double ticksPerMicrosecond = decoder.header.ticksPerSecond / 1e6;
+        size_t offset = decoder.header.headerSize;
+        bool first = true;
+
+        fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+        while (offset + sizeof(Trace::RecordHeader) <= trace.size())
+        {
+            Trace::RecordHeader record;
+            memcpy(&record, trace.data() + offset, sizeof(record));
+
+            if (record.size < sizeof(record) || offset + record.size > trace.size())
+            {
+                fprintf(stderr, "tracedecode: truncated record at offset %zu\n", offset);
+                break;
+            }
+
+            const unsigned char* payload = trace.data() + offset + sizeof(record);
+            size_t payloadSize = record.size - sizeof(record);
+            offset += record.size;
+
+            const char* phase = nullptr;
+
+            switch (record.type)
+            {
+            case Trace::RecordCategoryName:
+                {
+                    std::vector<std::string> names;
+                    ReadNames(payload, payloadSize, names);
+                    decoder.categories[record.event] = names.empty() ? std::string() : names[0];
+                }
+                continue;
+
+            case Trace::RecordEventName:
+                {
+                    std::vector<std::string> names;
+                    ReadNames(payload, payloadSize, names);
+
+                    EventName& event = decoder.events[record.event];
+                    if (!names.empty())
+                    {
+                        event.name = names[0];
+                        event.args.assign(names.begin() + 1, names.end());
+                    }
+                }
+                continue;
+
+            case Trace::RecordBegin:    phase = "B"; break;
+            case Trace::RecordEnd:      phase = "E"; break;
+            case Trace::RecordInstant:  phase = "i"; break;
+
+            default:
+                continue;
+            }
+
+            auto eventIt = decoder.events.find(record.event);
+            const EventName* event = (eventIt != decoder.events.end()) ? &eventIt->second : nullptr;
+
+            std::string name = event ? event->name : "event" + std::to_string(record.event);
+            std::string category = decoder.categories.count(record.category)
+                ? decoder.categories[record.category]
+                : "category" + std::to_string(record.category);
+
+            double timestamp = (double(int64_t(record.ticks - decoder.header.startTicks))) /
+                ticksPerMicrosecond;
+
+            fprintf(output,
+                "%s\n{\"name\":%s,\"cat\":%s,\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u",
+                first ? "" : ",", JsonString(name).c_str(), JsonString(category).c_str(),
+                phase, timestamp, unsigned(decoder.header.processId), unsigned(record.threadId));
+
+            if (record.type == Trace::RecordInstant)
+            {
+                fprintf(output, ",\"s\":\"t\"");
+            }
+
+            std::string args = DecodeArgs(payload, payloadSize, event);
+            if (!args.empty())
+            {
+                fprintf(output, ",\"args\":{%s}", args.c_str());
+            }
+
+            fprintf(output, "}");
+            first = false;
+        }
+
+        fprintf(output, "\n]}\n");
+        return true;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: tracedecode <litestep.trace> [output.json]\n");
+        return 2;
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input)
+    {
+        fprintf(stderr, "tracedecode: can not open %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<unsigned char> trace(
+        (std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    FILE* output = stdout;
+    if (argc == 3)
+    {
+        output = fopen(argv[2], "w");
+        if (!output)
+        {
+            fprintf(stderr, "tracedecode: can not create %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    bool decoded = Decode(trace, output);
+
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+
+    return decoded ? 0 : 1;
+}
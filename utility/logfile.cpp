@@ -0,0 +1,281 @@
+#include "logfile.h"
+
+#include <strsafe.h>
+#include <algorithm>
+
+namespace
+{
+    // How far ahead of the data the file is extended and mapped. Has to be a
+    // multiple of the allocation granularity (64K everywhere).
+    const uint64_t SegmentBytes = 1024 * 1024;
+
+    const BYTE Bom[] = { 0xEF, 0xBB, 0xBF };
+}
+
+namespace Logger
+{
+    LogFile::LogFile()
+        : m_file(INVALID_HANDLE_VALUE)
+        , m_view(nullptr)
+        , m_viewBase(0)
+        , m_viewEnd(0)
+        , m_size(0)
+        , m_flushedTo(0)
+        , m_maxBytes(0)
+        , m_generations(0)
+        , m_direct(false)
+    {
+    }
+
+    LogFile::~LogFile()
+    {
+        Close();
+    }
+
+    bool LogFile::Open(const std::wstring& path)
+    {
+        Close();
+        m_path = path;
+        return OpenFile();
+    }
+
+    void LogFile::Close()
+    {
+        if (IsOpen())
+        {
+            Flush();
+            CloseFile();
+        }
+    }
+
+    void LogFile::SetLimits(uint64_t maxBytes, unsigned generations)
+    {
+        m_maxBytes = maxBytes;
+        m_generations = generations;
+    }
+
+    void LogFile::Append(const void* data, size_t bytes)
+    {
+        if (!IsOpen() || bytes == 0)
+        {
+            return;
+        }
+
+        // A single append larger than the limit still goes into one file,
+        // rotating an empty file would not help.
+        if (m_maxBytes != 0 && m_size > sizeof(Bom) && m_size + bytes > m_maxBytes)
+        {
+            Rotate();
+            if (!IsOpen())
+            {
+                return;
+            }
+        }
+
+        const BYTE* source = static_cast<const BYTE*>(data);
+        while (bytes > 0 && !m_direct)
+        {
+            if (m_view == nullptr || m_size >= m_viewEnd)
+            {
+                if (!MapSegment())
+                {
+                    break;
+                }
+            }
+
+            size_t chunk = size_t(std::min<uint64_t>(bytes, m_viewEnd - m_size));
+            memcpy(m_view + (m_size - m_viewBase), source, chunk);
+            m_size += chunk;
+            source += chunk;
+            bytes -= chunk;
+        }
+
+        if (bytes > 0)
+        {
+            AppendDirect(source, bytes);
+        }
+    }
+
+    void LogFile::Flush()
+    {
+        if (m_view != nullptr && m_size > m_flushedTo)
+        {
+            uint64_t from = std::max<uint64_t>(m_flushedTo, m_viewBase);
+            FlushViewOfFile(m_view + (from - m_viewBase), SIZE_T(m_size - from));
+        }
+        m_flushedTo = m_size;
+    }
+
+    bool LogFile::OpenFile()
+    {
+        m_file = CreateFileW(m_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize = { 0 };
+        GetFileSizeEx(m_file, &fileSize);
+
+        m_size = FindDataEnd(uint64_t(fileSize.QuadPart));
+        m_flushedTo = m_size;
+        m_direct = false;
+
+        if (m_size == 0)
+        {
+            Append(Bom, sizeof(Bom));
+        }
+
+        return true;
+    }
+
+    void LogFile::CloseFile()
+    {
+        UnmapSegment();
+
+        LARGE_INTEGER end;
+        end.QuadPart = LONGLONG(m_size);
+        if (SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN))
+        {
+            SetEndOfFile(m_file);
+        }
+
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+    void LogFile::Rotate()
+    {
+        Flush();
+        CloseFile();
+
+        if (m_generations == 0)
+        {
+            DeleteFileW(m_path.c_str());
+        }
+        else
+        {
+            DeleteFileW(GenerationPath(m_generations).c_str());
+            for (unsigned generation = m_generations - 1; generation > 0; --generation)
+            {
+                MoveFileExW(GenerationPath(generation).c_str(),
+                    GenerationPath(generation + 1).c_str(), MOVEFILE_REPLACE_EXISTING);
+            }
+            MoveFileExW(m_path.c_str(), GenerationPath(1).c_str(), MOVEFILE_REPLACE_EXISTING);
+        }
+
+        OpenFile();
+    }
+
+    bool LogFile::MapSegment()
+    {
+        UnmapSegment();
+
+        uint64_t base = m_size - (m_size % SegmentBytes);
+        uint64_t end = base + SegmentBytes;
+
+        // Creating the mapping with a size past the end of the file extends
+        // the file. The view keeps the mapping alive after its handle is
+        // closed.
+        HANDLE mapping = CreateFileMappingW(m_file, nullptr, PAGE_READWRITE,
+            DWORD(end >> 32), DWORD(end), nullptr);
+
+        if (mapping != nullptr)
+        {
+            m_view = static_cast<BYTE*>(MapViewOfFile(mapping, FILE_MAP_WRITE,
+                DWORD(base >> 32), DWORD(base), SIZE_T(SegmentBytes)));
+            CloseHandle(mapping);
+        }
+
+        if (m_view == nullptr)
+        {
+            m_direct = true;
+            return false;
+        }
+
+        m_viewBase = base;
+        m_viewEnd = end;
+        return true;
+    }
+
+    void LogFile::UnmapSegment()
+    {
+        if (m_view != nullptr)
+        {
+            UnmapViewOfFile(m_view);
+            m_view = nullptr;
+        }
+        m_viewBase = 0;
+        m_viewEnd = 0;
+    }
+
+    void LogFile::AppendDirect(const BYTE* data, size_t bytes)
+    {
+        LARGE_INTEGER position;
+        position.QuadPart = LONGLONG(m_size);
+
+        DWORD written = 0;
+        if (SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) &&
+            WriteFile(m_file, data, DWORD(bytes), &written, nullptr))
+        {
+            m_size += written;
+        }
+    }
+
+    //
+    // FindDataEnd
+    // UTF-8 text never contains a zero byte, so any zeros at the end of the
+    // file are segment padding left behind by a session that did not close
+    // the file.
+    //
+    uint64_t LogFile::FindDataEnd(uint64_t fileSize)
+    {
+        BYTE block[4096];
+        uint64_t end = fileSize;
+
+        while (end > 0)
+        {
+            uint64_t start = end - std::min<uint64_t>(end, sizeof(block));
+            DWORD wanted = DWORD(end - start);
+
+            LARGE_INTEGER position;
+            position.QuadPart = LONGLONG(start);
+
+            DWORD read = 0;
+            if (!SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) ||
+                !ReadFile(m_file, block, wanted, &read, nullptr) || read != wanted)
+            {
+                return fileSize;
+            }
+
+            for (DWORD i = wanted; i > 0; --i)
+            {
+                if (block[i - 1] != 0)
+                {
+                    return start + i;
+                }
+            }
+
+            end = start;
+        }
+
+        return 0;
+    }
+
+    std::wstring LogFile::GenerationPath(unsigned generation) const
+    {
+        size_t dot = m_path.find_last_of(L'.');
+        size_t slash = m_path.find_last_of(L"\\/");
+        if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+        {
+            dot = m_path.length();
+        }
+
+        wchar_t suffix[16] = { 0 };
+        StringCchPrintfW(suffix, _countof(suffix), L".%u", generation);
+
+        return m_path.substr(0, dot) + suffix + m_path.substr(dot);
+    }
+}
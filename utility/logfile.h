@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Windows.h>
+#include <cstdint>
+#include <string>
+
+namespace Logger
+{
+    // Append-only UTF-8 log file written through a mapped view.
+    //
+    // The file is extended one segment ahead of the data and appending is a
+    // memcpy into the view; the memory manager writes the pages back, Flush
+    // forces it. Close trims the unused tail of the last segment. If the
+    // process dies before that, the tail is left as zero bytes, which Open
+    // strips again. Readers that open the file meanwhile see those zeros
+    // after the last line.
+    //
+    // Once an append would take the file past the size limit it is rotated:
+    // litestep.log becomes litestep.1.log, litestep.1.log becomes
+    // litestep.2.log and so on, up to the configured number of generations.
+    //
+    // Not thread safe, the logger only ever appends from one thread.
+    class LogFile
+    {
+    public:
+        LogFile();
+        ~LogFile();
+
+        bool Open(const std::wstring& path);
+        void Close();
+
+        bool IsOpen() const
+        {
+            return m_file != INVALID_HANDLE_VALUE;
+        }
+
+        // A maxBytes of 0 lets the file grow without bound. With 0
+        // generations the old file is simply discarded on rotation.
+        void SetLimits(uint64_t maxBytes, unsigned generations);
+
+        void Append(const void* data, size_t bytes);
+
+        // Starts writing everything appended so far back to disk.
+        void Flush();
+
+    private:
+        LogFile(const LogFile&) = delete;
+        LogFile& operator=(const LogFile&) = delete;
+
+        bool OpenFile();
+        void CloseFile();
+        void Rotate();
+        bool MapSegment();
+        void UnmapSegment();
+        void AppendDirect(const BYTE* data, size_t bytes);
+        uint64_t FindDataEnd(uint64_t fileSize);
+        std::wstring GenerationPath(unsigned generation) const;
+
+        std::wstring m_path;
+        HANDLE m_file;
+
+        // The mapped segment covers [m_viewBase, m_viewEnd) of the file.
+        BYTE* m_view;
+        uint64_t m_viewBase;
+        uint64_t m_viewEnd;
+
+        uint64_t m_size;
+        uint64_t m_flushedTo;
+        uint64_t m_maxBytes;
+        unsigned m_generations;
+
+        // Set when the file can not be mapped (e.g. some network shares),
+        // appends then fall back to WriteFile.
+        bool m_direct;
+    };
+}
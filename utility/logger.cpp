@@ -1,18 +1,89 @@
 #include "logger.h"
+#include "logfile.h"
 
 #include <Windows.h>
 #include <ShlObj.h>
 #include <strsafe.h>
+#include <atomic>
+#include <condition_variable>
+#include <cwctype>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
-#include <cstdarg>
 
 namespace
 {
+    // Slot::kind of a text message. Trace records use their Trace::RecordType.
+    const uint8_t TextSlot = 0;
+
+    // One queued message or trace record. The sequence number follows Dmitry
+    // Vyukov's bounded queue: a slot is free for the producer claiming
+    // position p while sequence == p, and readable by the flusher once
+    // sequence == p + 1.
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        const wchar_t* format;
+        FILETIME time;
+        uint64_t ticks;
+        uint32_t threadId;
+        uint16_t event;
+        uint16_t used;
+        uint8_t kind;
+        uint8_t category;
+        uint8_t level;
+        unsigned char args[Logger::detail::ArgBuffer::Capacity];
+    };
+
+    const size_t SlotCount = 2048;
+    const size_t SlotMask = SlotCount - 1;
+
+    // The flusher wakes up on its own this often, producers only signal it
+    // once the ring is half full.
+    const DWORD FlushIntervalMs = 100;
+
+    // Formatted text is converted and written once this many characters have
+    // accumulated, or when the ring has been drained.
+    const size_t BatchChars = 32 * 1024;
+
+    // Same for encoded trace records.
+    const size_t TraceBatchBytes = 64 * 1024;
+
+    // Defaults until SetFileOptions is called with the step.rc settings.
+    const uint64_t DefaultMaxFileBytes = 4 * 1024 * 1024;
+    const unsigned DefaultGenerations = 2;
+    const unsigned DefaultDiskFlushMs = 1000;
+
+    const wchar_t* const CategoryNames[] =
+    {
+        L"General",
+        L"Config",
+        L"ThemeEngineV2",
+        L"Module",
+        L"StartupRunner"
+    };
+    static_assert(_countof(CategoryNames) == size_t(Logger::Category::Count),
+        "CategoryNames is out of sync with Logger::Category");
+
+    const wchar_t* const LevelNames[] =
+    {
+        L"Off",
+        L"Error",
+        L"Warning",
+        L"Notice",
+        L"Debug"
+    };
+
     class LoggerImpl
     {
     public:
+        ~LoggerImpl()
+        {
+            Shutdown();
+        }
+
         void Initialize(const std::wstring& basePath)
         {
             std::lock_guard<std::mutex> lock(m_mutex);
@@ -36,60 +107,599 @@ namespace
             root += L"logs";
 
             SHCreateDirectoryExW(nullptr, root.c_str(), nullptr);
+            m_directory = root;
 
             std::wstring filePath = root;
             filePath += L"\\litestep.log";
 
-            m_handle = CreateFileW(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
-                nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-
-            if (m_handle != INVALID_HANDLE_VALUE)
+            m_file.SetLimits(m_maxBytes.load(), m_generations.load());
+            if (m_file.Open(filePath))
             {
-                LARGE_INTEGER zero = { 0 };
-                SetFilePointerEx(m_handle, zero, nullptr, FILE_END);
-
-                DWORD fileSizeHigh = 0;
-                DWORD fileSizeLow = GetFileSize(m_handle, &fileSizeHigh);
-                if (fileSizeLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR)
+                m_slots.reset(new Slot[SlotCount]);
+                for (size_t i = 0; i < SlotCount; ++i)
                 {
-                    // ignore
-                }
-                else if (fileSizeHigh == 0 && fileSizeLow == 0)
-                {
-                    const BYTE bom[] = { 0xEF, 0xBB, 0xBF };
-                    DWORD written = 0;
-                    WriteFile(m_handle, bom, sizeof(bom), &written, nullptr);
+                    m_slots[i].sequence.store(i, std::memory_order_relaxed);
                 }
+                m_enqueuePos.store(0, std::memory_order_relaxed);
+                m_dequeuePos.store(0, std::memory_order_relaxed);
+                m_written = 0;
+                m_stopping = false;
 
+                m_wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
                 m_initialized = true;
                 WriteLine(L"===== LiteStep logging started =====");
+
+                m_flusher = std::thread(&LoggerImpl::FlusherLoop, this);
+                m_enabled.store(true, std::memory_order_release);
             }
         }
 
         void Shutdown()
         {
             std::lock_guard<std::mutex> lock(m_mutex);
-            if (m_handle != INVALID_HANDLE_VALUE)
+
+            // Producers that already got past the enabled check still get
+            // their message in, and the flusher drains the ring before it
+            // exits.
+            m_enabled.store(false, std::memory_order_seq_cst);
+            while (m_producers.load(std::memory_order_seq_cst) != 0)
+            {
+                SwitchToThread();
+            }
+
+            if (m_flusher.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> flushLock(m_flushMutex);
+                    m_stopping = true;
+                }
+                SetEvent(m_wake);
+                m_flusher.join();
+            }
+
+            CloseTrace();
+
+            if (m_file.IsOpen())
             {
+                WriteSuppressedSummary();
                 WriteLine(L"===== LiteStep logging shutdown =====");
-                CloseHandle(m_handle);
-                m_handle = INVALID_HANDLE_VALUE;
+                m_file.Close();
+            }
+            if (m_wake)
+            {
+                CloseHandle(m_wake);
+                m_wake = nullptr;
             }
+            m_slots.reset();
             m_initialized = false;
         }
 
-        void Log(const wchar_t* message)
+        void Flush()
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            if (!m_initialized || m_handle == INVALID_HANDLE_VALUE)
+            if (!IsEnabled())
             {
                 return;
             }
 
-            WriteLine(message);
+            uint64_t target = m_enqueuePos.load(std::memory_order_acquire);
+            SetEvent(m_wake);
+
+            std::unique_lock<std::mutex> lock(m_flushMutex);
+            m_flushed.wait(lock, [&] { return m_written >= target || m_stopping; });
+        }
+
+        void SetFileOptions(uint64_t maxBytes, unsigned generations, unsigned flushIntervalMs)
+        {
+            m_maxBytes.store(maxBytes, std::memory_order_relaxed);
+            m_generations.store(generations, std::memory_order_relaxed);
+            m_diskFlushMs.store(flushIntervalMs, std::memory_order_relaxed);
+        }
+
+        bool IsEnabled() const
+        {
+            return m_enabled.load(std::memory_order_acquire);
+        }
+
+        bool StartTrace()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (!m_initialized)
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> traceLock(m_traceMutex);
+            if (m_trace != INVALID_HANDLE_VALUE)
+            {
+                return true;
+            }
+
+            std::wstring path = m_directory + L"\\litestep.trace";
+            m_trace = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+            if (m_trace == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+
+            std::vector<char> preamble;
+            WriteTracePreamble(preamble);
+
+            DWORD written = 0;
+            WriteFile(m_trace, preamble.data(), DWORD(preamble.size()), &written, nullptr);
+            return true;
+        }
+
+        // Records queued after this are dropped by the flusher.
+        void CloseTrace()
+        {
+            std::lock_guard<std::mutex> traceLock(m_traceMutex);
+            if (m_trace != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_trace);
+                m_trace = INVALID_HANDLE_VALUE;
+            }
+        }
+
+        void Submit(Logger::Category category, Logger::Level level, const wchar_t* format,
+            const Logger::detail::ArgBuffer& args)
+        {
+            m_producers.fetch_add(1, std::memory_order_seq_cst);
+            if (m_enabled.load(std::memory_order_seq_cst))
+            {
+                Enqueue(TextSlot, category, uint8_t(level), 0, format, args);
+            }
+            m_producers.fetch_sub(1, std::memory_order_release);
+        }
+
+        void SubmitTrace(Logger::Category category, Trace::RecordType type, Trace::Event event,
+            const Logger::detail::ArgBuffer& args)
+        {
+            m_producers.fetch_add(1, std::memory_order_seq_cst);
+            if (m_enabled.load(std::memory_order_seq_cst))
+            {
+                Enqueue(type, category, 0, uint16_t(event), nullptr, args);
+            }
+            m_producers.fetch_sub(1, std::memory_order_release);
         }
 
     private:
+        void Enqueue(uint8_t kind, Logger::Category category, uint8_t level, uint16_t event,
+            const wchar_t* format, const Logger::detail::ArgBuffer& args)
+        {
+            FILETIME now = { 0 };
+            LARGE_INTEGER ticks = { 0 };
+
+            if (kind == TextSlot)
+            {
+                GetSystemTimeAsFileTime(&now);
+            }
+            else
+            {
+                QueryPerformanceCounter(&ticks);
+            }
+
+            uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            Slot* slot = nullptr;
+
+            for (;;)
+            {
+                slot = &m_slots[pos & SlotMask];
+                uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+                int64_t diff = int64_t(sequence) - int64_t(pos);
+
+                if (diff == 0)
+                {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // The ring is full. Rather than dropping the message,
+                    // hurry the flusher along and wait for a slot.
+                    SetEvent(m_wake);
+                    SwitchToThread();
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+                else
+                {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->format = format;
+            slot->time = now;
+            slot->ticks = uint64_t(ticks.QuadPart);
+            slot->threadId = (kind == TextSlot) ? 0 : GetCurrentThreadId();
+            slot->event = event;
+            slot->used = uint16_t(args.used);
+            slot->kind = kind;
+            slot->category = uint8_t(category);
+            slot->level = level;
+            memcpy(slot->args, args.data, args.used);
+            slot->sequence.store(pos + 1, std::memory_order_release);
+
+            if (pos - m_dequeuePos.load(std::memory_order_relaxed) >= SlotCount / 2)
+            {
+                SetEvent(m_wake);
+            }
+        }
+
+        void FlusherLoop()
+        {
+            std::wstring batch;
+            batch.reserve(BatchChars + 1024);
+            std::vector<char> utf8;
+            std::vector<char> trace;
+            ULONGLONG lastDiskFlush = GetTickCount64();
+
+            for (;;)
+            {
+                WaitForSingleObject(m_wake, FlushIntervalMs);
+
+                // Options may change on recycle, the file is only ever
+                // touched from this thread while it runs.
+                m_file.SetLimits(m_maxBytes.load(std::memory_order_relaxed),
+                    m_generations.load(std::memory_order_relaxed));
+
+                bool stopping;
+                {
+                    std::lock_guard<std::mutex> lock(m_flushMutex);
+                    stopping = m_stopping;
+                }
+
+                // Whatever was published before the stop flag was seen is
+                // drained by this pass.
+                uint64_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    Slot& slot = m_slots[pos & SlotMask];
+                    if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+                    {
+                        break;
+                    }
+
+                    if (slot.kind == TextSlot)
+                    {
+                        FormatSlot(slot, batch);
+                    }
+                    else
+                    {
+                        EncodeTraceRecord(slot, trace);
+                    }
+                    slot.sequence.store(pos + SlotCount, std::memory_order_release);
+                    m_dequeuePos.store(++pos, std::memory_order_relaxed);
+
+                    if (batch.length() >= BatchChars)
+                    {
+                        WriteBatch(batch, utf8);
+                    }
+                    if (trace.size() >= TraceBatchBytes)
+                    {
+                        WriteTraceBatch(trace);
+                    }
+                }
+                WriteBatch(batch, utf8);
+                WriteTraceBatch(trace);
+
+                ULONGLONG now = GetTickCount64();
+                if (now - lastDiskFlush >= m_diskFlushMs.load(std::memory_order_relaxed))
+                {
+                    m_file.Flush();
+                    lastDiskFlush = now;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_flushMutex);
+                    m_written = pos;
+                }
+                m_flushed.notify_all();
+
+                if (stopping)
+                {
+                    return;
+                }
+            }
+        }
+
+        void FormatSlot(const Slot& slot, std::wstring& out)
+        {
+            FILETIME localTime;
+            SYSTEMTIME st = { 0 };
+            FileTimeToLocalFileTime(&slot.time, &localTime);
+            FileTimeToSystemTime(&localTime, &st);
+
+            wchar_t prefix[128] = { 0 };
+            StringCchPrintfW(prefix, _countof(prefix),
+                L"[%04u-%02u-%02u %02u:%02u:%02u.%03u] [%ls] [%ls] ",
+                st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds,
+                LevelNames[slot.level], CategoryNames[slot.category]);
+
+            out += prefix;
+            FormatText(slot, out);
+            out += L"\r\n";
+        }
+
+        // Walks the format string and formats each conversion on its own
+        // against the captured argument. The argument's captured type wins
+        // over the conversion character, so a mismatched specifier can not
+        // read the wrong kind of value.
+        void FormatText(const Slot& slot, std::wstring& out)
+        {
+            const wchar_t* format = slot.format ? slot.format : L"";
+            const unsigned char* arg = slot.args;
+            const unsigned char* argEnd = slot.args + slot.used;
+
+            while (*format)
+            {
+                const wchar_t* percent = wcschr(format, L'%');
+                if (!percent)
+                {
+                    out += format;
+                    return;
+                }
+                out.append(format, percent);
+
+                if (percent[1] == L'%')
+                {
+                    out += L'%';
+                    format = percent + 2;
+                    continue;
+                }
+
+                // %[flags][width][.precision][length]conversion
+                const wchar_t* cursor = percent + 1;
+                while (*cursor && wcschr(L"-+ #0", *cursor))
+                {
+                    ++cursor;
+                }
+                while (iswdigit(*cursor) || *cursor == L'.')
+                {
+                    ++cursor;
+                }
+                const wchar_t* lengthStart = cursor;
+                while (*cursor && wcschr(L"hlLzjtwI3264", *cursor))
+                {
+                    ++cursor;
+                }
+                if (*cursor == L'\0')
+                {
+                    out += percent;
+                    return;
+                }
+
+                wchar_t conversion = *cursor;
+                format = cursor + 1;
+
+                if (arg >= argEnd)
+                {
+                    out.append(percent, format);
+                    continue;
+                }
+
+                std::wstring spec(percent, lengthStart);
+                AppendArgument(out, spec, conversion, arg);
+            }
+        }
+
+        void AppendArgument(std::wstring& out, std::wstring& spec, wchar_t conversion,
+            const unsigned char*& arg)
+        {
+            wchar_t buffer[512] = { 0 };
+            Logger::detail::ArgType type = Logger::detail::ArgType(*arg++);
+
+            switch (type)
+            {
+            case Logger::detail::ArgWideString:
+            case Logger::detail::ArgNarrowString:
+                {
+                    uint16_t length;
+                    memcpy(&length, arg, 2);
+                    arg += 2;
+
+                    std::wstring text;
+                    if (type == Logger::detail::ArgWideString)
+                    {
+                        text.resize(length);
+                        memcpy(&text[0], arg, length * sizeof(wchar_t));
+                        arg += length * sizeof(wchar_t);
+                    }
+                    else
+                    {
+                        int chars = MultiByteToWideChar(CP_ACP, 0, (LPCSTR)arg, length, nullptr, 0);
+                        text.resize(size_t(chars));
+                        MultiByteToWideChar(CP_ACP, 0, (LPCSTR)arg, length, &text[0], chars);
+                        arg += length;
+                    }
+
+                    if (spec.length() == 1)
+                    {
+                        out += text;
+                        return;
+                    }
+                    spec += L"ls";
+                    _snwprintf_s(buffer, _countof(buffer), _TRUNCATE, spec.c_str(), text.c_str());
+                }
+                break;
+
+            case Logger::detail::ArgDouble:
+                {
+                    double value;
+                    memcpy(&value, arg, 8);
+                    arg += 8;
+
+                    spec += wcschr(L"fFeEgGaA", conversion) ? conversion : L'g';
+                    _snwprintf_s(buffer, _countof(buffer), _TRUNCATE, spec.c_str(), value);
+                }
+                break;
+
+            default:
+                {
+                    uint64_t value;
+                    memcpy(&value, arg, 8);
+                    arg += 8;
+
+                    if (type == Logger::detail::ArgPointer && conversion == L'p')
+                    {
+                        spec += L'p';
+                        _snwprintf_s(buffer, _countof(buffer), _TRUNCATE, spec.c_str(),
+                            (void*)uintptr_t(value));
+                    }
+                    else if (conversion == L'c')
+                    {
+                        spec += L'c';
+                        _snwprintf_s(buffer, _countof(buffer), _TRUNCATE, spec.c_str(),
+                            int(value));
+                    }
+                    else
+                    {
+                        if (!wcschr(L"diouxX", conversion))
+                        {
+                            conversion = (type == Logger::detail::ArgSigned) ? L'd' : L'u';
+                        }
+                        spec += L"ll";
+                        spec += conversion;
+                        _snwprintf_s(buffer, _countof(buffer), _TRUNCATE, spec.c_str(), value);
+                    }
+                }
+                break;
+            }
+
+            out += buffer;
+        }
+
+        void WriteBatch(std::wstring& batch, std::vector<char>& utf8)
+        {
+            if (batch.empty())
+            {
+                return;
+            }
+
+            // A UTF-16 code unit never takes more than three UTF-8 bytes, so
+            // one conversion call is enough.
+            utf8.resize(batch.length() * 3);
+            int bytes = WideCharToMultiByte(CP_UTF8, 0, batch.c_str(), int(batch.length()),
+                utf8.data(), int(utf8.size()), nullptr, nullptr);
+
+            if (bytes > 0)
+            {
+                m_file.Append(utf8.data(), size_t(bytes));
+            }
+            batch.clear();
+        }
+
+        void WriteTracePreamble(std::vector<char>& out)
+        {
+            LARGE_INTEGER frequency = { 0 };
+            LARGE_INTEGER now = { 0 };
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&now);
+
+            Trace::FileHeader header = { 0 };
+            header.magic = Trace::Magic;
+            header.version = Trace::Version;
+            header.headerSize = sizeof(header);
+            header.processId = GetCurrentProcessId();
+            header.ticksPerSecond = uint64_t(frequency.QuadPart);
+            header.startTicks = uint64_t(now.QuadPart);
+
+            const char* bytes = reinterpret_cast<const char*>(&header);
+            out.insert(out.end(), bytes, bytes + sizeof(header));
+
+            for (int i = 0; i < int(Logger::Category::Count); ++i)
+            {
+                char name[64] = { 0 };
+                WideCharToMultiByte(CP_UTF8, 0, CategoryNames[i], -1, name, sizeof(name),
+                    nullptr, nullptr);
+                AppendNameRecord(out, Trace::RecordCategoryName, uint16_t(i), name, nullptr);
+            }
+
+            for (int i = 0; i < int(Trace::Event::Count); ++i)
+            {
+                AppendNameRecord(out, Trace::RecordEventName, uint16_t(i),
+                    Trace::Events[i].name, Trace::Events[i].argNames);
+            }
+        }
+
+        void AppendNameRecord(std::vector<char>& out, Trace::RecordType type, uint16_t id,
+            const char* name, const char* argNames)
+        {
+            Trace::RecordHeader header = { 0 };
+            header.type = type;
+            header.event = id;
+
+            size_t start = out.size();
+            out.resize(start + sizeof(header));
+
+            out.insert(out.end(), name, name + strlen(name) + 1);
+
+            // Comma separated in the table, NUL separated in the file.
+            if (argNames && *argNames)
+            {
+                for (const char* c = argNames; *c; ++c)
+                {
+                    out.push_back(*c == ',' ? '\0' : *c);
+                }
+                out.push_back('\0');
+            }
+
+            header.size = uint16_t(out.size() - start);
+            memcpy(&out[start], &header, sizeof(header));
+        }
+
+        void EncodeTraceRecord(const Slot& slot, std::vector<char>& out)
+        {
+            Trace::RecordHeader header = { 0 };
+            header.size = uint16_t(sizeof(header) + slot.used);
+            header.type = slot.kind;
+            header.category = slot.category;
+            header.event = slot.event;
+            header.threadId = slot.threadId;
+            header.ticks = slot.ticks;
+
+            const char* bytes = reinterpret_cast<const char*>(&header);
+            out.insert(out.end(), bytes, bytes + sizeof(header));
+            out.insert(out.end(), slot.args, slot.args + slot.used);
+        }
+
+        void WriteTraceBatch(std::vector<char>& trace)
+        {
+            if (trace.empty())
+            {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> traceLock(m_traceMutex);
+                if (m_trace != INVALID_HANDLE_VALUE)
+                {
+                    DWORD written = 0;
+                    WriteFile(m_trace, trace.data(), DWORD(trace.size()), &written, nullptr);
+                }
+            }
+            trace.clear();
+        }
+
+        void WriteSuppressedSummary()
+        {
+            Logger::Sink* sink = Logger::GetSink();
+            std::wstring summary = L"Suppressed messages:";
+
+            for (int i = 0; i < int(Logger::Category::Count); ++i)
+            {
+                wchar_t entry[64] = { 0 };
+                StringCchPrintfW(entry, _countof(entry), L" %ls=%llu", CategoryNames[i],
+                    (unsigned long long)sink->suppressed[i].load(std::memory_order_relaxed));
+                summary += entry;
+            }
+
+            WriteLine(summary.c_str());
+        }
+
         void WriteLine(const wchar_t* message)
         {
             SYSTEMTIME st = { 0 };
@@ -104,22 +714,36 @@ namespace
             line += message;
             line += L"\r\n";
 
-            int utf8Bytes = WideCharToMultiByte(CP_UTF8, 0, line.c_str(), -1, nullptr, 0, nullptr, nullptr);
-            if (utf8Bytes <= 1)
-            {
-                return;
-            }
-
-            std::vector<char> buffer(static_cast<size_t>(utf8Bytes - 1));
-            WideCharToMultiByte(CP_UTF8, 0, line.c_str(), -1, buffer.data(), utf8Bytes - 1, nullptr, nullptr);
-
-            DWORD written = 0;
-            WriteFile(m_handle, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+            std::vector<char> buffer;
+            WriteBatch(line, buffer);
         }
 
-        HANDLE m_handle = INVALID_HANDLE_VALUE;
+        Logger::LogFile m_file;
+        std::atomic<uint64_t> m_maxBytes{ DefaultMaxFileBytes };
+        std::atomic<unsigned> m_generations{ DefaultGenerations };
+        std::atomic<unsigned> m_diskFlushMs{ DefaultDiskFlushMs };
+        std::wstring m_directory;
+        HANDLE m_wake = nullptr;
         bool m_initialized = false;
         std::mutex m_mutex;
+
+        std::atomic<bool> m_enabled{ false };
+        std::atomic<unsigned> m_producers{ 0 };
+        std::unique_ptr<Slot[]> m_slots;
+        std::atomic<uint64_t> m_enqueuePos{ 0 };
+        std::atomic<uint64_t> m_dequeuePos{ 0 };
+        std::thread m_flusher;
+
+        // Guards the handshake between the flusher, Flush and Shutdown.
+        std::mutex m_flushMutex;
+        std::condition_variable m_flushed;
+        uint64_t m_written = 0;
+        bool m_stopping = false;
+
+        // The trace file is opened and closed from the main thread while
+        // the flusher may be writing to it.
+        std::mutex m_traceMutex;
+        HANDLE m_trace = INVALID_HANDLE_VALUE;
     };
 
     LoggerImpl& GetLogger()
@@ -127,10 +751,75 @@ namespace
         static LoggerImpl instance;
         return instance;
     }
+
+    void SubmitLocal(Logger::Category category, Logger::Level level, const wchar_t* format,
+        const Logger::detail::ArgBuffer& args)
+    {
+        GetLogger().Submit(category, level, format, args);
+    }
+
+    void TraceLocal(Logger::Category category, Trace::RecordType type, Trace::Event event,
+        const Logger::detail::ArgBuffer& args)
+    {
+        GetLogger().SubmitTrace(category, type, event, args);
+    }
+
+    const int DefaultLevel = int(Logger::Level::Notice);
+
+    // Constant-initialized, so it is usable before any constructor runs.
+    Logger::Sink s_localSink =
+    {
+        { { DefaultLevel }, { DefaultLevel }, { DefaultLevel }, { DefaultLevel }, { DefaultLevel } },
+        { { 0 }, { 0 }, { 0 }, { 0 }, { 0 } },
+        { false },
+        SubmitLocal,
+        TraceLocal
+    };
 }
 
 namespace Logger
 {
+    namespace detail
+    {
+        std::atomic<Sink*> g_sink{ &s_localSink };
+
+        // Messages the calling thread filtered out that are not in the
+        // sink's counters yet. Only the owning thread touches them, so a
+        // filtered call does not write to memory other threads share. They
+        // are added to the sink every FoldEvery messages, on Flush and
+        // Shutdown, and when the thread exits.
+        struct SuppressedCounts
+        {
+            static const uint32_t FoldEvery = 1024;
+
+            uint32_t counts[int(Category::Count)];
+            uint32_t pending;
+
+            ~SuppressedCounts()
+            {
+                Fold();
+            }
+
+            void Fold();
+        };
+
+        SuppressedCounts& LocalSuppressed()
+        {
+            static thread_local SuppressedCounts counts = {};
+            return counts;
+        }
+
+        __declspec(noinline) void CountSuppressed(Category category)
+        {
+            SuppressedCounts& local = LocalSuppressed();
+            ++local.counts[int(category)];
+            if (++local.pending == SuppressedCounts::FoldEvery)
+            {
+                local.Fold();
+            }
+        }
+    }
+
     void Initialize(const std::wstring& basePath)
     {
         GetLogger().Initialize(basePath);
@@ -138,17 +827,110 @@ namespace Logger
 
     void Shutdown()
     {
+        s_localSink.tracing.store(false, std::memory_order_relaxed);
+        detail::LocalSuppressed().Fold();
         GetLogger().Shutdown();
     }
 
-    void Log(const wchar_t* format, ...)
+    void Flush()
+    {
+        detail::LocalSuppressed().Fold();
+        GetLogger().Flush();
+    }
+
+    void StartTrace()
+    {
+        if (GetLogger().StartTrace())
+        {
+            s_localSink.tracing.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void StopTrace()
+    {
+        if (s_localSink.tracing.exchange(false, std::memory_order_relaxed))
+        {
+            GetLogger().Flush();
+            GetLogger().CloseTrace();
+        }
+    }
+
+    void SetFileOptions(uint64_t maxBytes, unsigned generations, unsigned flushIntervalMs)
     {
-        wchar_t buffer[1024] = { 0 };
-        va_list args;
-        va_start(args, format);
-        _vsnwprintf_s(buffer, _countof(buffer), _TRUNCATE, format, args);
-        va_end(args);
+        GetLogger().SetFileOptions(maxBytes, generations, flushIntervalMs);
+    }
 
-        GetLogger().Log(buffer);
+    void SetLevel(Category category, Level level)
+    {
+        GetSink()->levels[int(category)].store(int(level), std::memory_order_relaxed);
+    }
+
+    Level GetLevel(Category category)
+    {
+        return Level(GetSink()->levels[int(category)].load(std::memory_order_relaxed));
+    }
+
+    // Other threads' counts arrive in batches, so the total can lag behind
+    // by up to SuppressedCounts::FoldEvery messages per thread
+    uint64_t GetSuppressedCount(Category category)
+    {
+        return GetSink()->suppressed[int(category)].load(std::memory_order_relaxed) +
+            detail::LocalSuppressed().counts[int(category)];
+    }
+
+    const wchar_t* GetCategoryName(Category category)
+    {
+        return CategoryNames[int(category)];
+    }
+
+    Level ParseLevel(const wchar_t* text, Level fallback)
+    {
+        if (!text || !*text)
+        {
+            return fallback;
+        }
+
+        for (size_t i = 0; i < _countof(LevelNames); ++i)
+        {
+            if (_wcsicmp(text, LevelNames[i]) == 0)
+            {
+                return Level(i);
+            }
+        }
+
+        wchar_t* end = nullptr;
+        long value = wcstol(text, &end, 10);
+        if (*end == L'\0' && value >= int(Level::Off) && value <= int(Level::Debug))
+        {
+            return Level(value);
+        }
+
+        return fallback;
+    }
+
+    void detail::SuppressedCounts::Fold()
+    {
+        Sink* sink = g_sink.load(std::memory_order_relaxed);
+
+        for (int i = 0; i < int(Category::Count); ++i)
+        {
+            if (counts[i] != 0)
+            {
+                sink->suppressed[i].fetch_add(counts[i], std::memory_order_relaxed);
+                counts[i] = 0;
+            }
+        }
+
+        pending = 0;
+    }
+
+    Sink* GetSink()
+    {
+        return detail::g_sink.load(std::memory_order_relaxed);
+    }
+
+    void AttachSink(Sink* sink)
+    {
+        detail::g_sink.store(sink ? sink : &s_localSink, std::memory_order_relaxed);
     }
 }
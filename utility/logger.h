@@ -1,10 +1,343 @@
 #pragma once
 
+#include "../litestep/buildoptions.h"
+#include "traceformat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <type_traits>
+
+// Highest level compiled in. Calls above it expand to nothing, so their
+// arguments are not even evaluated. Uses the LOG_ERROR (1) to LOG_DEBUG (4)
+// scale from lsapidefines.h.
+#if !defined(LS_LOG_MAX_LEVEL)
+#  define LS_LOG_MAX_LEVEL 4
+#endif
 
 namespace Logger
 {
+    enum class Level : int
+    {
+        Off     = 0,
+        Error   = 1,
+        Warning = 2,
+        Notice  = 3,
+        Debug   = 4
+    };
+
+    enum class Category : int
+    {
+        General,
+        Config,
+        ThemeEngineV2,
+        Module,
+        StartupRunner,
+        Count
+    };
+
     void Initialize(const std::wstring& basePath);
     void Shutdown();
-    void Log(const wchar_t* format, ...);
+
+    // Blocks until every message logged before the call has been written.
+    void Flush();
+
+    // Size at which litestep.log is rotated (0 for no limit), how many old
+    // files are kept and how often written data is flushed to disk.
+    void SetFileOptions(uint64_t maxBytes, unsigned generations, unsigned flushIntervalMs);
+
+    void SetLevel(Category category, Level level);
+    Level GetLevel(Category category);
+    uint64_t GetSuppressedCount(Category category);
+    const wchar_t* GetCategoryName(Category category);
+
+    // Accepts a level name (off, error, warning, notice, debug) or number.
+    Level ParseLevel(const wchar_t* text, Level fallback);
+
+    namespace detail
+    {
+        // The trace file stores arguments in this same encoding.
+        using Trace::ArgType;
+        using Trace::ArgSigned;
+        using Trace::ArgUnsigned;
+        using Trace::ArgPointer;
+        using Trace::ArgDouble;
+        using Trace::ArgWideString;
+        using Trace::ArgNarrowString;
+
+        // Arguments are packed as a type byte followed by either an 8 byte
+        // value or a 16 bit length and the characters. Strings that do not
+        // fit are truncated.
+        struct ArgBuffer
+        {
+            static const size_t Capacity = 448;
+
+            unsigned char data[Capacity];
+            size_t used = 0;
+
+            void PutScalar(ArgType type, const void* value)
+            {
+                if (used + 1 + 8 > Capacity)
+                {
+                    return;
+                }
+                data[used] = type;
+                memcpy(data + used + 1, value, 8);
+                used += 1 + 8;
+            }
+
+            void PutString(ArgType type, const void* chars, size_t length, size_t charSize)
+            {
+                if (used + 1 + 2 > Capacity)
+                {
+                    return;
+                }
+                size_t room = (Capacity - used - 1 - 2) / charSize;
+                uint16_t stored = uint16_t(length < room ? length : room);
+                data[used] = type;
+                memcpy(data + used + 1, &stored, 2);
+                memcpy(data + used + 1 + 2, chars, stored * charSize);
+                used += 1 + 2 + stored * charSize;
+            }
+        };
+
+        typedef void (*SubmitProc)(Category category, Level level, const wchar_t* format,
+            const ArgBuffer& args);
+
+        typedef void (*TraceProc)(Category category, Trace::RecordType type, Trace::Event event,
+            const ArgBuffer& args);
+
+        inline void Encode(ArgBuffer& args, const wchar_t* value)
+        {
+            if (!value)
+            {
+                value = L"(null)";
+            }
+            args.PutString(ArgWideString, value, wcslen(value), sizeof(wchar_t));
+        }
+
+        inline void Encode(ArgBuffer& args, const char* value)
+        {
+            if (!value)
+            {
+                value = "(null)";
+            }
+            args.PutString(ArgNarrowString, value, strlen(value), sizeof(char));
+        }
+
+        inline void Encode(ArgBuffer& args, const std::wstring& value)
+        {
+            args.PutString(ArgWideString, value.c_str(), value.length(), sizeof(wchar_t));
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+            Encode(ArgBuffer& args, T value)
+        {
+            if (std::is_signed<T>::value)
+            {
+                int64_t widened = int64_t(value);
+                args.PutScalar(ArgSigned, &widened);
+            }
+            else
+            {
+                uint64_t widened = uint64_t(value);
+                args.PutScalar(ArgUnsigned, &widened);
+            }
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type
+            Encode(ArgBuffer& args, T value)
+        {
+            double widened = double(value);
+            args.PutScalar(ArgDouble, &widened);
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_pointer<T>::value &&
+            !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, wchar_t>::value &&
+            !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value>::type
+            Encode(ArgBuffer& args, T value)
+        {
+            uint64_t address = uint64_t(uintptr_t(value));
+            args.PutScalar(ArgPointer, &address);
+        }
+
+        inline void EncodeAll(ArgBuffer&)
+        {
+        }
+
+        template <typename First, typename... Rest>
+        void EncodeAll(ArgBuffer& args, const First& first, const Rest&... rest)
+        {
+            Encode(args, first);
+            EncodeAll(args, rest...);
+        }
+    }
+
+    // Levels, counters and the write entry point of one logger. Every module
+    // that links the utility library has its own; AttachSink points a DLL's
+    // copy at the executable's so both write to the same file.
+    struct Sink
+    {
+        std::atomic<int> levels[int(Category::Count)];
+        std::atomic<uint64_t> suppressed[int(Category::Count)];
+        std::atomic<bool> tracing;
+        detail::SubmitProc submit;
+        detail::TraceProc trace;
+    };
+
+    Sink* GetSink();
+    void AttachSink(Sink* sink);
+
+    namespace detail
+    {
+        extern std::atomic<Sink*> g_sink;
+
+        // Adds a filtered message to the calling thread's suppressed
+        // counts. Kept out of line, so the thread-local state stays out of
+        // every call site.
+        void CountSuppressed(Category category);
+    }
+
+    // The only work a call site does when its category is filtered out:
+    // the level test, then a call that counts the message.
+    inline bool ShouldLog(Category category, Level level)
+    {
+        Sink* sink = detail::g_sink.load(std::memory_order_relaxed);
+        if (sink->levels[int(category)].load(std::memory_order_relaxed) >= int(level))
+        {
+            return true;
+        }
+
+        detail::CountSuppressed(category);
+        return false;
+    }
+
+    // Queues a printf-style message without checking the level; use the
+    // LS_LOG macros instead. Only the arguments are captured on the calling
+    // thread, formatting, UTF-8 conversion and the file write happen in
+    // batches on the logger's flusher thread. The format string is kept by
+    // pointer, so it has to be a literal. String arguments are copied.
+    template <typename... Args>
+    void Write(Category category, Level level, const wchar_t* format, const Args&... args)
+    {
+        detail::ArgBuffer buffer;
+        detail::EncodeAll(buffer, args...);
+        detail::g_sink.load(std::memory_order_relaxed)->submit(category, level, format, buffer);
+    }
+
+    // Starts writing structured events to logs\litestep.trace, replacing
+    // the previous trace. Runs until StopTrace or Shutdown.
+    void StartTrace();
+    void StopTrace();
+
+    inline bool IsTracing()
+    {
+        return detail::g_sink.load(std::memory_order_relaxed)->tracing.load(std::memory_order_relaxed);
+    }
+
+    // Queues a binary trace record, stamped with the performance counter and
+    // the calling thread. Does not check IsTracing.
+    template <typename... Args>
+    void WriteTrace(Category category, Trace::RecordType type, Trace::Event event,
+        const Args&... args)
+    {
+        detail::ArgBuffer buffer;
+        detail::EncodeAll(buffer, args...);
+        detail::g_sink.load(std::memory_order_relaxed)->trace(category, type, event, buffer);
+    }
+
+    // Records a begin event now and the matching end event when it goes out
+    // of scope. Decides once, on construction, whether the trace is on.
+    class TraceScope
+    {
+    public:
+        template <typename... Args>
+        TraceScope(Category category, Trace::Event event, const Args&... args)
+            : m_category(category)
+            , m_event(event)
+            , m_active(IsTracing())
+        {
+            if (m_active)
+            {
+                WriteTrace(m_category, Trace::RecordBegin, m_event, args...);
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (m_active)
+            {
+                WriteTrace(m_category, Trace::RecordEnd, m_event);
+            }
+        }
+
+    private:
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        Category m_category;
+        Trace::Event m_event;
+        bool m_active;
+    };
 }
+
+//
+// LS_TRACE_SCOPE(category, event, ...)
+// Traces the rest of the enclosing block as Trace::Event::event, with the
+// remaining arguments recorded on the begin event.
+//
+#define LS_TRACE_CONCAT2(a, b) a##b
+#define LS_TRACE_CONCAT(a, b) LS_TRACE_CONCAT2(a, b)
+#define LS_TRACE_SCOPE(category, event, ...) \
+    Logger::TraceScope LS_TRACE_CONCAT(lsTraceScope, __LINE__)( \
+        Logger::Category::category, Trace::Event::event, ##__VA_ARGS__)
+
+//
+// LS_TRACE_INSTANT(category, event, ...)
+// Records a single point in time as Trace::Event::event, if tracing.
+//
+#define LS_TRACE_INSTANT(category, event, ...) \
+    (Logger::IsTracing() \
+        ? Logger::WriteTrace(Logger::Category::category, Trace::RecordInstant, \
+            Trace::Event::event, ##__VA_ARGS__) \
+        : (void)0)
+
+//
+// LS_LOG(level, category, format, ...)
+// Logs under Logger::Category::category if level passes the runtime filter.
+// A filtered call costs one branch and a call that bumps a thread-local
+// count; the arguments are not evaluated.
+//
+#define LS_LOG(level, category, ...) \
+    (Logger::ShouldLog(Logger::Category::category, (level)) \
+        ? Logger::Write(Logger::Category::category, (level), __VA_ARGS__) \
+        : (void)0)
+
+#define LS_LOG_ERROR(category, ...) \
+    LS_LOG(Logger::Level::Error, category, __VA_ARGS__)
+
+#if LS_LOG_MAX_LEVEL >= 2
+#  define LS_LOG_WARNING(category, ...) \
+    LS_LOG(Logger::Level::Warning, category, __VA_ARGS__)
+#else
+#  define LS_LOG_WARNING(category, ...) ((void)0)
+#endif
+
+#if LS_LOG_MAX_LEVEL >= 3
+#  define LS_LOG_NOTICE(category, ...) \
+    LS_LOG(Logger::Level::Notice, category, __VA_ARGS__)
+#else
+#  define LS_LOG_NOTICE(category, ...) ((void)0)
+#endif
+
+#if LS_LOG_MAX_LEVEL >= 4
+#  define LS_LOG_DEBUG(category, ...) \
+    LS_LOG(Logger::Level::Debug, category, __VA_ARGS__)
+#else
+#  define LS_LOG_DEBUG(category, ...) ((void)0)
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Layout of logs\litestep.trace. Shared by the logger, which writes it, and
+// tools\tracedecode, which turns it into Chrome trace-event JSON, so this
+// header must not depend on Windows.h.
+//
+// A trace is a FileHeader followed by records. Every record starts with a
+// RecordHeader whose size covers the whole record, so readers can skip
+// record types they do not know. When tracing starts the writer emits a
+// RecordCategoryName for every category and a RecordEventName for every
+// event, so a decoder does not have to come from the same build.
+//
+// Begin, end and instant records carry their arguments after the header
+// as a type byte followed by either an 8 byte value or a 16 bit character
+// count and the characters (UTF-16 for ArgWideString). All values are
+// little endian.
+namespace Trace
+{
+    const uint32_t Magic = 0x5254534C;  // "LSTR"
+    const uint16_t Version = 1;
+
+    enum RecordType : uint8_t
+    {
+        RecordCategoryName = 1,  // payload: UTF-8 name, NUL terminated
+        RecordEventName,         // payload: UTF-8 name and argument names, each NUL terminated
+        RecordBegin,
+        RecordEnd,
+        RecordInstant
+    };
+
+    enum ArgType : uint8_t
+    {
+        ArgSigned,
+        ArgUnsigned,
+        ArgPointer,
+        ArgDouble,
+        ArgWideString,
+        ArgNarrowString
+    };
+
+    enum class Event : uint16_t
+    {
+        Startup,
+        StartModules,
+        ModuleInit,
+        ParseFile,
+        LoadStructure,
+        ModuleLoad,
+        ModuleResolve,
+        ModuleFirstMessage,
+        ModuleFirstPaint,
+        LoadStyles,
+        FlushBindings,
+        Count
+    };
+
+    struct EventInfo
+    {
+        const char* name;
+        const char* argNames;   // comma separated
+    };
+
+    const EventInfo Events[] =
+    {
+        { "CLiteStep::Start",               "" },
+        { "ModuleManager::_StartModules",   "modules" },
+        { "Module::Init",                   "module" },
+        { "FileParser::ParseFile",          "file" },
+        { "ThemeEngineV2::LoadStructure",   "file" },
+        { "Module::_LoadDll",               "module" },
+        { "Module::ResolveEntryPoints",     "module" },
+        { "Module::FirstMessage",           "module" },
+        { "Module::FirstPaint",             "module" },
+        { "ThemeEngineV2::LoadStyles",      "file" },
+        { "ThemeEngineV2::FlushBindings",   "" }
+    };
+    static_assert(sizeof(Events) / sizeof(Events[0]) == size_t(Event::Count),
+        "Trace::Events is out of sync with Trace::Event");
+
+#pragma pack(push, 1)
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t processId;
+        uint32_t reserved;
+        uint64_t ticksPerSecond;
+        uint64_t startTicks;
+    };
+
+    struct RecordHeader
+    {
+        uint16_t size;
+        uint8_t type;
+        uint8_t category;
+        uint16_t event;
+        uint16_t reserved;
+        uint32_t threadId;
+        uint32_t reserved2;
+        uint64_t ticks;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed");
+    static_assert(sizeof(RecordHeader) == 24, "RecordHeader layout changed");
+}